@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+/*
+ * Measure the latency of SpawnChildProcess(), i.e. the time until
+ * the child process has executed the new program.
+ */
+
+#include "spawn/Direct.hxx"
+#include "spawn/Prepared.hxx"
+#include "spawn/CgroupState.hxx"
+#include "spawn/SeccompCache.hxx"
+#include "spawn/config.h"
+#include "event/Loop.hxx"
+#include "system/Error.hxx"
+#include "co/InvokeTask.hxx"
+#include "co/Task.hxx"
+#include "util/PrintException.hxx"
+#include "util/StringCompare.hxx"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+struct Usage {};
+
+struct BenchOptions {
+	unsigned count = 1000;
+
+	/**
+	 * Use a new #SeccompProgramCache for each child process,
+	 * i.e. compile the system call filter each time.
+	 */
+	bool no_cache = false;
+
+	bool no_new_privs = false;
+	bool forbid_user_ns = false, forbid_multicast = false, forbid_bind = false;
+	bool userns = false;
+};
+
+class Instance {
+	Co::InvokeTask invoke_task;
+	std::optional<SpawnChildProcessResult> result;
+	std::exception_ptr error;
+
+public:
+	void Start(Co::Task<SpawnChildProcessResult> &&task) {
+		invoke_task = Await(std::move(task));
+		invoke_task.Start(BIND_THIS_METHOD(OnCompletion));
+	}
+
+	SpawnChildProcessResult Finish() && {
+		if (error)
+			std::rethrow_exception(std::move(error));
+
+		return std::move(*result);
+	}
+
+private:
+	Co::InvokeTask Await(Co::Task<SpawnChildProcessResult> task) {
+		result = co_await task;
+	}
+
+	void OnCompletion(std::exception_ptr &&_error) noexcept {
+		error = std::move(_error);
+	}
+};
+
+static PreparedChildProcess
+MakeChildProcess(const BenchOptions &options) noexcept
+{
+	PreparedChildProcess p;
+	p.exec_path = "/bin/true";
+	p.args.emplace_back("true");
+	p.stdin_fd = FileDescriptor{STDIN_FILENO};
+	p.stdout_fd = FileDescriptor{STDOUT_FILENO};
+	p.stderr_fd = FileDescriptor{STDERR_FILENO};
+	p.no_new_privs = options.no_new_privs;
+	p.ns.user.create = options.userns;
+
+#ifdef HAVE_LIBSECCOMP
+	p.forbid_user_ns = options.forbid_user_ns;
+	p.forbid_multicast = options.forbid_multicast;
+	p.forbid_bind = options.forbid_bind;
+#endif
+
+	return p;
+}
+
+static void
+WaitExit(FileDescriptor pidfd)
+{
+	siginfo_t info;
+	if (waitid((idtype_t)P_PIDFD, pidfd.Get(), &info, WEXITED) < 0)
+		throw MakeErrno("waitid() failed");
+
+	if (info.si_code != CLD_EXITED || info.si_status != 0)
+		throw std::runtime_error{"Child process failed"};
+}
+
+static void
+Bench(const BenchOptions &options)
+{
+	EventLoop event_loop;
+	const CgroupState cgroup_state;
+	const bool is_sys_admin = geteuid() == 0;
+
+	std::optional<SeccompProgramCache> seccomp_cache;
+
+	using Duration = std::chrono::duration<double, std::micro>;
+	std::vector<Duration> durations;
+	durations.reserve(options.count);
+
+	for (unsigned i = 0; i < options.count; ++i) {
+		if (options.no_cache || !seccomp_cache)
+			seccomp_cache.emplace();
+
+		const auto start = std::chrono::steady_clock::now();
+
+		Instance instance;
+		instance.Start(SpawnChildProcess(event_loop,
+						 MakeChildProcess(options),
+						 cgroup_state,
+						 *seccomp_cache,
+						 false, is_sys_admin));
+		event_loop.Run();
+		auto result = std::move(instance).Finish();
+
+		durations.emplace_back(std::chrono::steady_clock::now() - start);
+
+		WaitExit(result.pidfd);
+	}
+
+	std::sort(durations.begin(), durations.end());
+
+	Duration total{};
+	for (const auto &i : durations)
+		total += i;
+
+	fmt::print("{} spawns: mean={:.1f}us median={:.1f}us p99={:.1f}us max={:.1f}us\n",
+		   durations.size(),
+		   total.count() / durations.size(),
+		   durations[durations.size() / 2].count(),
+		   durations[durations.size() * 99 / 100].count(),
+		   durations.back().count());
+}
+
+int
+main(int argc, char **argv)
+try {
+	std::span<const char *const> args{argv + 1, static_cast<std::size_t>(argc - 1)};
+
+	BenchOptions options;
+
+	while (!args.empty() && *args.front() == '-') {
+		const char *arg = args.front();
+		args = args.subspan(1);
+
+		if (const char *count = StringAfterPrefix(arg, "--count=")) {
+			options.count = atoi(count);
+			if (options.count == 0)
+				throw Usage{};
+		} else if (StringIsEqual(arg, "--no-cache")) {
+			options.no_cache = true;
+		} else if (StringIsEqual(arg, "--no-new-privs")) {
+			options.no_new_privs = true;
+		} else if (StringIsEqual(arg, "--forbid-user-ns")) {
+			options.forbid_user_ns = true;
+		} else if (StringIsEqual(arg, "--forbid-multicast")) {
+			options.forbid_multicast = true;
+		} else if (StringIsEqual(arg, "--forbid-bind")) {
+			options.forbid_bind = true;
+		} else if (StringIsEqual(arg, "--userns")) {
+			options.userns = true;
+		} else
+			throw Usage{};
+	}
+
+	if (!args.empty())
+		throw Usage{};
+
+	Bench(options);
+	return EXIT_SUCCESS;
+} catch (Usage) {
+	fmt::print(stderr, "Usage: BenchSpawn"
+		   " [--count=N] [--no-cache] [--no-new-privs]"
+		   " [--forbid-user-ns] [--forbid-multicast] [--forbid-bind]"
+		   " [--userns]\n");
+	return EXIT_FAILURE;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
@@ -6,6 +6,7 @@
 #include "spawn/Prepared.hxx"
 #include "spawn/CgroupState.hxx"
 #include "spawn/CgroupOptions.hxx"
+#include "spawn/SeccompCache.hxx"
 #include "spawn/Mount.hxx"
 #include "spawn/Systemd.hxx"
 #include "event/Loop.hxx"
@@ -61,9 +62,10 @@ SpawnChildProcess(PreparedChildProcess &&params,
 	};
 
 	EventLoop event_loop;
+	SeccompProgramCache seccomp_cache;
 	Instance instance;
 
-	instance.Start(SpawnChildProcess(event_loop, std::move(params), cgroup_state, cgroups_group_writable, is_sys_admin));
+	instance.Start(SpawnChildProcess(event_loop, std::move(params), cgroup_state, seccomp_cache, cgroups_group_writable, is_sys_admin));
 	event_loop.Run();
 
 	return std::move(instance).Finish();
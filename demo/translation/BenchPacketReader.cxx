@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+/*
+ * Benchmark for TranslatePacketReader: compare Feed() (one copy per
+ * packet) with FeedInPlace() (payloads referenced in the receive
+ * buffer).
+ *
+ * Usage: BenchPacketReader [RESPONSE_FILE [ITERATIONS]]
+ *
+ * RESPONSE_FILE contains a raw translation response as recorded from
+ * a translation server socket.  Without it, a synthetic spawn-heavy
+ * response with many mounts and environment variables is used.
+ */
+
+#include "AllocatorPtr.hxx"
+#include "translation/Protocol.hxx"
+#include "translation/PReader.hxx"
+#include "io/Open.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+#include "lib/fmt/RuntimeError.hxx"
+#include "util/PrintException.hxx"
+#include "util/SpanCast.hxx"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <sysexits.h> // for EX_*
+
+using std::string_view_literals::operator""sv;
+
+static void
+AppendPacket(std::string &r, TranslationCommand command,
+	     std::string_view payload) noexcept
+{
+	const TranslationHeader header{
+		.length = static_cast<uint16_t>(payload.size()),
+		.command = command,
+	};
+
+	r += ToStringView(ReferenceAsBytes(header));
+	r += payload;
+}
+
+static std::string
+MakeSyntheticResponse() noexcept
+{
+	std::string r;
+	AppendPacket(r, TranslationCommand::BEGIN, {});
+	AppendPacket(r, TranslationCommand::EXECUTE, "/usr/lib/cgi-bin/app.cgi"sv);
+
+	for (unsigned i = 0; i < 200; ++i) {
+		const auto mount = fmt::format("/srv/vol{}/data\0/mnt/vol{}"sv, i, i);
+		AppendPacket(r, TranslationCommand::BIND_MOUNT, mount);
+	}
+
+	for (unsigned i = 0; i < 100; ++i)
+		AppendPacket(r, TranslationCommand::SETENV,
+			     fmt::format("VARIABLE_{}=some value for variable number {}"sv, i, i));
+
+	for (unsigned i = 0; i < 20; ++i)
+		AppendPacket(r, TranslationCommand::APPEND,
+			     fmt::format("--argument-{}"sv, i));
+
+	AppendPacket(r, TranslationCommand::END, {});
+	return r;
+}
+
+static std::string
+LoadResponse(const char *path)
+{
+	const auto fd = OpenReadOnly(path);
+
+	std::string r;
+	std::byte buffer[65536];
+	while (true) {
+		auto nbytes = fd.Read(buffer);
+		if (nbytes < 0)
+			throw std::runtime_error{"Failed to read file"};
+		if (nbytes == 0)
+			break;
+
+		r += ToStringView(std::span{buffer}.first(nbytes));
+	}
+
+	return r;
+}
+
+/**
+ * Simulate reading from a socket with a small buffer: the data
+ * arrives in chunks at the end of one contiguous buffer; after each
+ * chunk, invoke the given function with the unconsumed part of the
+ * buffer until it returns 0.
+ */
+template<typename T, typename F>
+static void
+Receive(std::span<T> src, F &&feed)
+{
+	std::size_t received = 0, position = 0;
+
+	while (received < src.size()) {
+		received += std::min<std::size_t>(src.size() - received, 4096);
+
+		while (true) {
+			const std::size_t consumed =
+				feed(src.subspan(position, received - position));
+			if (consumed == 0)
+				break;
+
+			position += consumed;
+		}
+	}
+}
+
+/**
+ * @return the number of packets
+ */
+static std::size_t
+RunFeed(std::span<const std::byte> src)
+{
+	Allocator allocator;
+	AllocatorPtr alloc{allocator};
+
+	TranslatePacketReader reader;
+	std::size_t n = 0;
+
+	Receive(src, [&](std::span<const std::byte> b){
+		const auto consumed = reader.Feed(alloc, b);
+		if (consumed > 0 && reader.IsComplete())
+			++n;
+		return consumed;
+	});
+
+	return n;
+}
+
+/**
+ * @return the number of packets
+ */
+static std::size_t
+RunFeedInPlace(std::span<std::byte> src) noexcept
+{
+	TranslatePacketReader reader;
+	std::size_t n = 0;
+
+	Receive(src, [&](std::span<std::byte> b){
+		const auto consumed = reader.FeedInPlace(b);
+		if (consumed > 0 && reader.IsComplete())
+			++n;
+		return consumed;
+	});
+
+	return n;
+}
+
+int
+main(int argc, char **argv)
+try {
+	if (argc > 3) {
+		fmt::print(stderr, "Usage: {} [RESPONSE_FILE [ITERATIONS]]\n"sv,
+			   argv[0]);
+		return EX_USAGE;
+	}
+
+	const std::string response = argc >= 2
+		? LoadResponse(argv[1])
+		: MakeSyntheticResponse();
+
+	const unsigned iterations = argc >= 3
+		? strtoul(argv[2], nullptr, 10)
+		: 10000;
+
+	using Clock = std::chrono::steady_clock;
+	using FloatMicros = std::chrono::duration<double, std::micro>;
+
+	std::size_t n_packets = 0, n_packets_in_place = 0;
+
+	auto start = Clock::now();
+	for (unsigned i = 0; i < iterations; ++i)
+		n_packets = RunFeed(AsBytes(response));
+	const FloatMicros feed_duration = Clock::now() - start;
+
+	/* FeedInPlace() modifies the buffer, so each iteration needs
+	   a fresh copy (not included in the measurement) */
+	std::vector<std::byte> buffer(response.size());
+	Clock::duration in_place_duration{};
+	for (unsigned i = 0; i < iterations; ++i) {
+		std::copy_n(AsBytes(response).begin(), buffer.size(), buffer.begin());
+
+		start = Clock::now();
+		n_packets_in_place = RunFeedInPlace(buffer);
+		in_place_duration += Clock::now() - start;
+	}
+
+	if (n_packets_in_place != n_packets)
+		throw FmtRuntimeError("Packet count mismatch: Feed()={} FeedInPlace()={}",
+				      n_packets, n_packets_in_place);
+
+	fmt::print("response: {} bytes, {} packets, {} iterations\n"
+		   "Feed():        {:.2f} us/response\n"
+		   "FeedInPlace(): {:.2f} us/response\n"sv,
+		   response.size(), n_packets, iterations,
+		   feed_duration.count() / iterations,
+		   FloatMicros{in_place_duration}.count() / iterations);
+
+	return EXIT_SUCCESS;
+} catch (...) {
+	PrintException(std::current_exception());
+	return EXIT_FAILURE;
+}
@@ -82,7 +82,7 @@ private:
 		queue.Push(*s, *this);
 	}
 
-	void OnUringCompletion(int res) noexcept override
+	void OnUringCompletion(int res, unsigned) noexcept override
 	try {
 		switch (state) {
 		case State::INIT:
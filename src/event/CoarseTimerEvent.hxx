@@ -5,6 +5,7 @@
 #pragma once
 
 #include "Chrono.hxx"
+#include "event/config.h" // for ENABLE_EVENT_LOOP_STATS
 #include "util/BindMethod.hxx"
 #include "util/IntrusiveList.hxx"
 
@@ -98,7 +99,11 @@ public:
 	}
 
 private:
+#ifdef ENABLE_EVENT_LOOP_STATS
+	void Run() noexcept;
+#else
 	void Run() noexcept {
 		callback();
 	}
+#endif
 };
@@ -50,3 +50,14 @@ FineTimerEvent::ScheduleEarlier(Event::Duration d) noexcept
 {
 	ScheduleEarlier(loop.SteadyNow() + d);
 }
+
+#ifdef ENABLE_EVENT_LOOP_STATS
+
+void
+FineTimerEvent::Run() noexcept
+{
+	loop.InvokeTracked(&EventLoopStats::timer_dispatches,
+			   callback.GetFunctionAddress(), callback);
+}
+
+#endif
@@ -5,8 +5,14 @@
 #pragma once
 
 #include "Chrono.hxx"
+#include "event/config.h" // for USE_FINE_TIMER_WHEEL, ENABLE_EVENT_LOOP_STATS
 #include "util/BindMethod.hxx"
+
+#ifdef USE_FINE_TIMER_WHEEL
+#include "util/IntrusiveList.hxx"
+#else
 #include "util/IntrusiveTreeSet.hxx"
+#endif
 
 #include <cassert>
 
@@ -24,9 +30,17 @@ class EventLoop;
  * as thread-safe.
  */
 class FineTimerEvent final :
+#ifdef USE_FINE_TIMER_WHEEL
+	AutoUnlinkIntrusiveListHook
+#else
 	public IntrusiveTreeSetHook<IntrusiveHookMode::AUTO_UNLINK>
+#endif
 {
 	friend class TimerList;
+	friend class FineTimerWheel;
+#ifdef USE_FINE_TIMER_WHEEL
+	friend struct IntrusiveListBaseHookTraits<FineTimerEvent>;
+#endif
 
 	EventLoop &loop;
 
@@ -98,7 +112,11 @@ public:
 	}
 
 private:
+#ifdef ENABLE_EVENT_LOOP_STATS
+	void Run() noexcept;
+#else
 	void Run() noexcept {
 		callback();
 	}
+#endif
 };
@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "FineTimerWheel.hxx"
+#include "FineTimerEvent.hxx"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+FineTimerWheel::FineTimerWheel() noexcept = default;
+
+FineTimerWheel::~FineTimerWheel() noexcept
+{
+	assert(IsEmpty());
+}
+
+bool
+FineTimerWheel::IsEmpty() const noexcept
+{
+	return ready.empty() && overflow.empty() &&
+		std::all_of(levels.begin(), levels.end(), [](const auto &level){
+			return std::all_of(level.slots.begin(), level.slots.end(),
+					   [](const auto &list){
+						   return list.empty();
+					   });
+		});
+}
+
+inline void
+FineTimerWheel::InsertWheel(FineTimerEvent &t, Tick due) noexcept
+{
+	assert(due > current);
+
+	const Tick delta = due - current;
+
+	for (unsigned level = 0; level < N_LEVELS; ++level) {
+		if (delta < (Tick{1} << LevelShift(level + 1))) {
+			const std::size_t slot = SlotIndex(due, level);
+			levels[level].slots[slot].push_back(t);
+			levels[level].occupied |= uint_least64_t{1} << slot;
+			return;
+		}
+	}
+
+	overflow.push_back(t);
+}
+
+void
+FineTimerWheel::Insert(FineTimerEvent &t, Event::TimePoint now) noexcept
+{
+	if (current == 0)
+		/* first call: initialize the wheel position */
+		current = FloorTick(now);
+
+	const Tick due = CeilTick(t.GetDue());
+	if (t.GetDue() <= now || due <= current)
+		ready.push_back(t);
+	else
+		InsertWheel(t, due);
+}
+
+inline FineTimerWheel::Tick
+FineTimerWheel::GetNextTick() const noexcept
+{
+	Tick result = 0;
+
+	const auto consider = [&result](Tick tick){
+		if (result == 0 || tick < result)
+			result = tick;
+	};
+
+	for (unsigned level = 0; level < N_LEVELS; ++level) {
+		const uint_least64_t occupied = levels[level].occupied;
+		if (occupied == 0)
+			continue;
+
+		const unsigned shift = LevelShift(level);
+		const unsigned block_shift = shift + SLOT_BITS;
+		const std::size_t position = SlotIndex(current, level);
+		const Tick block = current >> block_shift << block_shift;
+
+		/* slots after the current position belong to this
+		   rotation, all others to the next one */
+		const uint_least64_t after = position + 1 < N_SLOTS
+			? occupied & (~uint_least64_t{0} << (position + 1))
+			: 0;
+
+		if (after != 0)
+			consider(block + (Tick(std::countr_zero(after)) << shift));
+		else
+			consider(block + (Tick{1} << block_shift) +
+				 (Tick(std::countr_zero(occupied)) << shift));
+	}
+
+	if (!overflow.empty()) {
+		/* the next top-level slot boundary rescans the
+		   overflow list */
+		constexpr unsigned shift = LevelShift(N_LEVELS - 1);
+		consider(((current >> shift) + 1) << shift);
+	}
+
+	return result;
+}
+
+inline void
+FineTimerWheel::InsertCascaded(FineTimerEvent &t) noexcept
+{
+	const Tick due = CeilTick(t.GetDue());
+	if (due <= current) {
+		/* due in this tick: add it to the level 0 slot which
+		   RunTick() is about to process (and not to the
+		   "ready" list, which runs after all later ticks) */
+		const std::size_t slot = SlotIndex(current, 0);
+		levels[0].slots[slot].push_back(t);
+		levels[0].occupied |= uint_least64_t{1} << slot;
+	} else
+		InsertWheel(t, due);
+}
+
+void
+FineTimerWheel::Cascade(unsigned level, std::size_t slot) noexcept
+{
+	assert(level > 0);
+	assert(level < N_LEVELS);
+
+	levels[level].occupied &= ~(uint_least64_t{1} << slot);
+
+	auto tmp = std::move(levels[level].slots[slot]);
+	tmp.clear_and_dispose([this](auto *t){
+		InsertCascaded(*t);
+	});
+}
+
+void
+FineTimerWheel::CascadeOverflow() noexcept
+{
+	auto tmp = std::move(overflow);
+	tmp.clear_and_dispose([this](auto *t){
+		InsertCascaded(*t);
+	});
+}
+
+inline void
+FineTimerWheel::RunTick(Event::TimePoint now) noexcept
+{
+	/* cascade top-down so a timer may move through several
+	   levels at once */
+
+	if (current % (Tick{1} << LevelShift(N_LEVELS - 1)) == 0)
+		CascadeOverflow();
+
+	for (unsigned level = N_LEVELS - 1; level > 0; --level)
+		if (current % (Tick{1} << LevelShift(level)) == 0)
+			Cascade(level, SlotIndex(current, level));
+
+	const std::size_t slot = SlotIndex(current, 0);
+	levels[0].occupied &= ~(uint_least64_t{1} << slot);
+
+	/* move all timers to a temporary list to avoid problems with
+	   canceled timers while we traverse the list */
+	auto tmp = std::move(levels[0].slots[slot]);
+	tmp.clear_and_dispose([&](auto *t){
+		assert(t->GetDue() <= now);
+		(void)now;
+		t->Run();
+	});
+}
+
+Event::Duration
+FineTimerWheel::Run(const Event::TimePoint now) noexcept
+{
+	if (current == 0)
+		current = FloorTick(now);
+
+	const Tick target = FloorTick(now);
+
+	while (current < target) {
+		const Tick next = GetNextTick();
+		if (next == 0 || next > target) {
+			/* nothing to do until "now": skip ahead */
+			current = target;
+			break;
+		}
+
+		current = next;
+		RunTick(now);
+	}
+
+	/* invoke the "ready" list (which includes timers that were
+	   inserted by the callbacks above and are due already) */
+	while (!ready.empty()) {
+		auto tmp = std::move(ready);
+		tmp.clear_and_dispose([](auto *t){
+			t->Run();
+		});
+	}
+
+	const Tick next = GetNextTick();
+	if (next == 0)
+		return Event::Duration(-1);
+
+	assert(TickToTimePoint(next) > now);
+	return TickToTimePoint(next) - now;
+}
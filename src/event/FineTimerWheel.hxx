@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "Chrono.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <array>
+#include <cstdint>
+
+class FineTimerEvent;
+
+/**
+ * A hierarchical hashed timer wheel for #FineTimerEvent instances.
+ * This is an alternative to #TimerList (enabled at build time with
+ * "USE_FINE_TIMER_WHEEL") with O(1) insertion and deletion at
+ * millisecond resolution.
+ *
+ * There are #N_LEVELS levels with #N_SLOTS slots each; the slots of
+ * level 0 are 1 ms wide, the slots of level 1 are 64 ms wide, then
+ * 4 s, 4.4 minutes.  When a slot of a higher level is reached, its
+ * timers are moved down ("cascaded") to the lower levels.  Timers
+ * beyond the span of the top level are kept in a separate list which
+ * is rescanned every time a top-level slot is reached.
+ *
+ * Timers never fire early, but may fire up to one millisecond late.
+ */
+class FineTimerWheel final {
+	static constexpr Event::Duration RESOLUTION = std::chrono::milliseconds(1);
+
+	static constexpr unsigned SLOT_BITS = 6;
+	static constexpr std::size_t N_SLOTS = std::size_t{1} << SLOT_BITS;
+	static constexpr unsigned N_LEVELS = 4;
+
+	using Tick = uint_least64_t;
+
+	using List = IntrusiveList<FineTimerEvent>;
+
+	struct Level {
+		std::array<List, N_SLOTS> slots;
+
+		/**
+		 * A bit mask of slots which may be non-empty.  Bits
+		 * are set on insertion, but canceled timers
+		 * (auto-unlink) don't clear them; stale bits are
+		 * cleared lazily when the slot is visited.
+		 */
+		uint_least64_t occupied = 0;
+	};
+
+	static_assert(N_SLOTS == 64, "the occupancy mask is 64 bits wide");
+
+	std::array<Level, N_LEVELS> levels;
+
+	/**
+	 * Timers too far in the future for the top level.
+	 */
+	List overflow;
+
+	/**
+	 * Timers which are already due.
+	 */
+	List ready;
+
+	/**
+	 * The last tick which has been processed by Run().  All
+	 * wheel positions are relative to this value.
+	 */
+	Tick current = 0;
+
+public:
+	FineTimerWheel() noexcept;
+	~FineTimerWheel() noexcept;
+
+	FineTimerWheel(const FineTimerWheel &other) = delete;
+	FineTimerWheel &operator=(const FineTimerWheel &other) = delete;
+
+	[[gnu::pure]]
+	bool IsEmpty() const noexcept;
+
+	void Insert(FineTimerEvent &t, Event::TimePoint now) noexcept;
+
+	/**
+	 * Invoke all expired #FineTimerEvent instances and return the
+	 * duration until the next timer expires.  Returns a negative
+	 * duration if there is no timeout.
+	 */
+	Event::Duration Run(Event::TimePoint now) noexcept;
+
+private:
+	static constexpr Tick FloorTick(Event::TimePoint t) noexcept {
+		return t.time_since_epoch() / RESOLUTION;
+	}
+
+	static constexpr Tick CeilTick(Event::TimePoint t) noexcept {
+		const auto d = t.time_since_epoch();
+		return d / RESOLUTION + (d % RESOLUTION > Event::Duration::zero());
+	}
+
+	static constexpr Event::TimePoint TickToTimePoint(Tick tick) noexcept {
+		return Event::TimePoint{tick * RESOLUTION};
+	}
+
+	static constexpr unsigned LevelShift(unsigned level) noexcept {
+		return level * SLOT_BITS;
+	}
+
+	static constexpr std::size_t SlotIndex(Tick tick,
+					       unsigned level) noexcept {
+		return (tick >> LevelShift(level)) & (N_SLOTS - 1);
+	}
+
+	/**
+	 * Insert a timer which is not yet due (relative to
+	 * #current) into the proper wheel slot.
+	 */
+	void InsertWheel(FineTimerEvent &t, Tick due) noexcept;
+
+	/**
+	 * Determine the next tick after #current at which a slot
+	 * needs to be visited.
+	 *
+	 * @return the tick or 0 if the wheel is empty
+	 */
+	[[gnu::pure]]
+	Tick GetNextTick() const noexcept;
+
+	/**
+	 * Insert a timer which was removed from a higher level (or
+	 * from the overflow list) while cascading at tick #current.
+	 */
+	void InsertCascaded(FineTimerEvent &t) noexcept;
+
+	/**
+	 * Move all timers of the given slot down to lower levels.
+	 */
+	void Cascade(unsigned level, std::size_t slot) noexcept;
+
+	void CascadeOverflow() noexcept;
+
+	/**
+	 * Process the slots for tick #current.
+	 */
+	void RunTick(Event::TimePoint now) noexcept;
+};
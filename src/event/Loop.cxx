@@ -43,7 +43,7 @@ public:
 	}
 
 private:
-	void OnUringCompletion(int res) noexcept override {
+	void OnUringCompletion(int res, unsigned) noexcept override {
 		(void)res; // TODO
 
 		event_loop.epoll_ready = true;
@@ -87,7 +87,7 @@ public:
 	}
 
 private:
-	void OnUringCompletion(int res) noexcept override {
+	void OnUringCompletion(int res, unsigned) noexcept override {
 		if (res <= 0)
 			return;
 
@@ -244,7 +244,11 @@ EventLoop::Insert(FineTimerEvent &t) noexcept
 {
 	assert(IsInside());
 
+#ifdef USE_FINE_TIMER_WHEEL
+	timers.Insert(t, SteadyNow());
+#else
 	timers.Insert(t);
+#endif
 	again = true;
 }
 
@@ -315,12 +319,55 @@ EventLoop::AddNext(DeferEvent &e) noexcept
 	next.push_back(e);
 }
 
+#ifdef ENABLE_EVENT_LOOP_STATS
+
+void
+EventLoop::AddDispatch(uint_least64_t EventLoopStats::*counter,
+		       const void *function,
+		       Event::Duration duration) noexcept
+{
+	++(stats.*counter);
+	stats.dispatch_histogram.Add(duration);
+
+	if (duration >= slow_dispatch_threshold) [[unlikely]] {
+		auto &e = stats.slow_log[stats.slow_dispatches++ % stats.slow_log.size()];
+		e.duration = duration;
+		e.function = function;
+	}
+}
+
+inline void
+EventLoop::FinishIterationStats() noexcept
+{
+	stats.socket_dispatch_histogram.Add(stats.socket_dispatches - iteration_socket_dispatches);
+	stats.defer_dispatch_histogram.Add(stats.defer_dispatches - iteration_defer_dispatches);
+	stats.timer_dispatch_histogram.Add(stats.timer_dispatches - iteration_timer_dispatches);
+
+	iteration_socket_dispatches = stats.socket_dispatches;
+	iteration_defer_dispatches = stats.defer_dispatches;
+	iteration_timer_dispatches = stats.timer_dispatches;
+}
+
+#endif
+
+inline void
+EventLoop::RunDeferEvent(DeferEvent &e) noexcept
+{
+#ifdef ENABLE_EVENT_LOOP_STATS
+	InvokeTracked(&EventLoopStats::defer_dispatches,
+		      e.callback.GetFunctionAddress(),
+		      [&e]{ e.Run(); });
+#else
+	e.Run();
+#endif
+}
+
 void
 EventLoop::RunDeferred() noexcept
 {
 	while (!defer.empty() && !quit) {
-		defer.pop_front_and_dispose([](DeferEvent *e){
-			e->Run();
+		defer.pop_front_and_dispose([this](DeferEvent *e){
+			RunDeferEvent(*e);
 		});
 	}
 }
@@ -331,8 +378,8 @@ EventLoop::RunOneIdle() noexcept
 	if (idle.empty())
 		return false;
 
-	idle.pop_front_and_dispose([](DeferEvent *e){
-		e->Run();
+	idle.pop_front_and_dispose([this](DeferEvent *e){
+		RunDeferEvent(*e);
 	});
 
 	return true;
@@ -420,6 +467,15 @@ EventLoop::IsUringEmpty() const noexcept
 		!uring->HasPendingMoreThan(CountOwnUringOperations());
 }
 
+inline void
+EventLoop::StartUringPoll()
+{
+	if (!uring_poll) [[unlikely]] {
+		uring_poll = std::make_unique<UringPoll>(*this);
+		uring_poll->Start();
+	}
+}
+
 inline void
 EventLoop::UringWait(Event::Duration timeout) noexcept
 {
@@ -428,11 +484,7 @@ EventLoop::UringWait(Event::Duration timeout) noexcept
 	/* use io_uring_enter() and invoke epoll_wait() only if it's
            reported to be ready */
 
-	if (!uring_poll) [[unlikely]] {
-		/* start polling on the epoll file descriptor */
-		uring_poll = std::make_unique<UringPoll>(*this);
-		uring_poll->Start();
-	}
+	StartUringPoll();
 
 	/* repeat epoll_wait() until it returns no more events; this
            is a temporary workaround because
@@ -459,9 +511,107 @@ EventLoop::UringWait(Event::Duration timeout) noexcept
 
 #endif // HAVE_URING
 
+inline bool
+EventLoop::PollNonBlocking()
+{
+#ifdef HAVE_URING
+	if (uring) {
+		/* peek at the completion queue directly, without a
+		   system call */
+		bool result = uring->DispatchCompletions();
+
+		/* like UringWait(), invoke epoll_wait() only if
+		   #UringPoll has reported it to be ready, and keep
+		   #epoll_ready set until all events have been
+		   consumed (the multishot poll is edge-triggered) */
+		if (epoll_ready) {
+			epoll_ready = Poll(Event::Duration{0});
+			result = result || epoll_ready;
+		}
+
+		return result;
+	}
+#endif
+
+	return Poll(Event::Duration{0});
+}
+
+inline bool
+EventLoop::BusyPoll(Event::Duration timeout) noexcept
+{
+	assert(busy_poll_budget > Event::Duration::zero());
+
+	Event::Duration duration = busy_poll_current;
+	if (timeout >= Event::Duration::zero() && timeout < duration)
+		duration = timeout;
+
+	const auto start = Event::Clock::now();
+	const auto deadline = start + duration;
+
+	bool found;
+	Event::TimePoint now;
+
+	try {
+#ifdef HAVE_URING
+		if (uring) {
+			StartUringPoll();
+
+			/* submit pending operations once, or else
+			   there will never be completions */
+			uring->Submit();
+		}
+#endif
+
+		do {
+			found = PollNonBlocking();
+			now = Event::Clock::now();
+		} while (!found && now < deadline);
+	} catch (...) {
+		/* io_uring has failed; skip busy-polling and let
+		   UringWait() deal with it */
+		return false;
+	}
+
+	if (found)
+		busy_poll_current = std::min(busy_poll_current * 2,
+					     busy_poll_budget);
+	else
+		/* don't go below 1/16 of the budget, or else we'd
+		   never recover */
+		busy_poll_current = std::max(busy_poll_current / 2,
+					     busy_poll_budget / 16);
+
+#ifdef ENABLE_EVENT_LOOP_STATS
+	stats.busy_poll_duration += now - start;
+	++(found ? stats.busy_poll_hits : stats.busy_poll_misses);
+#endif
+
+	return found;
+}
+
 inline void
 EventLoop::Wait(Event::Duration timeout) noexcept
 {
+	if (busy_poll_budget > Event::Duration::zero() &&
+	    timeout != Event::Duration::zero()) {
+		/* not using SteadyNow() here, because that would
+		   fill the clock cache with a value which is stale
+		   after the wait */
+		const auto start = Event::Clock::now();
+
+		if (BusyPoll(timeout))
+			return;
+
+		if (timeout > Event::Duration::zero()) {
+			/* the busy-poll phase has used up part of the
+			   timeout */
+			const auto elapsed = Event::Clock::now() - start;
+			timeout = elapsed < timeout
+				? timeout - elapsed
+				: Event::Duration::zero();
+		}
+	}
+
 #ifdef HAVE_URING
 	if (uring)
 		return UringWait(timeout);
@@ -562,6 +712,8 @@ EventLoop::Run() noexcept
 			if (timeout.count() > 0) {
 				const auto now = SteadyNow();
 				stats.busy_duration += now - busy_since;
+				stats.busy_histogram.Add(now - busy_since);
+				FinishIterationStats();
 				idle_since = now;
 			}
 #endif
@@ -596,7 +748,13 @@ EventLoop::Run() noexcept
 			socket_event.unlink();
 			sockets.push_back(socket_event);
 
+#ifdef ENABLE_EVENT_LOOP_STATS
+			InvokeTracked(&EventLoopStats::socket_dispatches,
+				      socket_event.callback.GetFunctionAddress(),
+				      [&socket_event]{ socket_event.Dispatch(); });
+#else
 			socket_event.Dispatch();
+#endif
 		}
 
 		RunPost();
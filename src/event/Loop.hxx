@@ -16,7 +16,11 @@
 #endif
 
 #ifndef NO_FINE_TIMER_EVENT
+#ifdef USE_FINE_TIMER_WHEEL
+#include "FineTimerWheel.hxx"
+#else
 #include "TimerList.hxx"
+#endif
 #endif // NO_FINE_TIMER_EVENT
 
 #ifdef HAVE_THREADED_EVENT_LOOP
@@ -62,7 +66,11 @@ class EventLoop final
 	TimerWheel coarse_timers;
 
 #ifndef NO_FINE_TIMER_EVENT
+#ifdef USE_FINE_TIMER_WHEEL
+	FineTimerWheel timers;
+#else
 	TimerList timers;
+#endif
 #endif // NO_FINE_TIMER_EVENT
 
 	using DeferList = IntrusiveList<DeferEvent>;
@@ -117,8 +125,35 @@ class EventLoop final
 	PostCallback post_callback = nullptr;
 #endif
 
+	/**
+	 * The maximum duration of the busy-poll phase before going to
+	 * sleep.  Zero means busy-polling is disabled.
+	 */
+	Event::Duration busy_poll_budget{};
+
+	/**
+	 * The current (adaptive) busy-poll duration; it is doubled
+	 * after each successful busy-poll phase (up to
+	 * #busy_poll_budget) and halved after each unsuccessful one.
+	 */
+	Event::Duration busy_poll_current{};
+
 #ifdef ENABLE_EVENT_LOOP_STATS
 	EventLoopStats stats;
+
+	/**
+	 * Callback invocations which take longer than this are
+	 * recorded in EventLoopStats::slow_log.
+	 */
+	Event::Duration slow_dispatch_threshold = std::chrono::milliseconds(10);
+
+	/**
+	 * The dispatch counters of #stats at the beginning of the
+	 * current iteration; see FinishIterationStats().
+	 */
+	uint_least64_t iteration_socket_dispatches = 0,
+		iteration_defer_dispatches = 0,
+		iteration_timer_dispatches = 0;
 #endif
 
 #ifdef HAVE_THREADED_EVENT_LOOP
@@ -194,10 +229,50 @@ public:
 	EventLoop(const EventLoop &other) = delete;
 	EventLoop &operator=(const EventLoop &other) = delete;
 
+	/**
+	 * Enable the busy-poll mode: before going to sleep, poll for
+	 * events without blocking for up to the given duration.  This
+	 * trades CPU time for lower wakeup latency and should only be
+	 * used on latency-critical threads which have a CPU core for
+	 * themselves.  The actual duration adapts to how often
+	 * busy-polling finds new events.
+	 *
+	 * This can be combined with SocketDescriptor::SetBusyPoll()
+	 * on the sockets handled by this #EventLoop.
+	 *
+	 * @param budget the maximum busy-poll duration; zero disables
+	 * busy-polling
+	 */
+	void SetBusyPoll(Event::Duration budget) noexcept {
+		busy_poll_budget = busy_poll_current = budget;
+	}
+
 #ifdef ENABLE_EVENT_LOOP_STATS
 	const auto &GetStats() const noexcept {
 		return stats;
 	}
+
+	void SetSlowDispatchThreshold(Event::Duration _threshold) noexcept {
+		slow_dispatch_threshold = _threshold;
+	}
+
+	/**
+	 * Invoke an event callback and account its duration in the
+	 * #EventLoopStats.  This is used internally by the event
+	 * classes.
+	 *
+	 * @param counter the per-type counter to be incremented
+	 * @param function the callback function address for
+	 * EventLoopStats::slow_log (must be obtained before the
+	 * call, because the callback may destroy its owner)
+	 */
+	template<typename F>
+	void InvokeTracked(uint_least64_t EventLoopStats::*counter,
+			   const void *function, F &&f) noexcept {
+		const auto start = Event::Clock::now();
+		f();
+		AddDispatch(counter, function, Event::Clock::now() - start);
+	}
 #endif
 
 #ifndef NDEBUG
@@ -362,6 +437,19 @@ public:
 	void Run() noexcept;
 
 private:
+#ifdef ENABLE_EVENT_LOOP_STATS
+	void AddDispatch(uint_least64_t EventLoopStats::*counter,
+			 const void *function,
+			 Event::Duration duration) noexcept;
+
+	/**
+	 * Record the number of dispatches of the iteration which
+	 * has just finished in the #stats histograms.
+	 */
+	void FinishIterationStats() noexcept;
+#endif
+
+	void RunDeferEvent(DeferEvent &e) noexcept;
 	void RunDeferred() noexcept;
 
 	/**
@@ -396,6 +484,14 @@ private:
 	bool Poll(Event::Duration timeout) noexcept;
 
 #ifdef HAVE_URING
+	/**
+	 * Start polling on the epoll file descriptor with io_uring
+	 * (if not already started).
+	 *
+	 * Throws on error.
+	 */
+	void StartUringPoll();
+
 	void UringWait(Event::Duration timeout) noexcept;
 
 	/**
@@ -420,6 +516,26 @@ private:
 	}
 #endif
 
+	/**
+	 * Check for I/O events and io_uring completions without
+	 * blocking.
+	 *
+	 * Throws on io_uring error.
+	 *
+	 * @return true if something has happened
+	 */
+	bool PollNonBlocking();
+
+	/**
+	 * Invoke PollNonBlocking() repeatedly until it finds events
+	 * or until the busy-poll duration is over.
+	 *
+	 * @param timeout the regular Wait() timeout (negative means
+	 * no timeout)
+	 * @return true if events were found
+	 */
+	bool BusyPoll(Event::Duration timeout) noexcept;
+
 	/**
 	 * Wait for I/O (socket) events, either using Poll() or
 	 * UringWait().
@@ -6,17 +6,70 @@
 
 #include "Stats.hxx"
 
+#include <iterator> // for std::back_inserter()
 #include <string>
 #include <string_view>
 
 #include <fmt/format.h>
 
+inline double
+ToPrometheusValue(Event::Duration d) noexcept
+{
+	return std::chrono::duration_cast<std::chrono::duration<double>>(d).count();
+}
+
+constexpr uint_least64_t
+ToPrometheusValue(uint_least64_t value) noexcept
+{
+	return value;
+}
+
+/**
+ * Append a histogram (#EventLoopHistogram or
+ * #EventLoopCountHistogram) in the Prometheus text format.
+ *
+ * @param labels the formatted label list (e.g. `process="foo"`)
+ */
+template<typename H>
+inline void
+AppendPrometheusHistogram(std::string &s, std::string_view name,
+			  std::string_view help,
+			  const H &h,
+			  std::string_view labels) noexcept
+{
+	using std::string_view_literals::operator""sv;
+
+	fmt::format_to(std::back_inserter(s), R"(
+# HELP {} {}
+# TYPE {} histogram
+)"sv,
+		       name, help, name);
+
+	uint_least64_t cumulative = 0;
+	for (std::size_t i = 0; i < h.buckets.size() - 1; ++i) {
+		cumulative += h.buckets[i];
+		fmt::format_to(std::back_inserter(s),
+			       "{}_bucket{{{},le=\"{}\"}} {}\n"sv,
+			       name, labels,
+			       ToPrometheusValue(H::GetUpperBound(i)),
+			       cumulative);
+	}
+
+	fmt::format_to(std::back_inserter(s),
+		       "{}_bucket{{{},le=\"+Inf\"}} {}\n"
+		       "{}_sum{{{}}} {}\n"
+		       "{}_count{{{}}} {}\n"sv,
+		       name, labels, h.count,
+		       name, labels, ToPrometheusValue(h.sum),
+		       name, labels, h.count);
+}
+
 inline std::string
 ToPrometheusString(const EventLoopStats &stats, std::string_view process) noexcept
 {
 	using std::string_view_literals::operator""sv;
 
-	return fmt::format(R"(
+	auto s = fmt::format(R"(
 # HELP event_loop_iterations Total number of EventLoop iterations
 # TYPE event_loop_iterations counter
 
@@ -26,13 +79,59 @@ ToPrometheusString(const EventLoopStats &stats, std::string_view process) noexce
 # HELP event_loop_busy_duration Total duration handling events
 # TYPE event_loop_busy_duration counter
 
+# HELP event_loop_dispatches Total number of callback invocations
+# TYPE event_loop_dispatches counter
+
+# HELP event_loop_slow_dispatches Total number of callback invocations exceeding the threshold
+# TYPE event_loop_slow_dispatches counter
+
+# HELP event_loop_busy_poll_duration Total duration spent busy-polling
+# TYPE event_loop_busy_poll_duration counter
+
+# HELP event_loop_busy_polls Total number of busy-poll phases
+# TYPE event_loop_busy_polls counter
+
 event_loop_iterations{{process={:?}}} {}
 event_loop_idle_duration{{process={:?}}} {}
 event_loop_busy_duration{{process={:?}}} {}
+event_loop_dispatches{{process={:?},type="socket"}} {}
+event_loop_dispatches{{process={:?},type="defer"}} {}
+event_loop_dispatches{{process={:?},type="timer"}} {}
+event_loop_slow_dispatches{{process={:?}}} {}
+event_loop_busy_poll_duration{{process={:?}}} {}
+event_loop_busy_polls{{process={:?},result="hit"}} {}
+event_loop_busy_polls{{process={:?},result="miss"}} {}
 )"sv,
 			   process, stats.iterations,
 			   process,
 			   std::chrono::duration_cast<std::chrono::duration<double>>(stats.idle_duration).count(),
 			   process,
-			   std::chrono::duration_cast<std::chrono::duration<double>>(stats.busy_duration).count());
+			   std::chrono::duration_cast<std::chrono::duration<double>>(stats.busy_duration).count(),
+			   process, stats.socket_dispatches,
+			   process, stats.defer_dispatches,
+			   process, stats.timer_dispatches,
+			   process, stats.slow_dispatches,
+			   process,
+			   std::chrono::duration_cast<std::chrono::duration<double>>(stats.busy_poll_duration).count(),
+			   process, stats.busy_poll_hits,
+			   process, stats.busy_poll_misses);
+
+	const auto labels = fmt::format("process={:?}"sv, process);
+	AppendPrometheusHistogram(s, "event_loop_iteration_busy_seconds"sv,
+				  "Busy duration of each EventLoop iteration"sv,
+				  stats.busy_histogram, labels);
+	AppendPrometheusHistogram(s, "event_loop_dispatch_seconds"sv,
+				  "Duration of each callback invocation"sv,
+				  stats.dispatch_histogram, labels);
+	AppendPrometheusHistogram(s, "event_loop_iteration_socket_dispatches"sv,
+				  "Number of SocketEvent callbacks in each EventLoop iteration"sv,
+				  stats.socket_dispatch_histogram, labels);
+	AppendPrometheusHistogram(s, "event_loop_iteration_defer_dispatches"sv,
+				  "Number of DeferEvent callbacks in each EventLoop iteration"sv,
+				  stats.defer_dispatch_histogram, labels);
+	AppendPrometheusHistogram(s, "event_loop_iteration_timer_dispatches"sv,
+				  "Number of timer callbacks in each EventLoop iteration"sv,
+				  stats.timer_dispatch_histogram, labels);
+
+	return s;
 }
@@ -6,7 +6,111 @@
 
 #include "Chrono.hxx"
 
+#include <array>
+#include <bit>
 #include <cstddef>
+#include <cstdint>
+
+/**
+ * A histogram of durations with logarithmic (power of two) buckets.
+ */
+struct EventLoopHistogram {
+	static constexpr std::size_t N_BUCKETS = 24;
+
+	/**
+	 * The upper bound of the first bucket.  Bucket i counts
+	 * durations below UNIT * 2^i; the last bucket counts all
+	 * longer durations, too.
+	 */
+	static constexpr Event::Duration UNIT = std::chrono::microseconds(1);
+
+	std::array<uint_least64_t, N_BUCKETS> buckets{};
+
+	/**
+	 * The sum of all durations.
+	 */
+	Event::Duration sum{};
+
+	uint_least64_t count = 0;
+
+	static constexpr Event::Duration GetUpperBound(std::size_t i) noexcept {
+		return UNIT * (uint_least64_t{1} << i);
+	}
+
+	static constexpr std::size_t GetBucketIndex(Event::Duration d) noexcept {
+		const uint_least64_t units = d > Event::Duration::zero()
+			? static_cast<uint_least64_t>(d / UNIT)
+			: 0;
+
+		/* bit_width(0)=0 goes to bucket 0, 1 unit to bucket
+		   1 etc. */
+		const std::size_t i = std::bit_width(units);
+		return i < N_BUCKETS ? i : N_BUCKETS - 1;
+	}
+
+	constexpr void Add(Event::Duration d) noexcept {
+		++buckets[GetBucketIndex(d)];
+		sum += d;
+		++count;
+	}
+
+	constexpr auto &operator+=(const EventLoopHistogram &other) noexcept {
+		for (std::size_t i = 0; i < N_BUCKETS; ++i)
+			buckets[i] += other.buckets[i];
+		sum += other.sum;
+		count += other.count;
+		return *this;
+	}
+};
+
+/**
+ * A histogram of counts with logarithmic (power of two) buckets.
+ */
+struct EventLoopCountHistogram {
+	static constexpr std::size_t N_BUCKETS = 16;
+
+	/**
+	 * Bucket i counts values up to (including) 2^i-1, i.e. bucket
+	 * 0 counts zeroes; the last bucket counts all larger values,
+	 * too.
+	 */
+	std::array<uint_least64_t, N_BUCKETS> buckets{};
+
+	/**
+	 * The sum of all values.
+	 */
+	uint_least64_t sum = 0;
+
+	uint_least64_t count = 0;
+
+	static constexpr uint_least64_t GetUpperBound(std::size_t i) noexcept {
+		return (uint_least64_t{1} << i) - 1;
+	}
+
+	static constexpr std::size_t GetBucketIndex(uint_least64_t value) noexcept {
+		const std::size_t i = std::bit_width(value);
+		return i < N_BUCKETS ? i : N_BUCKETS - 1;
+	}
+
+	constexpr void Add(uint_least64_t value) noexcept {
+		++buckets[GetBucketIndex(value)];
+		sum += value;
+		++count;
+	}
+};
+
+/**
+ * An entry in #EventLoopStats::slow_log.
+ */
+struct EventLoopSlowDispatch {
+	Event::Duration duration;
+
+	/**
+	 * The address of the callback function (see
+	 * BoundMethod::GetFunctionAddress()).
+	 */
+	const void *function;
+};
 
 struct EventLoopStats {
 	/**
@@ -25,4 +129,56 @@ struct EventLoopStats {
 	 * calls with a positive timeout parameter.
 	 */
 	uint_least64_t iterations = 0;
+
+	/**
+	 * The busy duration of each iteration.
+	 */
+	EventLoopHistogram busy_histogram;
+
+	/**
+	 * The duration of each single callback invocation.
+	 */
+	EventLoopHistogram dispatch_histogram;
+
+	/**
+	 * Total number of #SocketEvent, #DeferEvent and timer
+	 * callback invocations.
+	 */
+	uint_least64_t socket_dispatches = 0, defer_dispatches = 0,
+		timer_dispatches = 0;
+
+	/**
+	 * The number of #SocketEvent, #DeferEvent and timer callback
+	 * invocations in each iteration.
+	 */
+	EventLoopCountHistogram socket_dispatch_histogram,
+		defer_dispatch_histogram, timer_dispatch_histogram;
+
+	/**
+	 * Total number of callback invocations which took longer
+	 * than the threshold (see
+	 * EventLoop::SetSlowDispatchThreshold()).
+	 */
+	uint_least64_t slow_dispatches = 0;
+
+	/**
+	 * A ring buffer with the most recent slow callback
+	 * invocations.  The most recent one is at index
+	 * (#slow_dispatches - 1) % size.
+	 */
+	std::array<EventLoopSlowDispatch, 16> slow_log{};
+
+	/**
+	 * Total (wallclock) duration spent in the busy-poll phase
+	 * (see EventLoop::SetBusyPoll()).  This is included in
+	 * #idle_duration.
+	 */
+	Event::Duration busy_poll_duration{};
+
+	/**
+	 * The number of busy-poll phases which found new events
+	 * (hits) and which ended without finding any (misses; the
+	 * time spent in those was wasted).
+	 */
+	uint_least64_t busy_poll_hits = 0, busy_poll_misses = 0;
 };
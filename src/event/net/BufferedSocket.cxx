@@ -9,27 +9,84 @@
 #include "net/TimeoutError.hxx"
 
 #ifdef HAVE_URING
+#include "io/uring/BufferRing.hxx"
 #include "io/uring/Close.hxx"
 #include "io/uring/Operation.hxx"
 #include "io/uring/Queue.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "util/DynamicFifoBuffer.hxx"
 #endif
 
 #include <utility> // for std::unreachable()
 
+#include <errno.h>
 #include <sys/uio.h> // for struct iovec
 
 #ifdef HAVE_URING
 
+/**
+ * Receives data with io_uring on behalf of BufferedSocket.
+ *
+ * Without a #Uring::BufferRing, each operation receives into
+ * #buffer, and the next one is submitted only after the data has
+ * been moved to BufferedSocket::input.
+ *
+ * With a #Uring::BufferRing, one multishot receive operation stays
+ * pending, and the kernel picks a provided buffer for each
+ * completion.  The data is copied to #buffer and the provided buffer
+ * is recycled immediately; whatever does not fit is kept in
+ * #provided (holding its provided buffer) and the operation is
+ * canceled until it has been consumed.
+ */
 class BufferedSocket::UringReceive final : Uring::Operation {
 	BufferedSocket &parent;
 	Uring::Queue &queue;
+
+	/**
+	 * If not nullptr, then multishot receive operations with
+	 * buffers from this ring are used.
+	 */
+	Uring::BufferRing *const buffer_ring;
+
 	DefaultFifoBuffer buffer;
 
+	/**
+	 * A provided buffer which has been filled by the kernel but
+	 * has not yet been consumed completely.
+	 */
+	struct ProvidedBuffer {
+		std::span<const std::byte> data;
+		uint_least16_t id;
+	};
+
+	/**
+	 * Received data which did not fit into #buffer.  This is
+	 * only used with #buffer_ring.
+	 */
+	DynamicFifoBuffer<ProvidedBuffer> provided{nullptr};
+
 	bool released = false;
 
+	/**
+	 * Has the multishot operation been canceled by Stop()?
+	 */
+	bool stopping = false;
+
+	/**
+	 * Has a multishot operation failed with ENOBUFS?  Then the
+	 * next Start() call submits a single receive into #buffer.
+	 */
+	bool no_buffers = false;
+
 public:
-	UringReceive(BufferedSocket &_parent, Uring::Queue &_queue) noexcept
-		:parent(_parent), queue(_queue) {}
+	UringReceive(BufferedSocket &_parent, Uring::Queue &_queue,
+		     Uring::BufferRing *_buffer_ring) noexcept
+		:parent(_parent), queue(_queue), buffer_ring(_buffer_ring) {}
+
+	~UringReceive() noexcept {
+		for (const auto &i : provided.Read())
+			buffer_ring->Recycle(i.id);
+	}
 
 	auto &GetQueue() const noexcept {
 		return queue;
@@ -39,13 +96,7 @@ public:
 		assert(!released);
 
 		if (IsUringPending()) {
-			if (auto *s = queue.GetSubmitEntry()) {
-				io_uring_prep_cancel(s, GetUringData(), 0);
-				io_uring_sqe_set_data(s, nullptr);
-				io_uring_sqe_set_flags(s, IOSQE_CQE_SKIP_SUCCESS);
-				queue.Submit();
-			}
-
+			Cancel();
 			released = true;
 		} else
 			delete this;
@@ -54,15 +105,54 @@ public:
 	void Start();
 
 	bool MoveBuffer() noexcept {
-		if (buffer.empty())
+		if (buffer.empty() && provided.empty())
 			return false;
 
 		parent.input.MoveFromAllowBothNull(buffer);
+
+		if (!provided.empty())
+			MoveProvided();
+
 		return true;
 	}
 
 private:
-	void OnUringCompletion(int res) noexcept override;
+	void Cancel() noexcept {
+		if (auto *s = queue.GetSubmitEntry()) {
+			io_uring_prep_cancel(s, GetUringData(), 0);
+			io_uring_sqe_set_data(s, nullptr);
+			io_uring_sqe_set_flags(s, IOSQE_CQE_SKIP_SUCCESS);
+			queue.Submit();
+		}
+	}
+
+	/**
+	 * Cancel the multishot operation because #provided is not
+	 * empty; Start() will submit a new one after all data has
+	 * been consumed.
+	 */
+	void Stop() noexcept {
+		if (stopping || !IsUringPending())
+			return;
+
+		stopping = true;
+		Cancel();
+	}
+
+	/**
+	 * Move data from #provided to BufferedSocket::input and
+	 * recycle all provided buffers which have been consumed
+	 * completely.
+	 */
+	void MoveProvided() noexcept;
+
+	/**
+	 * Copy data from a provided buffer to #buffer; the rest is
+	 * appended to #provided.
+	 */
+	void OnProvidedBuffer(uint_least16_t id, std::size_t length) noexcept;
+
+	void OnUringCompletion(int res, unsigned flags) noexcept override;
 };
 
 inline void
@@ -70,45 +160,383 @@ BufferedSocket::UringReceive::Start()
 {
 	assert(!released);
 	assert(buffer.empty());
+	assert(provided.empty());
 	assert(parent.IsValid());
 	assert(parent.IsConnected());
 
 	if (IsUringPending())
 		return;
 
-	buffer.AllocateIfNull();
+	auto &s = queue.RequireSubmitEntry();
 
-	auto w = buffer.Write();
-	assert(!w.empty());
+	if (buffer_ring != nullptr && !no_buffers) {
+		stopping = false;
 
-	auto &s = queue.RequireSubmitEntry();
-	io_uring_prep_recv(&s, parent.GetSocket().Get(), w.data(), w.size(), 0);
+		io_uring_prep_recv_multishot(&s, parent.GetSocket().Get(),
+					     nullptr, 0, 0);
+		io_uring_sqe_set_flags(&s, IOSQE_BUFFER_SELECT);
+		s.buf_group = buffer_ring->GetGroupId();
+	} else {
+		no_buffers = false;
+
+		buffer.AllocateIfNull();
+
+		auto w = buffer.Write();
+		assert(!w.empty());
 
-	/* always go async; this way, the overhead for the operation
-           does not cause latency in the main thread */
-	io_uring_sqe_set_flags(&s, IOSQE_ASYNC);
+		io_uring_prep_recv(&s, parent.GetSocket().Get(),
+				   w.data(), w.size(), 0);
+
+		/* always go async; this way, the overhead for the
+		   operation does not cause latency in the main
+		   thread */
+		io_uring_sqe_set_flags(&s, IOSQE_ASYNC);
+	}
 
 	queue.Push(s, *this);
 }
 
+inline void
+BufferedSocket::UringReceive::MoveProvided() noexcept
+{
+	auto &input = parent.input;
+	input.AllocateIfNull();
+
+	while (!provided.empty()) {
+		auto &p = provided.Read().front();
+
+		const std::size_t nbytes = input.MoveFrom(p.data);
+		if (nbytes < p.data.size()) {
+			p.data = p.data.subspan(nbytes);
+			break;
+		}
+
+		buffer_ring->Recycle(p.id);
+		provided.Consume(1);
+	}
+
+	if (provided.empty())
+		provided.Clear();
+}
+
 void
-BufferedSocket::UringReceive::OnUringCompletion(int res) noexcept
+BufferedSocket::UringReceive::OnProvidedBuffer(uint_least16_t id,
+					       std::size_t length) noexcept
+{
+	std::span<const std::byte> src = buffer_ring->Get(id).first(length);
+
+	if (provided.empty()) {
+		buffer.AllocateIfNull();
+		src = src.subspan(buffer.MoveFrom(src));
+
+		if (src.empty()) {
+			buffer_ring->Recycle(id);
+			return;
+		}
+	}
+
+	if (provided.GetCapacity() == 0)
+		provided.Grow(4);
+
+	const ProvidedBuffer p{src, id};
+	provided.Append({&p, 1});
+
+	/* #buffer is full; don't let the kernel fill more provided
+	   buffers until this one has been consumed */
+	Stop();
+}
+
+void
+BufferedSocket::UringReceive::OnUringCompletion(int res, unsigned flags) noexcept
 {
 	if (released) [[unlikely]] {
-		delete this;
+		if (flags & IORING_CQE_F_BUFFER)
+			buffer_ring->Recycle(Uring::BufferRing::GetBufferId(flags));
+
+		if (!(flags & IORING_CQE_F_MORE))
+			delete this;
 		return;
 	}
 
 	if (res > 0) [[likely]] {
-		buffer.Append(static_cast<std::size_t>(res));
+		if (flags & IORING_CQE_F_BUFFER)
+			OnProvidedBuffer(Uring::BufferRing::GetBufferId(flags),
+					 static_cast<std::size_t>(res));
+		else
+			buffer.Append(static_cast<std::size_t>(res));
+
 		parent.DeferRead();
 	} else if (res == 0) {
-		(void)parent.ClosedByPeer();
+		if (!buffer.empty() || !provided.empty())
+			/* the multishot operation has completed
+			   early; deliver the remaining data first;
+			   the next Start() call will see the end of
+			   the stream again */
+			parent.DeferRead();
+		else
+			(void)parent.ClosedByPeer();
+	} else if (res == -ENOBUFS && buffer_ring != nullptr) {
+		/* all provided buffers are in use; fall back to
+		   one receive into our own buffer */
+		no_buffers = true;
+		parent.DeferRead();
+	} else if (res == -ECANCELED && stopping) {
+		/* canceled by Stop(); Start() will submit a new
+		   operation */
+		parent.DeferRead();
 	} else {
 		parent.OnSocketError(-res);
 	}
 }
 
+/**
+ * Sends data with io_uring on behalf of BufferedSocket::Write().
+ *
+ * There are two buffers: #sending is owned by the kernel while an
+ * operation is pending and must not be modified; #pending collects
+ * data from Write() calls meanwhile and is submitted after the
+ * current operation completes.
+ */
+class BufferedSocket::UringSend final : Uring::Operation {
+	BufferedSocket &parent;
+	Uring::Queue &queue;
+
+	DefaultFifoBuffer sending, pending;
+
+	/**
+	 * After BufferedSocket::Close(), this object owns the socket
+	 * and closes it after all queued data has been sent.
+	 */
+	UniqueSocketDescriptor detached_socket;
+
+	/**
+	 * The errno of a failed send operation.  After an error, all
+	 * queued data has been discarded and no more data may be
+	 * sent.
+	 */
+	int error = 0;
+
+	bool released = false;
+
+	/**
+	 * Shut down the socket (SHUT_WR) as soon as all queued data
+	 * has been sent.  See BufferedSocket::Shutdown().
+	 */
+	bool shutdown_after_send = false;
+
+public:
+	UringSend(BufferedSocket &_parent, Uring::Queue &_queue) noexcept
+		:parent(_parent), queue(_queue) {}
+
+	bool IsEmpty() const noexcept {
+		return sending.empty() && pending.empty();
+	}
+
+	int GetError() const noexcept {
+		return error;
+	}
+
+	/**
+	 * Call SocketDescriptor::Shutdown() after all queued data
+	 * has been sent.
+	 */
+	void ShutdownAfterSend() noexcept {
+		assert(!released);
+		assert(!IsEmpty());
+
+		shutdown_after_send = true;
+	}
+
+	void Release() noexcept {
+		assert(!released);
+
+		if (IsUringPending())
+			/* the kernel still owns the #sending buffer;
+			   delete this object after the operation
+			   completes */
+			released = true;
+		else
+			delete this;
+	}
+
+	/**
+	 * Like Release(), but take over the socket and send all
+	 * queued data before closing it.
+	 */
+	void CloseAfterSend(UniqueSocketDescriptor &&socket) noexcept {
+		assert(!released);
+
+		detached_socket = std::move(socket);
+		released = true;
+
+		if (IsUringPending())
+			/* continue in OnUringCompletion() */
+			return;
+
+		try {
+			if (Start())
+				return;
+		} catch (...) {
+			/* the submission queue is full; give up and
+			   close the socket now */
+		}
+
+		Destroy();
+	}
+
+	/**
+	 * Copy data into the #pending buffer and submit it.
+	 *
+	 * Throws if the operation could not be submitted.
+	 *
+	 * @return the number of bytes that were copied (0 if the
+	 * buffer is full)
+	 */
+	std::size_t Write(std::span<const std::byte> src) {
+		assert(!released);
+		assert(error == 0);
+
+		pending.AllocateIfNull();
+		const std::size_t nbytes = pending.MoveFrom(src);
+		if (nbytes > 0)
+			Start();
+		return nbytes;
+	}
+
+private:
+	SocketDescriptor GetSocket() const noexcept {
+		if (released)
+			return detached_socket;
+
+		return parent.GetSocket();
+	}
+
+	/**
+	 * A send operation has failed: discard all queued data,
+	 * because the kernel may or may not have sent parts of it.
+	 */
+	void Fail(int _error) noexcept {
+		error = _error;
+		shutdown_after_send = false;
+		sending.FreeIfDefined();
+		pending.FreeIfDefined();
+	}
+
+	/**
+	 * Close the detached socket (if any) and delete this object.
+	 */
+	void Destroy() noexcept {
+		assert(released);
+
+		if (detached_socket.IsDefined())
+			Uring::Close(&queue,
+				     detached_socket.Release().ToFileDescriptor());
+
+		delete this;
+	}
+
+	/**
+	 * Submit a send operation unless one is already pending.
+	 *
+	 * Throws if the operation could not be submitted.
+	 *
+	 * @return true if an operation is pending, false if there is
+	 * no more data
+	 */
+	bool Start();
+
+	void OnUringCompletion(int res, unsigned) noexcept override;
+};
+
+bool
+BufferedSocket::UringSend::Start()
+{
+	if (IsUringPending())
+		return true;
+
+	if (sending.empty()) {
+		if (pending.empty()) {
+			sending.FreeIfDefined();
+			pending.FreeIfDefined();
+
+			if (shutdown_after_send) {
+				shutdown_after_send = false;
+				GetSocket().Shutdown();
+			}
+
+			return false;
+		}
+
+		sending.swap(pending);
+	}
+
+	const auto r = sending.Read();
+	assert(!r.empty());
+
+	auto &s = queue.RequireSubmitEntry();
+	io_uring_prep_send(&s, GetSocket().Get(), r.data(), r.size(),
+			   MSG_NOSIGNAL);
+	queue.Push(s, *this);
+	return true;
+}
+
+void
+BufferedSocket::UringSend::OnUringCompletion(int res, unsigned) noexcept
+{
+	if (released) [[unlikely]] {
+		if (res > 0 && detached_socket.IsDefined()) {
+			/* the #BufferedSocket was closed; keep sending
+			   the remaining data */
+			sending.Consume(static_cast<std::size_t>(res));
+
+			try {
+				if (Start())
+					return;
+			} catch (...) {
+				/* the submission queue is full; give
+				   up and close the socket now */
+			}
+		}
+
+		Destroy();
+		return;
+	}
+
+	if (res > 0) [[likely]] {
+		sending.Consume(static_cast<std::size_t>(res));
+
+		try {
+			Start();
+		} catch (...) {
+			parent.handler->OnBufferedError(std::current_exception());
+			return;
+		}
+
+		if (parent.uring_want_write) {
+			/* there is room in the buffer now */
+			parent.uring_want_write = false;
+			parent.base.CancelWriteTimeout();
+			parent.defer_write.Schedule();
+		}
+	} else {
+		/* a zero-length send on a non-empty buffer: treat as
+		   a broken connection; -ECANCELED is an error, too,
+		   because the queued data was not sent */
+		const int e = res < 0 ? -res : EPIPE;
+
+		/* don't resend the data; the next Write() call fails
+		   with the same error */
+		Fail(e);
+
+		if (parent.uring_want_write) {
+			parent.uring_want_write = false;
+			parent.base.CancelWriteTimeout();
+		}
+
+		parent.OnSocketError(e);
+	}
+}
+
 #endif
 
 BufferedSocket::BufferedSocket(EventLoop &_event_loop) noexcept
@@ -123,17 +551,21 @@ BufferedSocket::~BufferedSocket() noexcept
 #ifdef HAVE_URING
 	if (uring_receive != nullptr)
 		uring_receive->Release();
+
+	if (uring_send != nullptr)
+		uring_send->Release();
 #endif
 }
 
 #ifdef HAVE_URING
 
 void
-BufferedSocket::EnableUring(Uring::Queue &uring_queue)
+BufferedSocket::EnableUring(Uring::Queue &uring_queue,
+			    Uring::BufferRing *buffer_ring)
 {
 	assert(uring_receive == nullptr);
 
-	uring_receive = new UringReceive(*this, uring_queue);
+	uring_receive = new UringReceive(*this, uring_queue, buffer_ring);
 	uring_receive->Start();
 }
 
@@ -145,6 +577,143 @@ BufferedSocket::GetUringQueue() const noexcept
 		: nullptr;
 }
 
+void
+BufferedSocket::EnableUringSend(Uring::Queue &uring_queue) noexcept
+{
+	assert(uring_send == nullptr);
+
+	uring_send = new UringSend(*this, uring_queue);
+}
+
+bool
+BufferedSocket::HasQueuedUringSend() const noexcept
+{
+	return uring_send != nullptr && !uring_send->IsEmpty();
+}
+
+#endif
+
+void
+BufferedSocket::Shutdown() noexcept
+{
+#ifdef HAVE_URING
+	if (HasQueuedUringSend()) {
+		/* the data is still in the io_uring send queue; shut
+		   down after it has been sent */
+		uring_send->ShutdownAfterSend();
+		return;
+	}
+#endif
+
+	base.Shutdown();
+}
+
+#ifdef HAVE_URING
+
+inline void
+BufferedSocket::ReleaseUringSend() noexcept
+{
+	if (uring_send != nullptr) {
+		uring_send->Release();
+		uring_send = nullptr;
+		uring_want_write = false;
+	}
+}
+
+bool
+BufferedSocket::ScheduleUringWrite() noexcept
+{
+	assert(uring_send != nullptr);
+
+	if (uring_send->IsEmpty())
+		/* nothing queued: wait for EPOLLOUT as usual (which
+		   also enables the write timeout) */
+		return false;
+
+	/* OnBufferedWrite() will be invoked after the next send
+	   completion; until then, only the write timeout is armed */
+	base.UnscheduleWrite();
+	base.ScheduleWriteTimeout(write_timeout);
+	uring_want_write = true;
+	return true;
+}
+
+inline ssize_t
+BufferedSocket::UringWrite(std::span<const std::byte> src) noexcept
+{
+	assert(uring_send != nullptr);
+
+	if (const int e = uring_send->GetError(); e != 0) [[unlikely]] {
+		errno = e;
+		return WRITE_ERRNO;
+	}
+
+	if (src.empty())
+		return 0;
+
+	std::size_t nbytes;
+
+	try {
+		nbytes = uring_send->Write(src);
+	} catch (...) {
+		/* the submission queue is full; the caller closes
+		   the socket */
+		errno = ENOBUFS;
+		return WRITE_ERRNO;
+	}
+
+	if (nbytes == 0) {
+		/* the buffer is full */
+		uring_want_write = true;
+		return WRITE_BLOCKING;
+	}
+
+	return nbytes;
+}
+
+inline ssize_t
+BufferedSocket::UringWriteV(std::span<const struct iovec> v) noexcept
+{
+	assert(uring_send != nullptr);
+
+	if (const int e = uring_send->GetError(); e != 0) [[unlikely]] {
+		errno = e;
+		return WRITE_ERRNO;
+	}
+
+	std::size_t total = 0;
+
+	for (const auto &i : v) {
+		const std::span<const std::byte> src{
+			static_cast<const std::byte *>(i.iov_base),
+			i.iov_len,
+		};
+
+		std::size_t nbytes;
+
+		try {
+			nbytes = uring_send->Write(src);
+		} catch (...) {
+			/* the submission queue is full; the caller
+			   closes the socket */
+			errno = ENOBUFS;
+			return WRITE_ERRNO;
+		}
+
+		total += nbytes;
+		if (nbytes < src.size())
+			break;
+	}
+
+	if (total == 0 && !v.empty()) {
+		/* the buffer is full */
+		uring_want_write = true;
+		return WRITE_BLOCKING;
+	}
+
+	return total;
+}
+
 #endif
 
 #ifdef __GNUC__
@@ -931,6 +1500,15 @@ BufferedSocket::Close() noexcept
 	assert(!destroyed);
 
 #ifdef HAVE_URING
+	if (HasQueuedUringSend() && base.IsValid()) {
+		/* data accepted by Write() is still queued; let
+		   #UringSend finish sending it and close the socket
+		   afterwards */
+		uring_send->CloseAfterSend(UniqueSocketDescriptor{AdoptTag{}, base.ReleaseSocket()});
+		uring_send = nullptr;
+		uring_want_write = false;
+	}
+
 	if (uring_receive != nullptr) {
 		if (base.IsValid())
 			Uring::Close(&uring_receive->GetQueue(),
@@ -939,6 +1517,8 @@ BufferedSocket::Close() noexcept
 		uring_receive->Release();
 		uring_receive = nullptr;
 	}
+
+	ReleaseUringSend();
 #endif
 
 	defer_read.Cancel();
@@ -953,10 +1533,16 @@ BufferedSocket::ReleaseSocket() noexcept
 	assert(!destroyed);
 
 #ifdef HAVE_URING
+	/* the caller would not know about data which is still
+	   queued, and its own writes could overtake it */
+	assert(!HasQueuedUringSend());
+
 	if (uring_receive != nullptr) {
 		uring_receive->Release();
 		uring_receive = nullptr;
 	}
+
+	ReleaseUringSend();
 #endif
 
 	defer_read.Cancel();
@@ -1018,6 +1604,11 @@ BufferedSocket::HandleWriteError() noexcept
 ssize_t
 BufferedSocket::Write(std::span<const std::byte> src) noexcept
 {
+#ifdef HAVE_URING
+	if (uring_send != nullptr)
+		return UringWrite(src);
+#endif
+
 	ssize_t nbytes = base.Write(src);
 
 	if (nbytes < 0) [[unlikely]]
@@ -1029,6 +1620,11 @@ BufferedSocket::Write(std::span<const std::byte> src) noexcept
 ssize_t
 BufferedSocket::WriteV(std::span<const struct iovec> v) noexcept
 {
+#ifdef HAVE_URING
+	if (uring_send != nullptr)
+		return UringWriteV(v);
+#endif
+
 	ssize_t nbytes = base.WriteV(v);
 
 	if (nbytes < 0) [[unlikely]]
@@ -1042,6 +1638,15 @@ BufferedSocket::WriteFrom(FileDescriptor other_fd, FdType other_fd_type,
 			  off_t *other_offset,
 			  std::size_t length) noexcept
 {
+#ifdef HAVE_URING
+	if (uring_send != nullptr && !uring_send->IsEmpty()) {
+		/* wait until all queued data has been sent, or else
+		   this transfer would overtake it */
+		uring_want_write = true;
+		return WRITE_BLOCKING;
+	}
+#endif
+
 	ssize_t nbytes = base.WriteFrom(other_fd, other_fd_type, other_offset,
 					length);
 	if (nbytes < 0) [[unlikely]] {
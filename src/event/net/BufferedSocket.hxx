@@ -12,7 +12,7 @@
 #include "util/LeakDetector.hxx"
 
 #ifdef HAVE_URING
-namespace Uring { class Queue; }
+namespace Uring { class Queue; class BufferRing; }
 #endif
 
 #include <cassert>
@@ -319,6 +319,16 @@ class BufferedSocket final : DebugDestructAnchor, LeakDetector, SocketHandler {
 #ifdef HAVE_URING
 	class UringReceive;
 	UringReceive *uring_receive = nullptr;
+
+	class UringSend;
+	UringSend *uring_send = nullptr;
+
+	/**
+	 * Was a write scheduled while #uring_send was busy?  Then
+	 * BufferedSocketHandler::OnBufferedWrite() will be invoked
+	 * after the next send completion.
+	 */
+	bool uring_want_write = false;
 #endif
 
 	/**
@@ -379,7 +389,19 @@ public:
 	}
 
 #ifdef HAVE_URING
-	void EnableUring(Uring::Queue &uring_queue);
+	/**
+	 * Receive data with io_uring instead of recv().
+	 *
+	 * Throws if the first operation could not be submitted.
+	 *
+	 * @param buffer_ring if not nullptr, then one multishot
+	 * receive operation (Linux 6.0 or later) with provided
+	 * buffers from this ring is used instead of submitting one
+	 * operation for each read; the ring must outlive this
+	 * object
+	 */
+	void EnableUring(Uring::Queue &uring_queue,
+			 Uring::BufferRing *buffer_ring=nullptr);
 
 	/**
 	 * Returns the io_uring queue that was passed to
@@ -387,6 +409,29 @@ public:
 	 */
 	[[gnu::pure]]
 	Uring::Queue *GetUringQueue() const noexcept;
+
+	/**
+	 * Send data with io_uring instead of send().  Write() and
+	 * WriteV() copy the data into an internal buffer and submit
+	 * it to the io_uring; they return #WRITE_BLOCKING only if
+	 * that buffer is full.  Send errors are reported
+	 * asynchronously to the handler.
+	 *
+	 * This may be combined with EnableUring(), but it is
+	 * independent of it.
+	 *
+	 * Close() sends queued data before the socket is actually
+	 * closed; ReleaseSocket() must not be called until
+	 * HasQueuedUringSend() returns false.
+	 */
+	void EnableUringSend(Uring::Queue &uring_queue) noexcept;
+
+	/**
+	 * Is there data which was accepted by Write() but has not yet
+	 * been sent by io_uring?  (See EnableUringSend().)
+	 */
+	[[gnu::pure]]
+	bool HasQueuedUringSend() const noexcept;
 #endif
 
 	bool HasUring() const noexcept {
@@ -411,9 +456,12 @@ public:
 	void Reinit(Event::Duration _write_timeout,
 		    BufferedSocketHandler &_handler) noexcept;
 
-	void Shutdown() noexcept {
-		base.Shutdown();
-	}
+	/**
+	 * Shut down the sending side of the socket (SHUT_WR).  After
+	 * EnableUringSend(), this is deferred until all queued data
+	 * has been sent.
+	 */
+	void Shutdown() noexcept;
 
 	/**
 	 * Close the physical socket, but do not destroy the input buffer.  To
@@ -425,6 +473,9 @@ public:
 	 * Just like Close(), but do not actually close the
 	 * socket.  The caller is responsible for closing the socket (or
 	 * scheduling it for reuse).
+	 *
+	 * After EnableUringSend(), this must not be called while
+	 * HasQueuedUringSend() returns true.
 	 */
 	SocketDescriptor ReleaseSocket() noexcept;
 
@@ -614,6 +665,10 @@ public:
 	 * features and invokes SocketWrapper::Write() directly.  Use this
 	 * in special cases when you want to push data to the socket right
 	 * before closing it.
+	 *
+	 * This must not be used after EnableUringSend(), because the
+	 * data could overtake data which is still queued in the
+	 * io_uring.
 	 */
 	ssize_t DirectWrite(std::span<const std::byte> src) noexcept {
 		return base.Write(src);
@@ -653,6 +708,11 @@ public:
 
 	[[gnu::pure]]
 	bool IsWritePending() const noexcept {
+#ifdef HAVE_URING
+		if (uring_want_write)
+			return true;
+#endif
+
 		return base.IsWritePending() || defer_write.IsPending();
 	}
 
@@ -747,6 +807,12 @@ public:
 		assert(!destroyed);
 
 		defer_write.Cancel();
+
+#ifdef HAVE_URING
+		if (uring_send != nullptr && ScheduleUringWrite())
+			return;
+#endif
+
 		base.ScheduleWrite(write_timeout);
 	}
 
@@ -754,11 +820,30 @@ public:
 		assert(!ended);
 		assert(!destroyed);
 
+#ifdef HAVE_URING
+		uring_want_write = false;
+#endif
+
 		base.UnscheduleWrite();
 		defer_write.Cancel();
 	}
 
 private:
+#ifdef HAVE_URING
+	/**
+	 * Implementation of ScheduleWrite() for #uring_send.
+	 *
+	 * @return true if the write was scheduled, false if the
+	 * caller shall fall back to waiting for EPOLLOUT
+	 */
+	bool ScheduleUringWrite() noexcept;
+
+	ssize_t UringWrite(std::span<const std::byte> src) noexcept;
+	ssize_t UringWriteV(std::span<const struct iovec> v) noexcept;
+
+	void ReleaseUringSend() noexcept;
+#endif
+
 	void ClosedPrematurely() noexcept;
 
 	enum write_result HandleWriteError() noexcept;
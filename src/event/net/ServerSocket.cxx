@@ -66,7 +66,7 @@ public:
 	void Start();
 
 private:
-	void OnUringCompletion(int res) noexcept override;
+	void OnUringCompletion(int res, unsigned) noexcept override;
 };
 
 inline void
@@ -85,7 +85,7 @@ ServerSocket::UringAccept::Start()
 }
 
 void
-ServerSocket::UringAccept::OnUringCompletion(int res) noexcept
+ServerSocket::UringAccept::OnUringCompletion(int res, unsigned) noexcept
 {
 	if (released) [[unlikely]] {
 		if (res >= 0)
@@ -170,6 +170,25 @@ public:
 		write_timeout_event.Cancel();
 	}
 
+	/**
+	 * Arm only the write timeout, without waiting for the socket
+	 * to become writable, e.g. because the data is being sent
+	 * by io_uring.
+	 *
+	 * @param timeout the write timeout; a negative value disables
+	 * the timeout
+	 */
+	void ScheduleWriteTimeout(Event::Duration timeout) noexcept {
+		if (timeout < timeout.zero())
+			write_timeout_event.Cancel();
+		else
+			write_timeout_event.Schedule(timeout);
+	}
+
+	void CancelWriteTimeout() noexcept {
+		write_timeout_event.Cancel();
+	}
+
 	[[gnu::pure]]
 	bool IsReadPending() const noexcept {
 		return socket_event.IsReadPending();
@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "BatchSink.hxx"
+#include "net/log/Serializer.hxx"
+
+#include <cassert>
+#include <cerrno>
+
+#include <sys/socket.h>
+
+namespace Net::Log {
+
+BatchSink::BatchSink(EventLoop &event_loop, SocketDescriptor _socket,
+		     const BatchSinkConfig &_config)
+	:socket(_socket), config(_config),
+	 buffer(config.max_batch * config.max_datagram_size),
+	 iovecs(new struct iovec[config.max_batch]),
+	 messages(new struct mmsghdr[config.max_batch]),
+	 defer_flush(event_loop, BIND_THIS_METHOD(Flush)),
+	 flush_timer(event_loop, BIND_THIS_METHOD(Flush))
+{
+	assert(config.max_batch > 0);
+	assert(config.max_datagram_size > 0);
+
+	for (std::size_t i = 0; i < config.max_batch; ++i) {
+		messages[i] = {};
+		messages[i].msg_hdr.msg_iov = &iovecs[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+BatchSink::~BatchSink() noexcept
+{
+	Flush();
+}
+
+inline void
+BatchSink::ScheduleFlush() noexcept
+{
+	if (config.max_latency > Event::Duration{}) {
+		if (!flush_timer.IsPending())
+			flush_timer.Schedule(config.max_latency);
+	} else
+		defer_flush.ScheduleIdle();
+}
+
+void
+BatchSink::Flush() noexcept
+{
+	defer_flush.Cancel();
+	flush_timer.Cancel();
+
+	std::size_t position = 0;
+	while (position < n_pending) {
+		const int result = sendmmsg(socket.Get(), &messages[position],
+					    n_pending - position,
+					    MSG_DONTWAIT);
+		if (result < 0) {
+			if (errno == EINTR)
+				continue;
+
+			/* discard the rest of this batch; this is
+			   what Send() would do, too (by throwing) */
+			stats.drops += n_pending - position;
+			break;
+		}
+
+		++stats.batches;
+		stats.datagrams += result;
+		position += result;
+	}
+
+	n_pending = 0;
+}
+
+void
+BatchSink::Log(const Datagram &d) noexcept
+{
+	assert(n_pending < config.max_batch);
+
+	const auto slot = GetSlot(n_pending);
+
+	std::size_t size;
+	try {
+		size = Serialize(slot, d);
+	} catch (const BufferTooSmall &) {
+		++stats.drops;
+		return;
+	}
+
+	iovecs[n_pending] = {slot.data(), size};
+	++n_pending;
+
+	if (n_pending == config.max_batch)
+		Flush();
+	else if (n_pending == 1)
+		ScheduleFlush();
+}
+
+} // namespace Net::Log
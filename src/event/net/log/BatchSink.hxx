@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "net/log/Sink.hxx"
+#include "net/SocketDescriptor.hxx"
+#include "event/Chrono.hxx"
+#include "event/DeferEvent.hxx"
+#include "event/FineTimerEvent.hxx"
+#include "system/LargeAllocation.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+struct mmsghdr;
+struct iovec;
+
+namespace Net::Log {
+
+struct BatchSinkConfig {
+	/**
+	 * The maximum number of datagrams submitted with one
+	 * sendmmsg() call.  If the batch is full, it is flushed
+	 * immediately.
+	 */
+	std::size_t max_batch = 64;
+
+	/**
+	 * The maximum size of one serialized datagram.  Larger
+	 * datagrams are dropped.
+	 */
+	std::size_t max_datagram_size = 4096;
+
+	/**
+	 * The maximum time a datagram may stay in the batch.  If
+	 * zero, the batch is flushed at the end of the current
+	 * #EventLoop iteration.
+	 */
+	Event::Duration max_latency{};
+};
+
+struct BatchSinkStats {
+	/**
+	 * The number of datagrams which were sent successfully.
+	 */
+	uint_least64_t datagrams = 0;
+
+	/**
+	 * The number of successful sendmmsg() calls.
+	 */
+	uint_least64_t batches = 0;
+
+	/**
+	 * The number of datagrams which were discarded, either
+	 * because they were too large or because sendmmsg() failed
+	 * (e.g. because the socket buffer was full).
+	 */
+	uint_least64_t drops = 0;
+};
+
+/**
+ * A #Sink implementation which serializes datagrams into a
+ * preallocated buffer and sends them in batches with sendmmsg().
+ * This saves one system call per datagram.
+ *
+ * Errors are not reported; failed datagrams are only counted in
+ * #BatchSinkStats::drops.
+ *
+ * This class is not thread-safe, all methods must be called from the
+ * thread that runs the #EventLoop.
+ */
+class BatchSink final : public Sink {
+	const SocketDescriptor socket;
+
+	const BatchSinkConfig config;
+
+	/**
+	 * Space for #max_batch serialized datagrams, each one
+	 * #max_datagram_size bytes.
+	 */
+	const LargeAllocation buffer;
+
+	const std::unique_ptr<struct iovec[]> iovecs;
+	const std::unique_ptr<struct mmsghdr[]> messages;
+
+	/**
+	 * The number of datagrams in the batch.
+	 */
+	std::size_t n_pending = 0;
+
+	/**
+	 * Flushes at the end of the current #EventLoop iteration
+	 * (if #BatchSinkConfig::max_latency is zero).
+	 */
+	DeferEvent defer_flush;
+
+	/**
+	 * Flushes after #BatchSinkConfig::max_latency.
+	 */
+	FineTimerEvent flush_timer;
+
+	BatchSinkStats stats;
+
+public:
+	/**
+	 * Throws std::bad_alloc on error.
+	 *
+	 * @param _socket a datagram socket connected to a Pond
+	 * server (owned by caller)
+	 */
+	BatchSink(EventLoop &event_loop, SocketDescriptor _socket,
+		  const BatchSinkConfig &_config);
+
+	/**
+	 * Flushes all pending datagrams.
+	 */
+	~BatchSink() noexcept;
+
+	BatchSink(const BatchSink &) = delete;
+	BatchSink &operator=(const BatchSink &) = delete;
+
+	const BatchSinkStats &GetStats() const noexcept {
+		return stats;
+	}
+
+	/**
+	 * Send all pending datagrams now.
+	 */
+	void Flush() noexcept;
+
+	/* virtual methods from class Sink */
+	void Log(const Datagram &d) noexcept override;
+
+private:
+	std::span<std::byte> GetSlot(std::size_t i) const noexcept {
+		return buffer.get().subspan(i * config.max_datagram_size,
+					    config.max_datagram_size);
+	}
+
+	void ScheduleFlush() noexcept;
+};
+
+} // namespace Net::Log
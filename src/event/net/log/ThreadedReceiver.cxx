@@ -0,0 +1,423 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "ThreadedReceiver.hxx"
+#include "event/Loop.hxx"
+#include "event/SocketEvent.hxx"
+#include "net/MultiReceiveMessage.hxx"
+#include "net/SocketConfig.hxx"
+#include "net/SocketError.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "net/log/Datagram.hxx"
+#include "net/log/Parser.hxx"
+#include "net/log/Sink.hxx"
+#include "system/Error.hxx"
+#include "system/linux/CpuAffinity.hxx"
+#include "util/ScopeExit.hxx"
+
+#include <atomic>
+#include <cassert>
+#include <mutex>
+
+#include <linux/filter.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+namespace Net::Log {
+
+namespace {
+
+/**
+ * The datagrams of one recvmmsg() call, parsed by a worker thread.
+ */
+struct ReceivedBatch {
+	/**
+	 * Copies of all payloads.  The #Datagram instances point
+	 * into this buffer.
+	 */
+	std::vector<std::byte> buffer;
+
+	std::vector<Datagram> datagrams;
+};
+
+using BatchPtr = std::unique_ptr<ReceivedBatch>;
+
+} // anonymous namespace
+
+class ThreadedReceiver::Worker {
+	ThreadedReceiver &parent;
+
+	const std::size_t max_queued_batches;
+
+	EventLoop event_loop;
+
+	SocketEvent socket_event;
+
+	MultiReceiveMessage multi;
+
+	/**
+	 * Signalled by the main thread to stop this thread.
+	 */
+	Notify stop_notify;
+
+	/**
+	 * Protects #queue and #spare.
+	 */
+	std::mutex mutex;
+
+	/**
+	 * Batches which are waiting for the main thread.
+	 */
+	std::vector<BatchPtr> queue;
+
+	/**
+	 * Batches which have been consumed by the main thread and
+	 * can be reused (to avoid allocations).
+	 */
+	std::vector<BatchPtr> spare;
+
+	std::atomic<uint_least64_t> n_datagrams{0}, n_batches{0},
+		n_parse_errors{0}, n_drops{0};
+
+	pthread_t thread;
+
+public:
+	/**
+	 * Throws on error.
+	 */
+	Worker(ThreadedReceiver &_parent,
+	       UniqueSocketDescriptor &&socket,
+	       const ThreadedReceiverConfig &config,
+	       int cpu);
+
+	~Worker() noexcept {
+		socket_event.Close();
+	}
+
+	Worker(const Worker &) = delete;
+	Worker &operator=(const Worker &) = delete;
+
+	/**
+	 * Ask the thread to exit.  This method is thread-safe.
+	 */
+	void Stop() noexcept {
+		stop_notify.Signal();
+	}
+
+	void Join() noexcept {
+		pthread_join(thread, nullptr);
+	}
+
+	ThreadedReceiverStats GetStats() const noexcept {
+		return {
+			.datagrams = n_datagrams.load(std::memory_order_relaxed),
+			.batches = n_batches.load(std::memory_order_relaxed),
+			.parse_errors = n_parse_errors.load(std::memory_order_relaxed),
+			.drops = n_drops.load(std::memory_order_relaxed),
+		};
+	}
+
+	/**
+	 * Pass all queued batches to the #Sink.  Must be called in
+	 * the main thread.
+	 */
+	void Consume(Sink &sink) noexcept;
+
+private:
+	BatchPtr TakeSpare() noexcept;
+
+	/**
+	 * Copy and parse the datagrams received by #multi.
+	 */
+	void Parse(ReceivedBatch &batch) noexcept;
+
+	void OnSocketReady(unsigned events) noexcept;
+
+	void OnStop() noexcept {
+		event_loop.Break();
+	}
+
+	static void *Run(void *ctx) noexcept;
+};
+
+/**
+ * Launch a thread, optionally pinned to one CPU.
+ *
+ * @param cpu if not negative, then the thread is pinned to this CPU
+ * @return 0 on success or an errno value
+ */
+static int
+CreateThread(pthread_t &thread, void *(*run)(void *), void *ctx,
+	     int cpu) noexcept
+{
+	pthread_attr_t attr;
+	if (int error = pthread_attr_init(&attr); error != 0)
+		return error;
+
+	AtScopeExit(&attr) { pthread_attr_destroy(&attr); };
+
+	if (cpu >= 0) {
+		if (cpu >= CPU_SETSIZE)
+			return EINVAL;
+
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu, &cpuset);
+
+		if (int error = pthread_attr_setaffinity_np(&attr, sizeof(cpuset),
+							    &cpuset);
+		    error != 0)
+			return error;
+	}
+
+	return pthread_create(&thread, &attr, run, ctx);
+}
+
+ThreadedReceiver::Worker::Worker(ThreadedReceiver &_parent,
+				 UniqueSocketDescriptor &&socket,
+				 const ThreadedReceiverConfig &config,
+				 int cpu)
+	:parent(_parent),
+	 max_queued_batches(config.max_queued_batches),
+	 socket_event(event_loop, BIND_THIS_METHOD(OnSocketReady),
+		      socket.Release()),
+	 multi(config.max_datagrams, config.max_payload_size),
+	 stop_notify(event_loop, BIND_THIS_METHOD(OnStop))
+{
+	socket_event.ScheduleRead();
+
+	int error = CreateThread(thread, Run, this, cpu);
+	if (error != 0 && cpu >= 0)
+		/* pinning is only an optimization; if it fails (e.g.
+		   because the CPU is not available), launch the
+		   thread without it */
+		error = CreateThread(thread, Run, this, -1);
+
+	if (error != 0) {
+		socket_event.Close();
+		throw MakeErrno(error, "Failed to create receiver thread");
+	}
+}
+
+void *
+ThreadedReceiver::Worker::Run(void *ctx) noexcept
+{
+	/* reduce glibc's thread cancellation overhead */
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, nullptr);
+
+	auto &w = *static_cast<Worker *>(ctx);
+	w.event_loop.Run();
+
+	return nullptr;
+}
+
+inline BatchPtr
+ThreadedReceiver::Worker::TakeSpare() noexcept
+{
+	{
+		const std::scoped_lock lock{mutex};
+		if (!spare.empty()) {
+			auto batch = std::move(spare.back());
+			spare.pop_back();
+			return batch;
+		}
+	}
+
+	return std::make_unique<ReceivedBatch>();
+}
+
+inline void
+ThreadedReceiver::Worker::Parse(ReceivedBatch &batch) noexcept
+{
+	batch.buffer.clear();
+	batch.datagrams.clear();
+
+	std::size_t total_size = 0;
+	for (const auto &d : multi)
+		total_size += d.payload.size();
+
+	/* reserve the whole buffer in advance; it must not be
+	   reallocated after the first datagram has been parsed */
+	batch.buffer.reserve(total_size);
+
+	for (const auto &d : multi) {
+		const std::size_t offset = batch.buffer.size();
+		batch.buffer.insert(batch.buffer.end(),
+				    d.payload.begin(), d.payload.end());
+
+		try {
+			batch.datagrams.emplace_back(ParseDatagram(std::span{batch.buffer}.subspan(offset)));
+		} catch (const ProtocolError &) {
+			n_parse_errors.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+}
+
+void
+ThreadedReceiver::Worker::OnSocketReady(unsigned) noexcept
+{
+	try {
+		if (!multi.Receive(socket_event.GetSocket()))
+			return;
+	} catch (...) {
+		/* ignore receive errors (e.g. ICMP errors reported
+		   by the kernel); the socket remains usable */
+		return;
+	}
+
+	auto batch = TakeSpare();
+	Parse(*batch);
+	multi.Clear();
+
+	n_batches.fetch_add(1, std::memory_order_relaxed);
+
+	const std::size_t n = batch->datagrams.size();
+	if (n == 0) {
+		const std::scoped_lock lock{mutex};
+		spare.emplace_back(std::move(batch));
+		return;
+	}
+
+	{
+		const std::scoped_lock lock{mutex};
+		if (queue.size() >= max_queued_batches) {
+			/* the main thread cannot keep up */
+			n_drops.fetch_add(n, std::memory_order_relaxed);
+			spare.emplace_back(std::move(batch));
+			return;
+		}
+
+		/* count before the main thread can see the batch,
+		   so the statistics are never behind the #Sink */
+		n_datagrams.fetch_add(n, std::memory_order_relaxed);
+		queue.emplace_back(std::move(batch));
+	}
+
+	/* this is cheap if the main thread has not yet handled the
+	   previous signal */
+	parent.notify.Signal();
+}
+
+void
+ThreadedReceiver::Worker::Consume(Sink &sink) noexcept
+{
+	std::vector<BatchPtr> batches;
+
+	{
+		const std::scoped_lock lock{mutex};
+		batches.swap(queue);
+	}
+
+	for (const auto &batch : batches)
+		for (const auto &d : batch->datagrams)
+			sink.Log(d);
+
+	const std::scoped_lock lock{mutex};
+	for (auto &batch : batches)
+		if (spare.size() < max_queued_batches)
+			spare.emplace_back(std::move(batch));
+}
+
+/**
+ * Attach a classic BPF program to the SO_REUSEPORT group which
+ * selects the socket by the current CPU number.
+ */
+static void
+AttachCpuSteering(SocketDescriptor s, unsigned n_sockets)
+{
+	struct sock_filter code[] = {
+		/* A = current CPU */
+		BPF_STMT(BPF_LD|BPF_W|BPF_ABS,
+			 static_cast<uint32_t>(SKF_AD_OFF + SKF_AD_CPU)),
+		/* A = A % n_sockets */
+		BPF_STMT(BPF_ALU|BPF_MOD|BPF_K, n_sockets),
+		/* return A */
+		BPF_STMT(BPF_RET|BPF_A, 0),
+	};
+
+	const struct sock_fprog program{
+		.len = std::size(code),
+		.filter = code,
+	};
+
+	if (!s.SetOption(SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+			 &program, sizeof(program)))
+		throw MakeSocketError("Failed to set SO_ATTACH_REUSEPORT_CBPF");
+}
+
+ThreadedReceiver::ThreadedReceiver(EventLoop &event_loop,
+				   const SocketConfig &_socket_config,
+				   const ThreadedReceiverConfig &config,
+				   Sink &_sink)
+	:sink(_sink),
+	 notify(event_loop, BIND_THIS_METHOD(OnNotify))
+{
+	assert(config.n_threads > 0);
+
+	SocketConfig socket_config = _socket_config;
+	socket_config.reuse_port = true;
+
+	const auto cpus = config.pin_threads
+		? GetAllowedCpus()
+		: std::vector<unsigned>{};
+
+	workers.reserve(config.n_threads);
+
+	try {
+		for (unsigned i = 0; i < config.n_threads; ++i) {
+			auto s = socket_config.Create(SOCK_DGRAM);
+
+			if (i == 0 && config.steering == ReceiverSteering::CPU)
+				AttachCpuSteering(s, config.n_threads);
+
+			const int cpu = cpus.empty()
+				? -1
+				: static_cast<int>(cpus[i % cpus.size()]);
+
+			workers.emplace_back(std::make_unique<Worker>(*this, std::move(s),
+								      config, cpu));
+		}
+	} catch (...) {
+		for (auto &i : workers)
+			i->Stop();
+		for (auto &i : workers)
+			i->Join();
+		throw;
+	}
+}
+
+ThreadedReceiver::~ThreadedReceiver() noexcept
+{
+	for (auto &i : workers)
+		i->Stop();
+
+	for (auto &i : workers)
+		i->Join();
+}
+
+ThreadedReceiverStats
+ThreadedReceiver::GetStats(std::size_t thread) const noexcept
+{
+	assert(thread < workers.size());
+
+	return workers[thread]->GetStats();
+}
+
+ThreadedReceiverStats
+ThreadedReceiver::GetStats() const noexcept
+{
+	ThreadedReceiverStats result;
+	for (const auto &i : workers)
+		result += i->GetStats();
+	return result;
+}
+
+void
+ThreadedReceiver::OnNotify() noexcept
+{
+	for (auto &i : workers)
+		i->Consume(sink);
+}
+
+} // namespace Net::Log
@@ -0,0 +1,171 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "thread/Notify.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct SocketConfig;
+
+namespace Net::Log {
+
+class Sink;
+
+/**
+ * How does the kernel distribute incoming datagrams among the
+ * receiver threads?
+ */
+enum class ReceiverSteering : uint_least8_t {
+	/**
+	 * The kernel's default SO_REUSEPORT selection: a hash of
+	 * source and destination address.  All datagrams from one
+	 * sender go to the same thread (as long as the number of
+	 * sockets does not change).
+	 */
+	KERNEL,
+
+	/**
+	 * A classic BPF program selects the thread by the number of
+	 * the CPU which received the datagram.  Combined with
+	 * #ThreadedReceiverConfig::pin_threads, this keeps each
+	 * datagram on the CPU which received it (as long as the
+	 * process is allowed to run on CPUs 0 to N-1).
+	 */
+	CPU,
+};
+
+struct ThreadedReceiverConfig {
+	/**
+	 * The number of receiver threads (and sockets).
+	 */
+	unsigned n_threads = 4;
+
+	/**
+	 * The maximum number of datagrams received with one
+	 * recvmmsg() call.
+	 */
+	std::size_t max_datagrams = 64;
+
+	/**
+	 * The maximum size of one datagram.  Larger ones are
+	 * truncated (and will then usually fail to parse).
+	 */
+	std::size_t max_payload_size = 16384;
+
+	/**
+	 * The maximum number of batches each thread may queue for
+	 * the main thread.  If the main thread cannot keep up, new
+	 * batches are dropped.
+	 */
+	std::size_t max_queued_batches = 256;
+
+	ReceiverSteering steering = ReceiverSteering::KERNEL;
+
+	/**
+	 * Pin each thread to one of the CPUs this process is allowed
+	 * to run on (thread N to the Nth allowed CPU)?  If pinning a
+	 * thread fails, it runs unpinned.
+	 */
+	bool pin_threads = false;
+};
+
+struct ThreadedReceiverStats {
+	/**
+	 * The number of datagrams which were parsed successfully
+	 * and passed to the main thread.
+	 */
+	uint_least64_t datagrams = 0;
+
+	/**
+	 * The number of recvmmsg() batches.
+	 */
+	uint_least64_t batches = 0;
+
+	/**
+	 * The number of datagrams which could not be parsed.
+	 */
+	uint_least64_t parse_errors = 0;
+
+	/**
+	 * The number of parsed datagrams which were discarded
+	 * because the queue to the main thread was full.
+	 */
+	uint_least64_t drops = 0;
+
+	constexpr auto &operator+=(const ThreadedReceiverStats &other) noexcept {
+		datagrams += other.datagrams;
+		batches += other.batches;
+		parse_errors += other.parse_errors;
+		drops += other.drops;
+		return *this;
+	}
+};
+
+/**
+ * Receives Net::Log datagrams with several threads, each with its
+ * own #EventLoop and its own SO_REUSEPORT socket.  The threads
+ * receive datagrams in batches with recvmmsg() and parse them; the
+ * parsed datagrams are then passed (through one queue per thread)
+ * to the main thread, which submits them to the #Sink.
+ */
+class ThreadedReceiver {
+	class Worker;
+
+	Sink &sink;
+
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	/**
+	 * Wakes up the main thread when a worker has queued a
+	 * batch.
+	 */
+	Notify notify;
+
+public:
+	/**
+	 * Throws on error.
+	 *
+	 * @param event_loop the main thread's #EventLoop
+	 * @param socket_config the socket configuration;
+	 * SO_REUSEPORT is enabled implicitly
+	 * @param sink receives all datagrams (in the main thread)
+	 */
+	ThreadedReceiver(EventLoop &event_loop,
+			 const SocketConfig &socket_config,
+			 const ThreadedReceiverConfig &config,
+			 Sink &sink);
+
+	/**
+	 * Stops all threads and waits for them to exit.
+	 */
+	~ThreadedReceiver() noexcept;
+
+	ThreadedReceiver(const ThreadedReceiver &) = delete;
+	ThreadedReceiver &operator=(const ThreadedReceiver &) = delete;
+
+	std::size_t GetThreadCount() const noexcept {
+		return workers.size();
+	}
+
+	/**
+	 * Obtain the statistics of one thread.  This method is
+	 * thread-safe.
+	 */
+	ThreadedReceiverStats GetStats(std::size_t thread) const noexcept;
+
+	/**
+	 * Obtain the sum of all threads' statistics.
+	 */
+	ThreadedReceiverStats GetStats() const noexcept;
+
+private:
+	void OnNotify() noexcept;
+};
+
+} // namespace Net::Log
@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "BufferRing.hxx"
+#include "Queue.hxx"
+#include "memory/SlicePool.hxx"
+
+#include <cassert>
+
+namespace Uring {
+
+BufferRing::BufferRing(Queue &_queue, SlicePool &pool,
+		       uint_least16_t _group_id, unsigned _n_buffers)
+	:queue(_queue),
+	 buffers(new SliceAllocation[_n_buffers]),
+	 ring(queue.SetupBufRing(_n_buffers, _group_id)),
+	 n_buffers(_n_buffers), group_id(_group_id)
+{
+	const int mask = io_uring_buf_ring_mask(n_buffers);
+
+	for (unsigned i = 0; i < n_buffers; ++i) {
+		auto &b = buffers[i] = pool.Alloc();
+		io_uring_buf_ring_add(ring, b.data, b.size, i, mask, i);
+	}
+
+	io_uring_buf_ring_advance(ring, n_buffers);
+}
+
+BufferRing::~BufferRing() noexcept
+{
+	queue.FreeBufRing(ring, n_buffers, group_id);
+}
+
+std::span<std::byte>
+BufferRing::Get(uint_least16_t buffer_id) const noexcept
+{
+	assert(buffer_id < n_buffers);
+
+	const auto &b = buffers[buffer_id];
+	return {static_cast<std::byte *>(b.data), b.size};
+}
+
+void
+BufferRing::Recycle(uint_least16_t buffer_id) noexcept
+{
+	assert(buffer_id < n_buffers);
+
+	const auto &b = buffers[buffer_id];
+	io_uring_buf_ring_add(ring, b.data, b.size, buffer_id,
+			      io_uring_buf_ring_mask(n_buffers), 0);
+	io_uring_buf_ring_advance(ring, 1);
+}
+
+} // namespace Uring
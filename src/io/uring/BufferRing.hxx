@@ -0,0 +1,88 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "memory/SliceAllocation.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+#include <liburing.h>
+
+class SlicePool;
+
+namespace Uring {
+
+class Queue;
+
+/**
+ * A ring of provided buffers (`IORING_REGISTER_PBUF_RING`).  The
+ * kernel picks a buffer from it for each completion of an operation
+ * with `IOSQE_BUFFER_SELECT` (e.g. a multishot receive), and the
+ * buffer belongs to the application until it is passed to
+ * Recycle().
+ *
+ * Each buffer is one slice from a #SlicePool.
+ *
+ * This object must outlive all operations which use it.
+ */
+class BufferRing {
+	Queue &queue;
+
+	const std::unique_ptr<SliceAllocation[]> buffers;
+
+	struct io_uring_buf_ring *const ring;
+
+	const unsigned n_buffers;
+
+	const uint_least16_t group_id;
+
+public:
+	/**
+	 * Throws on error.
+	 *
+	 * @param n_buffers the number of buffers; must be a power of
+	 * two and not larger than 32768
+	 */
+	BufferRing(Queue &_queue, SlicePool &pool,
+		   uint_least16_t _group_id, unsigned _n_buffers);
+
+	~BufferRing() noexcept;
+
+	BufferRing(const BufferRing &) = delete;
+	BufferRing &operator=(const BufferRing &) = delete;
+
+	/**
+	 * Returns the buffer group id to be passed to operations
+	 * (`io_uring_sqe::buf_group`).
+	 */
+	uint_least16_t GetGroupId() const noexcept {
+		return group_id;
+	}
+
+	/**
+	 * Extract the buffer id from the flags of a completion.  This
+	 * is only legal if #IORING_CQE_F_BUFFER is set.
+	 */
+	static constexpr uint_least16_t GetBufferId(unsigned cqe_flags) noexcept {
+		return cqe_flags >> IORING_CQE_BUFFER_SHIFT;
+	}
+
+	/**
+	 * Returns the (writable) memory of the specified buffer.
+	 */
+	[[gnu::pure]]
+	std::span<std::byte> Get(uint_least16_t buffer_id) const noexcept;
+
+	/**
+	 * Give a buffer back to the kernel after its contents have
+	 * been consumed.
+	 */
+	void Recycle(uint_least16_t buffer_id) noexcept;
+};
+
+} // namespace Uring
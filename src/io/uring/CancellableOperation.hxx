@@ -11,6 +11,7 @@
 #include <utility>
 
 #include <errno.h> // for ECANCELED
+#include <liburing.h> // for IORING_CQE_F_MORE
 
 namespace Uring {
 
@@ -29,7 +30,7 @@ public:
 
 	~CancellableOperation() noexcept {
 		if (operation != nullptr)
-			operation->OnUringCompletion(-ECANCELED);
+			operation->OnUringCompletion(-ECANCELED, 0);
 	}
 
 	void Cancel(Operation &_operation) noexcept {
@@ -51,18 +52,18 @@ public:
 		new_operation.cancellable = this;
 	}
 
-	void OnUringCompletion(int res, bool more) noexcept {
+	void OnUringCompletion(int res, unsigned flags) noexcept {
 		if (operation == nullptr)
 			return;
 
 		assert(operation->cancellable == this);
 
-		if (more) {
-			operation->OnUringCompletion(res);
+		if (flags & IORING_CQE_F_MORE) {
+			operation->OnUringCompletion(res, flags);
 		} else {
 			operation->cancellable = nullptr;
 
-			std::exchange(operation, nullptr)->OnUringCompletion(res);
+			std::exchange(operation, nullptr)->OnUringCompletion(res, flags);
 		}
 	}
 };
@@ -12,7 +12,7 @@
 namespace Uring {
 
 void
-CoOperationBase::OnUringCompletion(int res) noexcept
+CoOperationBase::OnUringCompletion(int res, unsigned) noexcept
 {
 	result = res;
 
@@ -32,7 +32,7 @@ protected:
 
 private:
 	/* virtual methods from class Uring::Operation */
-	void OnUringCompletion(int res) noexcept final;
+	void OnUringCompletion(int res, unsigned) noexcept final;
 };
 
 struct io_uring_sqe &
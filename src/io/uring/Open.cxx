@@ -67,7 +67,7 @@ Open::StartOpenReadOnlyBeneath(FileAt file) noexcept
 }
 
 void
-Open::OnUringCompletion(int res) noexcept
+Open::OnUringCompletion(int res, unsigned) noexcept
 {
 	if (canceled) {
 		if (res >= 0)
@@ -67,7 +67,7 @@ OpenStat::StartOpenStatReadOnlyBeneath(FileAt file) noexcept
 }
 
 void
-OpenStat::OnUringCompletion(int res) noexcept
+OpenStat::OnUringCompletion(int res, unsigned) noexcept
 {
 	if (canceled) {
 		if (!fd.IsDefined() && res >= 0)
@@ -66,7 +66,7 @@ public:
 
 private:
 	/* virtual methods from class Operation */
-	void OnUringCompletion(int res) noexcept override;
+	void OnUringCompletion(int res, unsigned) noexcept override;
 };
 
 } // namespace Uring
@@ -63,8 +63,13 @@ public:
 	 * @param res the result code; the meaning is specific to the
 	 * operation, but negative values usually mean an error has
 	 * occurred
+	 *
+	 * @param flags the completion flags (`IORING_CQE_F_*`),
+	 * e.g. #IORING_CQE_F_MORE if this is not the last completion
+	 * of a multishot operation, or #IORING_CQE_F_BUFFER with a
+	 * provided buffer id
 	 */
-	virtual void OnUringCompletion(int res) noexcept = 0;
+	virtual void OnUringCompletion(int res, unsigned flags) noexcept = 0;
 };
 
 } // namespace Uring
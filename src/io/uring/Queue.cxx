@@ -58,7 +58,7 @@ Queue::_DispatchOneCompletion(const struct io_uring_cqe &cqe) noexcept
 	if (data != nullptr) {
 		auto *c = (CancellableOperation *)data;
 		const bool more = cqe.flags & IORING_CQE_F_MORE;
-		c->OnUringCompletion(cqe.res, more);
+		c->OnUringCompletion(cqe.res, cqe.flags);
 		if (!more) {
 			c->unlink();
 			delete c;
@@ -38,6 +38,16 @@ public:
 		ring.SetMaxWorkers(bounded, unbounded);
 	}
 
+	struct io_uring_buf_ring *SetupBufRing(unsigned entries,
+					       uint_least16_t group_id) {
+		return ring.SetupBufRing(entries, group_id);
+	}
+
+	void FreeBufRing(struct io_uring_buf_ring *br, unsigned entries,
+			 uint_least16_t group_id) noexcept {
+		ring.FreeBufRing(br, entries, group_id);
+	}
+
 	[[gnu::pure]]
 	bool HasOverflow() const noexcept {
 		return ring.HasOverflow();
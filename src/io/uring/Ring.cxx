@@ -41,6 +41,17 @@ Ring::SetMaxWorkers(unsigned values[2])
 		throw MakeErrno(-error, "io_uring_register_iowq_max_workers() failed");
 }
 
+struct io_uring_buf_ring *
+Ring::SetupBufRing(unsigned entries, uint_least16_t group_id)
+{
+	int error;
+	auto *br = io_uring_setup_buf_ring(&ring, entries, group_id, 0, &error);
+	if (br == nullptr)
+		throw MakeErrno(-error, "io_uring_setup_buf_ring() failed");
+
+	return br;
+}
+
 void
 Ring::Submit()
 {
@@ -6,6 +6,8 @@
 
 #include "io/FileDescriptor.hxx"
 
+#include <cstdint>
+
 #include <liburing.h>
 
 namespace Uring {
@@ -67,6 +69,30 @@ public:
 		SetMaxWorkers(values);
 	}
 
+	/**
+	 * Allocate a ring of provided buffers and register it
+	 * (`IORING_REGISTER_PBUF_RING`).  Wrapper for
+	 * io_uring_setup_buf_ring().
+	 *
+	 * Throws on error.
+	 *
+	 * @param entries the number of entries; must be a power of
+	 * two
+	 * @param group_id the buffer group id which is passed to
+	 * operations with `IOSQE_BUFFER_SELECT`
+	 */
+	struct io_uring_buf_ring *SetupBufRing(unsigned entries,
+					       uint_least16_t group_id);
+
+	/**
+	 * Unregister and free a ring which was allocated with
+	 * SetupBufRing().
+	 */
+	void FreeBufRing(struct io_uring_buf_ring *br, unsigned entries,
+			 uint_least16_t group_id) noexcept {
+		io_uring_free_buf_ring(&ring, br, entries, group_id);
+	}
+
 	/**
 	 * @return true if there are overflow entries waiting to be
 	 * flushed onto the CQ ring
@@ -17,32 +17,45 @@ struct AllocatorStats {
 	 */
 	std::size_t netto_size;
 
+	/**
+	 * Number of bytes held in per-thread caches (included in
+	 * #brutto_size, but not in #netto_size).
+	 */
+	std::size_t cached_size;
+
 	constexpr void Clear() noexcept {
 		brutto_size = 0;
 		netto_size = 0;
+		cached_size = 0;
 	}
 
 	constexpr AllocatorStats &operator+=(const AllocatorStats other) noexcept {
 		brutto_size += other.brutto_size;
 		netto_size += other.netto_size;
+		cached_size += other.cached_size;
 		return *this;
 	}
 
 	constexpr AllocatorStats &operator-=(const AllocatorStats other) noexcept {
 		brutto_size -= other.brutto_size;
 		netto_size -= other.netto_size;
+		cached_size -= other.cached_size;
 		return *this;
 	}
 
 	constexpr AllocatorStats operator+(const AllocatorStats other) const noexcept {
-		return { brutto_size + other.brutto_size,
-			netto_size + other.netto_size };
+		return {
+			brutto_size + other.brutto_size,
+			netto_size + other.netto_size,
+			cached_size + other.cached_size,
+		};
 	}
 
 	constexpr AllocatorStats operator-(const AllocatorStats other) const noexcept {
 		return {
 			brutto_size - other.brutto_size,
 			netto_size - other.netto_size,
+			cached_size - other.cached_size,
 		};
 	}
 };
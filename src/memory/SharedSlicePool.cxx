@@ -0,0 +1,233 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "SharedSlicePool.hxx"
+#include "SliceArea.hxx"
+#include "Checker.hxx"
+#include "util/Poison.h"
+
+#include <algorithm> // for std::move()
+#include <cassert>
+#include <new>
+
+/**
+ * The list of #SliceCache instances owned by the current thread.
+ */
+static thread_local SliceCache *thread_caches = nullptr;
+
+SharedSlicePool::SharedSlicePool(std::size_t _slice_size,
+				 unsigned _slices_per_area,
+				 const char *_vma_name,
+				 unsigned _magazine_size) noexcept
+	:pool(_slice_size, _slices_per_area, _vma_name),
+	 magazine_size(_magazine_size)
+{
+	assert(magazine_size >= 2);
+
+	pool.shared = this;
+}
+
+SharedSlicePool::~SharedSlicePool() noexcept
+{
+	assert(caches.empty());
+
+	DrainRemoteFree();
+}
+
+void
+SharedSlicePool::ForkCow(bool inherit) noexcept
+{
+	const std::scoped_lock lock{mutex};
+	pool.ForkCow(inherit);
+}
+
+AllocatorStats
+SharedSlicePool::GetStats() const noexcept
+{
+	const std::scoped_lock lock{mutex};
+
+	auto stats = pool.GetStats();
+
+	for (const auto &cache : caches) {
+		const auto c = cache.GetStats();
+		stats.cached_size += c.cached_size;
+		stats.netto_size -= c.cached_size;
+	}
+
+	return stats;
+}
+
+void
+SharedSlicePool::Compress() noexcept
+{
+	const std::scoped_lock lock{mutex};
+	DrainRemoteFree();
+	pool.Compress();
+}
+
+inline SliceCache *
+SharedSlicePool::FindThreadCache() noexcept
+{
+	for (auto *cache = thread_caches; cache != nullptr;
+	     cache = cache->next_in_thread)
+		if (&cache->pool == this)
+			return cache;
+
+	return nullptr;
+}
+
+void
+SharedSlicePool::DrainRemoteFree() noexcept
+{
+	auto *i = remote_free.exchange(nullptr, std::memory_order_acquire);
+	while (i != nullptr) {
+		auto *next = i->next;
+		pool.Free(*i->area, i);
+		i = next;
+	}
+}
+
+inline void
+SharedSlicePool::PushRemoteFree(SliceArea &area, void *p) noexcept
+{
+	auto *node = ::new(p) RemoteFree{nullptr, &area};
+	node->next = remote_free.load(std::memory_order_relaxed);
+	while (!remote_free.compare_exchange_weak(node->next, node,
+						  std::memory_order_release,
+						  std::memory_order_relaxed)) {}
+}
+
+SliceAllocation
+SharedSlicePool::Alloc() noexcept
+{
+	if (HaveMemoryChecker())
+		/* this only calls malloc() which is thread-safe */
+		return pool.Alloc();
+
+	if (auto *cache = FindThreadCache())
+		return cache->Alloc();
+
+	const std::scoped_lock lock{mutex};
+	DrainRemoteFree();
+	return pool.Alloc();
+}
+
+void
+SharedSlicePool::Free(SliceArea &area, void *p) noexcept
+{
+	assert(!HaveMemoryChecker());
+
+	if (auto *cache = FindThreadCache())
+		cache->Free(area, p);
+	else
+		PushRemoteFree(area, p);
+}
+
+SliceCache::SliceCache(SharedSlicePool &_pool) noexcept
+	:pool(_pool), next_in_thread(thread_caches),
+	 magazine(new Entry[pool.magazine_size])
+{
+	thread_caches = this;
+
+	const std::scoped_lock lock{pool.mutex};
+	pool.caches.push_back(*this);
+}
+
+SliceCache::~SliceCache() noexcept
+{
+	/* unregister from this thread */
+	auto **i = &thread_caches;
+	while (*i != this) {
+		assert(*i != nullptr);
+		i = &(*i)->next_in_thread;
+	}
+
+	*i = next_in_thread;
+
+	/* return all slices to the depot */
+	const std::scoped_lock lock{pool.mutex};
+	unlink();
+
+	for (unsigned n = n_cached.load(std::memory_order_relaxed); n > 0;) {
+		const auto &e = magazine[--n];
+		pool.pool.Free(*e.area, e.p);
+	}
+
+	n_cached.store(0, std::memory_order_relaxed);
+}
+
+AllocatorStats
+SliceCache::GetStats() const noexcept
+{
+	AllocatorStats stats;
+	stats.Clear();
+	stats.brutto_size = stats.cached_size =
+		n_cached.load(std::memory_order_relaxed) * pool.GetSliceSize();
+	return stats;
+}
+
+void
+SliceCache::Refill() noexcept
+{
+	assert(n_cached.load(std::memory_order_relaxed) == 0);
+
+	const unsigned n = pool.magazine_size / 2;
+
+	const std::scoped_lock lock{pool.mutex};
+	pool.DrainRemoteFree();
+
+	for (unsigned i = 0; i < n; ++i) {
+		auto allocation = pool.pool.Alloc();
+		magazine[i] = {allocation.area, allocation.Steal()};
+		PoisonInaccessible(magazine[i].p, pool.GetSliceSize());
+	}
+
+	n_cached.store(n, std::memory_order_relaxed);
+}
+
+void
+SliceCache::Flush(unsigned n) noexcept
+{
+	unsigned i = n_cached.load(std::memory_order_relaxed);
+	assert(n <= i);
+
+	const std::scoped_lock lock{pool.mutex};
+
+	/* return the oldest entries; the most recently freed ones
+	   are more likely to be in the CPU cache */
+	for (unsigned j = 0; j < n; ++j) {
+		const auto &e = magazine[j];
+		pool.pool.Free(*e.area, e.p);
+	}
+
+	std::move(&magazine[n], &magazine[i], &magazine[0]);
+	n_cached.store(i - n, std::memory_order_relaxed);
+}
+
+inline SliceAllocation
+SliceCache::Alloc() noexcept
+{
+	if (n_cached.load(std::memory_order_relaxed) == 0)
+		Refill();
+
+	const unsigned n = n_cached.load(std::memory_order_relaxed) - 1;
+	const auto &e = magazine[n];
+	n_cached.store(n, std::memory_order_relaxed);
+
+	PoisonUndefined(e.p, pool.GetSliceSize());
+	return {*e.area, e.p, pool.GetSliceSize()};
+}
+
+inline void
+SliceCache::Free(SliceArea &area, void *p) noexcept
+{
+	if (n_cached.load(std::memory_order_relaxed) == pool.magazine_size)
+		Flush(pool.magazine_size / 2);
+
+	PoisonInaccessible(p, pool.GetSliceSize());
+
+	const unsigned n = n_cached.load(std::memory_order_relaxed);
+	magazine[n] = {&area, p};
+	n_cached.store(n + 1, std::memory_order_relaxed);
+}
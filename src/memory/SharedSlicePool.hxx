@@ -0,0 +1,191 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "SlicePool.hxx"
+#include "AllocatorStats.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+class SliceCache;
+
+/**
+ * A thread-safe front end for #SlicePool which can be shared by all
+ * threads of a process.
+ *
+ * Threads which allocate frequently should create a #SliceCache;
+ * allocations and deallocations in that thread are then served from
+ * a per-thread "magazine" without any locking, and only refilling or
+ * flushing the magazine locks the shared #SlicePool (the "depot").
+ *
+ * Threads without a #SliceCache lock the depot for each allocation;
+ * their Free() calls are pushed to a lock-free "remote free" list
+ * which is drained by the next thread that locks the depot.
+ */
+class SharedSlicePool {
+	friend class SliceCache;
+
+	/**
+	 * Protects #pool and #caches.
+	 */
+	mutable std::mutex mutex;
+
+	SlicePool pool;
+
+	IntrusiveList<SliceCache> caches;
+
+	/**
+	 * A slice freed by a thread without a #SliceCache.  This
+	 * struct is stored inside the slice memory.
+	 */
+	struct RemoteFree {
+		RemoteFree *next;
+		SliceArea *area;
+	};
+
+	static_assert(sizeof(RemoteFree) <= 0x20,
+		      "must fit into the smallest slice");
+
+	std::atomic<RemoteFree *> remote_free{nullptr};
+
+	/**
+	 * The maximum number of slices in each #SliceCache.
+	 */
+	const unsigned magazine_size;
+
+public:
+	/**
+	 * @param _magazine_size the maximum number of slices cached
+	 * by each #SliceCache
+	 */
+	SharedSlicePool(std::size_t _slice_size, unsigned _slices_per_area,
+			const char *_vma_name,
+			unsigned _magazine_size=64) noexcept;
+	~SharedSlicePool() noexcept;
+
+	SharedSlicePool(const SharedSlicePool &) = delete;
+	SharedSlicePool &operator=(const SharedSlicePool &) = delete;
+
+	std::size_t GetSliceSize() const noexcept {
+		return pool.GetSliceSize();
+	}
+
+	void ForkCow(bool inherit) noexcept;
+
+	/**
+	 * @see SlicePool::HugeTlb()
+	 */
+	void HugeTlb() noexcept {
+		const std::scoped_lock lock{mutex};
+		pool.HugeTlb();
+	}
+
+	/**
+	 * @see SlicePool::NumaLocal()
+	 */
+	void NumaLocal() noexcept {
+		const std::scoped_lock lock{mutex};
+		pool.NumaLocal();
+	}
+
+	/**
+	 * Returns the statistics of the whole pool.  Slices held by
+	 * a #SliceCache are accounted in
+	 * AllocatorStats::cached_size, not in
+	 * AllocatorStats::netto_size.
+	 */
+	[[gnu::pure]]
+	AllocatorStats GetStats() const noexcept;
+
+	/**
+	 * Release unused memory to the kernel.  Slices held by a
+	 * #SliceCache are not affected.
+	 */
+	void Compress() noexcept;
+
+	SliceAllocation Alloc() noexcept;
+	void Free(SliceArea &area, void *p) noexcept;
+
+private:
+	/**
+	 * Find the #SliceCache of the current thread for this pool.
+	 */
+	[[gnu::pure]]
+	SliceCache *FindThreadCache() noexcept;
+
+	/**
+	 * Return all slices in the "remote free" list to the depot.
+	 * Caller must hold the mutex.
+	 */
+	void DrainRemoteFree() noexcept;
+
+	void PushRemoteFree(SliceArea &area, void *p) noexcept;
+};
+
+/**
+ * A per-thread cache for a #SharedSlicePool.  It registers itself
+ * for the thread which constructs it; it must be destructed in the
+ * same thread.  Upon destruction, all cached slices are returned to
+ * the depot.
+ */
+class SliceCache final
+	: public IntrusiveListHook<IntrusiveHookMode::NORMAL>
+{
+	friend class SharedSlicePool;
+
+	SharedSlicePool &pool;
+
+	/**
+	 * The next #SliceCache registered for this thread (for a
+	 * different #SharedSlicePool).
+	 */
+	SliceCache *next_in_thread;
+
+	struct Entry {
+		SliceArea *area;
+		void *p;
+	};
+
+	const std::unique_ptr<Entry[]> magazine;
+
+	/**
+	 * The number of slices in #magazine.  This is atomic only
+	 * because GetStats() may read it from another thread.
+	 */
+	std::atomic_uint n_cached{0};
+
+public:
+	explicit SliceCache(SharedSlicePool &_pool) noexcept;
+	~SliceCache() noexcept;
+
+	SliceCache(const SliceCache &) = delete;
+	SliceCache &operator=(const SliceCache &) = delete;
+
+	/**
+	 * Returns the occupancy of this cache in
+	 * AllocatorStats::cached_size (and the same value in
+	 * AllocatorStats::brutto_size).
+	 */
+	[[gnu::pure]]
+	AllocatorStats GetStats() const noexcept;
+
+private:
+	SliceAllocation Alloc() noexcept;
+	void Free(SliceArea &area, void *p) noexcept;
+
+	/**
+	 * Allocate up to half a magazine from the depot.
+	 */
+	void Refill() noexcept;
+
+	/**
+	 * Return the given number of slices to the depot.
+	 */
+	void Flush(unsigned n) noexcept;
+};
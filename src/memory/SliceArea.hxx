@@ -23,6 +23,12 @@ class SliceArea
 
 	unsigned free_head = 0;
 
+	/**
+	 * Is this area backed by explicit huge pages (hugetlbfs)?
+	 * Those cannot be discarded partially.
+	 */
+	const bool hugetlb;
+
 	struct Slot {
 		unsigned next;
 
@@ -40,7 +46,7 @@ class SliceArea
 
 	Slot slices[1];
 
-	explicit SliceArea(SlicePool &pool) noexcept;
+	SliceArea(SlicePool &pool, bool _hugetlb) noexcept;
 
 	~SliceArea() noexcept {
 		assert(allocated_count == 0);
@@ -4,6 +4,7 @@
 
 #include "SlicePool.hxx"
 #include "SliceArea.hxx"
+#include "SharedSlicePool.hxx"
 #include "Checker.hxx"
 #include "AllocatorStats.hxx"
 #include "system/PageAllocator.hxx"
@@ -31,8 +32,8 @@ align_size(std::size_t size) noexcept
  */
 
 inline
-SliceArea::SliceArea(SlicePool &_pool) noexcept
-	:pool(_pool)
+SliceArea::SliceArea(SlicePool &_pool, bool _hugetlb) noexcept
+	:pool(_pool), hugetlb(_hugetlb)
 {
 	/* build the "free" list */
 	for (unsigned i = 0; i < pool.slices_per_area - 1; ++i)
@@ -47,16 +48,28 @@ SliceArea::SliceArea(SlicePool &_pool) noexcept
 SliceArea *
 SliceArea::New(SlicePool &pool) noexcept
 {
-	std::byte *p = AllocatePages(pool.area_size);
+	std::byte *p = nullptr;
+	bool hugetlb = false;
+
+	if (pool.hugetlb) {
+		p = AllocateHugeTlbPages(pool.area_size);
+		hugetlb = p != nullptr;
+	}
+
+	if (p == nullptr) {
+		/* align to the huge page size so the kernel can back
+		   the whole area with transparent huge pages */
+		p = AllocateAlignedPages(pool.area_size, HUGE_PAGE_SIZE);
+		EnableHugePages({p, pool.area_size});
+	}
 
 	if (pool.vma_name != nullptr)
 		SetVmaName({p, pool.area_size}, pool.vma_name);
 
-	if (std::size_t huge_size = AlignHugePageDown(pool.area_size);
-	    huge_size > 0)
-		EnableHugePages({p, huge_size});
+	if (pool.numa_local)
+		BindPagesToLocalNode({p, pool.area_size});
 
-	return ::new(p) SliceArea(pool);
+	return ::new(p) SliceArea(pool, hugetlb);
 }
 
 inline bool
@@ -184,6 +197,10 @@ SliceArea::PunchSliceRange(unsigned start,
 void
 SliceArea::Compress() noexcept
 {
+	if (hugetlb)
+		/* hugetlbfs pages can only be discarded as a whole */
+		return;
+
 	unsigned position = 0;
 
 	while (true) {
@@ -291,6 +308,9 @@ SliceArea::Populate() noexcept
 inline void
 SliceArea::CollapseHugePages() noexcept
 {
+	if (hugetlb)
+		return;
+
 	::CollapseHugePages({reinterpret_cast<std::byte *>(this), pool.area_size});
 }
 
@@ -458,7 +478,10 @@ SliceArea::Free(void *p) noexcept
 		return;
 	}
 
-	pool.Free(*this, p);
+	if (pool.shared != nullptr)
+		pool.shared->Free(*this, p);
+	else
+		pool.Free(*this, p);
 }
 
 inline void
@@ -474,7 +497,7 @@ AllocatorStats
 SlicePool::GetStats() const noexcept
 {
 	AllocatorStats stats;
-	stats.brutto_size = stats.netto_size = 0;
+	stats.Clear();
 
 	AddStats(stats, areas);
 	AddStats(stats, empty_areas);
@@ -11,6 +11,7 @@
 
 struct AllocatorStats;
 class SliceArea;
+class SharedSlicePool;
 
 /**
  * The "slice" memory allocator.  It is an allocator for large numbers
@@ -18,6 +19,7 @@ class SliceArea;
  */
 class SlicePool {
 	friend class SliceArea;
+	friend class SharedSlicePool;
 
 	const char *const vma_name;
 
@@ -69,6 +71,23 @@ class SlicePool {
 
 	bool populate = false;
 
+	/**
+	 * Attempt to back new areas with explicit huge pages from
+	 * hugetlbfs?
+	 */
+	bool hugetlb = false;
+
+	/**
+	 * Bind new areas to the NUMA node of the allocating thread?
+	 */
+	bool numa_local = false;
+
+	/**
+	 * If this pool is owned by a #SharedSlicePool, then
+	 * SliceArea::Free() is routed through it.
+	 */
+	SharedSlicePool *shared = nullptr;
+
 public:
 	SlicePool(std::size_t _slice_size, unsigned _slices_per_area,
 		  const char *_vma_name) noexcept;
@@ -100,6 +119,28 @@ public:
 	 */
 	void Populate() noexcept;
 
+	/**
+	 * Back new areas with explicit huge pages from hugetlbfs
+	 * (MAP_HUGETLB).  If the hugetlbfs pool is exhausted, new
+	 * areas fall back to regular pages (with transparent huge
+	 * pages).  Existing areas are not affected.
+	 *
+	 * Pages of such areas are never returned to the kernel by
+	 * Compress() until the whole area is empty.
+	 */
+	void HugeTlb() noexcept {
+		hugetlb = true;
+	}
+
+	/**
+	 * Bind the memory of new areas to the NUMA node of the
+	 * thread which allocates them.  Existing areas are not
+	 * affected.
+	 */
+	void NumaLocal() noexcept {
+		numa_local = true;
+	}
+
 	void AddStats(AllocatorStats &stats, const AreaList &list) const noexcept;
 
 	[[gnu::pure]]
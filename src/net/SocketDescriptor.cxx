@@ -360,6 +360,13 @@ SocketDescriptor::SetBindToDevice(const char *name) const noexcept
 	return SetOption(SOL_SOCKET, SO_BINDTODEVICE, name, strlen(name));
 }
 
+bool
+SocketDescriptor::SetBusyPoll(unsigned microseconds) const noexcept
+{
+	return SetOption(SOL_SOCKET, SO_BUSY_POLL,
+			 &microseconds, sizeof(microseconds));
+}
+
 #ifdef TCP_FASTOPEN
 
 bool
@@ -274,6 +274,13 @@ public:
 
 	bool SetTcpFastOpen(int qlen=16) const noexcept;
 
+	/**
+	 * Setter for SO_BUSY_POLL: the number of microseconds to
+	 * busy-poll the device queue on blocking receives and in
+	 * epoll_wait().
+	 */
+	bool SetBusyPoll(unsigned microseconds) const noexcept;
+
 	bool AddMembership(const IPv4Address &address) const noexcept;
 	bool AddMembership(const IPv6Address &address) const noexcept;
 	bool AddMembership(SocketAddress address) const noexcept;
@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+/*
+ * Definitions for the Net::Log "spool" file format: an append-only
+ * file containing #Datagram instances in a compact, block-compressed
+ * columnar encoding.
+ *
+ * The file begins with a #FileHeader, followed by any number of
+ * blocks.  Each block consists of a #BlockHeader and a
+ * zlib-compressed payload; the header contains enough meta data
+ * (min/max timestamp and HTTP status) to skip blocks without
+ * decompressing them.
+ *
+ * The uncompressed payload begins with the size (varint) of each
+ * column in the order of #Column, followed by the column data.
+ * Columns contain one value for each datagram (or only for those
+ * which have the attribute, see #Flag):
+ *
+ * - integers are LEB128 varints; timestamps and durations are
+ *   delta-encoded (zig-zag) relative to the previous datagram
+ *
+ * - dictionary columns begin with the number of dictionary
+ *   entries (varint) and the null-terminated entries, followed by
+ *   one index (varint) per value
+ *
+ * - plain string columns contain null-terminated strings
+ *
+ * All dictionaries are local to the block, so each block can be
+ * decoded independently.
+ */
+
+#include "util/PackedLittleEndian.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace Net::Log::Spool {
+
+/**
+ * "NLS" followed by the format version.
+ */
+static constexpr uint32_t FILE_MAGIC = 0x4e4c5301;
+
+static constexpr uint32_t BLOCK_MAGIC = 0x4e4c5342;
+
+struct FileHeader {
+	PackedLE32 magic;
+};
+
+static_assert(sizeof(FileHeader) == 4);
+
+struct BlockHeader {
+	PackedLE32 magic;
+
+	/**
+	 * The size of the compressed payload following this header.
+	 */
+	PackedLE32 compressed_size;
+
+	PackedLE32 uncompressed_size;
+
+	/**
+	 * CRC32 of the compressed payload.
+	 */
+	PackedLE32 crc;
+
+	PackedLE32 n_datagrams;
+
+	/**
+	 * The range of HTTP status codes in this block (only
+	 * datagrams which have one).  If there is none, then
+	 * #min_status is 0xffff and #max_status is 0.
+	 */
+	PackedLE16 min_status, max_status;
+
+	/**
+	 * The range of timestamps (microseconds since the epoch) in
+	 * this block (only datagrams which have one).  If there is
+	 * none, then #min_timestamp is UINT64_MAX and #max_timestamp
+	 * is 0.
+	 */
+	PackedLE64 min_timestamp, max_timestamp;
+};
+
+static_assert(sizeof(BlockHeader) == 40);
+
+enum class Column : uint8_t {
+	/**
+	 * Bit mask of #Flag values.
+	 */
+	FLAGS,
+
+	TIMESTAMP,
+	DURATION,
+	HTTP_METHOD,
+	HTTP_STATUS,
+	TYPE,
+	CONTENT_TYPE,
+	LENGTH,
+	TRAFFIC,
+
+	/* dictionary-encoded strings */
+	REMOTE_HOST,
+	HOST,
+	SITE,
+	FORWARDED_TO,
+	ANALYTICS_ID,
+	GENERATOR,
+	USER_AGENT,
+
+	/* plain strings */
+	HTTP_URI,
+	HTTP_REFERER,
+	MESSAGE,
+	JSON,
+};
+
+static constexpr std::size_t N_COLUMNS = std::size_t(Column::JSON) + 1;
+
+static constexpr Column FIRST_DICT_COLUMN = Column::REMOTE_HOST;
+static constexpr Column FIRST_PLAIN_COLUMN = Column::HTTP_URI;
+
+static constexpr std::size_t N_DICT_COLUMNS =
+	std::size_t(FIRST_PLAIN_COLUMN) - std::size_t(FIRST_DICT_COLUMN);
+
+/**
+ * Bits in the #Column::FLAGS column.  The first bits correspond to
+ * the string columns, starting at #FIRST_DICT_COLUMN.
+ */
+enum class Flag : uint32_t {
+	REMOTE_HOST = 1 << 0,
+	HOST = 1 << 1,
+	SITE = 1 << 2,
+	FORWARDED_TO = 1 << 3,
+	ANALYTICS_ID = 1 << 4,
+	GENERATOR = 1 << 5,
+	USER_AGENT = 1 << 6,
+	HTTP_URI = 1 << 7,
+	HTTP_REFERER = 1 << 8,
+	MESSAGE = 1 << 9,
+	JSON = 1 << 10,
+
+	TIMESTAMP = 1 << 11,
+	LENGTH = 1 << 12,
+	TRAFFIC = 1 << 13,
+	DURATION = 1 << 14,
+
+	TRUNCATED_HOST = 1 << 15,
+	TRUNCATED_HTTP_URI = 1 << 16,
+	TRUNCATED_HTTP_REFERER = 1 << 17,
+	TRUNCATED_USER_AGENT = 1 << 18,
+	TRUNCATED_MESSAGE = 1 << 19,
+};
+
+constexpr uint32_t
+StringColumnFlag(Column column) noexcept
+{
+	return uint32_t{1} << (uint8_t(column) - uint8_t(FIRST_DICT_COLUMN));
+}
+
+static_assert(StringColumnFlag(Column::REMOTE_HOST) == uint32_t(Flag::REMOTE_HOST));
+static_assert(StringColumnFlag(Column::USER_AGENT) == uint32_t(Flag::USER_AGENT));
+static_assert(StringColumnFlag(Column::JSON) == uint32_t(Flag::JSON));
+
+/**
+ * Thrown by the reader if the file is malformed.
+ */
+class FormatError : public std::runtime_error {
+public:
+	using std::runtime_error::runtime_error;
+};
+
+} // namespace Net::Log::Spool
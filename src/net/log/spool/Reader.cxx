@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "Reader.hxx"
+#include "Format.hxx"
+#include "Varint.hxx"
+#include "io/FileDescriptor.hxx"
+#include "lib/zlib/Error.hxx"
+#include "system/Error.hxx"
+#include "util/CRC32.hxx"
+
+#include <array>
+
+#include <sys/mman.h>
+
+namespace Net::Log::Spool {
+
+bool
+Filter::Match(const BlockInfo &block) const noexcept
+{
+	if (HasTimeFilter() &&
+	    (block.max_timestamp < since || block.min_timestamp >= until))
+		return false;
+
+	if (HasStatusFilter() &&
+	    (block.max_status < min_status || block.min_status > max_status))
+		return false;
+
+	return true;
+}
+
+bool
+Filter::Match(const Datagram &d) const noexcept
+{
+	if (HasTimeFilter() &&
+	    (!d.HasTimestamp() || d.timestamp < since || d.timestamp >= until))
+		return false;
+
+	if (HasStatusFilter()) {
+		if (!d.HasHttpStatus())
+			return false;
+
+		const auto status = uint16_t(d.http_status);
+		if (status < min_status || status > max_status)
+			return false;
+	}
+
+	return true;
+}
+
+Reader::Reader(FileDescriptor fd)
+{
+	const off_t size = fd.GetSize();
+	if (size < 0)
+		throw MakeErrno("Failed to get spool file size");
+
+	if (static_cast<std::size_t>(size) < sizeof(FileHeader))
+		throw FormatError{"Not a spool file"};
+
+	void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd.Get(), 0);
+	if (p == MAP_FAILED)
+		throw MakeErrno("Failed to map spool file");
+
+	mapping = {static_cast<const std::byte *>(p), static_cast<std::size_t>(size)};
+
+	/* we'll read the whole file sequentially */
+	madvise(p, size, MADV_SEQUENTIAL);
+
+	try {
+		const auto &file_header = *reinterpret_cast<const FileHeader *>(mapping.data());
+		if (file_header.magic != FILE_MAGIC)
+			throw FormatError{"Not a spool file"};
+
+		auto rest = mapping.subspan(sizeof(file_header));
+		while (rest.size() >= sizeof(BlockHeader)) {
+			const auto &header = *reinterpret_cast<const BlockHeader *>(rest.data());
+			if (header.magic != BLOCK_MAGIC)
+				throw FormatError{"Malformed spool block header"};
+
+			rest = rest.subspan(sizeof(header));
+			if (rest.size() < header.compressed_size)
+				/* incomplete block at the end of the
+				   file */
+				break;
+
+			blocks.push_back(BlockInfo{
+				.compressed = rest.first(header.compressed_size),
+				.uncompressed_size = header.uncompressed_size,
+				.crc = header.crc,
+				.n_datagrams = header.n_datagrams,
+				.min_status = header.min_status,
+				.max_status = header.max_status,
+				.min_timestamp = TimePoint{Duration{header.min_timestamp}},
+				.max_timestamp = TimePoint{Duration{header.max_timestamp}},
+			});
+
+			rest = rest.subspan(header.compressed_size);
+		}
+	} catch (...) {
+		munmap(p, size);
+		throw;
+	}
+}
+
+Reader::~Reader() noexcept
+{
+	munmap(const_cast<std::byte *>(mapping.data()), mapping.size());
+}
+
+namespace {
+
+/**
+ * A decoded dictionary column.
+ */
+class DictReader {
+	std::vector<const char *> entries;
+
+	ColumnReader indexes;
+
+public:
+	void Init(std::span<const std::byte> src) {
+		ColumnReader r{src};
+
+		const auto n = r.ReadVarint();
+		if (n > src.size())
+			throw FormatError{"Malformed spool dictionary"};
+
+		entries.clear();
+		entries.reserve(n);
+		for (uint64_t i = 0; i < n; ++i)
+			entries.push_back(r.ReadString().data());
+
+		indexes = r;
+	}
+
+	const char *Read() {
+		const auto i = indexes.ReadVarint();
+		if (i >= entries.size())
+			throw FormatError{"Malformed spool dictionary index"};
+
+		return entries[i];
+	}
+};
+
+} // anonymous namespace
+
+/**
+ * The maximum ratio of uncompressed to compressed size of a deflate
+ * stream.
+ */
+static constexpr std::size_t MAX_DEFLATE_RATIO = 1032;
+
+void
+Reader::Decode(const BlockInfo &block, DecodedBlock &dest) const
+{
+	CRC32State crc;
+	crc.Update(block.compressed);
+	if (crc.Finish() != block.crc)
+		throw FormatError{"Spool block CRC mismatch"};
+
+	/* the header is not covered by the CRC; don't let a corrupt
+	   header make us allocate huge buffers (deflate cannot
+	   compress better than this ratio) */
+	if (block.uncompressed_size > block.compressed.size() * MAX_DEFLATE_RATIO)
+		throw FormatError{"Malformed spool block header"};
+
+	dest.datagrams.clear();
+	dest.buffer.resize(block.uncompressed_size);
+
+	uLongf size = block.uncompressed_size;
+	int result = uncompress(reinterpret_cast<Bytef *>(dest.buffer.data()), &size,
+				reinterpret_cast<const Bytef *>(block.compressed.data()),
+				block.compressed.size());
+	if (result != Z_OK)
+		throw MakeZlibError(result, "uncompress() failed");
+
+	if (size != block.uncompressed_size)
+		throw FormatError{"Wrong spool block size"};
+
+	/* split the payload into columns */
+	ColumnReader payload{dest.buffer};
+	std::array<uint64_t, N_COLUMNS> column_sizes;
+	for (auto &i : column_sizes)
+		i = payload.ReadVarint();
+
+	std::array<std::span<const std::byte>, N_COLUMNS> column_data;
+	for (std::size_t i = 0; i < N_COLUMNS; ++i)
+		column_data[i] = payload.ReadBytes(column_sizes[i]);
+
+	std::array<ColumnReader, N_COLUMNS> columns;
+	for (std::size_t i = 0; i < N_COLUMNS; ++i)
+		columns[i] = ColumnReader{column_data[i]};
+
+	std::array<DictReader, N_DICT_COLUMNS> dicts;
+	for (std::size_t i = 0; i < N_DICT_COLUMNS; ++i)
+		dicts[i].Init(column_data[std::size_t(FIRST_DICT_COLUMN) + i]);
+
+	const auto GetColumn = [&columns](Column column) -> auto & {
+		return columns[std::size_t(column)];
+	};
+
+	/* each datagram has at least one byte in the FLAGS
+	   column */
+	if (block.n_datagrams > column_sizes[std::size_t(Column::FLAGS)])
+		throw FormatError{"Malformed spool block header"};
+
+	uint64_t previous_timestamp = 0, previous_duration = 0;
+
+	dest.datagrams.reserve(block.n_datagrams);
+	for (std::size_t i = 0; i < block.n_datagrams; ++i) {
+		auto &d = dest.datagrams.emplace_back();
+
+		const auto flags = GetColumn(Column::FLAGS).ReadVarint();
+
+		const auto ReadDict = [&dicts, flags](Column column) -> const char * {
+			if ((flags & StringColumnFlag(column)) == 0)
+				return nullptr;
+
+			return dicts[std::size_t(column) - std::size_t(FIRST_DICT_COLUMN)].Read();
+		};
+
+		const auto ReadPlain = [&GetColumn, flags](Column column) -> std::string_view {
+			if ((flags & StringColumnFlag(column)) == 0)
+				return {};
+
+			return GetColumn(column).ReadString();
+		};
+
+		d.remote_host = ReadDict(Column::REMOTE_HOST);
+		d.host = ReadDict(Column::HOST);
+		d.site = ReadDict(Column::SITE);
+		d.forwarded_to = ReadDict(Column::FORWARDED_TO);
+		d.analytics_id = ReadDict(Column::ANALYTICS_ID);
+		d.generator = ReadDict(Column::GENERATOR);
+
+		if (const char *user_agent = ReadDict(Column::USER_AGENT))
+			d.user_agent = user_agent;
+
+		d.http_uri = ReadPlain(Column::HTTP_URI);
+		d.http_referer = ReadPlain(Column::HTTP_REFERER);
+		d.message = ReadPlain(Column::MESSAGE);
+		d.json = ReadPlain(Column::JSON);
+
+		if (flags & uint32_t(Flag::TIMESTAMP)) {
+			previous_timestamp = GetColumn(Column::TIMESTAMP).ReadDelta(previous_timestamp);
+			d.timestamp = TimePoint{Duration{previous_timestamp}};
+		}
+
+		if (flags & uint32_t(Flag::DURATION)) {
+			previous_duration = GetColumn(Column::DURATION).ReadDelta(previous_duration);
+			d.duration = Duration{previous_duration};
+			d.valid_duration = true;
+		}
+
+		d.http_method = static_cast<HttpMethod>(GetColumn(Column::HTTP_METHOD).ReadByte());
+		d.http_status = static_cast<HttpStatus>(GetColumn(Column::HTTP_STATUS).ReadVarint());
+		d.type = static_cast<Type>(GetColumn(Column::TYPE).ReadByte());
+		d.content_type = static_cast<ContentType>(GetColumn(Column::CONTENT_TYPE).ReadByte());
+
+		if (flags & uint32_t(Flag::LENGTH)) {
+			d.length = GetColumn(Column::LENGTH).ReadVarint();
+			d.valid_length = true;
+		}
+
+		if (flags & uint32_t(Flag::TRAFFIC)) {
+			d.traffic_received = GetColumn(Column::TRAFFIC).ReadVarint();
+			d.traffic_sent = GetColumn(Column::TRAFFIC).ReadVarint();
+			d.valid_traffic = true;
+		}
+
+		d.truncated_host = flags & uint32_t(Flag::TRUNCATED_HOST);
+		d.truncated_http_uri = flags & uint32_t(Flag::TRUNCATED_HTTP_URI);
+		d.truncated_http_referer = flags & uint32_t(Flag::TRUNCATED_HTTP_REFERER);
+		d.truncated_user_agent = flags & uint32_t(Flag::TRUNCATED_USER_AGENT);
+		d.truncated_message = flags & uint32_t(Flag::TRUNCATED_MESSAGE);
+	}
+}
+
+} // namespace Net::Log::Spool
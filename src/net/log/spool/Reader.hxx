@@ -0,0 +1,187 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "net/log/Chrono.hxx"
+#include "net/log/Datagram.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+class FileDescriptor;
+
+namespace Net::Log::Spool {
+
+/**
+ * Meta data of one block, obtained from its #BlockHeader without
+ * decompressing it.
+ */
+struct BlockInfo {
+	std::span<const std::byte> compressed;
+
+	std::size_t uncompressed_size;
+
+	uint32_t crc;
+
+	std::size_t n_datagrams;
+
+	/**
+	 * The range of HTTP status codes (only datagrams which have
+	 * one).  If there is none, then #min_status is greater than
+	 * #max_status.
+	 */
+	uint16_t min_status, max_status;
+
+	/**
+	 * The range of timestamps (only datagrams which have one).
+	 * If there is none, then #min_timestamp is greater than
+	 * #max_timestamp.
+	 */
+	TimePoint min_timestamp, max_timestamp;
+};
+
+/**
+ * Select datagrams by timestamp and HTTP status.  The default
+ * instance matches everything.
+ */
+struct Filter {
+	/**
+	 * Only datagrams with a timestamp within [since, until).
+	 * Unless these have their default values, datagrams without
+	 * a timestamp are not matched.
+	 */
+	TimePoint since = TimePoint::min(), until = TimePoint::max();
+
+	/**
+	 * Only datagrams with a HTTP status within [min_status,
+	 * max_status].  Unless these have their default values,
+	 * datagrams without a HTTP status are not matched.
+	 */
+	uint16_t min_status = 0, max_status = UINT16_MAX;
+
+	constexpr bool HasTimeFilter() const noexcept {
+		return since != TimePoint::min() || until != TimePoint::max();
+	}
+
+	constexpr bool HasStatusFilter() const noexcept {
+		return min_status > 0 || max_status < UINT16_MAX;
+	}
+
+	/**
+	 * May the given block contain matching datagrams?
+	 */
+	[[gnu::pure]]
+	bool Match(const BlockInfo &block) const noexcept;
+
+	[[gnu::pure]]
+	bool Match(const Datagram &d) const noexcept;
+};
+
+/**
+ * The decoded contents of one block.  The #Datagram instances point
+ * into a buffer owned by this object.
+ */
+class DecodedBlock {
+	friend class Reader;
+
+	std::vector<std::byte> buffer;
+
+	std::vector<Datagram> datagrams;
+
+public:
+	auto begin() const noexcept {
+		return datagrams.begin();
+	}
+
+	auto end() const noexcept {
+		return datagrams.end();
+	}
+
+	std::size_t size() const noexcept {
+		return datagrams.size();
+	}
+
+	const Datagram &operator[](std::size_t i) const noexcept {
+		return datagrams[i];
+	}
+};
+
+/**
+ * Reads a spool file (see Format.hxx) which was written by
+ * #Writer.  The file is mapped into memory; the block index is
+ * built from the block headers, and blocks are decompressed only
+ * on demand.
+ *
+ * An incomplete block at the end of the file (e.g. because the
+ * writer is still writing it or was interrupted) is ignored.
+ *
+ * The file must not be truncated while this object exists (not
+ * even after the file descriptor has been closed): accessing a
+ * page of the mapping beyond the new end of the file raises
+ * SIGBUS.  Appending (which is what #Writer does) is safe; blocks
+ * appended after the constructor has returned are not visible.
+ * Rotate spool files by renaming or unlinking them, never with
+ * truncate().
+ */
+class Reader {
+	std::span<const std::byte> mapping;
+
+	std::vector<BlockInfo> blocks;
+
+public:
+	/**
+	 * Throws on error (e.g. #FormatError if this is not a spool
+	 * file).
+	 *
+	 * @param fd the file; it may be closed after this
+	 * constructor returns
+	 */
+	explicit Reader(FileDescriptor fd);
+
+	~Reader() noexcept;
+
+	Reader(const Reader &) = delete;
+	Reader &operator=(const Reader &) = delete;
+
+	std::span<const BlockInfo> GetBlocks() const noexcept {
+		return blocks;
+	}
+
+	/**
+	 * Decompress and decode one block.
+	 *
+	 * Throws #FormatError on error.
+	 *
+	 * @param dest the destination object; its allocations are
+	 * reused
+	 */
+	void Decode(const BlockInfo &block, DecodedBlock &dest) const;
+
+	/**
+	 * Invoke the given function for each matching #Datagram.
+	 * Blocks which cannot contain matching datagrams are
+	 * skipped without decompressing them.
+	 *
+	 * Throws #FormatError on error.
+	 */
+	void ForEach(const Filter &filter, auto &&f) const {
+		DecodedBlock decoded;
+
+		for (const auto &block : blocks) {
+			if (!filter.Match(block))
+				continue;
+
+			Decode(block, decoded);
+
+			for (const auto &d : decoded)
+				if (filter.Match(d))
+					f(d);
+		}
+	}
+};
+
+} // namespace Net::Log::Spool
@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "Format.hxx"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace Net::Log::Spool {
+
+/**
+ * Append an unsigned LEB128 integer.
+ *
+ * Throws std::bad_alloc on out-of-memory.
+ */
+inline void
+AppendVarint(std::vector<std::byte> &dest, uint64_t value)
+{
+	while (value >= 0x80) {
+		dest.push_back(std::byte(value | 0x80));
+		value >>= 7;
+	}
+
+	dest.push_back(std::byte(value));
+}
+
+/**
+ * Append the difference between two values (zig-zag encoded, so
+ * small negative differences are small, too).
+ */
+inline void
+AppendDelta(std::vector<std::byte> &dest,
+	    uint64_t value, uint64_t previous)
+{
+	const auto delta = static_cast<int64_t>(value - previous);
+	AppendVarint(dest, (static_cast<uint64_t>(delta) << 1) ^
+		     static_cast<uint64_t>(delta >> 63));
+}
+
+/**
+ * Append a null-terminated string.
+ */
+inline void
+AppendString(std::vector<std::byte> &dest, std::string_view value)
+{
+	const auto b = std::as_bytes(std::span{value});
+	dest.insert(dest.end(), b.begin(), b.end());
+	dest.push_back(std::byte{});
+}
+
+/**
+ * Reads values from a column.  Throws #FormatError if the column is
+ * too short.
+ */
+class ColumnReader {
+	const std::byte *p, *end;
+
+public:
+	constexpr ColumnReader() noexcept:p(nullptr), end(nullptr) {}
+
+	explicit constexpr ColumnReader(std::span<const std::byte> src) noexcept
+		:p(src.data()), end(src.data() + src.size()) {}
+
+	uint64_t ReadVarint() {
+		uint64_t value = 0;
+		for (unsigned shift = 0; shift < 64; shift += 7) {
+			if (p == end)
+				throw FormatError{"Truncated spool column"};
+
+			const auto b = static_cast<uint8_t>(*p++);
+			value |= static_cast<uint64_t>(b & 0x7f) << shift;
+			if (b < 0x80)
+				return value;
+		}
+
+		throw FormatError{"Malformed varint in spool column"};
+	}
+
+	uint64_t ReadDelta(uint64_t previous) {
+		const uint64_t zz = ReadVarint();
+		const auto delta = static_cast<int64_t>(zz >> 1) ^ -static_cast<int64_t>(zz & 1);
+		return previous + static_cast<uint64_t>(delta);
+	}
+
+	std::byte ReadByte() {
+		if (p == end)
+			throw FormatError{"Truncated spool column"};
+
+		return *p++;
+	}
+
+	/**
+	 * Read a null-terminated string.  The returned pointer
+	 * points into the column.
+	 */
+	std::string_view ReadString() {
+		const std::byte *const start = p;
+		while (true) {
+			if (p == end)
+				throw FormatError{"Truncated spool column"};
+
+			if (*p++ == std::byte{})
+				return {reinterpret_cast<const char *>(start),
+					static_cast<std::size_t>(p - 1 - start)};
+		}
+	}
+
+	std::span<const std::byte> ReadBytes(std::size_t size) {
+		if (static_cast<std::size_t>(end - p) < size)
+			throw FormatError{"Truncated spool column"};
+
+		const std::span<const std::byte> result{p, size};
+		p += size;
+		return result;
+	}
+};
+
+} // namespace Net::Log::Spool
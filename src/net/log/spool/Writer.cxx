@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "Writer.hxx"
+#include "Varint.hxx"
+#include "net/log/Datagram.hxx"
+#include "lib/zlib/Error.hxx"
+#include "system/Error.hxx"
+#include "util/CRC32.hxx"
+#include "util/SpanCast.hxx"
+
+#include <algorithm> // for std::min()
+#include <cassert>
+
+namespace Net::Log::Spool {
+
+static constexpr std::string_view
+OptionalString(const char *s) noexcept
+{
+	return s != nullptr ? std::string_view{s} : std::string_view{};
+}
+
+inline void
+Writer::DictColumn::Add(std::string_view value)
+{
+	auto i = map.find(value);
+	if (i == map.end()) {
+		i = map.emplace(value, uint32_t(map.size())).first;
+		AppendString(entries, value);
+	}
+
+	AppendVarint(indexes, i->second);
+}
+
+inline void
+Writer::DictColumn::Clear() noexcept
+{
+	map.clear();
+	entries.clear();
+	indexes.clear();
+}
+
+Writer::Writer(FileDescriptor _fd, std::size_t _max_datagrams)
+	:fd(_fd), max_datagrams(_max_datagrams)
+{
+	assert(max_datagrams > 0);
+
+	const off_t size = fd.GetSize();
+	if (size < 0)
+		throw MakeErrno("Failed to get spool file size");
+
+	if (size == 0) {
+		const FileHeader header{.magic = FILE_MAGIC};
+		fd.FullWrite(ReferenceAsBytes(header));
+	}
+
+	ResetBlock();
+}
+
+Writer::~Writer() noexcept = default;
+
+void
+Writer::ResetBlock() noexcept
+{
+	for (auto &i : columns)
+		i.clear();
+
+	for (auto &i : dicts)
+		i.Clear();
+
+	n_datagrams = 0;
+	previous_timestamp = previous_duration = 0;
+	min_timestamp = UINT64_MAX;
+	max_timestamp = 0;
+	min_status = UINT16_MAX;
+	max_status = 0;
+}
+
+void
+Writer::Append(const Datagram &d)
+{
+	uint32_t flags = 0;
+
+	const auto AddDict = [this, &flags](Column column, std::string_view value){
+		if (value.data() == nullptr)
+			return;
+
+		flags |= StringColumnFlag(column);
+		dicts[std::size_t(column) - std::size_t(FIRST_DICT_COLUMN)].Add(value);
+	};
+
+	const auto AddPlain = [this, &flags](Column column, std::string_view value){
+		if (value.data() == nullptr)
+			return;
+
+		/* strings must not contain null bytes because that's
+		   the terminator */
+		assert(value.find('\0') == value.npos);
+
+		flags |= StringColumnFlag(column);
+		AppendString(columns[std::size_t(column)], value);
+	};
+
+	const auto GetColumn = [this](Column column) -> auto & {
+		return columns[std::size_t(column)];
+	};
+
+	AddDict(Column::REMOTE_HOST, OptionalString(d.remote_host));
+	AddDict(Column::HOST, OptionalString(d.host));
+	AddDict(Column::SITE, OptionalString(d.site));
+	AddDict(Column::FORWARDED_TO, OptionalString(d.forwarded_to));
+	AddDict(Column::ANALYTICS_ID, OptionalString(d.analytics_id));
+	AddDict(Column::GENERATOR, OptionalString(d.generator));
+	AddDict(Column::USER_AGENT, d.user_agent);
+
+	AddPlain(Column::HTTP_URI, d.http_uri);
+	AddPlain(Column::HTTP_REFERER, d.http_referer);
+	AddPlain(Column::MESSAGE, d.message);
+	AddPlain(Column::JSON, d.json);
+
+	if (d.HasTimestamp()) {
+		const uint64_t t = d.timestamp.time_since_epoch().count();
+		flags |= uint32_t(Flag::TIMESTAMP);
+		AppendDelta(GetColumn(Column::TIMESTAMP), t, previous_timestamp);
+		previous_timestamp = t;
+		min_timestamp = std::min(min_timestamp, t);
+		max_timestamp = std::max(max_timestamp, t);
+	}
+
+	if (d.valid_duration) {
+		const uint64_t duration = d.duration.count();
+		flags |= uint32_t(Flag::DURATION);
+		AppendDelta(GetColumn(Column::DURATION), duration, previous_duration);
+		previous_duration = duration;
+	}
+
+	GetColumn(Column::HTTP_METHOD).push_back(std::byte(d.http_method));
+
+	AppendVarint(GetColumn(Column::HTTP_STATUS), uint16_t(d.http_status));
+	if (d.HasHttpStatus()) {
+		min_status = std::min(min_status, uint16_t(d.http_status));
+		max_status = std::max(max_status, uint16_t(d.http_status));
+	}
+
+	GetColumn(Column::TYPE).push_back(std::byte(d.type));
+	GetColumn(Column::CONTENT_TYPE).push_back(std::byte(d.content_type));
+
+	if (d.valid_length) {
+		flags |= uint32_t(Flag::LENGTH);
+		AppendVarint(GetColumn(Column::LENGTH), d.length);
+	}
+
+	if (d.valid_traffic) {
+		flags |= uint32_t(Flag::TRAFFIC);
+		AppendVarint(GetColumn(Column::TRAFFIC), d.traffic_received);
+		AppendVarint(GetColumn(Column::TRAFFIC), d.traffic_sent);
+	}
+
+	if (d.truncated_host)
+		flags |= uint32_t(Flag::TRUNCATED_HOST);
+	if (d.truncated_http_uri)
+		flags |= uint32_t(Flag::TRUNCATED_HTTP_URI);
+	if (d.truncated_http_referer)
+		flags |= uint32_t(Flag::TRUNCATED_HTTP_REFERER);
+	if (d.truncated_user_agent)
+		flags |= uint32_t(Flag::TRUNCATED_USER_AGENT);
+	if (d.truncated_message)
+		flags |= uint32_t(Flag::TRUNCATED_MESSAGE);
+
+	AppendVarint(GetColumn(Column::FLAGS), flags);
+
+	if (++n_datagrams >= max_datagrams)
+		WriteBlock();
+}
+
+void
+Writer::WriteBlock()
+{
+	assert(n_datagrams > 0);
+
+	/* move the dictionary columns into the column array */
+	for (std::size_t i = 0; i < dicts.size(); ++i) {
+		const auto &dict = dicts[i];
+		auto &column = columns[std::size_t(FIRST_DICT_COLUMN) + i];
+
+		column.clear();
+		AppendVarint(column, dict.map.size());
+		column.insert(column.end(), dict.entries.begin(), dict.entries.end());
+		column.insert(column.end(), dict.indexes.begin(), dict.indexes.end());
+	}
+
+	/* assemble the uncompressed payload */
+	payload.clear();
+	for (const auto &column : columns)
+		AppendVarint(payload, column.size());
+	for (const auto &column : columns)
+		payload.insert(payload.end(), column.begin(), column.end());
+
+	/* compress */
+	output.resize(sizeof(BlockHeader) + compressBound(payload.size()));
+
+	uLongf compressed_size = output.size() - sizeof(BlockHeader);
+	int result = compress2(reinterpret_cast<Bytef *>(output.data() + sizeof(BlockHeader)),
+			       &compressed_size,
+			       reinterpret_cast<const Bytef *>(payload.data()),
+			       payload.size(), Z_DEFAULT_COMPRESSION);
+	if (result != Z_OK)
+		throw MakeZlibError(result, "compress2() failed");
+
+	output.resize(sizeof(BlockHeader) + compressed_size);
+
+	CRC32State crc;
+	crc.Update(std::span{output}.subspan(sizeof(BlockHeader)));
+
+	const BlockHeader header{
+		.magic = BLOCK_MAGIC,
+		.compressed_size = uint32_t(compressed_size),
+		.uncompressed_size = uint32_t(payload.size()),
+		.crc = crc.Finish(),
+		.n_datagrams = uint32_t(n_datagrams),
+		.min_status = min_status,
+		.max_status = max_status,
+		.min_timestamp = min_timestamp,
+		.max_timestamp = max_timestamp,
+	};
+
+	std::copy_n(ReferenceAsBytes(header).begin(), sizeof(header),
+		    output.begin());
+
+	/* write the block with one write() call, so concurrent
+	   readers see either nothing or a complete block (at least
+	   on local filesystems) */
+	fd.FullWrite(output);
+
+	ResetBlock();
+}
+
+void
+Writer::Flush()
+{
+	if (error)
+		std::rethrow_exception(error);
+
+	if (n_datagrams > 0)
+		WriteBlock();
+}
+
+void
+Writer::Log(const Datagram &d) noexcept
+{
+	if (error)
+		/* the file may be inconsistent; refuse to write more
+		   blocks */
+		return;
+
+	try {
+		Append(d);
+	} catch (...) {
+		error = std::current_exception();
+	}
+}
+
+} // namespace Net::Log::Spool
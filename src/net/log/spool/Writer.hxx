@@ -0,0 +1,129 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "Format.hxx"
+#include "net/log/Sink.hxx"
+#include "io/FileDescriptor.hxx"
+#include "util/TransparentHash.hxx"
+
+#include <array>
+#include <cstddef>
+#include <exception>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Net::Log::Spool {
+
+/**
+ * Appends #Datagram instances to a spool file (see Format.hxx).
+ * Datagrams are collected in memory and written as one compressed
+ * block when the block is full or when Flush() is called.
+ */
+class Writer final : public Sink {
+	/**
+	 * A dictionary-encoded string column.
+	 */
+	struct DictColumn {
+		std::unordered_map<std::string, uint32_t,
+				   TransparentHash, std::equal_to<>> map;
+
+		/**
+		 * The null-terminated dictionary entries in the order
+		 * of their indexes.
+		 */
+		std::vector<std::byte> entries;
+
+		std::vector<std::byte> indexes;
+
+		/**
+		 * Throws std::bad_alloc on out-of-memory.
+		 */
+		void Add(std::string_view value);
+		void Clear() noexcept;
+	};
+
+	const FileDescriptor fd;
+
+	const std::size_t max_datagrams;
+
+	std::array<std::vector<std::byte>, N_COLUMNS> columns;
+
+	std::array<DictColumn, N_DICT_COLUMNS> dicts;
+
+	/**
+	 * The uncompressed payload and the compressed block
+	 * (including the #BlockHeader) which is being written.  These
+	 * are fields to reuse the allocations.
+	 */
+	std::vector<std::byte> payload, output;
+
+	std::size_t n_datagrams = 0;
+
+	uint64_t previous_timestamp, previous_duration;
+
+	uint64_t min_timestamp, max_timestamp;
+	uint16_t min_status, max_status;
+
+	/**
+	 * The first error which occurred in Log().  It is rethrown by
+	 * Flush().
+	 */
+	std::exception_ptr error;
+
+public:
+	/**
+	 * The default number of datagrams per block.
+	 */
+	static constexpr std::size_t DEFAULT_BLOCK_SIZE = 4096;
+
+	/**
+	 * Throws on error.
+	 *
+	 * @param fd a file opened for writing (preferably with
+	 * O_APPEND); the file header is written if the file is empty;
+	 * the caller is responsible for closing it after this object
+	 * has been destructed
+	 * @param max_datagrams the maximum number of datagrams per
+	 * block
+	 */
+	explicit Writer(FileDescriptor fd,
+			std::size_t max_datagrams=DEFAULT_BLOCK_SIZE);
+
+	/**
+	 * The destructor does not flush; call Flush() before
+	 * destructing this object.
+	 */
+	~Writer() noexcept;
+
+	Writer(const Writer &) = delete;
+	Writer &operator=(const Writer &) = delete;
+
+	/**
+	 * Append one datagram.  If the block is full, it is written
+	 * to the file.
+	 *
+	 * Throws on error.
+	 */
+	void Append(const Datagram &d);
+
+	/**
+	 * Write all pending datagrams to the file.  Rethrows errors
+	 * which occurred in Log().
+	 *
+	 * Throws on error.
+	 */
+	void Flush();
+
+	/* virtual methods from class Sink */
+	void Log(const Datagram &d) noexcept override;
+
+private:
+	void ResetBlock() noexcept;
+	void WriteBlock();
+};
+
+} // namespace Net::Log::Spool
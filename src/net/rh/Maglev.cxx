@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "Maglev.hxx"
+#include "Node.hxx"
+#include "HashAlgorithm.hxx"
+
+#include <algorithm> // for std::max()
+#include <cassert>
+
+namespace RendezvousHashing {
+
+namespace {
+
+/**
+ * The state of one node while populating the table.
+ */
+struct MaglevPermutation {
+	uint32_t index;
+
+	/**
+	 * The node's preference list is "offset + i * skip".
+	 */
+	std::size_t offset, skip, next = 0;
+
+	/**
+	 * The node's weight relative to the heaviest node (0..1].
+	 */
+	double share;
+
+	/**
+	 * Accumulates #share; each time it reaches 1, the node gets
+	 * to take a slot.
+	 */
+	double credit = 0;
+
+	MaglevPermutation(uint32_t _index, const Node &node,
+			  std::size_t size, double _share) noexcept
+		:index(_index), share(_share)
+	{
+		const auto steady = node.GetAddress().GetSteadyPart();
+		const uint32_t h1 = HashAlgorithm::BinaryHash(steady);
+		const uint32_t h2 = HashAlgorithm::BinaryHash(steady, h1);
+
+		offset = h1 % size;
+		skip = h2 % (size - 1) + 1;
+	}
+
+	std::size_t Next(std::size_t size) noexcept {
+		return (offset + next++ * skip) % size;
+	}
+};
+
+} // anonymous namespace
+
+void
+MaglevTable::Build(std::span<const Node> nodes, std::size_t size) noexcept
+{
+	assert(size > 1);
+
+	table.clear();
+
+	double max_weight = 0;
+	for (const auto &i : nodes)
+		max_weight = std::max(max_weight, i.GetWeight());
+
+	if (max_weight <= 0)
+		return;
+
+	std::vector<MaglevPermutation> permutations;
+	permutations.reserve(nodes.size());
+
+	for (std::size_t i = 0; i < nodes.size(); ++i)
+		if (const double weight = nodes[i].GetWeight(); weight > 0)
+			permutations.emplace_back(i, nodes[i], size,
+						  weight / max_weight);
+
+	table.assign(size, EMPTY);
+
+	/* each node takes turns claiming the next free slot in its
+	   preference list until the table is full; lighter nodes
+	   skip some of their turns */
+	for (std::size_t filled = 0;;) {
+		for (auto &p : permutations) {
+			p.credit += p.share;
+
+			for (; p.credit >= 1; p.credit -= 1) {
+				std::size_t slot;
+				do {
+					slot = p.Next(size);
+				} while (table[slot] != EMPTY);
+
+				table[slot] = p.index;
+				if (++filled == size)
+					return;
+			}
+		}
+	}
+}
+
+std::size_t
+MaglevTable::Lookup(std::span<const std::byte> sticky_source) const noexcept
+{
+	assert(!empty());
+
+	return table[HashAlgorithm::BinaryHash(sticky_source) % table.size()];
+}
+
+} // namespace RendezvousHashing
@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace RendezvousHashing {
+
+class Node;
+
+/**
+ * A lookup table for "Maglev" consistent hashing.  It is a cheaper
+ * alternative to Rendezvous Hashing for callers which do not need
+ * the exact node ranking: after building the table (which is
+ * expensive), each lookup is one hash of the sticky source and one
+ * table access, independent of the number of nodes.  When a node is
+ * added or removed, only few table entries change.
+ *
+ * The table follows the node weights approximately; the
+ * architecture is ignored.  All daemons which build the table from
+ * the same list of nodes (in the same order) get the same table.
+ */
+class MaglevTable {
+	static constexpr uint32_t EMPTY = UINT32_MAX;
+
+	/**
+	 * Maps each slot to a node index.
+	 */
+	std::vector<uint32_t> table;
+
+public:
+	/**
+	 * The default table size.  It is a prime number which is
+	 * large enough for a few hundred nodes.
+	 */
+	static constexpr std::size_t DEFAULT_SIZE = 65537;
+
+	/**
+	 * Is the table empty (i.e. Build() has not been called or
+	 * there were no nodes with a positive weight)?
+	 */
+	bool empty() const noexcept {
+		return table.empty();
+	}
+
+	/**
+	 * (Re)build the table.
+	 *
+	 * @param size the number of table slots; must be a prime
+	 * number which is much larger than the number of nodes
+	 */
+	void Build(std::span<const Node> nodes,
+		   std::size_t size=DEFAULT_SIZE) noexcept;
+
+	/**
+	 * Find the node for the given sticky source.
+	 *
+	 * @return an index into the node list which was passed to
+	 * Build()
+	 */
+	[[gnu::pure]]
+	std::size_t Lookup(std::span<const std::byte> sticky_source) const noexcept;
+};
+
+} // namespace RendezvousHashing
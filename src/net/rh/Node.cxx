@@ -8,6 +8,9 @@
 #include "lib/avahi/Arch.hxx"
 #include "lib/avahi/Weight.hxx"
 
+#include <algorithm> // for std::min()
+#include <array>
+
 namespace RendezvousHashing {
 
 void
@@ -36,4 +39,36 @@ Node::CalculateRendezvousScore(std::span<const std::byte> sticky_source) const n
 	return negative_weight / std::log(UintToDouble(rendezvous_hash));
 }
 
+void
+Node::UpdateRendezvousScores(std::span<Node> nodes,
+			     std::span<const std::byte> sticky_source) noexcept
+{
+	using Traits = FNVTraits<uint32_t>;
+
+	/* the hash states of one chunk of nodes are kept in a small
+	   array (struct of arrays), so the compiler can vectorise
+	   the inner loop */
+	constexpr std::size_t CHUNK_SIZE = 16;
+
+	while (!nodes.empty()) {
+		const auto chunk = nodes.first(std::min(nodes.size(), CHUNK_SIZE));
+		nodes = nodes.subspan(chunk.size());
+
+		std::array<uint32_t, CHUNK_SIZE> hashes{};
+		for (std::size_t i = 0; i < chunk.size(); ++i)
+			hashes[i] = chunk[i].address_hash;
+
+		/* this is HashAlgorithm::BinaryHash(), but with
+		   explicit 32 bit arithmetic (which yields the same
+		   value) */
+		for (const auto b : sticky_source)
+			for (auto &h : hashes)
+				h = (h ^ static_cast<uint8_t>(b)) * Traits::PRIME;
+
+		for (std::size_t i = 0; i < chunk.size(); ++i)
+			chunk[i].rendezvous_score = chunk[i].negative_weight /
+				std::log(UintToDouble(hashes[i]));
+	}
+}
+
 } // namespace RendezvousHashing
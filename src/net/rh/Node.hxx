@@ -67,6 +67,16 @@ public:
 		rendezvous_score = CalculateRendezvousScore(sticky_source);
 	}
 
+	/**
+	 * Update the scores of all nodes at once.  This yields the
+	 * same results as calling UpdateRendezvousScore() on each
+	 * node, but is faster for many nodes because the hash states
+	 * of several nodes are updated in parallel (SIMD).
+	 */
+	[[gnu::hot]]
+	static void UpdateRendezvousScores(std::span<Node> nodes,
+					   std::span<const std::byte> sticky_source) noexcept;
+
 	constexpr const InetAddress &GetAddress() const noexcept {
 		return address;
 	}
@@ -75,6 +85,10 @@ public:
 		return arch;
 	}
 
+	constexpr double GetWeight() const noexcept {
+		return -negative_weight;
+	}
+
 	constexpr const Avahi::ObjectFlags &GetFlags() const noexcept {
 		return flags;
 	}
@@ -7,6 +7,7 @@
 #include "net/SocketDescriptor.hxx"
 #include "net/ScmRightsBuilder.hxx"
 #include "net/SendMessage.hxx"
+#include "net/SocketError.hxx"
 #include "IProtocol.hxx"
 #include "system/Error.hxx"
 #include "io/FileDescriptor.hxx"
@@ -27,22 +28,30 @@ namespace Spawn {
 
 class PayloadTooLargeError {};
 
-class Serializer {
+template<std::size_t CAPACITY>
+class BasicSerializer {
 	size_t size = 0;
 
-	std::array<std::byte, MAX_DATAGRAM_SIZE> buffer;
+	std::array<std::byte, CAPACITY> buffer;
 
 	StaticVector<FileDescriptor, 8> fds;
 
 public:
-	explicit constexpr Serializer(RequestCommand cmd) noexcept {
+	explicit constexpr BasicSerializer(RequestCommand cmd) noexcept {
 		buffer[size++] = static_cast<std::byte>(cmd);
 	}
 
-	explicit constexpr Serializer(ResponseCommand cmd) noexcept {
+	explicit constexpr BasicSerializer(ResponseCommand cmd) noexcept {
 		buffer[size++] = static_cast<std::byte>(cmd);
 	}
 
+	/**
+	 * How many more bytes can be written?
+	 */
+	constexpr std::size_t GetRemaining() const noexcept {
+		return buffer.size() - size;
+	}
+
 	void WriteByte(std::byte value) {
 		if (size >= buffer.size())
 			throw PayloadTooLargeError();
@@ -133,6 +142,19 @@ public:
 	}
 };
 
+/**
+ * Serializer for requests (client to server).
+ */
+class Serializer final : public BasicSerializer<MAX_DATAGRAM_SIZE> {
+public:
+	using BasicSerializer::BasicSerializer;
+};
+
+/**
+ * Serializer for responses (server to client).
+ */
+using ResponseSerializer = BasicSerializer<MAX_RESPONSE_DATAGRAM_SIZE>;
+
 template<size_t MAX_FDS>
 static void
 Send(SocketDescriptor s, std::span<const std::byte> payload,
@@ -152,11 +174,48 @@ Send(SocketDescriptor s, std::span<const std::byte> payload,
 	SendMessage(s, msg, MSG_NOSIGNAL);
 }
 
-template<size_t MAX_FDS>
+template<size_t MAX_FDS, std::size_t CAPACITY>
 static void
-Send(SocketDescriptor socket, const Serializer &s)
+Send(SocketDescriptor socket, const BasicSerializer<CAPACITY> &s)
 {
 	return Send<MAX_FDS>(socket, s.GetPayload(), s.GetFds());
 }
 
+/**
+ * Send several datagrams (without file descriptors) with one
+ * sendmmsg() call.
+ *
+ * Throws on error, including if the socket buffer is too full to
+ * send all of them (just like Send() would).
+ */
+template<std::size_t CAPACITY, std::size_t N>
+static void
+SendMulti(SocketDescriptor s,
+	  const StaticVector<BasicSerializer<CAPACITY>, N> &datagrams)
+{
+	assert(s.IsDefined());
+
+	std::array<struct iovec, N> vec;
+	std::array<struct mmsghdr, N> msgs{};
+
+	for (std::size_t i = 0; i < datagrams.size(); ++i) {
+		assert(datagrams[i].GetFds().empty());
+
+		vec[i] = MakeIovec(datagrams[i].GetPayload());
+		msgs[i].msg_hdr.msg_iov = &vec[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	std::size_t position = 0;
+	while (position < datagrams.size()) {
+		int result = sendmmsg(s.Get(), &msgs[position],
+				      datagrams.size() - position,
+				      MSG_NOSIGNAL);
+		if (result < 0)
+			throw MakeSocketError("sendmmsg() failed");
+
+		position += result;
+	}
+}
+
 } // namespace Spawn
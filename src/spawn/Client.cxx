@@ -22,6 +22,8 @@
 
 #include <fmt/core.h>
 
+#include <algorithm> // for std::min()
+#include <iterator> // for std::distance()
 #include <stdexcept>
 
 #include <assert.h>
@@ -196,6 +198,63 @@ SpawnServerClient::Send(const Serializer &s)
 	::Send<MAX_FDS>(event.GetSocket(), s);
 }
 
+static constexpr std::size_t KILL_ITEM_SIZE = sizeof(unsigned) + sizeof(int);
+
+/**
+ * The size of the header preceding each request in a BATCH payload.
+ */
+static constexpr std::size_t BATCH_HEADER_SIZE = sizeof(uint16_t) + sizeof(uint8_t);
+
+inline void
+SpawnServerClient::SerializeKillQueue(Serializer &s, std::size_t max_size) noexcept
+{
+	for (; !kill_queue.empty() && max_size >= KILL_ITEM_SIZE;
+	     max_size -= KILL_ITEM_SIZE) {
+		const auto &i = kill_queue.front();
+
+		s.WriteUnsigned(i.pid);
+		s.WriteInt(i.signo);
+
+		kill_queue.pop_front();
+	}
+}
+
+inline void
+SpawnServerClient::SendWithKills(const Serializer &exec)
+{
+	assert(!kill_queue.empty());
+
+	const auto exec_payload = exec.GetPayload();
+
+	/* the BATCH command, two request headers, the KILL command
+	   and the EXEC request */
+	const std::size_t size = 1 + 2 * BATCH_HEADER_SIZE + 1 + exec_payload.size();
+	if (size + KILL_ITEM_SIZE > MAX_DATAGRAM_SIZE) {
+		/* no room for KILL; FlushKillQueue() will send it */
+		Send(exec);
+		return;
+	}
+
+	const std::size_t n_kills =
+		std::min<std::size_t>(std::distance(kill_queue.begin(),
+						    kill_queue.end()),
+				      (MAX_DATAGRAM_SIZE - size) / KILL_ITEM_SIZE);
+	const std::size_t kill_size = 1 + n_kills * KILL_ITEM_SIZE;
+
+	Serializer s{RequestCommand::BATCH};
+
+	s.WriteT(static_cast<uint16_t>(kill_size));
+	s.WriteU8(0);
+	s.WriteByte(static_cast<std::byte>(RequestCommand::KILL));
+	SerializeKillQueue(s, kill_size - 1);
+
+	s.WriteT(static_cast<uint16_t>(exec_payload.size()));
+	s.WriteU8(exec.GetFds().size());
+	s.Write(exec_payload);
+
+	Send(s.GetPayload(), exec.GetFds());
+}
+
 UniqueSocketDescriptor
 SpawnServerClient::Connect()
 {
@@ -217,6 +276,21 @@ SpawnServerClient::Connect()
 	return std::move(local_socket);
 }
 
+void
+SpawnServerClient::InvalidateMountTemplates()
+{
+	CheckOrAbort();
+
+	static constexpr RequestCommand cmd = RequestCommand::INVALIDATE_MOUNT_TEMPLATES;
+
+	try {
+		const std::span payload{&cmd, 1};
+		Send(std::as_bytes(payload), {});
+	} catch (...) {
+		std::throw_with_nested(std::runtime_error("Spawn server failed"));
+	}
+}
+
 static void
 Serialize(Serializer &s, const CgroupOptions &c)
 {
@@ -558,7 +632,12 @@ try {
 	}
 
 	try {
-		Send(s.GetPayload(), s.GetFds());
+		/* piggy-back pending KILL requests to save a
+		   system call */
+		if (kill_queue.empty())
+			Send(s.GetPayload(), s.GetFds());
+		else
+			SendWithKills(s);
 	} catch (const std::runtime_error &e) {
 		std::throw_with_nested(std::runtime_error("Spawn server failed"));
 	}
@@ -712,6 +791,27 @@ SpawnServerClient::HandleTerminatorStats(std::span<const std::byte> payload) noe
 	LoadUnaligned(terminator_stats, payload.data());
 }
 
+inline void
+SpawnServerClient::HandleWorkerStats(std::span<const std::byte> payload) noexcept
+{
+	assert(payload.size() % sizeof(SpawnWorkerStats) == 0);
+
+	worker_stats.resize(payload.size() / sizeof(SpawnWorkerStats));
+
+	for (auto &i : worker_stats) {
+		LoadUnaligned(i, payload.data());
+		payload = payload.subspan(sizeof(i));
+	}
+}
+
+inline void
+SpawnServerClient::HandleZygoteStats(std::span<const std::byte> payload) noexcept
+{
+	assert(payload.size() == sizeof(zygote_stats));
+
+	LoadUnaligned(zygote_stats, payload.data());
+}
+
 inline void
 SpawnServerClient::HandleMessage(std::span<const std::byte> payload,
 				 [[maybe_unused]] std::span<UniqueFileDescriptor> fds)
@@ -731,6 +831,14 @@ SpawnServerClient::HandleMessage(std::span<const std::byte> payload,
 	case ResponseCommand::TERMINATOR_STATS:
 		HandleTerminatorStats(payload);
 		break;
+
+	case ResponseCommand::WORKER_STATS:
+		HandleWorkerStats(payload);
+		break;
+
+	case ResponseCommand::ZYGOTE_STATS:
+		HandleZygoteStats(payload);
+		break;
 	}
 }
 
@@ -741,15 +849,7 @@ SpawnServerClient::FlushKillQueue()
 		return;
 
 	Serializer s{RequestCommand::KILL};
-
-	for (std::size_t n = 0; n < 256 && !kill_queue.empty(); ++n) {
-		const auto &i = kill_queue.front();
-
-		s.WriteUnsigned(i.pid);
-		s.WriteInt(i.signo);
-
-		kill_queue.pop_front();
-	}
+	SerializeKillQueue(s, s.GetRemaining());
 
 	Send(s.GetPayload(), s.GetFds());
 }
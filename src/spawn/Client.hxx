@@ -7,6 +7,7 @@
 #include "Interface.hxx"
 #include "Config.hxx"
 #include "Stats.hxx"
+#include "IProtocol.hxx"
 #include "event/DeferEvent.hxx"
 #include "event/SocketEvent.hxx"
 #include "net/MultiReceiveMessage.hxx"
@@ -18,6 +19,7 @@
 #include <map>
 #include <memory>
 #include <span>
+#include <vector>
 
 struct PreparedChildProcess;
 namespace Spawn {
@@ -66,12 +68,25 @@ class SpawnServerClient final : public SpawnService {
 
 	DeferEvent defer_spawn_queue;
 
-	MultiReceiveMessage receive{16, 1024, CMSG_SPACE(sizeof(int)), 1};
+	MultiReceiveMessage receive{16, Spawn::MAX_RESPONSE_DATAGRAM_SIZE,
+				    CMSG_SPACE(sizeof(int)), 1};
 
 	mutable SpawnStats stats{};
 
 	ChildProcessTerminatorStats terminator_stats{};
 
+	/**
+	 * The most recent #SpawnWorkerStats received from the
+	 * spawner; referenced by SpawnStats::workers.
+	 */
+	std::vector<SpawnWorkerStats> worker_stats;
+
+	/**
+	 * The most recent #SpawnZygoteStats received from the
+	 * spawner (all zero if zygotes are disabled).
+	 */
+	SpawnZygoteStats zygote_stats{};
+
 	unsigned last_pid = 0;
 
 	/**
@@ -119,6 +134,7 @@ public:
 	const SpawnStats &GetStats() const noexcept {
 		stats.alive = processes.size();
 		stats.pending = n_pending_execs;
+		stats.workers = worker_stats;
 		return stats;
 	}
 
@@ -126,10 +142,23 @@ public:
 		return terminator_stats;
 	}
 
+	const SpawnZygoteStats &GetZygoteStats() const noexcept {
+		return zygote_stats;
+	}
+
 	void Shutdown() noexcept;
 
 	UniqueSocketDescriptor Connect();
 
+	/**
+	 * Ask the spawner to discard all cached mount tree
+	 * templates, e.g. after the filesystems which are
+	 * bind-mounted into child processes have changed.
+	 *
+	 * Throws on error.
+	 */
+	void InvalidateMountTemplates();
+
 private:
 	unsigned MakePid() noexcept {
 		++last_pid;
@@ -170,13 +199,29 @@ private:
 		  std::span<const FileDescriptor> fds);
 	void Send(const Spawn::Serializer &s);
 
+	/**
+	 * Send the given EXEC request together with pending KILL
+	 * requests (from #kill_queue) in one BATCH datagram.
+	 *
+	 * Throws on error.
+	 */
+	void SendWithKills(const Spawn::Serializer &exec);
+
 	void HandleExecCompleteMessage(Spawn::Payload payload);
 	void HandleOneExit(Spawn::Payload &payload);
 	void HandleExitMessage(Spawn::Payload payload);
 	void HandleTerminatorStats(std::span<const std::byte> payload) noexcept;
+	void HandleWorkerStats(std::span<const std::byte> payload) noexcept;
+	void HandleZygoteStats(std::span<const std::byte> payload) noexcept;
 	void HandleMessage(std::span<const std::byte> payload,
 			   std::span<UniqueFileDescriptor> fds);
 
+	/**
+	 * Move as many items from #kill_queue into the KILL payload
+	 * as fit.
+	 */
+	void SerializeKillQueue(Spawn::Serializer &s, std::size_t max_size) noexcept;
+
 	/**
 	 * Throws on error.
 	 */
@@ -59,6 +59,32 @@ struct SpawnConfig {
 	 */
 	gid_t cgroups_writable_by_gid = 0;
 
+	/**
+	 * The number of worker processes which call
+	 * SpawnChildProcess() in parallel.  Zero means the spawner
+	 * process does it.
+	 */
+	unsigned workers = 0;
+
+	static constexpr unsigned MAX_WORKERS = 32;
+
+	/**
+	 * The maximum number of zygote processes, i.e. pre-forked
+	 * processes which are already set up for a frequently used
+	 * set of options and only need to fork and execute the new
+	 * program.  Zero disables this feature.
+	 */
+	unsigned zygotes = 0;
+
+	static constexpr unsigned MAX_ZYGOTES = 64;
+
+	/**
+	 * The directory where #MountTemplateCache mounts its
+	 * templates (in the spawner's mount namespace).  An empty
+	 * string disables mount templates.
+	 */
+	std::string mount_template_root = "/tmp/vfs";
+
 	/**
 	 * Attempt to run the spawner in a new PID namespace?  This
 	 * means it cannot attach to externally managed PID namespaces
@@ -237,6 +237,30 @@ SpawnConfigParser::ParseLine(FileLineParser &line)
 			throw std::runtime_error("Duplicate 'default_user'");
 
 		config.default_uid_gid.Lookup(s);
+	} else if (StringIsEqual(word, "workers")) {
+		const unsigned value = line.NextPositiveInteger();
+		line.ExpectEnd();
+
+		if (value > SpawnConfig::MAX_WORKERS)
+			throw FmtRuntimeError("Too many workers; must be at most {}",
+					      SpawnConfig::MAX_WORKERS);
+
+		config.workers = value;
+	} else if (StringIsEqual(word, "zygotes")) {
+		const unsigned value = line.NextPositiveInteger();
+		line.ExpectEnd();
+
+		if (value > SpawnConfig::MAX_ZYGOTES)
+			throw FmtRuntimeError("Too many zygotes; must be at most {}",
+					      SpawnConfig::MAX_ZYGOTES);
+
+		config.zygotes = value;
+	} else if (StringIsEqual(word, "mount_template_root")) {
+		const char *value = line.ExpectValueAndEnd();
+		if (*value != '/')
+			throw std::runtime_error("Absolute path expected");
+
+		config.mount_template_root = value;
 	} else if (StringIsEqual(word, "systemd_scope_optional")) {
 		config.systemd_scope_optional = line.NextBool();
 		line.ExpectEnd();
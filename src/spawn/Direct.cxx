@@ -26,10 +26,8 @@
 #include "util/Exception.hxx"
 #include "util/ScopeExit.hxx"
 
-#ifdef HAVE_LIBSECCOMP
-#include "SeccompFilter.hxx"
-#include "SyscallFilter.hxx"
-#endif
+#include "SeccompCache.hxx"
+#include "SeccompProgram.hxx"
 
 #ifdef HAVE_LIBCAP
 #include "lib/cap/State.hxx"
@@ -166,7 +164,8 @@ Exec(const char *path, PreparedChildProcess &&p,
      UniqueFileDescriptor &&userns_map_pipe_r,
      UniqueFileDescriptor &&userns_create_pipe_w,
      UniqueFileDescriptor &&wait_pipe_r,
-     UniqueFileDescriptor &&error_pipe_w) noexcept
+     UniqueFileDescriptor &&error_pipe_w,
+     const Seccomp::Program *seccomp_program) noexcept
 try {
 	assert(error_pipe_w.IsDefined());
 
@@ -308,42 +307,25 @@ try {
 		prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0);
 
 #ifdef HAVE_LIBSECCOMP
-	try {
-		Seccomp::Filter sf(SCMP_ACT_ALLOW);
-
-#ifdef PR_SET_NO_NEW_PRIVS
-		/* don't enable PR_SET_NO_NEW_PRIVS unless the feature
-		   was explicitly enabled */
-		if (!p.no_new_privs)
-			sf.SetAttributeNoThrow(SCMP_FLTATR_CTL_NNP, 0);
-#endif
-
-		sf.AddSecondaryArchs();
-
-		BuildSyscallFilter(sf);
-
-		if (!p.allow_ptrace)
-			ForbidPtrace(sf);
-
-		if (p.forbid_user_ns)
-			ForbidUserNamespace(sf);
-
-		if (p.forbid_multicast)
-			ForbidMulticast(sf);
-
-		if (p.forbid_bind)
-			ForbidBind(sf);
-
-		sf.Load();
-	} catch (const std::runtime_error &e) {
-		if (p.HasSyscallFilter())
-			/* filter options have been explicitly enabled, and thus
-			   failure to set up the filter are fatal */
-			throw;
-
-		fmt::print(stderr, "Failed to setup seccomp filter for {:?}: {}\n",
-			   path, e.what());
+	if (seccomp_program != nullptr) {
+		/* the program was compiled by the parent process (see
+		   SeccompProgramCache); installing it is just one
+		   system call */
+		try {
+			seccomp_program->Install();
+		} catch (const std::runtime_error &e) {
+			if (p.HasSyscallFilter())
+				/* filter options have been explicitly
+				   enabled, and thus failure to set up the
+				   filter are fatal */
+				throw;
+
+			fmt::print(stderr, "Failed to setup seccomp filter for {:?}: {}\n",
+				   path, e.what());
+		}
 	}
+#else
+	(void)seccomp_program;
 #endif // HAVE_LIBSECCOMP
 
 	if (!early_uid_gid && !skip_uid_gid) {
@@ -431,32 +413,33 @@ try {
 	_exit(EXIT_FAILURE);
 }
 
-/**
- * Read an error message from the pipe and if there is one, throw it
- * as a C++ exception.
- */
-static Co::Task<void>
-CoReadErrorPipe(EventLoop &event_loop, FileDescriptor error_pipe_r)
-{
-	const unsigned events = co_await AwaitableSocketEvent{
-		event_loop,
-		SocketDescriptor::FromFileDescriptor(error_pipe_r),
-		SocketEvent::READ,
-	};
-
-	if (events & SocketEvent::READ)
-		ReadErrorPipe(error_pipe_r);
-}
-
 Co::Task<SpawnChildProcessResult>
 SpawnChildProcess(EventLoop &event_loop,
 		  PreparedChildProcess params,
 		  const CgroupState &cgroup_state,
+		  SeccompProgramCache &seccomp_cache,
 		  bool cgroups_group_writable,
 		  bool is_sys_admin)
 {
 	const char *path = params.Finish();
 
+	/* compile the system call filter before clone(), so the
+	   child process only needs to install it */
+	const Seccomp::Program *seccomp_program = nullptr;
+#ifdef HAVE_LIBSECCOMP
+	try {
+		seccomp_program = seccomp_cache.Get(params);
+	} catch (const std::runtime_error &e) {
+		if (params.HasSyscallFilter())
+			throw;
+
+		fmt::print(stderr, "Failed to setup seccomp filter for {:?}: {}\n",
+			   path, e.what());
+	}
+#else
+	(void)seccomp_cache;
+#endif
+
 	/**
 	 * If an error occurs during setup, the child process will
 	 * write an error message to this pipe.
@@ -527,6 +510,8 @@ SpawnChildProcess(EventLoop &event_loop,
 
 	uint_least64_t clone_flags = CLONE_CLEAR_SIGHAND|CLONE_PIDFD;
 	clone_flags = params.ns.GetCloneFlags(clone_flags);
+	if (params.clone_parent)
+		clone_flags |= CLONE_PARENT;
 
 	/**
 	 * A pipe used by the parent process to wait for the child to
@@ -610,7 +595,9 @@ SpawnChildProcess(EventLoop &event_loop,
 	struct clone_args ca{
 		.flags = clone_flags,
 		.pidfd = (uintptr_t)&_pidfd,
-		.exit_signal = SIGCHLD,
+		/* with CLONE_PARENT, the kernel requires exit_signal=0
+		   and uses the caller's exit signal (SIGCHLD) instead */
+		.exit_signal = params.clone_parent ? 0U : SIGCHLD,
 	};
 
 	/* if a cgroup name is specified, it is used as the name for
@@ -682,7 +669,8 @@ SpawnChildProcess(EventLoop &event_loop,
 		     std::move(userns_map_pipe_r),
 		     std::move(userns_create_pipe_w),
 		     std::move(wait_pipe_r),
-		     std::move(error_pipe_w));
+		     std::move(error_pipe_w),
+		     seccomp_program);
 	}
 
 	if (old_pidns.IsDefined()) {
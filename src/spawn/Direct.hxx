@@ -12,6 +12,7 @@
 
 struct PreparedChildProcess;
 struct CgroupState;
+class SeccompProgramCache;
 class UniqueFileDescriptor;
 class EventLoop;
 namespace Co { template <typename T> class Task; }
@@ -40,6 +41,8 @@ struct SpawnChildProcessResult {
 /**
  * Throws exception on error.
  *
+ * @param seccomp_cache a cache for compiled system call filters
+ *
  * @param cgroups_group_writable shall cgroups created by this
  * function be writable by the owner gid?
  *
@@ -50,5 +53,6 @@ Co::Task<SpawnChildProcessResult>
 SpawnChildProcess(EventLoop &event_loop,
 		  PreparedChildProcess params,
 		  const CgroupState &cgroup_state,
+		  SeccompProgramCache &seccomp_cache,
 		  bool cgroups_group_writable,
 		  bool is_sys_admin);
@@ -3,8 +3,10 @@
 // author: Max Kellermann <max.kellermann@ionos.com>
 
 #include "ErrorPipe.hxx"
+#include "event/AwaitableSocketEvent.hxx"
 #include "io/FileDescriptor.hxx"
 #include "io/Iovec.hxx"
+#include "co/Task.hxx"
 #include "util/Exception.hxx"
 #include "util/SpanCast.hxx"
 
@@ -41,3 +43,16 @@ ReadErrorPipe(FileDescriptor p)
 		throw std::runtime_error{buffer.data()};
 	}
 }
+
+Co::Task<void>
+CoReadErrorPipe(EventLoop &event_loop, FileDescriptor p)
+{
+	const unsigned events = co_await AwaitableSocketEvent{
+		event_loop,
+		SocketDescriptor::FromFileDescriptor(p),
+		SocketEvent::READ,
+	};
+
+	if (events & SocketEvent::READ)
+		ReadErrorPipe(p);
+}
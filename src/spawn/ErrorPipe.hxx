@@ -8,6 +8,8 @@
 #include <string_view>
 
 class FileDescriptor;
+class EventLoop;
+namespace Co { template <typename T> class Task; }
 
 void
 WriteErrorPipe(FileDescriptor p, std::string_view prefix,
@@ -26,3 +28,11 @@ WriteErrorPipe(FileDescriptor p, std::string_view prefix,
  */
 void
 ReadErrorPipe(FileDescriptor p);
+
+/**
+ * Like ReadErrorPipe(), but wait (asynchronously) until the pipe
+ * becomes readable, i.e. until the child process has either written
+ * an error message or has closed the pipe (by calling execve()).
+ */
+Co::Task<void>
+CoReadErrorPipe(EventLoop &event_loop, FileDescriptor p);
@@ -13,6 +13,12 @@ namespace Spawn {
 
 static constexpr std::size_t MAX_DATAGRAM_SIZE = 32768;
 
+/**
+ * The maximum size of a response datagram (server to client).  The
+ * client's receive buffers are dimensioned for this.
+ */
+static constexpr std::size_t MAX_RESPONSE_DATAGRAM_SIZE = 1024;
+
 /*
  * This header contains definitions for the internal protocol between
  * #SpawnServerClient and #SpawnServerConnection.  It is not a stable
@@ -25,6 +31,20 @@ enum class RequestCommand : uint8_t {
 	CONNECT,
 	EXEC,
 	KILL,
+
+	/**
+	 * Discard all cached mount tree templates (no payload).
+	 */
+	INVALIDATE_MOUNT_TEMPLATES,
+
+	/**
+	 * Several requests in one datagram.  Each one is preceded by
+	 * its size (uint16_t) and the number of file descriptors it
+	 * consumes (uint8_t); the datagram's file descriptors are
+	 * assigned to the requests in this order.  Nested BATCH
+	 * requests are not allowed.
+	 */
+	BATCH,
 };
 
 enum class ExecCommand : uint8_t {
@@ -116,6 +136,19 @@ enum class ResponseCommand : uint8_t {
 	 * periodically.
 	 */
 	TERMINATOR_STATS,
+
+	/**
+	 * Contains one #SpawnWorkerStats for each worker process.
+	 * This gets sent together with #TERMINATOR_STATS, but only
+	 * if the spawner has worker processes.
+	 */
+	WORKER_STATS,
+
+	/**
+	 * Contains #SpawnZygoteStats.  This gets sent together with
+	 * #TERMINATOR_STATS, but only if zygotes are enabled.
+	 */
+	ZYGOTE_STATS,
 };
 
 struct MemoryWarningPayload {
@@ -144,6 +144,7 @@ LocalSpawnService::SpawnChildProcess(std::string_view name,
 
 	auto task = ::SpawnChildProcess(event_loop,
 					std::move(params), CgroupState(),
+					seccomp_cache,
 					false,
 					false /* TODO? */);
 
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "Interface.hxx"
+#include "SeccompCache.hxx"
 
 struct SpawnConfig;
 class EventLoop;
@@ -16,6 +17,8 @@ class LocalSpawnService final : public SpawnService {
 	EventLoop &event_loop;
 	ChildProcessTerminator &terminator;
 
+	SeccompProgramCache seccomp_cache;
+
 public:
 	explicit LocalSpawnService(const SpawnConfig &_config,
 				   EventLoop &_event_loop,
@@ -12,9 +12,10 @@
 #include "lib/fmt/ToBuffer.hxx"
 #include "system/linux/pivot_root.h"
 #include "system/Mount.hxx"
-#include "io/FileDescriptor.hxx"
+#include "io/UniqueFileDescriptor.hxx"
 #include "util/ScopeExit.hxx"
 #include "util/StringAPI.hxx"
+#include "util/StringCompare.hxx"
 
 #if TRANSLATION_ENABLE_EXPAND
 #include "pexpand.hxx"
@@ -79,6 +80,233 @@ ChdirOrThrow(const char *path)
 		throw FmtErrno("chdir({:?}) failed", path);
 }
 
+inline void
+MountNamespaceOptions::MountProc(VfsBuilder &vfs_builder) const
+{
+	vfs_builder.Add("/proc");
+
+	unsigned long flags = MS_NOEXEC|MS_NOSUID|MS_NODEV;
+	if (!writable_proc)
+		flags |= MS_RDONLY;
+
+	MountOrThrow("proc", "/proc", "proc", flags, "hidepid=1,subset=pid");
+}
+
+inline void
+MountNamespaceOptions::MountPts(VfsBuilder &vfs_builder) const
+{
+	vfs_builder.Add("/dev/pts");
+
+	/* the "newinstance" option is only needed with pre-4.7
+	   kernels; from v4.7 on, this is implicit for all new devpts
+	   mounts (kernel commit eedf265aa003) */
+	MountOrThrow("devpts", "/dev/pts", "devpts",
+		     MS_NOEXEC|MS_NOSUID,
+		     "newinstance");
+}
+
+inline void
+MountNamespaceOptions::MountTmpTmpfs(VfsBuilder &vfs_builder) const
+{
+	assert(mount_tmp_tmpfs != nullptr);
+
+	const char *options = "size=16M,nr_inodes=256,mode=1777";
+	StringBuffer<256> buffer;
+	if (*mount_tmp_tmpfs != 0) {
+		buffer = FmtBuffer<256>("{},{}",
+					options, mount_tmp_tmpfs);
+		options = buffer;
+	}
+
+	vfs_builder.Add("/tmp");
+
+	unsigned long flags = MS_NODEV|MS_NOSUID;
+	if (!mount_tmp_tmpfs_exec)
+		flags |= MS_NOEXEC;
+
+	MountOrThrow("none", "/tmp", "tmpfs",
+		     flags, options);
+
+	vfs_builder.MakeWritable();
+}
+
+/**
+ * Is the given path equal to or below the given directory?
+ */
+[[gnu::pure]]
+static bool
+IsBelow(const char *path, const char *dir) noexcept
+{
+	const char *rest = StringAfterPrefix(path, dir);
+	return rest != nullptr && (*rest == '/' || *rest == '\0');
+}
+
+bool
+MountNamespaceOptions::IsTemplateCompatible() const noexcept
+{
+	if (!IsRootMounted())
+		/* without pivot_root(), there is no tree to attach */
+		return false;
+
+	if (mount_pts && bind_mount_pts)
+		/* both are mounted on /dev/pts, but one of them would
+		   go into the template and the other one not */
+		return false;
+
+	for (const auto &i : mounts) {
+		if (i.source_fd.IsDefined())
+			/* owned by the caller and valid only for this
+			   one process */
+			return false;
+
+		switch (i.type) {
+		case Mount::Type::TMPFS:
+			if (i.writable)
+				/* each process needs its own */
+				return false;
+
+			break;
+
+		case Mount::Type::NAMED_TMPFS:
+			/* resolved by the #TmpfsManager for each
+			   process */
+			return false;
+
+		case Mount::Type::BIND:
+		case Mount::Type::BIND_FILE:
+		case Mount::Type::WRITE_FILE:
+		case Mount::Type::SYMLINK:
+			break;
+		}
+
+		/* the per-process mounts are applied after the
+		   template has been attached and would hide
+		   everything below them */
+		if ((mount_proc && IsBelow(i.target, "/proc")) ||
+		    (mount_pts && IsBelow(i.target, "/dev/pts")) ||
+		    (mount_tmp_tmpfs != nullptr && IsBelow(i.target, "/tmp")))
+			return false;
+	}
+
+	return true;
+}
+
+void
+MountNamespaceOptions::BuildTemplate(const char *path) const
+{
+	assert(IsTemplateCompatible());
+	assert(template_root == nullptr);
+
+	/* this mirrors Apply(), but mount points are resolved in the
+	   template (which becomes the root directory) and sources
+	   relative to the old root (the working directory) */
+
+	VfsBuilder vfs_builder{0, 0, dir_mode};
+
+	if (pivot_root != nullptr) {
+		BindMount(pivot_root, path);
+		MountSetAttr(FileDescriptor::Undefined(), path,
+			     AT_SYMLINK_NOFOLLOW|AT_NO_AUTOMOUNT,
+			     MS_NOSUID|MS_RDONLY,
+			     MS_NOEXEC|MS_NODEV);
+	} else {
+		MountOrThrow("none", path, "tmpfs", MS_NODEV|MS_NOEXEC|MS_NOSUID,
+			     "size=256k,nr_inodes=1024,mode=755");
+	}
+
+	/* unmounting the template must not propagate to the
+	   spawner's other mounts (and vice versa) */
+	MountSetAttr(FileDescriptor::Undefined(), path,
+		     AT_RECURSIVE|AT_SYMLINK_NOFOLLOW|AT_NO_AUTOMOUNT,
+		     0, 0, MS_PRIVATE);
+
+	ChdirOrThrow("/");
+
+	if (chroot(path) < 0)
+		throw FmtErrno("chroot({:?}) failed", path);
+
+	if (pivot_root == nullptr) {
+		/* like in Apply(), mount_root_tmpfs applies only if
+		   there is no pivot_root; the read-only bind mount
+		   above must not be used as a writable root */
+		assert(mount_root_tmpfs);
+
+		vfs_builder.AddWritableRoot("/");
+		vfs_builder.ScheduleRemount(MS_RDONLY, 0);
+	}
+
+	/* create only the mount points for the per-process mounts */
+
+	if (mount_proc)
+		vfs_builder.Add("/proc");
+
+	if (mount_dev) {
+		vfs_builder.Add("/dev");
+		MountOrThrow("dev", "/dev", nullptr, MS_BIND|MS_REC, nullptr);
+	}
+
+	if (mount_pts)
+		vfs_builder.Add("/dev/pts");
+
+	if (mount_tmp_tmpfs != nullptr)
+		/* a scratch /tmp for WRITE_FILE; the files which
+		   were bind-mounted from it remain accessible after
+		   it has been unmounted */
+		MountTmpTmpfs(vfs_builder);
+
+	if (bind_mount_pts) {
+		vfs_builder.Add("/dev/pts");
+		BindMount("dev/pts", "/dev/pts");
+	}
+
+	Mount::ApplyAll(mounts, vfs_builder);
+
+	if (mount_tmp_tmpfs != nullptr)
+		Umount("/tmp", MNT_DETACH);
+
+	vfs_builder.Finish();
+}
+
+inline void
+MountNamespaceOptions::ApplyTemplate(const UidGid &uid_gid) const
+{
+	assert(template_root != nullptr);
+
+	/* attach a copy of the template on top of itself; unlike the
+	   template (which was copied into this mount namespace by
+	   clone() and may be locked), the copy belongs to us and can
+	   become the new root */
+	MoveMount(OpenTree(FileDescriptor::Undefined(), template_root,
+			   OPEN_TREE_CLONE|AT_RECURSIVE), "",
+		  FileDescriptor::Undefined(), template_root,
+		  MOVE_MOUNT_F_EMPTY_PATH);
+
+	ChdirOrThrow(template_root);
+
+	/* this stacks the old root on top of the new one; detaching
+	   it right away (see pivot_root(2)) gets rid of it (and of
+	   all other templates) without needing a "put_old"
+	   directory */
+	if (my_pivot_root(".", ".") < 0)
+		throw FmtErrno("pivot_root({:?}) failed", template_root);
+
+	Umount(".", MNT_DETACH);
+	ChdirOrThrow("/");
+
+	VfsBuilder vfs_builder{uid_gid.effective_uid, uid_gid.effective_gid, dir_mode};
+
+	if (mount_proc)
+		MountProc(vfs_builder);
+
+	if (mount_pts)
+		MountPts(vfs_builder);
+
+	if (mount_tmp_tmpfs != nullptr)
+		MountTmpTmpfs(vfs_builder);
+
+	vfs_builder.Finish();
+}
+
 void
 MountNamespaceOptions::Apply(const UidGid &uid_gid) const
 {
@@ -90,6 +318,11 @@ MountNamespaceOptions::Apply(const UidGid &uid_gid) const
 		     AT_RECURSIVE|AT_SYMLINK_NOFOLLOW|AT_NO_AUTOMOUNT,
 		     0, 0, MS_PRIVATE);
 
+	if (template_root != nullptr) {
+		ApplyTemplate(uid_gid);
+		return;
+	}
+
 	const char *const put_old = "/mnt";
 
 	const char *new_root = nullptr;
@@ -145,13 +378,7 @@ MountNamespaceOptions::Apply(const UidGid &uid_gid) const
 			   else that will fail with EBUSY */
 			umount2("/proc", MNT_DETACH);
 
-		vfs_builder.Add("/proc");
-
-		unsigned long flags = MS_NOEXEC|MS_NOSUID|MS_NODEV;
-		if (!writable_proc)
-			flags |= MS_RDONLY;
-
-		MountOrThrow("proc", "/proc", "proc", flags, "hidepid=1,subset=pid");
+		MountProc(vfs_builder);
 	}
 
 	if (mount_dev) {
@@ -169,37 +396,11 @@ MountNamespaceOptions::Apply(const UidGid &uid_gid) const
 			ChdirOrThrow("/");
 	}
 
-	if (mount_pts) {
-		vfs_builder.Add("/dev/pts");
-
-		/* the "newinstance" option is only needed with pre-4.7
-		   kernels; from v4.7 on, this is implicit for all new devpts
-		   mounts (kernel commit eedf265aa003) */
-		MountOrThrow("devpts", "/dev/pts", "devpts",
-			     MS_NOEXEC|MS_NOSUID,
-			     "newinstance");
-	}
-
-	if (mount_tmp_tmpfs != nullptr) {
-		const char *options = "size=16M,nr_inodes=256,mode=1777";
-		StringBuffer<256> buffer;
-		if (*mount_tmp_tmpfs != 0) {
-			buffer = FmtBuffer<256>("{},{}",
-						options, mount_tmp_tmpfs);
-			options = buffer;
-		}
-
-		vfs_builder.Add("/tmp");
+	if (mount_pts)
+		MountPts(vfs_builder);
 
-		unsigned long flags = MS_NODEV|MS_NOSUID;
-		if (!mount_tmp_tmpfs_exec)
-			flags |= MS_NOEXEC;
-
-		MountOrThrow("none", "/tmp", "tmpfs",
-			     flags, options);
-
-		vfs_builder.MakeWritable();
-	}
+	if (mount_tmp_tmpfs != nullptr)
+		MountTmpTmpfs(vfs_builder);
 
 	if (HasBindMount()) {
 		/* go to /mnt so we can refer to the old directories with a
@@ -16,6 +16,7 @@ class AllocatorPtr;
 struct UidGid;
 struct Mount;
 class MatchData;
+class VfsBuilder;
 
 struct MountNamespaceOptions {
 	/**
@@ -87,6 +88,15 @@ struct MountNamespaceOptions {
 	 */
 	bool mount_tmp_tmpfs_exec = false;
 
+	/**
+	 * If this is defined, then it is the absolute path of a
+	 * mount tree prepared by BuildTemplate() in the spawner's
+	 * mount namespace; Apply() attaches a copy of it instead of
+	 * replaying all mounts.  This is set by the spawner (see
+	 * #MountTemplateCache) and is not copied.
+	 */
+	const char *template_root = nullptr;
+
 	MountNamespaceOptions() = default;
 
 	constexpr MountNamespaceOptions(ShallowCopy shallow_copy,
@@ -144,6 +154,29 @@ struct MountNamespaceOptions {
 	 */
 	void Apply(const UidGid &uid_gid) const;
 
+	/**
+	 * Can the mounts be prepared once by BuildTemplate() and be
+	 * shared by all processes with these options?  This is not
+	 * the case if a process needs a private writable tmpfs or
+	 * file descriptors passed by the caller.
+	 */
+	[[gnu::pure]]
+	bool IsTemplateCompatible() const noexcept;
+
+	/**
+	 * Build all mounts except for the ones which are specific to
+	 * a process (/proc, /dev/pts and /tmp) on the given (empty)
+	 * directory, to be attached later by Apply() via
+	 * #template_root.
+	 *
+	 * This changes the root directory and the working directory,
+	 * so it must be called in a thread which has called
+	 * unshare(CLONE_FS).
+	 *
+	 * Throws std::system_error on error.
+	 */
+	void BuildTemplate(const char *path) const;
+
 	char *MakeId(char *p) const noexcept;
 
 	[[gnu::pure]]
@@ -160,6 +193,12 @@ struct MountNamespaceOptions {
 				    const char *host_path) const noexcept;
 
 private:
+	void ApplyTemplate(const UidGid &uid_gid) const;
+
+	void MountProc(VfsBuilder &vfs_builder) const;
+	void MountPts(VfsBuilder &vfs_builder) const;
+	void MountTmpTmpfs(VfsBuilder &vfs_builder) const;
+
 	constexpr bool HasBindMount() const noexcept {
 		return bind_mount_pts || !mounts.empty();
 	}
@@ -0,0 +1,199 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "MountTemplateCache.hxx"
+#include "MountNamespaceOptions.hxx"
+#include "Mount.hxx"
+#include "MakeId.hxx"
+#include "system/Error.hxx"
+#include "util/SharedLease.hxx"
+
+#include <fmt/core.h>
+
+#include <cassert>
+#include <cstring>
+#include <thread>
+
+#include <sched.h> // for unshare()
+#include <sys/mount.h>
+#include <sys/stat.h> // for mkdir()
+#include <unistd.h> // for rmdir()
+
+using std::string_view_literals::operator""sv;
+
+/**
+ * Build the template in a new thread, because
+ * MountNamespaceOptions::BuildTemplate() changes the root directory;
+ * after unshare(CLONE_FS), the thread still shares the mount
+ * namespace with the spawner, but not the root directory.
+ */
+static void
+BuildTemplate(const MountNamespaceOptions &options, const char *path)
+{
+	std::exception_ptr error;
+
+	std::thread thread{[&options, path, &error]{
+		try {
+			if (unshare(CLONE_FS) < 0)
+				throw MakeErrno("unshare(CLONE_FS) failed");
+
+			options.BuildTemplate(path);
+		} catch (...) {
+			error = std::current_exception();
+		}
+	}};
+
+	thread.join();
+
+	if (error)
+		std::rethrow_exception(std::move(error));
+}
+
+static void
+RemoveTemplate(const char *path) noexcept
+{
+	umount2(path, MNT_DETACH);
+	rmdir(path);
+}
+
+struct MountTemplateCache::Item final
+	: IntrusiveHashSetHook<>, IntrusiveListHook<>, SharedAnchor
+{
+	const std::string key;
+
+	const std::string path;
+
+	/**
+	 * Was this item removed from the cache?  Then it gets
+	 * deleted as soon as it is abandoned.
+	 */
+	bool discarded = false;
+
+	Item(std::string &&_key, std::string &&_path,
+	     const MountNamespaceOptions &options)
+		:key(std::move(_key)), path(std::move(_path))
+	{
+		if (mkdir(path.c_str(), 0700) < 0 && errno != EEXIST)
+			throw MakeErrno("Failed to create mount template directory");
+
+		try {
+			BuildTemplate(options, path.c_str());
+		} catch (...) {
+			RemoveTemplate(path.c_str());
+			throw;
+		}
+	}
+
+	~Item() noexcept {
+		RemoveTemplate(path.c_str());
+	}
+
+	Item(const Item &) = delete;
+	Item &operator=(const Item &) = delete;
+
+	// virtual methods from SharedAnchor
+	void OnAbandoned() noexcept override {
+		if (discarded)
+			delete this;
+	}
+};
+
+inline std::string_view
+MountTemplateCache::ItemGetKey::operator()(const Item &item) const noexcept
+{
+	return item.key;
+}
+
+MountTemplateCache::MountTemplateCache(std::string_view _path) noexcept
+	:path(_path) {}
+
+MountTemplateCache::~MountTemplateCache() noexcept
+{
+	Invalidate();
+}
+
+std::string
+MountTemplateCache::MakeKey(const MountNamespaceOptions &options) noexcept
+{
+	/* calculate an upper bound for the length of the string
+	   generated by MountNamespaceOptions::MakeId() */
+	std::size_t size = 256;
+	if (options.pivot_root != nullptr)
+		size += strlen(options.pivot_root);
+	if (options.mount_tmp_tmpfs != nullptr)
+		size += strlen(options.mount_tmp_tmpfs);
+
+	for (const auto &i : options.mounts) {
+		size += 32 + strlen(i.target);
+		if (i.source != nullptr)
+			size += strlen(i.source);
+	}
+
+	std::string key;
+	key.resize(size);
+
+	char *p = options.MakeId(key.data());
+
+	/* MakeId() omits a few details which affect the tree */
+	p = AppendIntBase32(p, ";dm="sv, options.dir_mode);
+
+	for (const auto &i : options.mounts) {
+		*p++ = ';';
+		p = AppendOptional(p, 'w', i.writable);
+		p = AppendOptional(p, 'x', i.exec);
+		p = AppendOptional(p, 'o', i.optional);
+	}
+
+	key.resize(p - key.data());
+	return key;
+}
+
+void
+MountTemplateCache::Invalidate() noexcept
+{
+	while (!lru.empty())
+		Discard(lru.front());
+}
+
+MountTemplateCache::Result
+MountTemplateCache::Get(const MountNamespaceOptions &options)
+{
+	if (!options.IsTemplateCompatible())
+		return {nullptr, SharedLease{}};
+
+	auto key = MakeKey(options);
+
+	if (auto i = items.find(key); i != items.end()) {
+		/* move to the end of the LRU list */
+		lru.erase(lru.iterator_to(*i));
+		lru.push_back(*i);
+
+		return {i->path.c_str(), *i};
+	}
+
+	if (lru.size() >= MAX_ITEMS)
+		Discard(lru.front());
+
+	auto *item = new Item(std::move(key),
+			      fmt::format("{}/{}", path, ++last_id),
+			      options);
+	items.insert(*item);
+	lru.push_back(*item);
+
+	return {item->path.c_str(), *item};
+}
+
+void
+MountTemplateCache::Discard(Item &item) noexcept
+{
+	assert(!item.discarded);
+
+	items.erase(items.iterator_to(item));
+	lru.erase(lru.iterator_to(item));
+
+	if (item.IsAbandoned())
+		delete &item;
+	else
+		item.discarded = true;
+}
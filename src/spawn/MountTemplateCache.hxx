@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "util/IntrusiveHashSet.hxx"
+#include "util/IntrusiveList.hxx"
+#include "util/TransparentHash.hxx"
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility> // for std::pair
+
+struct MountNamespaceOptions;
+class SharedLease;
+
+/**
+ * Manages a set of mount trees built by
+ * MountNamespaceOptions::BuildTemplate(), one for each distinct
+ * #MountNamespaceOptions.  Child processes attach a copy of it with
+ * one move_mount() instead of replaying all mounts.
+ *
+ * The templates are mounted (below the directory passed to the
+ * constructor) in the spawner's mount namespace, because open_tree()
+ * cannot clone detached mount trees.  Since clone(CLONE_NEWNS) copies
+ * all of them into each new mount namespace, the number of templates
+ * is limited; the least recently used one is discarded.  Templates
+ * which are still referenced by a #SharedLease are unmounted only
+ * after the last lease has been released.
+ */
+class MountTemplateCache {
+	struct Item;
+
+	struct ItemGetKey {
+		[[gnu::pure]]
+		std::string_view operator()(const Item &item) const noexcept;
+	};
+
+	IntrusiveHashSet<Item, 256,
+			 IntrusiveHashSetOperators<Item, ItemGetKey, TransparentHash,
+						   std::equal_to<std::string_view>>> items;
+
+	/**
+	 * All items, the least recently used one first.
+	 */
+	IntrusiveList<Item, IntrusiveListBaseHookTraits<Item>,
+		      IntrusiveListOptions{.constant_time_size = true}> lru;
+
+	/**
+	 * The directory where the templates are mounted.
+	 */
+	const std::string path;
+
+	unsigned last_id = 0;
+
+public:
+	static constexpr std::size_t MAX_ITEMS = 64;
+
+	explicit MountTemplateCache(std::string_view _path) noexcept;
+	~MountTemplateCache() noexcept;
+
+	MountTemplateCache(const MountTemplateCache &) = delete;
+	MountTemplateCache &operator=(const MountTemplateCache &) = delete;
+
+	/**
+	 * Discard all templates, e.g. because mounts which were
+	 * bind-mounted into them have changed.  Processes which have
+	 * already been spawned are not affected.
+	 */
+	void Invalidate() noexcept;
+
+	/**
+	 * Generate a string which identifies the mount tree built
+	 * from the given options.  Options with equal keys share a
+	 * template.
+	 */
+	static std::string MakeKey(const MountNamespaceOptions &options) noexcept;
+
+	/**
+	 * The absolute path of the template (valid as long as the
+	 * lease is held) or nullptr if the options are not
+	 * compatible with templates.
+	 */
+	using Result = std::pair<const char *, SharedLease>;
+
+	/**
+	 * Obtain the template for the given options, building it if
+	 * it is not yet in the cache.
+	 *
+	 * Throws on error.
+	 */
+	Result Get(const MountNamespaceOptions &options);
+
+private:
+	/**
+	 * Remove the item from the cache and delete it as soon as it
+	 * is abandoned.
+	 */
+	void Discard(Item &item) noexcept;
+};
@@ -31,6 +31,14 @@ public:
 		return end - begin;
 	}
 
+	/**
+	 * Returns the part of the payload which has not yet been
+	 * read.
+	 */
+	constexpr std::span<const std::byte> GetRest() const noexcept {
+		return {begin, end};
+	}
+
 	std::byte ReadByte() noexcept {
 		assert(!empty());
 		return *begin++;
@@ -61,6 +69,15 @@ public:
 		ReadT(value_r);
 	}
 
+	std::span<const std::byte> ReadSpan(std::size_t size) {
+		if (GetSize() < size)
+			throw MalformedPayloadError{};
+
+		std::span<const std::byte> value{begin, size};
+		begin += size;
+		return value;
+	}
+
 	std::string_view ReadStringView() {
 		auto n = std::find(begin, end, std::byte{0});
 		if (n == end)
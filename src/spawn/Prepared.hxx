@@ -128,6 +128,14 @@ struct PreparedChildProcess {
 	 */
 	bool sigkill = false;
 
+	/**
+	 * Make the new process a child of this process's parent
+	 * (CLONE_PARENT)?  This is used by spawn worker processes,
+	 * so the spawner can wait for the new process with its
+	 * pidfd.
+	 */
+	bool clone_parent = false;
+
 	/**
 	 * Select the "idle" CPU scheduling policy.  With this policy, the
 	 * "priority" value is ignored.
@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "SeccompCache.hxx"
+#include "SeccompProgram.hxx"
+#include "Prepared.hxx"
+#include "spawn/config.h"
+
+#ifdef HAVE_LIBSECCOMP
+#include "SeccompFilter.hxx"
+#include "SyscallFilter.hxx"
+#endif
+
+SeccompProgramCache::SeccompProgramCache() noexcept = default;
+SeccompProgramCache::~SeccompProgramCache() noexcept = default;
+
+#ifdef HAVE_LIBSECCOMP
+
+static Seccomp::Program
+CompileSyscallFilter(const PreparedChildProcess &p)
+{
+	Seccomp::Filter sf(SCMP_ACT_ALLOW);
+	sf.AddSecondaryArchs();
+
+	BuildSyscallFilter(sf);
+
+	if (!p.allow_ptrace)
+		ForbidPtrace(sf);
+
+	if (p.forbid_user_ns)
+		ForbidUserNamespace(sf);
+
+	if (p.forbid_multicast)
+		ForbidMulticast(sf);
+
+	if (p.forbid_bind)
+		ForbidBind(sf);
+
+	return sf.Export();
+}
+
+#endif // HAVE_LIBSECCOMP
+
+const Seccomp::Program *
+SeccompProgramCache::Get(const PreparedChildProcess &p)
+{
+#ifdef HAVE_LIBSECCOMP
+	/* PR_SET_NO_NEW_PRIVS is not part of the key: it is applied
+	   by the child process before installing the program */
+	const std::size_t key = (p.allow_ptrace ? 0x1 : 0) |
+		(p.forbid_user_ns ? 0x2 : 0) |
+		(p.forbid_multicast ? 0x4 : 0) |
+		(p.forbid_bind ? 0x8 : 0);
+
+	auto &program = programs[key];
+	if (!program)
+		program = std::make_unique<Seccomp::Program>(CompileSyscallFilter(p));
+
+	return program.get();
+#else
+	(void)p;
+	return nullptr;
+#endif
+}
@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include <array>
+#include <memory>
+
+struct PreparedChildProcess;
+namespace Seccomp { class Program; }
+
+/**
+ * Caches the compiled system call filters for SpawnChildProcess().
+ * Compiling a filter with libseccomp is expensive; doing it once per
+ * distinct configuration in the spawner (instead of once per child
+ * process, after clone()) takes it out of the spawn latency.
+ *
+ * If libseccomp is disabled, this class does nothing.
+ */
+class SeccompProgramCache {
+	/**
+	 * Indexed by a bit mask of the #PreparedChildProcess filter
+	 * options.
+	 */
+	std::array<std::unique_ptr<Seccomp::Program>, 16> programs;
+
+public:
+	SeccompProgramCache() noexcept;
+	~SeccompProgramCache() noexcept;
+
+	SeccompProgramCache(const SeccompProgramCache &) = delete;
+	SeccompProgramCache &operator=(const SeccompProgramCache &) = delete;
+
+	/**
+	 * Obtain the filter program for the given child process,
+	 * compiling it if it is not yet in the cache.
+	 *
+	 * Throws std::runtime_error on error.
+	 *
+	 * @return the program (owned by this object) or nullptr if
+	 * libseccomp is disabled
+	 */
+	const Seccomp::Program *Get(const PreparedChildProcess &p);
+};
@@ -3,6 +3,11 @@
 // author: Max Kellermann <max.kellermann@ionos.com>
 
 #include "SeccompFilter.hxx"
+#include "SeccompProgram.hxx"
+#include "io/linux/MemFD.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+
+#include <span>
 
 namespace Seccomp {
 
@@ -29,6 +34,34 @@ Filter::Load() const
 		throw MakeErrno(-error, "seccomp_load() failed");
 }
 
+Program
+Filter::Export() const
+{
+	/* seccomp_export_bpf_mem() is not available in older
+	   libseccomp versions; export to a memfd instead */
+	auto fd = CreateMemFD("seccomp");
+
+	int error = seccomp_export_bpf(ctx, fd.Get());
+	if (error < 0)
+		throw MakeErrno(-error, "seccomp_export_bpf() failed");
+
+	const off_t size = fd.GetSize();
+	if (size < 0)
+		throw MakeErrno("Failed to get BPF program size");
+
+	if (size == 0 || size % sizeof(struct sock_filter) != 0)
+		throw std::runtime_error("Malformed BPF program");
+
+	std::vector<struct sock_filter> code(size / sizeof(struct sock_filter));
+
+	if (!fd.Rewind())
+		throw MakeErrno("Failed to rewind BPF program");
+
+	fd.FullRead(std::as_writable_bytes(std::span{code}));
+
+	return Program{std::move(code)};
+}
+
 void
 Filter::AddArch(uint32_t arch_token)
 {
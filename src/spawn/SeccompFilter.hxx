@@ -12,6 +12,8 @@
 
 namespace Seccomp {
 
+class Program;
+
 class Filter {
 	const scmp_filter_ctx ctx;
 
@@ -35,6 +37,15 @@ public:
 
 	void Load() const;
 
+	/**
+	 * Compile this filter to a BPF program which can be
+	 * installed later (e.g. in a child process) without
+	 * libseccomp.
+	 *
+	 * Throws std::runtime_error on error.
+	 */
+	Program Export() const;
+
 	void SetAttributeNoThrow(enum scmp_filter_attr attr, uint32_t value) noexcept {
 		seccomp_attr_set(ctx, attr, value);
 	}
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "system/Error.hxx"
+
+#include <utility>
+#include <vector>
+
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace Seccomp {
+
+/**
+ * A compiled seccomp BPF program, exported from a #Filter.  Unlike
+ * #Filter, installing it does not need libseccomp; it is just one
+ * system call.
+ */
+class Program {
+	std::vector<struct sock_filter> code;
+
+public:
+	explicit Program(std::vector<struct sock_filter> &&_code) noexcept
+		:code(std::move(_code)) {}
+
+	/**
+	 * Install this program into the current process.  Unless
+	 * PR_SET_NO_NEW_PRIVS was set, this requires CAP_SYS_ADMIN.
+	 *
+	 * Throws std::system_error on error.
+	 */
+	void Install() const {
+		const struct sock_fprog prog{
+			.len = static_cast<unsigned short>(code.size()),
+			.filter = const_cast<struct sock_filter *>(code.data()),
+		};
+
+		if (syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER, 0, &prog) < 0)
+			throw MakeErrno("seccomp(SECCOMP_SET_MODE_FILTER) failed");
+	}
+};
+
+} // namespace Seccomp
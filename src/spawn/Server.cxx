@@ -15,7 +15,13 @@
 #include "Direct.hxx"
 #include "Terminator.hxx"
 #include "TmpfsManager.hxx"
+#include "MountTemplateCache.hxx"
+#include "ServerExec.hxx"
+#include "ServerWorker.hxx"
+#include "Zygote.hxx"
+#include "ZygoteCache.hxx"
 #include "ZombieReaper.hxx"
+#include "SeccompCache.hxx"
 #include "ExitListener.hxx"
 #include "PidfdEvent.hxx"
 #include "spawn/config.h"
@@ -25,7 +31,8 @@
 #include "event/Loop.hxx"
 #include "net/EasyMessage.hxx"
 #include "net/UniqueSocketDescriptor.hxx"
-#include "net/ReceiveMessage.hxx"
+#include "net/MultiReceiveMessage.hxx"
+#include "net/SocketPair.hxx"
 #include "net/SocketError.hxx"
 #include "io/FileAt.hxx"
 #include "io/MakeDirectory.hxx"
@@ -38,12 +45,14 @@
 #include "util/IntrusiveList.hxx"
 #include "util/Exception.hxx"
 #include "util/SharedLease.hxx"
+#include "util/StaticVector.hxx"
 
 #ifdef HAVE_LIBCAP
 #include "lib/cap/Glue.hxx"
 #endif
 
 #include <forward_list>
+#include <list>
 #include <optional>
 #include <memory>
 
@@ -58,57 +67,15 @@ class SpawnServerProcess;
 using std::string_view_literals::operator""sv;
 using namespace Spawn;
 
-class SpawnFdList {
-	std::vector<UniqueFileDescriptor> v;
-	decltype(v)::iterator i;
-
-public:
-	SpawnFdList(std::vector<UniqueFileDescriptor> &&_v) noexcept
-		:v(std::move(_v)),
-		 i(v.begin()) {}
-
-	SpawnFdList(SpawnFdList &&src) = default;
-
-	SpawnFdList &operator=(SpawnFdList &&src) = default;
-
-	bool IsEmpty() noexcept {
-		return i == v.end();
-	}
-
-	size_t size() const noexcept {
-		return v.size();
-	}
-
-	UniqueFileDescriptor Get() {
-		if (IsEmpty())
-			throw MalformedPayloadError();
-
-		return std::move(*i++);
-	}
-
-	UniqueSocketDescriptor GetSocket() {
-		return UniqueSocketDescriptor{Get()};
-	}
-
-	/**
-	 * Like Get(), but does not transfer ownership to the caller.
-	 */
-	FileDescriptor Borrow() {
-		if (IsEmpty())
-			throw MalformedPayloadError();
-
-		return *i++;
-	}
-};
-
 class SpawnServerConnection;
+class SpawnServerJob;
 
 class SpawnServerChild final : public ExitListener,
 			       public IntrusiveHashSetHook<IntrusiveHookMode::NORMAL>
 {
 	SpawnServerConnection &connection;
 
-	const std::forward_list<SharedLease> leases;
+	std::forward_list<SharedLease> leases;
 
 	const unsigned id;
 
@@ -125,6 +92,13 @@ class SpawnServerChild final : public ExitListener,
 
 	Co::InvokeTask invoke_task;
 
+	/**
+	 * The job which runs SpawnChildProcess() in a
+	 * #SpawnServerWorker process (if any).  It is orphaned if
+	 * this object gets deleted before the job completes.
+	 */
+	SpawnServerJob *job = nullptr;
+
 	std::unique_ptr<PidfdEvent> pidfd;
 
 	UniqueFileDescriptor session_cgroup_fd;
@@ -144,14 +118,36 @@ public:
 		 name(_name),
 		 sigkill(_sigkill) {}
 
+	~SpawnServerChild() noexcept;
+
 	SpawnServerChild(const SpawnServerChild &) = delete;
 	SpawnServerChild &operator=(const SpawnServerChild &) = delete;
 
+	/**
+	 * Run the task in this process.
+	 */
 	void Start(Co::Task<SpawnChildProcessResult> &&task) {
 		invoke_task = Await(std::move(task));
 		invoke_task.Start(BIND_THIS_METHOD(OnCompletion));
 	}
 
+	/**
+	 * Pass the request to the given worker process.
+	 *
+	 * @param exec the request data (owning the file descriptors
+	 * referenced by the #request)
+	 */
+	void Submit(SpawnServerWorker &worker,
+		    ChildProcessTerminator &terminator,
+		    std::unique_ptr<SpawnServerExec> &&exec,
+		    SpawnServerWorker::Request &&request) noexcept;
+
+	/**
+	 * Called by #SpawnServerJob.
+	 */
+	void OnJobComplete(SpawnChildProcessResult &&result,
+			   std::exception_ptr &&error) noexcept;
+
 	void Kill(ChildProcessTerminator &child_process_terminator,
 		  int signo) noexcept {
 		if (sigkill && session_cgroup_fd.IsDefined() &&
@@ -173,13 +169,87 @@ public:
 	};
 
 private:
+	void OnSpawned(SpawnChildProcessResult &&result);
+
 	Co::InvokeTask Await(Co::Task<SpawnChildProcessResult> task);
 	void OnCompletion(std::exception_ptr &&error) noexcept;
 };
 
+class SpawnServerJob final : public SpawnServerWorker::Job {
+	const std::unique_ptr<SpawnServerExec> exec;
+
+	/**
+	 * Kills the new child process if the job was orphaned.
+	 */
+	EventLoop &event_loop;
+	ChildProcessTerminator &terminator;
+	const std::string name;
+
+public:
+	/**
+	 * The child this job belongs to or nullptr if it was
+	 * deleted meanwhile; the result will then be discarded.
+	 */
+	SpawnServerChild *child;
+
+	/**
+	 * The leases of an orphaned child; they must be kept until
+	 * the job completes, because the worker process may still be
+	 * using the mounts.
+	 */
+	std::forward_list<SharedLease> leases;
+
+	SpawnServerJob(SpawnServerChild &_child,
+		       EventLoop &_event_loop,
+		       ChildProcessTerminator &_terminator,
+		       std::string_view _name,
+		       std::unique_ptr<SpawnServerExec> &&_exec) noexcept
+		:exec(std::move(_exec)),
+		 event_loop(_event_loop), terminator(_terminator),
+		 name(_name),
+		 child(&_child) {}
+
+	// virtual methods from SpawnServerWorker::Job
+	void OnSpawnJobComplete() noexcept override {
+		if (child != nullptr)
+			child->OnJobComplete(std::move(result),
+					     std::move(error));
+		else if (!error)
+			/* the child was killed (or its connection was
+			   closed) while the worker process was still
+			   spawning it; nobody else knows about the new
+			   process, so kill it now */
+			terminator.Kill(event_loop, std::move(result.pidfd),
+					name, SIGKILL);
+
+		delete this;
+	}
+};
+
 class SpawnServerConnection final
 	: public IntrusiveListHook<IntrusiveHookMode::NORMAL>
 {
+	/**
+	 * The maximum number of datagrams received with one
+	 * recvmmsg() call.
+	 */
+	static constexpr std::size_t MAX_RECEIVE_DATAGRAMS = 8;
+
+	static constexpr std::size_t MAX_FDS_PER_DATAGRAM = 32;
+
+	/**
+	 * The maximum number of datagrams sent with one sendmmsg()
+	 * call.  This is below the kernel's default
+	 * "net.unix.max_dgram_qlen" to avoid EAGAIN.
+	 */
+	static constexpr std::size_t MAX_SEND_DATAGRAMS = 8;
+
+	/**
+	 * Longer EXEC_COMPLETE error messages are truncated, so each
+	 * one fits into a response datagram.
+	 */
+	static constexpr std::size_t MAX_ERROR_LENGTH = 512;
+
 	SpawnServerProcess &process;
 	UniqueSocketDescriptor socket;
 
@@ -199,6 +269,12 @@ class SpawnServerConnection final
 
 	Event::TimePoint next_stats_send;
 
+	MultiReceiveMessage receive{
+		MAX_RECEIVE_DATAGRAMS, MAX_DATAGRAM_SIZE,
+		CMSG_SPACE(sizeof(int) * MAX_FDS_PER_DATAGRAM),
+		MAX_RECEIVE_DATAGRAMS * MAX_FDS_PER_DATAGRAM,
+	};
+
 	using ChildIdMap =
 		IntrusiveHashSet<SpawnServerChild, 1024,
 				 IntrusiveHashSetOperators<SpawnServerChild,
@@ -244,14 +320,33 @@ public:
 private:
 	void RemoveConnection() noexcept;
 
+	void VerifyUidGid(PreparedChildProcess &p) const;
+	void PrepareMounts(SpawnServerExec &exec,
+			   std::forward_list<SharedLease> &leases);
+
+	/**
+	 * Start a zygote for the given (already parsed and
+	 * verified) request.  Errors are logged.
+	 */
+	void StartZygote(const SpawnServerExec &src,
+			 const SpawnZygoteKey &key) noexcept;
+
 	void SpawnChild(unsigned id, std::string_view name,
-			PreparedChildProcess &&p);
+			std::unique_ptr<SpawnServerExec> &&exec,
+			const SpawnZygoteKey *zygote_key);
 
-	void HandleExecMessage(Payload payload, SpawnFdList &&fds);
+	void HandleExecMessage(std::unique_ptr<SpawnServerExec> &&exec);
 	void HandleOneKill(Payload &payload);
 	void HandleKillMessage(Payload payload, SpawnFdList &&fds);
+	void HandleBatchMessage(Payload payload, SpawnFdList &&fds);
 	void HandleMessage(std::span<const std::byte> payload, SpawnFdList &&fds);
-	void HandleMessage(ReceiveMessageResult &&result);
+
+	/**
+	 * Like HandleMessage(), but log (and otherwise ignore)
+	 * malformed requests.
+	 */
+	void TryHandleMessage(std::span<const std::byte> payload,
+			      SpawnFdList &&fds);
 
 	void ReceiveAndHandle();
 
@@ -264,8 +359,10 @@ private:
 			defer_flush_output.ScheduleIdle();
 	}
 
-	void FlushExecCompleteQueue();
-	void FlushExitQueue();
+	using OutputBatch = StaticVector<ResponseSerializer, MAX_SEND_DATAGRAMS>;
+
+	void FlushExecCompleteQueue(OutputBatch &output);
+	void FlushExitQueue(OutputBatch &output);
 	void FlushOutput();
 
 	void DeferredFlushOutput() noexcept;
@@ -278,11 +375,30 @@ private:
 	void OnStatsSendTimer() noexcept;
 };
 
-inline Co::InvokeTask
-SpawnServerChild::Await(Co::Task<SpawnChildProcessResult> task)
+SpawnServerChild::~SpawnServerChild() noexcept
 {
-	auto result = co_await task;
+	if (job != nullptr) {
+		job->child = nullptr;
+		job->leases = std::move(leases);
+	}
+}
 
+inline void
+SpawnServerChild::Submit(SpawnServerWorker &worker,
+			 ChildProcessTerminator &terminator,
+			 std::unique_ptr<SpawnServerExec> &&exec,
+			 SpawnServerWorker::Request &&request) noexcept
+{
+	assert(job == nullptr);
+
+	job = new SpawnServerJob(*this, connection.GetEventLoop(),
+				 terminator, name, std::move(exec));
+	worker.Submit(*job, std::move(request));
+}
+
+inline void
+SpawnServerChild::OnSpawned(SpawnChildProcessResult &&result)
+{
 	ExitListener &exit_listener = *this;
 	pidfd = std::make_unique<PidfdEvent>(connection.GetEventLoop(),
 					     std::move(result.pidfd),
@@ -295,6 +411,30 @@ SpawnServerChild::Await(Co::Task<SpawnChildProcessResult> task)
 	accessory_lease_pipe = std::move(result.accessory_lease_pipe);
 }
 
+inline Co::InvokeTask
+SpawnServerChild::Await(Co::Task<SpawnChildProcessResult> task)
+{
+	OnSpawned(co_await task);
+}
+
+void
+SpawnServerChild::OnJobComplete(SpawnChildProcessResult &&result,
+				std::exception_ptr &&error) noexcept
+{
+	assert(job != nullptr);
+	job = nullptr;
+
+	if (!error) {
+		try {
+			OnSpawned(std::move(result));
+		} catch (...) {
+			error = std::current_exception();
+		}
+	}
+
+	OnCompletion(std::move(error));
+}
+
 inline void
 SpawnServerChild::OnCompletion(std::exception_ptr &&error) noexcept
 {
@@ -332,6 +472,13 @@ MakeTmpfsMountRoot()
 			     {.mode = 0100});
 }
 
+static void
+MakeMountTemplateRoot(const char *path)
+{
+	MakeDirectory({FileDescriptor::Undefined(), path},
+		      {.mode = 0700});
+}
+
 class SpawnServerProcess {
 	const SpawnConfig config;
 	const CgroupState &cgroup_state;
@@ -345,10 +492,35 @@ class SpawnServerProcess {
 
 	std::optional<TmpfsManager> tmpfs_manager;
 
+	std::optional<MountTemplateCache> mount_template_cache;
+
 	ChildProcessTerminator child_process_terminator;
 
 	ZombieReaper zombie_reaper{loop};
 
+	SeccompProgramCache seccomp_cache;
+
+	/**
+	 * Zygote processes for frequently spawned programs (see
+	 * SpawnConfig::zygotes).
+	 */
+	std::optional<SpawnZygoteCache> zygote_cache;
+
+	/**
+	 * Worker processes for SpawnChildProcess() (see
+	 * SpawnConfig::workers).  If this is empty, this process
+	 * does it.
+	 */
+	std::list<SpawnServerWorker> workers;
+
+	/**
+	 * Destroys the #workers after Quit() when the last job has
+	 * completed.
+	 */
+	DeferEvent defer_stop_workers{loop, BIND_THIS_METHOD(StopWorkers)};
+
+	bool quitting = false;
+
 	using ConnectionList = IntrusiveList<SpawnServerConnection>;
 	ConnectionList connections;
 
@@ -369,8 +541,22 @@ public:
 		if (has_mount_namespace) {
 			tmpfs_manager.emplace(MakeTmpfsMountRoot());
 
+			if (!config.mount_template_root.empty()) {
+				MakeMountTemplateRoot(config.mount_template_root.c_str());
+				mount_template_cache.emplace(config.mount_template_root);
+			}
+
 			ScheduleExpireTimer();
 		}
+
+		for (unsigned i = 0; i < config.workers; ++i)
+			workers.emplace_back(loop,
+					     BIND_THIS_METHOD(OnWorkerIdle),
+					     config, cgroup_state,
+					     is_sys_admin);
+
+		if (config.zygotes > 0)
+			zygote_cache.emplace(config.zygotes);
 	}
 
 	const SpawnConfig &GetConfig() const noexcept {
@@ -385,10 +571,40 @@ public:
 		return tmpfs_manager;
 	}
 
+	auto &GetMountTemplateCache() noexcept {
+		return mount_template_cache;
+	}
+
+	auto &GetZygoteCache() noexcept {
+		return zygote_cache;
+	}
+
 	bool IsSysAdmin() const noexcept {
 		return is_sys_admin;
 	}
 
+	SeccompProgramCache &GetSeccompCache() noexcept {
+		return seccomp_cache;
+	}
+
+	const auto &GetWorkers() const noexcept {
+		return workers;
+	}
+
+	/**
+	 * Choose the (alive) worker with the fewest pending jobs.
+	 *
+	 * @return the worker or nullptr if there are no workers
+	 */
+	SpawnServerWorker *PickWorker() noexcept {
+		SpawnServerWorker *best = nullptr;
+		for (auto &i : workers)
+			if (i.IsAlive() &&
+			    (best == nullptr || i.GetPending() < best->GetPending()))
+				best = &i;
+		return best;
+	}
+
 	EventLoop &GetEventLoop() noexcept {
 		return loop;
 	}
@@ -436,6 +652,39 @@ private:
 
 		zombie_reaper.Disable();
 		expire_timer.Cancel();
+
+		/* close the zygote sockets, which makes the zygotes
+		   exit */
+		if (zygote_cache)
+			zygote_cache->Invalidate();
+
+		/* stop the worker processes; their sockets would
+		   otherwise keep the EventLoop running */
+		quitting = true;
+		StopWorkers();
+	}
+
+	void OnWorkerIdle() noexcept {
+		if (quitting)
+			/* not calling StopWorkers() directly,
+			   because it would destroy the caller */
+			defer_stop_workers.Schedule();
+	}
+
+	/**
+	 * Destroy all workers, but only after all of their jobs have
+	 * completed; the processes spawned by orphaned jobs must be
+	 * passed to the #ChildProcessTerminator.
+	 */
+	void StopWorkers() noexcept {
+		assert(quitting);
+
+		for (const auto &i : workers)
+			if (i.GetPending() > 0)
+				/* OnWorkerIdle() will try again */
+				return;
+
+		workers.clear();
 	}
 };
 
@@ -504,9 +753,23 @@ PrepareNamedTmpfs(TmpfsManager &tmpfs_manager,
 	}
 }
 
+/**
+ * Look up (or build) the mount tree template for the given options.
+ */
+static void
+PrepareMountTemplate(MountTemplateCache &cache,
+		     MountNamespaceOptions &options,
+		     std::forward_list<SharedLease> &leases)
+{
+	auto [path, lease] = cache.Get(options);
+	if (path != nullptr) {
+		options.template_root = path;
+		leases.emplace_front(std::move(lease));
+	}
+}
+
 inline void
-SpawnServerConnection::SpawnChild(unsigned id, std::string_view name,
-				  PreparedChildProcess &&p)
+SpawnServerConnection::VerifyUidGid(PreparedChildProcess &p) const
 {
 	const auto &config = process.GetConfig();
 
@@ -521,17 +784,104 @@ SpawnServerConnection::SpawnChild(unsigned id, std::string_view name,
 
 		p.uid_gid = config.default_uid_gid;
 	}
+}
 
-	std::forward_list<SharedLease> leases;
+inline void
+SpawnServerConnection::PrepareMounts(SpawnServerExec &exec,
+				     std::forward_list<SharedLease> &leases)
+{
+	auto &p = exec.p;
 
-	std::forward_list<UniqueFileDescriptor> fds;
 	if (auto &tmpfs_manager = process.GetTmpfsManager())
                 PrepareNamedTmpfs(*tmpfs_manager,
-                                  p.ns.mount, leases, fds);
+                                  p.ns.mount, leases, exec.tmpfs_fds);
+
+	if (auto &mount_template_cache = process.GetMountTemplateCache())
+		PrepareMountTemplate(*mount_template_cache,
+				     p.ns.mount, leases);
+}
+
+/**
+ * Wait for the child process forked by a zygote and account the
+ * saved time in the #SpawnZygoteCache.
+ */
+static Co::Task<SpawnChildProcessResult>
+CoWaitZygoteChild(EventLoop &event_loop, SpawnZygoteCache &zygote_cache,
+		  UniqueSocketDescriptor reply_socket,
+		  std::chrono::steady_clock::time_point start_time,
+		  std::chrono::steady_clock::duration setup_duration)
+{
+	auto result = co_await WaitSpawnZygoteChild(event_loop,
+						    std::move(reply_socket));
+	zygote_cache.AddSavedDuration(setup_duration,
+				      std::chrono::steady_clock::now() - start_time);
+	co_return result;
+}
+
+inline void
+SpawnServerConnection::SpawnChild(unsigned id, std::string_view name,
+				  std::unique_ptr<SpawnServerExec> &&exec,
+				  const SpawnZygoteKey *zygote_key)
+{
+	const auto &config = process.GetConfig();
+	auto &p = exec->p;
+
+	VerifyUidGid(p);
+
+	if (zygote_key != nullptr && zygote_key->IsCompatible()) {
+		auto &zygote_cache = *process.GetZygoteCache();
+
+		const auto start_time = std::chrono::steady_clock::now();
+
+		if (auto fork = zygote_cache.Fork(zygote_key->GetValue(), p);
+		    fork.reply_socket.IsDefined()) {
+			/* the zygote forks the new child process;
+			   its mount namespace leases are owned by the
+			   zygote */
+			auto *child = new SpawnServerChild(*this, {},
+							   id, name,
+							   p.sigkill);
+			children.insert(*child);
+			child->Start(CoWaitZygoteChild(GetEventLoop(), zygote_cache,
+						       std::move(fork.reply_socket),
+						       start_time,
+						       fork.setup_duration));
+			return;
+		}
+
+		/* start the zygote now, because #exec may be moved
+		   to a worker job below */
+		if (zygote_cache.WantStart(zygote_key->GetValue()))
+			StartZygote(*exec, *zygote_key);
+	}
+
+	std::forward_list<SharedLease> leases;
+	PrepareMounts(*exec, leases);
+
+	const bool sigkill = p.sigkill;
+
+	if (auto *worker = process.PickWorker()) {
+		SpawnServerWorker::Request request{*exec};
+
+		auto *child = new SpawnServerChild(*this,
+						   std::move(leases),
+						   id,
+						   name,
+						   sigkill);
+		children.insert(*child);
+
+		/* the job keeps the request data (and its file
+		   descriptors) alive until the worker process has
+		   completed it */
+		child->Submit(*worker, process.GetChildProcessTerminator(),
+			      std::move(exec), std::move(request));
+		return;
+	}
 
 	auto task = SpawnChildProcess(GetEventLoop(),
 				      std::move(p),
 				      process.GetCgroupState(),
+				      process.GetSeccompCache(),
 				      config.cgroups_writable_by_gid > 0,
 				      process.IsSysAdmin());
 
@@ -539,445 +889,104 @@ SpawnServerConnection::SpawnChild(unsigned id, std::string_view name,
 					   std::move(leases),
 					   id,
 					   name,
-					   p.sigkill);
+					   sigkill);
 	children.insert(*child);
 
+	/* the task has passed the point where it needs the request
+	   data when Start() returns */
 	child->Start(std::move(task));
 }
 
-static void
-Read(Payload &payload, ResourceLimits &rlimits)
-{
-	unsigned i = (unsigned)payload.ReadByte();
-	struct rlimit &data = rlimits.values[i];
-	payload.ReadT(data);
-}
-
-static void
-Read(Payload &payload, UidGid &uid_gid)
+/**
+ * Wait for the zygote process to be spawned and return the
+ * spawner's handle to it.
+ *
+ * @param exec the request data referenced by the task
+ */
+static Co::Task<SpawnZygote>
+CoSpawnZygote(std::unique_ptr<SpawnServerExec> exec,
+	      std::forward_list<SharedLease> leases,
+	      UniqueSocketDescriptor socket,
+	      UniqueSocketDescriptor zygote_socket,
+	      Co::Task<SpawnChildProcessResult> task)
 {
-	payload.ReadT(uid_gid.real_uid);
-	payload.ReadT(uid_gid.real_gid);
-	payload.ReadT(uid_gid.effective_uid);
-	payload.ReadT(uid_gid.effective_gid);
-
-	const size_t n_groups = (std::size_t)payload.ReadByte();
-	if (n_groups > uid_gid.supplementary_groups.max_size())
-		throw MalformedPayloadError();
+	/* the zygote gets reaped by the #ZombieReaper; its pidfd is
+	   not needed, because it exits when the socket gets
+	   closed */
+	co_await task;
 
-	for (size_t i = 0; i < n_groups; ++i)
-		payload.ReadT(uid_gid.supplementary_groups[i]);
+	/* the zygote has its own copy now */
+	zygote_socket.Close();
+	exec.reset();
 
-	if (n_groups < uid_gid.supplementary_groups.max_size())
-		uid_gid.supplementary_groups[n_groups] = UidGid::UNSET_GID;
+	co_return SpawnZygote{std::move(socket), std::move(leases)};
 }
 
-inline void
-SpawnServerConnection::HandleExecMessage(Payload payload,
-					 SpawnFdList &&fds)
-{
+void
+SpawnServerConnection::StartZygote(const SpawnServerExec &src,
+				   const SpawnZygoteKey &key) noexcept
+try {
+	/* parse the request again into a new #SpawnServerExec which
+	   is owned by the zygote task; zygote-compatible requests
+	   have no file descriptors other than stdio, which are
+	   supplied to each forked child process later */
+	auto exec = std::make_unique<SpawnServerExec>(std::span{src.buffer.get(), src.size},
+						      SpawnFdList{std::vector<UniqueFileDescriptor>(src.fds.size())});
+
+	auto payload = exec->GetPayload();
 	unsigned id;
 	payload.ReadUnsigned(id);
-	const std::string_view name = payload.ReadStringView();
-
-	PreparedChildProcess p;
-	CgroupOptions cgroup;
-
-	auto mount_tail = p.ns.mount.mounts.before_begin();
-
-	std::forward_list<Mount> mounts;
-	std::forward_list<AssignmentList::Item> assignments;
-
-	while (!payload.empty()) {
-		const ExecCommand cmd = static_cast<ExecCommand>(payload.ReadByte());
-		switch (cmd) {
-		case ExecCommand::EXEC_FUNCTION:
-			payload.ReadT(p.exec_function);
-			break;
-
-		case ExecCommand::EXEC_PATH:
-			p.exec_path = payload.ReadString();
-			break;
-
-		case ExecCommand::EXEC_FD:
-			p.exec_fd = fds.Borrow();
-			break;
-
-		case ExecCommand::ARG:
-			if (p.args.size() >= 16384)
-				throw MalformedPayloadError();
-
-			p.Append(payload.ReadString());
-			break;
-
-		case ExecCommand::SETENV:
-			if (p.env.size() >= 16384)
-				throw MalformedPayloadError();
-
-			p.PutEnv(payload.ReadString());
-			break;
-
-		case ExecCommand::UMASK:
-			{
-				uint16_t value;
-				payload.ReadT(value);
-				p.umask = value;
-			}
-
-			break;
-
-		case ExecCommand::STDIN:
-			p.stdin_fd = fds.Borrow();
-			break;
-
-		case ExecCommand::STDOUT:
-			p.stdout_fd = fds.Borrow();
-			break;
-
-		case ExecCommand::STDOUT_IS_STDIN:
-			p.stdout_fd = p.stdin_fd;
-			break;
-
-		case ExecCommand::STDERR:
-			p.stderr_fd = fds.Borrow();
-			break;
-
-		case ExecCommand::STDERR_IS_STDIN:
-			p.stderr_fd = p.stdin_fd;
-			break;
-
-		case ExecCommand::STDERR_PATH:
-			p.stderr_path = payload.ReadString();
-			break;
-
-		case ExecCommand::RETURN_STDERR:
-			p.return_stderr = UniqueSocketDescriptor{fds.Get()};
-			break;
-
-		case ExecCommand::RETURN_PIDFD:
-			p.return_pidfd = UniqueSocketDescriptor{fds.Get()};
-			break;
-
-		case ExecCommand::RETURN_CGROUP:
-			p.return_cgroup = UniqueSocketDescriptor{fds.Get()};
-			break;
-
-		case ExecCommand::CONTROL:
-			p.control_fd = fds.Borrow();
-			break;
-
-		case ExecCommand::TTY:
-			p.tty = true;
-			break;
-
-		case ExecCommand::USER_NS:
-			p.ns.user.create = true;
-			break;
-
-		case ExecCommand::USER_NS_LIMITS:
-			payload.ReadT(p.ns.user.limits);
-			break;
-
-		case ExecCommand::PID_NS:
-			payload.ReadT(p.ns.pid.mode);
-			switch (p.ns.pid.mode) {
-			case PidNamespaceOptions::Mode::DISABLED:
-			case PidNamespaceOptions::Mode::ANONYMOUS:
-				break;
-
-			case PidNamespaceOptions::Mode::ACCESSORY:
-				p.ns.pid.name = payload.ReadString();
-				break;
-			}
-
-			break;
-
-		case ExecCommand::PID_NS_FD:
-			p.ns.pid.fd = fds.Borrow();
-			break;
-
-		case ExecCommand::CGROUP_NS:
-			p.ns.enable_cgroup = true;
-			break;
-
-		case ExecCommand::NETWORK_NS:
-			p.ns.enable_network = true;
-			break;
-
-		case ExecCommand::NETWORK_NS_NAME:
-			p.ns.network_namespace_name = payload.ReadString();
-			break;
-
-		case ExecCommand::IPC_NS:
-			p.ns.enable_ipc = true;
-			break;
-
-		case ExecCommand::MOUNT_PROC:
-			p.ns.mount.mount_proc = true;
-			break;
-
-		case ExecCommand::WRITABLE_PROC:
-			p.ns.mount.writable_proc = true;
-			break;
-
-		case ExecCommand::MOUNT_DEV:
-			p.ns.mount.mount_dev = true;
-			break;
-
-		case ExecCommand::MOUNT_PTS:
-			p.ns.mount.mount_pts = true;
-			break;
-
-		case ExecCommand::BIND_MOUNT_PTS:
-			p.ns.mount.bind_mount_pts = true;
-			break;
-
-		case ExecCommand::PIVOT_ROOT:
-			p.ns.mount.pivot_root = payload.ReadString();
-			break;
-
-		case ExecCommand::MOUNT_ROOT_TMPFS:
-			p.ns.mount.mount_root_tmpfs = true;
-			break;
-
-		case ExecCommand::MOUNT_TMP_TMPFS:
-			p.ns.mount.mount_tmp_tmpfs = payload.ReadString();
-			p.ns.mount.mount_tmp_tmpfs_exec = payload.ReadBool();
-			break;
-
-		case ExecCommand::MOUNT_TMPFS:
-			{
-				const char *target = payload.ReadString();
-				bool writable = payload.ReadBool();
-				mounts.emplace_front(Mount::Tmpfs{}, target,
-						     writable);
-			}
-
-			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
-								    mounts.front());
-			break;
-
-		case ExecCommand::MOUNT_NAMED_TMPFS:
-			{
-				const char *source = payload.ReadString();
-				const char *target = payload.ReadString();
-				bool writable = payload.ReadBool();
-				mounts.emplace_front(Mount::NamedTmpfs{},
-						     source, target,
-						     writable);
-			}
-
-			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
-								    mounts.front());
-			break;
-
-		case ExecCommand::BIND_MOUNT:
-			{
-				const char *source = payload.ReadString();
-				const char *target = payload.ReadString();
-				bool writable = payload.ReadBool();
-				bool exec = payload.ReadBool();
-				mounts.emplace_front(source, target,
-						     writable, exec);
-				mounts.front().optional = payload.ReadBool();
-			}
-
-			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
-								    mounts.front());
-			break;
-
-		case ExecCommand::BIND_MOUNT_FILE:
-			{
-				const char *source = payload.ReadString();
-				const char *target = payload.ReadString();
-				mounts.emplace_front(source, target);
-				mounts.front().type = Mount::Type::BIND_FILE;
-				mounts.front().exec = payload.ReadBool();
-				mounts.front().optional = payload.ReadBool();
-			}
-
-			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
-								    mounts.front());
-			break;
-
-		case ExecCommand::FD_BIND_MOUNT:
-			{
-				const char *target = payload.ReadString();
-				bool writable = payload.ReadBool();
-				bool exec = payload.ReadBool();
-				mounts.emplace_front(nullptr, target,
-						     writable, exec);
-				mounts.front().source_fd = fds.Borrow();
-				mounts.front().optional = payload.ReadBool();
-			}
-
-			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
-								    mounts.front());
-			break;
-
-		case ExecCommand::FD_BIND_MOUNT_FILE:
-			{
-				const char *target = payload.ReadString();
-				mounts.emplace_front(nullptr, target);
-				mounts.front().type = Mount::Type::BIND_FILE;
-				mounts.front().source_fd = fds.Borrow();
-				mounts.front().exec = payload.ReadBool();
-				mounts.front().optional = payload.ReadBool();
-			}
-
-			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
-								    mounts.front());
-			break;
-
-		case ExecCommand::WRITE_FILE:
-			{
-				const char *path = payload.ReadString();
-				const char *contents = payload.ReadString();
-				mounts.emplace_front(Mount::WriteFile{},
-						     path, contents);
-				mounts.front().optional = payload.ReadBool();
-			}
-
-			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
-								    mounts.front());
-			break;
-
-		case ExecCommand::SYMLINK:
-			{
-				const char *target = payload.ReadString();
-				const char *source = payload.ReadString();
-				mounts.emplace_front(source, target);
-				mounts.front().type = Mount::Type::SYMLINK;
-			}
+	payload.ReadStringView();
 
-			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
-								    mounts.front());
-			break;
+	ParseExecCommands(payload, *exec, nullptr);
 
-		case ExecCommand::DIR_MODE:
-			payload.ReadT(p.ns.mount.dir_mode);
-			break;
+	auto &p = exec->p;
+	VerifyUidGid(p);
 
-		case ExecCommand::HOSTNAME:
-			p.ns.hostname = payload.ReadString();
-			break;
-
-		case ExecCommand::RLIMIT:
-			Read(payload, p.rlimits);
-			break;
-
-		case ExecCommand::UID_GID:
-			Read(payload, p.uid_gid);
-			break;
-
-		case ExecCommand::MAPPED_REAL_UID:
-			payload.ReadT(p.ns.user.mapped_real_uid);
-			break;
-
-		case ExecCommand::MAPPED_EFFECTIVE_UID:
-			payload.ReadT(p.ns.user.mapped_effective_uid);
-			break;
+	std::forward_list<SharedLease> leases;
+	PrepareMounts(*exec, leases);
 
-		case ExecCommand::SIGKILL_:
-			p.sigkill = true;
-			break;
+	auto [control_socket, zygote_socket] = CreateSocketPair(SOCK_SEQPACKET);
 
-		case ExecCommand::SCHED_IDLE_:
-			p.sched_idle = true;
-			break;
+	p.exec_function = RunSpawnZygote;
+	p.control_fd = zygote_socket.ToFileDescriptor();
 
-		case ExecCommand::IOPRIO_IDLE:
-			p.ioprio_idle = true;
-			break;
+	auto task = SpawnChildProcess(GetEventLoop(),
+				      std::move(p),
+				      process.GetCgroupState(),
+				      process.GetSeccompCache(),
+				      process.GetConfig().cgroups_writable_by_gid > 0,
+				      process.IsSysAdmin());
 
-#ifdef HAVE_LIBSECCOMP
-		case ExecCommand::ALLOW_PTRACE:
-			p.allow_ptrace = true;
-			break;
+	process.GetZygoteCache()->Start(key.GetValue(),
+					CoSpawnZygote(std::move(exec),
+						      std::move(leases),
+						      std::move(control_socket),
+						      std::move(zygote_socket),
+						      std::move(task)));
+} catch (...) {
+	logger(1, "Failed to start zygote: ", std::current_exception());
+}
 
-		case ExecCommand::FORBID_USER_NS:
-			p.forbid_user_ns = true;
-			break;
+inline void
+SpawnServerConnection::HandleExecMessage(std::unique_ptr<SpawnServerExec> &&exec)
+{
+	auto payload = exec->GetPayload();
 
-		case ExecCommand::FORBID_MULTICAST:
-			p.forbid_multicast = true;
-			break;
+	unsigned id;
+	payload.ReadUnsigned(id);
+	const std::string_view name = payload.ReadStringView();
 
-		case ExecCommand::FORBID_BIND:
-			p.forbid_bind = true;
-			break;
-#endif // HAVE_LIBSECCOMP
+	std::optional<SpawnZygoteKey> zygote_key;
+	if (process.GetZygoteCache())
+		zygote_key.emplace();
 
-#ifdef HAVE_LIBCAP
-		case ExecCommand::CAP_SYS_RESOURCE:
-			p.cap_sys_resource = true;
-			break;
-#endif // HAVE_LIBCAP
-
-		case ExecCommand::NO_NEW_PRIVS:
-			p.no_new_privs = true;
-			break;
-
-		case ExecCommand::CGROUP:
-			if (p.cgroup != nullptr)
-				throw MalformedPayloadError();
-
-			cgroup.name = payload.ReadString();
-			p.cgroup = &cgroup;
-			break;
-
-		case ExecCommand::CGROUP_SESSION:
-			if (p.cgroup == nullptr)
-				throw MalformedPayloadError();
-
-			p.cgroup_session = payload.ReadString();
-			break;
-
-		case ExecCommand::CGROUP_SET:
-			if (p.cgroup != nullptr) {
-				const char *set_name = payload.ReadString();
-				const char *set_value = payload.ReadString();
-
-				assignments.emplace_front(set_name, set_value);
-				auto &set = assignments.front();
-				cgroup.set.Add(set);
-			} else
-				throw MalformedPayloadError();
-
-			break;
-
-		case ExecCommand::CGROUP_XATTR:
-			if (p.cgroup != nullptr) {
-				const char *_name = payload.ReadString();
-				const char *_value = payload.ReadString();
-
-				assignments.emplace_front(_name, _value);
-				cgroup.xattr.Add(assignments.front());
-			} else
-				throw MalformedPayloadError();
-
-			break;
-
-		case ExecCommand::PRIORITY:
-			payload.ReadInt(p.priority);
-			break;
-
-		case ExecCommand::CHROOT:
-			p.chroot = payload.ReadString();
-			break;
-
-		case ExecCommand::CHDIR:
-			p.chdir = payload.ReadString();
-			break;
-
-		case ExecCommand::HOOK_INFO:
-			p.hook_info = payload.ReadString();
-			break;
-		}
-	}
+	ParseExecCommands(payload, *exec,
+			  zygote_key ? &*zygote_key : nullptr);
 
 	try {
-		SpawnChild(id, name, std::move(p));
+		SpawnChild(id, name, std::move(exec),
+			   zygote_key ? &*zygote_key : nullptr);
 	} catch (...) {
 		SendExecComplete(id, {}, GetFullMessage(std::current_exception()));
 		SendExit(id, W_EXITCODE(0xff, 0));
@@ -1015,6 +1024,35 @@ SpawnServerConnection::HandleKillMessage(Payload payload,
 }
 
 inline void
+SpawnServerConnection::HandleBatchMessage(Payload payload,
+					  SpawnFdList &&fds)
+{
+	while (!payload.empty()) {
+		uint16_t size;
+		uint8_t n_fds;
+		payload.ReadT(size);
+		payload.ReadT(n_fds);
+
+		const auto request = payload.ReadSpan(size);
+		if (request.empty() ||
+		    static_cast<RequestCommand>(request.front()) == RequestCommand::BATCH)
+			throw MalformedPayloadError();
+
+		std::vector<UniqueFileDescriptor> request_fds;
+		request_fds.reserve(n_fds);
+		for (unsigned i = 0; i < n_fds; ++i)
+			request_fds.emplace_back(fds.Get());
+
+		/* a malformed request does not affect the other
+		   requests in this batch */
+		TryHandleMessage(request, std::move(request_fds));
+	}
+
+	if (!fds.IsEmpty())
+		throw MalformedPayloadError();
+}
+
+void
 SpawnServerConnection::HandleMessage(std::span<const std::byte> payload,
 				     SpawnFdList &&fds)
 {
@@ -1030,19 +1068,40 @@ SpawnServerConnection::HandleMessage(std::span<const std::byte> payload,
 		break;
 
 	case RequestCommand::EXEC:
-		HandleExecMessage(Payload{payload}, std::move(fds));
+		HandleExecMessage(std::make_unique<SpawnServerExec>(payload,
+								    std::move(fds)));
 		break;
 
 	case RequestCommand::KILL:
 		HandleKillMessage(Payload{payload}, std::move(fds));
 		break;
+
+	case RequestCommand::INVALIDATE_MOUNT_TEMPLATES:
+		if (!payload.empty() || !fds.IsEmpty())
+			throw MalformedPayloadError();
+
+		if (auto &mount_template_cache = process.GetMountTemplateCache())
+			mount_template_cache->Invalidate();
+
+		/* the zygotes' mount namespaces were set up from the
+		   old templates */
+		if (auto &zygote_cache = process.GetZygoteCache())
+			zygote_cache->Invalidate();
+		break;
+
+	case RequestCommand::BATCH:
+		HandleBatchMessage(Payload{payload}, std::move(fds));
+		break;
 	}
 }
 
-inline void
-SpawnServerConnection::HandleMessage(ReceiveMessageResult &&result)
-{
-	HandleMessage(result.payload, std::move(result.fds));
+void
+SpawnServerConnection::TryHandleMessage(std::span<const std::byte> payload,
+					SpawnFdList &&fds)
+try {
+	HandleMessage(payload, std::move(fds));
+} catch (MalformedPayloadError) {
+	logger(3, "Malformed spawn payload");
 }
 
 inline void
@@ -1050,72 +1109,110 @@ SpawnServerConnection::ReceiveAndHandle()
 {
 	ScheduleStatsSendTimer();
 
-	ReceiveMessageBuffer<MAX_DATAGRAM_SIZE, CMSG_SPACE(sizeof(int) * 32)> rmb;
-
-	auto result = ReceiveMessage(socket, rmb, MSG_DONTWAIT);
-	if (result.payload.empty()) {
+	if (!receive.Receive(socket)) {
 		RemoveConnection();
 		return;
 	}
 
-	try {
-		HandleMessage(std::move(result));
-	} catch (MalformedPayloadError) {
-		logger(3, "Malformed spawn payload");
+	for (auto &i : receive) {
+		if (i.payload.empty()) {
+			/* when the peer closes the socket, recvmmsg()
+			   doesn't return 0; instead, it fills the
+			   mmsghdr array with empty packets */
+			RemoveConnection();
+			return;
+		}
+
+		std::vector<UniqueFileDescriptor> fds;
+		fds.reserve(i.fds.size());
+		for (auto &fd : i.fds)
+			fds.emplace_back(std::move(fd));
+
+		TryHandleMessage(i.payload, std::move(fds));
 	}
+
+	receive.Clear();
 }
 
+/**
+ * The number of #OutputBatch slots reserved for the stats datagrams.
+ */
+static constexpr std::size_t STATS_DATAGRAMS = 3;
+
+static_assert(1 + SpawnConfig::MAX_WORKERS * sizeof(SpawnWorkerStats) <=
+	      MAX_RESPONSE_DATAGRAM_SIZE);
+
 inline void
-SpawnServerConnection::FlushExecCompleteQueue()
+SpawnServerConnection::FlushExecCompleteQueue(OutputBatch &output)
 {
-	if (exec_complete_queue.empty())
-		return;
+	while (!exec_complete_queue.empty() &&
+	       output.size() < output.max_size() - STATS_DATAGRAMS) {
+		auto &s = output.emplace_back(ResponseCommand::EXEC_COMPLETE);
 
-	Serializer s{ResponseCommand::EXEC_COMPLETE};
+		while (!exec_complete_queue.empty()) {
+			const auto &i = exec_complete_queue.front();
+			const std::string_view error =
+				std::string_view{i.error}.substr(0, MAX_ERROR_LENGTH);
 
-	for (std::size_t n = 0; n < 64 && !exec_complete_queue.empty(); ++n) {
-		const auto &i = exec_complete_queue.front();
-		s.WriteUnsigned(i.id);
-		s.WriteT(i.duration);
-		s.WriteString(i.error);
-		exec_complete_queue.pop_front();
-	}
+			if (s.GetRemaining() < sizeof(i.id) + sizeof(i.duration) +
+			    error.size() + 1)
+				break;
 
-	::Send<1>(socket, s);
+			s.WriteUnsigned(i.id);
+			s.WriteT(i.duration);
+			s.WriteString(error);
+			exec_complete_queue.pop_front();
+		}
+	}
 }
 
 inline void
-SpawnServerConnection::FlushExitQueue()
+SpawnServerConnection::FlushExitQueue(OutputBatch &output)
 {
-	if (exit_queue.empty())
-		return;
+	while (!exit_queue.empty() &&
+	       output.size() < output.max_size() - STATS_DATAGRAMS) {
+		auto &s = output.emplace_back(ResponseCommand::EXIT);
 
-	Serializer s(ResponseCommand::EXIT);
+		while (!exit_queue.empty() &&
+		       s.GetRemaining() >= sizeof(ExitQueueItem::id) +
+		       sizeof(ExitQueueItem::status)) {
+			const auto &i = exit_queue.front();
 
-	for (std::size_t n = 0; n < 64 && !exit_queue.empty(); ++n) {
-		const auto &i = exit_queue.front();
+			s.WriteUnsigned(i.id);
+			s.WriteInt(i.status);
 
-		s.WriteUnsigned(i.id);
-		s.WriteInt(i.status);
-
-		exit_queue.pop_front();
+			exit_queue.pop_front();
+		}
 	}
-
-	::Send<1>(socket, s);
 }
 
 inline void
 SpawnServerConnection::FlushOutput()
 {
-	FlushExecCompleteQueue();
-	FlushExitQueue();
+	OutputBatch output;
+
+	FlushExecCompleteQueue(output);
+	FlushExitQueue(output);
 
 	if (const auto now = GetEventLoop().SteadyNow(); now >= next_stats_send) {
 		next_stats_send = now + std::chrono::milliseconds{200};
-		Serializer s(ResponseCommand::TERMINATOR_STATS);
+		auto &s = output.emplace_back(ResponseCommand::TERMINATOR_STATS);
 		s.WriteT(process.GetChildProcessTerminator().GetStats());
-		::Send<1>(socket, s);
+
+		if (const auto &workers = process.GetWorkers(); !workers.empty()) {
+			auto &ws = output.emplace_back(ResponseCommand::WORKER_STATS);
+			for (const auto &i : workers)
+				ws.WriteT(i.GetStats());
+		}
+
+		if (const auto &zygote_cache = process.GetZygoteCache()) {
+			auto &zs = output.emplace_back(ResponseCommand::ZYGOTE_STATS);
+			zs.WriteT(zygote_cache->GetStats());
+		}
 	}
+
+	if (!output.empty())
+		SendMulti(socket, output);
 }
 
 inline void
@@ -0,0 +1,443 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "ServerExec.hxx"
+#include "IProtocol.hxx"
+#include "ZygoteCache.hxx"
+#include "spawn/config.h"
+
+using namespace Spawn;
+
+static void
+Read(Payload &payload, ResourceLimits &rlimits)
+{
+	unsigned i = (unsigned)payload.ReadByte();
+	struct rlimit &data = rlimits.values[i];
+	payload.ReadT(data);
+}
+
+static void
+Read(Payload &payload, UidGid &uid_gid)
+{
+	payload.ReadT(uid_gid.real_uid);
+	payload.ReadT(uid_gid.real_gid);
+	payload.ReadT(uid_gid.effective_uid);
+	payload.ReadT(uid_gid.effective_gid);
+
+	const size_t n_groups = (std::size_t)payload.ReadByte();
+	if (n_groups > uid_gid.supplementary_groups.max_size())
+		throw MalformedPayloadError();
+
+	for (size_t i = 0; i < n_groups; ++i)
+		payload.ReadT(uid_gid.supplementary_groups[i]);
+
+	if (n_groups < uid_gid.supplementary_groups.max_size())
+		uid_gid.supplementary_groups[n_groups] = UidGid::UNSET_GID;
+}
+
+void
+ParseExecCommands(Payload payload, SpawnServerExec &request,
+		  SpawnZygoteKey *zygote_key)
+{
+	auto &fds = request.fds;
+	auto &p = request.p;
+	auto &cgroup = request.cgroup;
+
+	auto mount_tail = p.ns.mount.mounts.before_begin();
+
+	auto &mounts = request.mounts;
+	auto &assignments = request.assignments;
+
+	while (!payload.empty()) {
+		const auto rest = payload.GetRest();
+		const ExecCommand cmd = static_cast<ExecCommand>(payload.ReadByte());
+		switch (cmd) {
+		case ExecCommand::EXEC_FUNCTION:
+			payload.ReadT(p.exec_function);
+			break;
+
+		case ExecCommand::EXEC_PATH:
+			p.exec_path = payload.ReadString();
+			break;
+
+		case ExecCommand::EXEC_FD:
+			p.exec_fd = fds.Borrow();
+			break;
+
+		case ExecCommand::ARG:
+			if (p.args.size() >= 16384)
+				throw MalformedPayloadError();
+
+			p.Append(payload.ReadString());
+			break;
+
+		case ExecCommand::SETENV:
+			if (p.env.size() >= 16384)
+				throw MalformedPayloadError();
+
+			p.PutEnv(payload.ReadString());
+			break;
+
+		case ExecCommand::UMASK:
+			{
+				uint16_t value;
+				payload.ReadT(value);
+				p.umask = value;
+			}
+
+			break;
+
+		case ExecCommand::STDIN:
+			p.stdin_fd = fds.Borrow();
+			break;
+
+		case ExecCommand::STDOUT:
+			p.stdout_fd = fds.Borrow();
+			break;
+
+		case ExecCommand::STDOUT_IS_STDIN:
+			p.stdout_fd = p.stdin_fd;
+			break;
+
+		case ExecCommand::STDERR:
+			p.stderr_fd = fds.Borrow();
+			break;
+
+		case ExecCommand::STDERR_IS_STDIN:
+			p.stderr_fd = p.stdin_fd;
+			break;
+
+		case ExecCommand::STDERR_PATH:
+			p.stderr_path = payload.ReadString();
+			break;
+
+		case ExecCommand::RETURN_STDERR:
+			p.return_stderr = UniqueSocketDescriptor{fds.Get()};
+			break;
+
+		case ExecCommand::RETURN_PIDFD:
+			p.return_pidfd = UniqueSocketDescriptor{fds.Get()};
+			break;
+
+		case ExecCommand::RETURN_CGROUP:
+			p.return_cgroup = UniqueSocketDescriptor{fds.Get()};
+			break;
+
+		case ExecCommand::CONTROL:
+			p.control_fd = fds.Borrow();
+			break;
+
+		case ExecCommand::TTY:
+			p.tty = true;
+			break;
+
+		case ExecCommand::USER_NS:
+			p.ns.user.create = true;
+			break;
+
+		case ExecCommand::USER_NS_LIMITS:
+			payload.ReadT(p.ns.user.limits);
+			break;
+
+		case ExecCommand::PID_NS:
+			payload.ReadT(p.ns.pid.mode);
+			switch (p.ns.pid.mode) {
+			case PidNamespaceOptions::Mode::DISABLED:
+			case PidNamespaceOptions::Mode::ANONYMOUS:
+				break;
+
+			case PidNamespaceOptions::Mode::ACCESSORY:
+				p.ns.pid.name = payload.ReadString();
+				break;
+			}
+
+			break;
+
+		case ExecCommand::PID_NS_FD:
+			p.ns.pid.fd = fds.Borrow();
+			break;
+
+		case ExecCommand::CGROUP_NS:
+			p.ns.enable_cgroup = true;
+			break;
+
+		case ExecCommand::NETWORK_NS:
+			p.ns.enable_network = true;
+			break;
+
+		case ExecCommand::NETWORK_NS_NAME:
+			p.ns.network_namespace_name = payload.ReadString();
+			break;
+
+		case ExecCommand::IPC_NS:
+			p.ns.enable_ipc = true;
+			break;
+
+		case ExecCommand::MOUNT_PROC:
+			p.ns.mount.mount_proc = true;
+			break;
+
+		case ExecCommand::WRITABLE_PROC:
+			p.ns.mount.writable_proc = true;
+			break;
+
+		case ExecCommand::MOUNT_DEV:
+			p.ns.mount.mount_dev = true;
+			break;
+
+		case ExecCommand::MOUNT_PTS:
+			p.ns.mount.mount_pts = true;
+			break;
+
+		case ExecCommand::BIND_MOUNT_PTS:
+			p.ns.mount.bind_mount_pts = true;
+			break;
+
+		case ExecCommand::PIVOT_ROOT:
+			p.ns.mount.pivot_root = payload.ReadString();
+			break;
+
+		case ExecCommand::MOUNT_ROOT_TMPFS:
+			p.ns.mount.mount_root_tmpfs = true;
+			break;
+
+		case ExecCommand::MOUNT_TMP_TMPFS:
+			p.ns.mount.mount_tmp_tmpfs = payload.ReadString();
+			p.ns.mount.mount_tmp_tmpfs_exec = payload.ReadBool();
+			break;
+
+		case ExecCommand::MOUNT_TMPFS:
+			{
+				const char *target = payload.ReadString();
+				bool writable = payload.ReadBool();
+				mounts.emplace_front(Mount::Tmpfs{}, target,
+						     writable);
+			}
+
+			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
+								    mounts.front());
+			break;
+
+		case ExecCommand::MOUNT_NAMED_TMPFS:
+			{
+				const char *source = payload.ReadString();
+				const char *target = payload.ReadString();
+				bool writable = payload.ReadBool();
+				mounts.emplace_front(Mount::NamedTmpfs{},
+						     source, target,
+						     writable);
+			}
+
+			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
+								    mounts.front());
+			break;
+
+		case ExecCommand::BIND_MOUNT:
+			{
+				const char *source = payload.ReadString();
+				const char *target = payload.ReadString();
+				bool writable = payload.ReadBool();
+				bool exec = payload.ReadBool();
+				mounts.emplace_front(source, target,
+						     writable, exec);
+				mounts.front().optional = payload.ReadBool();
+			}
+
+			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
+								    mounts.front());
+			break;
+
+		case ExecCommand::BIND_MOUNT_FILE:
+			{
+				const char *source = payload.ReadString();
+				const char *target = payload.ReadString();
+				mounts.emplace_front(source, target);
+				mounts.front().type = Mount::Type::BIND_FILE;
+				mounts.front().exec = payload.ReadBool();
+				mounts.front().optional = payload.ReadBool();
+			}
+
+			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
+								    mounts.front());
+			break;
+
+		case ExecCommand::FD_BIND_MOUNT:
+			{
+				const char *target = payload.ReadString();
+				bool writable = payload.ReadBool();
+				bool exec = payload.ReadBool();
+				mounts.emplace_front(nullptr, target,
+						     writable, exec);
+				mounts.front().source_fd = fds.Borrow();
+				mounts.front().optional = payload.ReadBool();
+			}
+
+			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
+								    mounts.front());
+			break;
+
+		case ExecCommand::FD_BIND_MOUNT_FILE:
+			{
+				const char *target = payload.ReadString();
+				mounts.emplace_front(nullptr, target);
+				mounts.front().type = Mount::Type::BIND_FILE;
+				mounts.front().source_fd = fds.Borrow();
+				mounts.front().exec = payload.ReadBool();
+				mounts.front().optional = payload.ReadBool();
+			}
+
+			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
+								    mounts.front());
+			break;
+
+		case ExecCommand::WRITE_FILE:
+			{
+				const char *path = payload.ReadString();
+				const char *contents = payload.ReadString();
+				mounts.emplace_front(Mount::WriteFile{},
+						     path, contents);
+				mounts.front().optional = payload.ReadBool();
+			}
+
+			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
+								    mounts.front());
+			break;
+
+		case ExecCommand::SYMLINK:
+			{
+				const char *target = payload.ReadString();
+				const char *source = payload.ReadString();
+				mounts.emplace_front(source, target);
+				mounts.front().type = Mount::Type::SYMLINK;
+			}
+
+			mount_tail = p.ns.mount.mounts.insert_after(mount_tail,
+								    mounts.front());
+			break;
+
+		case ExecCommand::DIR_MODE:
+			payload.ReadT(p.ns.mount.dir_mode);
+			break;
+
+		case ExecCommand::HOSTNAME:
+			p.ns.hostname = payload.ReadString();
+			break;
+
+		case ExecCommand::RLIMIT:
+			Read(payload, p.rlimits);
+			break;
+
+		case ExecCommand::UID_GID:
+			Read(payload, p.uid_gid);
+			break;
+
+		case ExecCommand::MAPPED_REAL_UID:
+			payload.ReadT(p.ns.user.mapped_real_uid);
+			break;
+
+		case ExecCommand::MAPPED_EFFECTIVE_UID:
+			payload.ReadT(p.ns.user.mapped_effective_uid);
+			break;
+
+		case ExecCommand::SIGKILL_:
+			p.sigkill = true;
+			break;
+
+		case ExecCommand::SCHED_IDLE_:
+			p.sched_idle = true;
+			break;
+
+		case ExecCommand::IOPRIO_IDLE:
+			p.ioprio_idle = true;
+			break;
+
+#ifdef HAVE_LIBSECCOMP
+		case ExecCommand::ALLOW_PTRACE:
+			p.allow_ptrace = true;
+			break;
+
+		case ExecCommand::FORBID_USER_NS:
+			p.forbid_user_ns = true;
+			break;
+
+		case ExecCommand::FORBID_MULTICAST:
+			p.forbid_multicast = true;
+			break;
+
+		case ExecCommand::FORBID_BIND:
+			p.forbid_bind = true;
+			break;
+#endif // HAVE_LIBSECCOMP
+
+#ifdef HAVE_LIBCAP
+		case ExecCommand::CAP_SYS_RESOURCE:
+			p.cap_sys_resource = true;
+			break;
+#endif // HAVE_LIBCAP
+
+		case ExecCommand::NO_NEW_PRIVS:
+			p.no_new_privs = true;
+			break;
+
+		case ExecCommand::CGROUP:
+			if (p.cgroup != nullptr)
+				throw MalformedPayloadError();
+
+			cgroup.name = payload.ReadString();
+			p.cgroup = &cgroup;
+			break;
+
+		case ExecCommand::CGROUP_SESSION:
+			if (p.cgroup == nullptr)
+				throw MalformedPayloadError();
+
+			p.cgroup_session = payload.ReadString();
+			break;
+
+		case ExecCommand::CGROUP_SET:
+			if (p.cgroup != nullptr) {
+				const char *set_name = payload.ReadString();
+				const char *set_value = payload.ReadString();
+
+				assignments.emplace_front(set_name, set_value);
+				auto &set = assignments.front();
+				cgroup.set.Add(set);
+			} else
+				throw MalformedPayloadError();
+
+			break;
+
+		case ExecCommand::CGROUP_XATTR:
+			if (p.cgroup != nullptr) {
+				const char *_name = payload.ReadString();
+				const char *_value = payload.ReadString();
+
+				assignments.emplace_front(_name, _value);
+				cgroup.xattr.Add(assignments.front());
+			} else
+				throw MalformedPayloadError();
+
+			break;
+
+		case ExecCommand::PRIORITY:
+			payload.ReadInt(p.priority);
+			break;
+
+		case ExecCommand::CHROOT:
+			p.chroot = payload.ReadString();
+			break;
+
+		case ExecCommand::CHDIR:
+			p.chdir = payload.ReadString();
+			break;
+
+		case ExecCommand::HOOK_INFO:
+			p.hook_info = payload.ReadString();
+			break;
+		}
+
+		if (zygote_key != nullptr)
+			zygote_key->Add(cmd, rest.first(rest.size() - payload.GetSize()));
+	}
+}
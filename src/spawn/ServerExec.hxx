@@ -0,0 +1,132 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "Parser.hxx"
+#include "Prepared.hxx"
+#include "CgroupOptions.hxx"
+#include "Mount.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+
+#include <cstddef>
+#include <forward_list>
+#include <memory>
+#include <span>
+#include <vector>
+
+class SpawnZygoteKey;
+
+class SpawnFdList {
+	std::vector<UniqueFileDescriptor> v;
+	decltype(v)::iterator i;
+
+public:
+	SpawnFdList(std::vector<UniqueFileDescriptor> &&_v) noexcept
+		:v(std::move(_v)),
+		 i(v.begin()) {}
+
+	SpawnFdList(SpawnFdList &&src) = default;
+
+	SpawnFdList &operator=(SpawnFdList &&src) = default;
+
+	bool IsEmpty() noexcept {
+		return i == v.end();
+	}
+
+	size_t size() const noexcept {
+		return v.size();
+	}
+
+	/**
+	 * Returns a copy of all file descriptors in their original
+	 * order.  Call this before consuming any of them.
+	 */
+	std::vector<FileDescriptor> GetAll() const noexcept {
+		return {v.begin(), v.end()};
+	}
+
+	UniqueFileDescriptor Get() {
+		if (IsEmpty())
+			throw Spawn::MalformedPayloadError();
+
+		return std::move(*i++);
+	}
+
+	UniqueSocketDescriptor GetSocket() {
+		return UniqueSocketDescriptor{Get()};
+	}
+
+	/**
+	 * Like Get(), but does not transfer ownership to the caller.
+	 */
+	FileDescriptor Borrow() {
+		if (IsEmpty())
+			throw Spawn::MalformedPayloadError();
+
+		return *i++;
+	}
+};
+
+/**
+ * A parsed EXEC request.  All strings point into #buffer (a copy of
+ * the datagram payload) and all file descriptors are owned by this
+ * object, so it can outlive the receive buffer, e.g. while it is
+ * queued for a #SpawnServerWorker.
+ */
+struct SpawnServerExec {
+	const std::unique_ptr<std::byte[]> buffer;
+	const std::size_t size;
+
+	SpawnFdList fds;
+
+	/**
+	 * All file descriptors of the request in their original
+	 * order (owned by #fds or #p); used for forwarding the
+	 * request to a #SpawnServerWorker.
+	 */
+	const std::vector<FileDescriptor> raw_fds;
+
+	PreparedChildProcess p;
+	CgroupOptions cgroup;
+
+	std::forward_list<Mount> mounts;
+	std::forward_list<AssignmentList::Item> assignments;
+
+	/**
+	 * File descriptors obtained from the #TmpfsManager.
+	 */
+	std::forward_list<UniqueFileDescriptor> tmpfs_fds;
+
+	SpawnServerExec(std::span<const std::byte> payload,
+			SpawnFdList &&_fds) noexcept
+		:buffer(new std::byte[payload.size()]),
+		 size(payload.size()),
+		 fds(std::move(_fds)),
+		 raw_fds(fds.GetAll())
+	{
+		std::copy(payload.begin(), payload.end(), buffer.get());
+	}
+
+	SpawnServerExec(const SpawnServerExec &) = delete;
+	SpawnServerExec &operator=(const SpawnServerExec &) = delete;
+
+	Spawn::Payload GetPayload() const noexcept {
+		return Spawn::Payload{std::span{buffer.get(), size}};
+	}
+};
+
+/**
+ * Parse the commands of an EXEC request (after the id and the name)
+ * into the given #SpawnServerExec.
+ *
+ * Throws #Spawn::MalformedPayloadError on error.
+ *
+ * @param zygote_key if not nullptr, then the raw commands are added
+ * to this key
+ */
+void
+ParseExecCommands(Spawn::Payload payload, SpawnServerExec &request,
+		  SpawnZygoteKey *zygote_key);
@@ -0,0 +1,574 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "ServerWorker.hxx"
+#include "ServerExec.hxx"
+#include "Config.hxx"
+#include "IProtocol.hxx"
+#include "SeccompCache.hxx"
+#include "event/Loop.hxx"
+#include "net/ReceiveMessage.hxx"
+#include "net/ScmRightsBuilder.hxx"
+#include "net/SendMessage.hxx"
+#include "net/SocketError.hxx"
+#include "net/SocketPair.hxx"
+#include "io/Iovec.hxx"
+#include "io/Logger.hxx"
+#include "co/InvokeTask.hxx"
+#include "co/Task.hxx"
+#include "system/Error.hxx"
+#include "util/DeleteDisposer.hxx"
+#include "util/Exception.hxx"
+#include "util/SpanCast.hxx"
+
+#include <algorithm> // for std::find_if()
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include <signal.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+using namespace Spawn;
+
+/**
+ * The header of a request sent by the spawner to the worker
+ * process.  It is followed by the #template_root_size bytes of
+ * MountNamespaceOptions::template_root and the EXEC payload (without
+ * the command byte).  The file descriptors of the EXEC request are
+ * followed by #n_tmpfs_fds file descriptors from the #TmpfsManager,
+ * one for each NAMED_TMPFS mount.
+ *
+ * Both processes run the same executable, so this struct is sent as
+ * it is.
+ */
+struct SpawnWorkerRequestHeader {
+	unsigned id;
+
+	/**
+	 * The verified #UidGid (with SpawnConfig::default_uid_gid
+	 * applied).
+	 */
+	UidGid uid_gid;
+
+	uint16_t template_root_size;
+
+	uint8_t n_tmpfs_fds;
+
+	uint8_t reserved;
+};
+
+/**
+ * The header of a response sent by the worker process.  It is
+ * followed by the error message; if there is none, then the first
+ * file descriptor is the pidfd, optionally followed by the session
+ * cgroup and the accessory lease pipe.
+ */
+struct SpawnWorkerResponseHeader {
+	unsigned id;
+
+	pid_t pid;
+
+	uint8_t has_session_cgroup_fd, has_accessory_lease_pipe;
+
+	uint8_t reserved[2];
+};
+
+static constexpr std::size_t MAX_WORKER_ERROR_LENGTH = 512;
+
+static constexpr std::size_t MAX_WORKER_REQUEST_SIZE =
+	sizeof(SpawnWorkerRequestHeader) + 4096 + MAX_DATAGRAM_SIZE;
+
+static constexpr std::size_t MAX_WORKER_RESPONSE_SIZE =
+	sizeof(SpawnWorkerResponseHeader) + MAX_WORKER_ERROR_LENGTH;
+
+/**
+ * The worker process side of #SpawnServerWorker.
+ */
+class SpawnWorkerProcess {
+	const SpawnConfig &config;
+	const CgroupState &cgroup_state;
+	const bool is_sys_admin;
+
+	const LLogger logger{"spawn-worker"};
+
+	EventLoop event_loop;
+
+	SeccompProgramCache seccomp_cache;
+
+	UniqueSocketDescriptor socket;
+	SocketEvent event;
+
+	class Job;
+	using JobList = IntrusiveList<Job>;
+	JobList jobs;
+
+	ReceiveMessageBuffer<MAX_WORKER_REQUEST_SIZE,
+			     sizeof(int) * SpawnServerWorker::MAX_FDS> receive_buffer;
+
+public:
+	SpawnWorkerProcess(const SpawnConfig &_config,
+			   const CgroupState &_cgroup_state,
+			   bool _is_sys_admin,
+			   UniqueSocketDescriptor &&_socket) noexcept
+		:config(_config), cgroup_state(_cgroup_state),
+		 is_sys_admin(_is_sys_admin),
+		 socket(std::move(_socket)),
+		 event(event_loop, BIND_THIS_METHOD(OnSocketReady), socket)
+	{
+		event.ScheduleRead();
+	}
+
+	~SpawnWorkerProcess() noexcept {
+		jobs.clear_and_dispose(DeleteDisposer{});
+	}
+
+	void Run() noexcept {
+		event_loop.Run();
+	}
+
+private:
+	void HandleRequest(std::span<const std::byte> payload,
+			   std::vector<UniqueFileDescriptor> &&fds);
+
+	void SendResponse(unsigned id, const SpawnChildProcessResult &result,
+			  std::string_view error);
+
+	void OnJobComplete(Job &job, std::exception_ptr error) noexcept;
+
+	void OnSocketReady(unsigned events) noexcept;
+};
+
+class SpawnWorkerProcess::Job final
+	: public IntrusiveListHook<IntrusiveHookMode::NORMAL>
+{
+	SpawnWorkerProcess &process;
+
+public:
+	const unsigned id;
+
+	/**
+	 * Owns the data referenced by the task.
+	 */
+	SpawnServerExec exec;
+
+	std::string template_root;
+
+private:
+	Co::InvokeTask invoke_task;
+
+public:
+	SpawnChildProcessResult result;
+
+	Job(SpawnWorkerProcess &_process, unsigned _id,
+	    std::span<const std::byte> payload,
+	    std::vector<UniqueFileDescriptor> &&fds) noexcept
+		:process(_process), id(_id),
+		 exec(payload, std::move(fds)) {}
+
+	~Job() noexcept {
+		/* the task references data owned by #exec */
+		invoke_task = {};
+	}
+
+	void Start(Co::Task<SpawnChildProcessResult> &&task) noexcept {
+		invoke_task = Await(std::move(task));
+		invoke_task.Start(BIND_THIS_METHOD(OnCompletion));
+	}
+
+private:
+	Co::InvokeTask Await(Co::Task<SpawnChildProcessResult> task) {
+		result = co_await task;
+	}
+
+	void OnCompletion(std::exception_ptr &&error) noexcept {
+		process.OnJobComplete(*this, std::move(error));
+	}
+};
+
+inline void
+SpawnWorkerProcess::HandleRequest(std::span<const std::byte> payload,
+				  std::vector<UniqueFileDescriptor> &&fds)
+{
+	Payload p{payload};
+
+	SpawnWorkerRequestHeader header;
+	p.ReadT(header);
+	const auto template_root = p.ReadSpan(header.template_root_size);
+
+	auto *job = new Job(*this, header.id, p.GetRest(), std::move(fds));
+	jobs.push_back(*job);
+
+	try {
+		auto &exec = job->exec;
+		auto exec_payload = exec.GetPayload();
+
+		unsigned exec_id;
+		exec_payload.ReadUnsigned(exec_id);
+		exec_payload.ReadStringView();
+
+		ParseExecCommands(exec_payload, exec, nullptr);
+
+		/* the remaining file descriptors were obtained from
+		   the spawner's #TmpfsManager */
+		if (header.n_tmpfs_fds > 0) {
+			for (auto &i : exec.p.ns.mount.mounts)
+				if (i.type == Mount::Type::NAMED_TMPFS)
+					i.source_fd = exec.fds.Borrow();
+		}
+
+		if (!exec.fds.IsEmpty())
+			throw MalformedPayloadError{};
+
+		exec.p.uid_gid = header.uid_gid;
+
+		if (!template_root.empty()) {
+			job->template_root = ToStringView(template_root);
+			exec.p.ns.mount.template_root = job->template_root.c_str();
+		}
+
+		/* make the new child process a child of the spawner */
+		exec.p.clone_parent = true;
+
+		job->Start(SpawnChildProcess(event_loop, std::move(exec.p),
+					     cgroup_state, seccomp_cache,
+					     config.cgroups_writable_by_gid > 0,
+					     is_sys_admin));
+	} catch (const MalformedPayloadError &) {
+		OnJobComplete(*job, std::make_exception_ptr(std::runtime_error{"Malformed spawn worker request"}));
+	} catch (...) {
+		OnJobComplete(*job, std::current_exception());
+	}
+}
+
+inline void
+SpawnWorkerProcess::SendResponse(unsigned id,
+				 const SpawnChildProcessResult &result,
+				 std::string_view error)
+{
+	const bool success = error.empty();
+	const SpawnWorkerResponseHeader header{
+		.id = id,
+		.pid = success ? result.pid : -1,
+		.has_session_cgroup_fd = success && result.session_cgroup_fd.IsDefined(),
+		.has_accessory_lease_pipe = success && result.accessory_lease_pipe.IsDefined(),
+		.reserved = {},
+	};
+
+	error = error.substr(0, MAX_WORKER_ERROR_LENGTH);
+
+	const std::array vec{
+		MakeIovecT(header),
+		MakeIovec(AsBytes(error)),
+	};
+
+	MessageHeader msg{std::span{vec}};
+
+	ScmRightsBuilder<3> b(msg);
+	if (success) {
+		b.push_back(result.pidfd.Get());
+		if (header.has_session_cgroup_fd)
+			b.push_back(result.session_cgroup_fd.Get());
+		if (header.has_accessory_lease_pipe)
+			b.push_back(result.accessory_lease_pipe.Get());
+	}
+	b.Finish(msg);
+
+	/* this is a blocking socket; the spawner never blocks on
+	   sending to us, so it will eventually receive this */
+	SendMessage(socket, msg, MSG_NOSIGNAL);
+}
+
+void
+SpawnWorkerProcess::OnJobComplete(Job &job, std::exception_ptr error) noexcept
+{
+	try {
+		SendResponse(job.id, job.result,
+			     error ? GetFullMessage(std::move(error)) : std::string{});
+	} catch (...) {
+		/* the spawner is gone */
+		logger(1, std::current_exception());
+		event_loop.Break();
+	}
+
+	jobs.erase_and_dispose(jobs.iterator_to(job), DeleteDisposer{});
+}
+
+void
+SpawnWorkerProcess::OnSocketReady(unsigned events) noexcept
+try {
+	if (events & (SocketEvent::ERROR|SocketEvent::HANGUP)) {
+		/* the spawner has exited */
+		event_loop.Break();
+		return;
+	}
+
+	auto d = ReceiveMessage(socket, receive_buffer, MSG_DONTWAIT);
+	if (d.payload.empty()) {
+		event_loop.Break();
+		return;
+	}
+
+	HandleRequest(d.payload, std::move(d.fds));
+} catch (...) {
+	logger(1, std::current_exception());
+	event_loop.Break();
+}
+
+[[noreturn]]
+static void
+RunSpawnWorkerProcess(const SpawnConfig &config,
+		      const CgroupState &cgroup_state,
+		      bool is_sys_admin,
+		      UniqueSocketDescriptor &&socket) noexcept
+{
+	/* if the spawner gets killed, don't linger */
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+	{
+		SpawnWorkerProcess process{config, cgroup_state, is_sys_admin,
+					   std::move(socket)};
+		process.Run();
+	}
+
+	_exit(EXIT_SUCCESS);
+}
+
+SpawnServerWorker::Request::Request(const SpawnServerExec &exec)
+	:fds(exec.raw_fds)
+{
+	const auto &p = exec.p;
+
+	for (const auto &i : p.ns.mount.mounts)
+		if (i.type == Mount::Type::NAMED_TMPFS &&
+		    i.source_fd.IsDefined())
+			fds.push_back(i.source_fd);
+
+	if (fds.size() > MAX_FDS)
+		throw std::runtime_error{"Too many file descriptors"};
+
+	const std::string_view template_root =
+		p.ns.mount.template_root != nullptr
+		? std::string_view{p.ns.mount.template_root}
+		: std::string_view{};
+
+	const auto exec_payload = std::span{exec.buffer.get(), exec.size};
+
+	const SpawnWorkerRequestHeader header{
+		.id = 0, // filled in by Submit()
+		.uid_gid = p.uid_gid,
+		.template_root_size = static_cast<uint16_t>(template_root.size()),
+		.n_tmpfs_fds = static_cast<uint8_t>(fds.size() - exec.raw_fds.size()),
+		.reserved = 0,
+	};
+
+	const std::size_t size = sizeof(header) + template_root.size() +
+		exec_payload.size();
+	if (size > MAX_WORKER_REQUEST_SIZE)
+		throw std::runtime_error{"Spawn request too large"};
+
+	payload.reserve(size);
+	const auto header_bytes = ReferenceAsBytes(header);
+	payload.insert(payload.end(), header_bytes.begin(), header_bytes.end());
+	const auto template_root_bytes = AsBytes(template_root);
+	payload.insert(payload.end(), template_root_bytes.begin(),
+		       template_root_bytes.end());
+	payload.insert(payload.end(), exec_payload.begin(), exec_payload.end());
+}
+
+SpawnServerWorker::SpawnServerWorker(EventLoop &event_loop,
+				     IdleCallback _idle_callback,
+				     const SpawnConfig &config,
+				     const CgroupState &cgroup_state,
+				     bool is_sys_admin)
+	:event(event_loop, BIND_THIS_METHOD(OnSocketReady)),
+	 idle_callback(_idle_callback)
+{
+	auto [spawner_socket, worker_socket] = CreateSocketPair(SOCK_SEQPACKET);
+
+	const pid_t pid = fork();
+	if (pid < 0)
+		throw MakeErrno("fork() failed");
+
+	if (pid == 0) {
+		spawner_socket.Close();
+		RunSpawnWorkerProcess(config, cgroup_state, is_sys_admin,
+				      std::move(worker_socket));
+	}
+
+	/* the worker process gets reaped by the #ZombieReaper after
+	   it has exited */
+
+	socket = std::move(spawner_socket);
+	socket.SetNonBlocking();
+	event.Open(socket);
+	event.ScheduleRead();
+}
+
+SpawnServerWorker::~SpawnServerWorker() noexcept
+{
+	event.Cancel();
+
+	if (socket.IsDefined())
+		/* this makes the worker process exit even if later
+		   worker processes have inherited a copy of this
+		   socket */
+		socket.Shutdown();
+
+	queue.clear_and_dispose(DeleteDisposer{});
+	running.clear_and_dispose(DeleteDisposer{});
+}
+
+void
+SpawnServerWorker::Submit(Job &job, Request &&request) noexcept
+{
+	assert(IsAlive());
+
+	job.id = ++last_id;
+	job.request = std::move(request);
+
+	/* patch the job id into the SpawnWorkerRequestHeader */
+	memcpy(job.request.payload.data() + offsetof(SpawnWorkerRequestHeader, id),
+	       &job.id, sizeof(job.id));
+
+	++n_pending;
+
+	const bool was_empty = queue.empty();
+	queue.push_back(job);
+
+	if (was_empty)
+		event.ScheduleWrite();
+}
+
+inline void
+SpawnServerWorker::FlushQueue()
+{
+	while (!queue.empty()) {
+		auto &job = queue.front();
+
+		const std::array vec{MakeIovec(job.request.payload)};
+		MessageHeader msg{std::span{vec}};
+
+		ScmRightsBuilder<MAX_FDS> b(msg);
+		for (const auto &i : job.request.fds)
+			b.push_back(i.Get());
+		b.Finish(msg);
+
+		if (socket.Send(msg, MSG_DONTWAIT|MSG_NOSIGNAL) < 0) {
+			const auto e = GetSocketError();
+			if (IsSocketErrorSendWouldBlock(e))
+				return;
+
+			throw MakeSocketError(e, "Failed to send to spawn worker");
+		}
+
+		queue.pop_front();
+		running.push_back(job);
+
+		/* the payload is not needed anymore */
+		job.request = {};
+	}
+
+	event.CancelWrite();
+}
+
+inline void
+SpawnServerWorker::Complete(Job &job) noexcept
+{
+	--n_pending;
+	++n_spawned;
+
+	job.OnSpawnJobComplete();
+
+	if (n_pending == 0)
+		idle_callback();
+}
+
+inline bool
+SpawnServerWorker::ReceiveResponse()
+{
+	ReceiveMessageBuffer<MAX_WORKER_RESPONSE_SIZE, sizeof(int) * 3> buffer;
+	auto d = ReceiveMessage(socket, buffer, MSG_DONTWAIT);
+	if (d.payload.empty())
+		return false;
+
+	Payload payload{d.payload};
+	SpawnWorkerResponseHeader header;
+	payload.ReadT(header);
+
+	/* responses arrive roughly in submission order, so this
+	   linear search is cheap */
+	auto i = std::find_if(running.begin(), running.end(), [&header](const Job &job){
+		return job.id == header.id;
+	});
+	if (i == running.end())
+		throw std::runtime_error{"Unexpected response from spawn worker"};
+
+	auto &job = *i;
+	running.erase(i);
+
+	auto fds = d.fds.begin();
+	const auto next_fd = [&d, &fds](){
+		if (fds == d.fds.end())
+			throw MalformedPayloadError{};
+		return std::move(*fds++);
+	};
+
+	try {
+		if (!payload.empty())
+			throw std::runtime_error{std::string{ToStringView(payload.GetRest())}};
+
+		job.result.pidfd = next_fd();
+		job.result.pid = header.pid;
+
+		if (header.has_session_cgroup_fd)
+			job.result.session_cgroup_fd = next_fd();
+
+		if (header.has_accessory_lease_pipe)
+			job.result.accessory_lease_pipe = next_fd();
+	} catch (const MalformedPayloadError &) {
+		job.error = std::make_exception_ptr(std::runtime_error{"Malformed response from spawn worker"});
+	} catch (...) {
+		job.error = std::current_exception();
+	}
+
+	Complete(job);
+	return true;
+}
+
+void
+SpawnServerWorker::Abandon(std::exception_ptr e) noexcept
+{
+	event.Cancel();
+	socket.Close();
+
+	queue.splice(queue.end(), running);
+
+	while (!queue.empty()) {
+		auto &job = queue.pop_front();
+		job.error = e;
+		Complete(job);
+	}
+}
+
+void
+SpawnServerWorker::OnSocketReady(unsigned events) noexcept
+try {
+	if (events & SocketEvent::ERROR)
+		throw MakeSocketError(socket.GetError(), "Spawn worker socket error");
+
+	if (events & SocketEvent::READ) {
+		if (!ReceiveResponse())
+			throw std::runtime_error{"Spawn worker has exited"};
+	} else if (events & SocketEvent::HANGUP)
+		throw std::runtime_error{"Spawn worker has exited"};
+
+	if (events & SocketEvent::WRITE)
+		FlushQueue();
+} catch (...) {
+	LLogger{"spawn"}(1, std::current_exception());
+	Abandon(std::current_exception());
+}
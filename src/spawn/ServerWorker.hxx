@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "Direct.hxx"
+#include "Stats.hxx"
+#include "event/SocketEvent.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "util/BindMethod.hxx"
+#include "util/IntrusiveList.hxx"
+
+#include <cstddef>
+#include <exception>
+#include <vector>
+
+struct SpawnConfig;
+struct CgroupState;
+struct SpawnServerExec;
+
+/**
+ * A process forked by the spawner which runs SpawnChildProcess()
+ * calls on its behalf, so several child processes can be spawned in
+ * parallel.  Everything else (parsing and verifying requests,
+ * managing child processes, sending responses) remains in the
+ * spawner.
+ *
+ * This is a separate single-threaded process and not a thread,
+ * because the new child process (created with clone() without
+ * CLONE_VM) calls functions which are not async-signal-safe, such as
+ * malloc(); in a multi-threaded process, another thread may be
+ * holding a lock which would never be released in the child.
+ *
+ * The worker process clones with CLONE_PARENT, so the new child
+ * processes are children of the spawner, which can therefore use
+ * waitid() on the pidfds sent back by the worker.
+ */
+class SpawnServerWorker {
+public:
+	/**
+	 * The maximum number of file descriptors per request.
+	 */
+	static constexpr std::size_t MAX_FDS = 64;
+
+	/**
+	 * An EXEC request serialized for the worker process.
+	 */
+	struct Request {
+		std::vector<std::byte> payload;
+
+		/**
+		 * The file descriptors to be sent along with
+		 * #payload; they are owned by the #SpawnServerExec.
+		 */
+		std::vector<FileDescriptor> fds;
+
+		Request() noexcept = default;
+
+		/**
+		 * Serialize the given (already parsed, verified and
+		 * prepared) request.
+		 *
+		 * Throws on error.
+		 */
+		explicit Request(const SpawnServerExec &exec);
+	};
+
+	/**
+	 * One SpawnChildProcess() call.  It is created by the
+	 * spawner, passed to Submit() and then handed back via
+	 * OnSpawnJobComplete().
+	 */
+	class Job : public IntrusiveListHook<IntrusiveHookMode::NORMAL> {
+		friend class SpawnServerWorker;
+
+		unsigned id;
+
+		Request request;
+
+	protected:
+		/**
+		 * The result of SpawnChildProcess(); only valid
+		 * in OnSpawnJobComplete() if #error is not set.
+		 */
+		SpawnChildProcessResult result;
+
+		std::exception_ptr error;
+
+	public:
+		Job() noexcept = default;
+		virtual ~Job() noexcept = default;
+
+		Job(const Job &) = delete;
+		Job &operator=(const Job &) = delete;
+
+		/**
+		 * SpawnChildProcess() has finished (successfully or
+		 * not).  The method is responsible for deleting this
+		 * object.
+		 */
+		virtual void OnSpawnJobComplete() noexcept = 0;
+	};
+
+	using IdleCallback = BoundMethod<void() noexcept>;
+
+private:
+	UniqueSocketDescriptor socket;
+	SocketEvent event;
+
+	/**
+	 * Invoked when the last pending job has completed.
+	 */
+	const IdleCallback idle_callback;
+
+	using JobList = IntrusiveList<Job>;
+
+	/**
+	 * Jobs which were submitted, but not yet sent to the worker
+	 * process because its socket buffer was full.
+	 */
+	JobList queue;
+
+	/**
+	 * Jobs which were sent to the worker process and are waiting
+	 * for its response.
+	 */
+	JobList running;
+
+	unsigned last_id = 0;
+
+	/**
+	 * Counters for GetStats().
+	 */
+	uint_least64_t n_pending = 0, n_spawned = 0;
+
+public:
+	/**
+	 * Fork the worker process.  This must be called while the
+	 * spawner is still single-threaded.
+	 *
+	 * Throws on error.
+	 *
+	 * @param event_loop the #EventLoop of the spawner
+	 */
+	SpawnServerWorker(EventLoop &event_loop,
+			  IdleCallback _idle_callback,
+			  const SpawnConfig &config,
+			  const CgroupState &cgroup_state,
+			  bool is_sys_admin);
+
+	/**
+	 * Closes the socket, which makes the worker process exit,
+	 * and deletes all jobs which have not yet completed.  Use
+	 * GetPending() to wait for them before destroying this
+	 * object.
+	 */
+	~SpawnServerWorker() noexcept;
+
+	SpawnServerWorker(const SpawnServerWorker &) = delete;
+	SpawnServerWorker &operator=(const SpawnServerWorker &) = delete;
+
+	/**
+	 * Is the worker process still alive?  If not, no more jobs
+	 * may be submitted.
+	 */
+	bool IsAlive() const noexcept {
+		return socket.IsDefined();
+	}
+
+	/**
+	 * The number of submitted jobs which have not yet completed.
+	 */
+	std::size_t GetPending() const noexcept {
+		return n_pending;
+	}
+
+	SpawnWorkerStats GetStats() const noexcept {
+		return {
+			.pending = n_pending,
+			.spawned = n_spawned,
+		};
+	}
+
+	/**
+	 * Send the request to the worker process.  The job's
+	 * OnSpawnJobComplete() method will be called when the worker
+	 * has finished.
+	 */
+	void Submit(Job &job, Request &&request) noexcept;
+
+private:
+	/**
+	 * Send queued jobs until the socket buffer is full.
+	 *
+	 * Throws on error.
+	 */
+	void FlushQueue();
+
+	/**
+	 * Receive and handle one response from the worker process.
+	 *
+	 * Throws on error.
+	 *
+	 * @return false if the worker process has exited
+	 */
+	bool ReceiveResponse();
+
+	void Complete(Job &job) noexcept;
+
+	/**
+	 * The worker process has exited or its socket has failed;
+	 * fail all pending jobs.
+	 */
+	void Abandon(std::exception_ptr e) noexcept;
+
+	void OnSocketReady(unsigned events) noexcept;
+};
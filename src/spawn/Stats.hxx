@@ -6,6 +6,7 @@
 
 #include <chrono>
 #include <cstdint>
+#include <span>
 
 struct ChildProcessTerminatorStats {
 	/**
@@ -41,6 +42,56 @@ struct ChildProcessTerminatorStats {
 	}
 };
 
+/**
+ * Statistics about one worker process of the spawner (see
+ * SpawnConfig::workers).
+ */
+struct SpawnWorkerStats {
+	/**
+	 * The number of EXEC requests which were passed to this
+	 * worker but have not yet completed (the queue depth).
+	 */
+	uint_least64_t pending;
+
+	/**
+	 * The total number of SpawnChildProcess() calls by this
+	 * worker (including failed ones).
+	 */
+	uint_least64_t spawned;
+};
+
+/**
+ * Statistics about the zygote processes of the spawner (see
+ * SpawnConfig::zygotes).
+ */
+struct SpawnZygoteStats {
+	/**
+	 * The number of child processes which were forked from a
+	 * zygote.
+	 */
+	uint_least64_t hits;
+
+	/**
+	 * The number of zygote-compatible EXEC requests which were
+	 * handled without a zygote, because none was ready.
+	 */
+	uint_least64_t misses;
+
+	/**
+	 * The number of zygote processes which were started.
+	 */
+	uint_least64_t started;
+
+	/**
+	 * An estimate of how much time was saved by forking from a
+	 * zygote: for each hit, the duration of the zygote's own
+	 * setup minus the duration from sending the fork request
+	 * until the new child process has executed its program (the
+	 * zygote's clone() and the asynchronous reply included).
+	 */
+	std::chrono::steady_clock::duration saved_duration;
+};
+
 struct SpawnStats {
 	/**
 	 * The total number of SpawnChildProcess() calls (include
@@ -78,4 +129,10 @@ struct SpawnStats {
 	 * The total duration of all SpawnChildProcess() calls.
 	 */
 	std::chrono::steady_clock::duration total_spawn_duration;
+
+	/**
+	 * Per-worker statistics (empty if the spawner has no worker
+	 * processes).  This is updated periodically by the spawner.
+	 */
+	std::span<const SpawnWorkerStats> workers;
 };
@@ -8,6 +8,7 @@
 #include "event/CoarseTimerEvent.hxx"
 #include "event/Loop.hxx"
 #include "io/Logger.hxx"
+#include "io/UniqueFileDescriptor.hxx"
 
 #include <cassert>
 
@@ -45,6 +46,26 @@ public:
 		kill_timeout_event.Schedule(child_kill_timeout);
 	}
 
+	KilledChildProcess(ChildProcessTerminator &_parent,
+			   EventLoop &event_loop,
+			   UniqueFileDescriptor &&_pidfd,
+			   std::string_view name) noexcept
+		:parent(_parent),
+		 pidfd(std::make_unique<PidfdEvent>(event_loop,
+						    std::move(_pidfd),
+						    name,
+						    static_cast<ExitListener &>(*this))),
+		 kill_timeout_event(event_loop,
+				    BIND_THIS_METHOD(KillTimeoutCallback)),
+		 start_time(event_loop.SteadyNow())
+	{
+		kill_timeout_event.Schedule(child_kill_timeout);
+	}
+
+	bool Kill(int signo) noexcept {
+		return pidfd->Kill(signo);
+	}
+
 	void KillNow() noexcept {
 		pidfd->Kill(SIGKILL);
 	}
@@ -95,3 +116,21 @@ ChildProcessTerminator::Kill(std::unique_ptr<PidfdEvent> pidfd,
 	auto *k = new KilledChildProcess(*this, std::move(pidfd));
 	killed_list.push_back(*k);
 }
+
+void
+ChildProcessTerminator::Kill(EventLoop &event_loop,
+			     UniqueFileDescriptor &&pidfd,
+			     std::string_view name, int signo) noexcept
+{
+	++stats.n_signals;
+
+	auto *k = new KilledChildProcess(*this, event_loop,
+					 std::move(pidfd), name);
+	if (!k->Kill(signo)) {
+		++stats.n_failed_signals;
+		delete k;
+		return;
+	}
+
+	killed_list.push_back(*k);
+}
@@ -8,8 +8,11 @@
 #include "util/IntrusiveList.hxx"
 
 #include <memory>
+#include <string_view>
 
 class PidfdEvent;
+class EventLoop;
+class UniqueFileDescriptor;
 
 /**
  * Manage child process termination.
@@ -39,4 +42,11 @@ public:
 	 */
 	void Kill(std::unique_ptr<PidfdEvent> pidfd,
 		  int signo) noexcept;
+
+	/**
+	 * Like above, but for a child process which has no
+	 * #PidfdEvent yet.
+	 */
+	void Kill(EventLoop &event_loop, UniqueFileDescriptor &&pidfd,
+		  std::string_view name, int signo) noexcept;
 };
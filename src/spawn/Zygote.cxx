@@ -0,0 +1,341 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "Zygote.hxx"
+#include "Direct.hxx"
+#include "ErrorPipe.hxx"
+#include "Prepared.hxx"
+#include "IProtocol.hxx"
+#include "Parser.hxx"
+#include "Builder.hxx"
+#include "lib/fmt/ExceptionFormatter.hxx"
+#include "lib/fmt/SystemError.hxx"
+#include "event/AwaitableSocketEvent.hxx"
+#include "event/co/Timeout.hxx"
+#include "net/ReceiveMessage.hxx"
+#include "net/SocketPair.hxx"
+#include "io/Pipe.hxx"
+#include "system/Error.hxx"
+#include "system/linux/CloseRange.hxx"
+#include "co/Task.hxx"
+#include "util/Exception.hxx"
+#include "util/SpanCast.hxx"
+
+#include <array>
+#include <iterator> // for std::end(), std::next()
+#include <stdexcept>
+
+#include <sched.h> // for clone()
+#include <signal.h>
+#include <stdio.h>
+#include <string.h> // for memcpy()
+#include <unistd.h>
+
+using namespace Spawn;
+
+/**
+ * The zygote's control socket (see PreparedChildProcess::control_fd).
+ */
+static constexpr int CONTROL_FILENO = 3;
+
+/**
+ * How long does the spawner wait for the zygote's reply?
+ */
+static constexpr Event::Duration REPLY_TIMEOUT = std::chrono::seconds{1};
+
+namespace {
+
+/**
+ * A child process forked by the zygote, as received by the spawner.
+ */
+struct SpawnZygoteChild {
+	UniqueFileDescriptor pidfd;
+
+	pid_t pid;
+
+	/**
+	 * The new child process writes an error message to this pipe
+	 * if execve() fails; it gets closed by execve().
+	 */
+	UniqueFileDescriptor error_pipe;
+};
+
+struct ZygoteChild {
+	const char *path;
+	const PreparedChildProcess &p;
+	FileDescriptor error_pipe_w;
+};
+
+} // anonymous namespace
+
+/**
+ * The stack for ZygoteChildMain().  This is not shared with the
+ * zygote, because clone() is called without CLONE_VM; the new child
+ * process writes to its own copy.
+ */
+alignas(16) static std::byte child_stack[64 * 1024];
+
+static void
+CheckedDup2(FileDescriptor oldfd, int newfd) noexcept
+{
+	if (oldfd.IsDefined())
+		oldfd.CheckDuplicate(FileDescriptor{newfd});
+}
+
+static int
+ZygoteChildMain(void *_ctx) noexcept
+{
+	const auto &ctx = *static_cast<const ZygoteChild *>(_ctx);
+	const auto &p = ctx.p;
+
+	try {
+		/* the zygote is already a session leader (if
+		   PreparedChildProcess::session is set), but this
+		   child process gets a session of its own */
+		if (p.session)
+			setsid();
+
+		CheckedDup2(p.stdin_fd, STDIN_FILENO);
+		CheckedDup2(p.stdout_fd, STDOUT_FILENO);
+		CheckedDup2(p.stderr_fd, STDERR_FILENO);
+
+		execve(ctx.path, const_cast<char *const*>(p.args.data()),
+		       const_cast<char *const*>(p.env.data()));
+
+		throw FmtErrno("Failed to execute {:?}", ctx.path);
+	} catch (...) {
+		WriteErrorPipe(ctx.error_pipe_w, {}, std::current_exception());
+	}
+
+	return EXIT_FAILURE;
+}
+
+/**
+ * Parse one request from the spawner, fork a new child process and
+ * send its pidfd (and the read side of its error pipe) to the
+ * spawner.
+ *
+ * Throws on error.
+ *
+ * @param reply the request's reply socket (the first file
+ * descriptor, see SpawnZygote::Fork())
+ */
+static void
+HandleZygoteRequest(SocketDescriptor reply, PreparedChildProcess &p,
+		    Payload payload,
+		    std::span<const UniqueFileDescriptor> fds)
+{
+	if (payload.empty() ||
+	    static_cast<RequestCommand>(payload.ReadByte()) != RequestCommand::EXEC ||
+	    payload.empty() ||
+	    static_cast<ExecCommand>(payload.ReadByte()) != ExecCommand::CONTROL)
+		throw MalformedPayloadError{};
+
+	/* the #PreparedChildProcess which was used to set up this
+	   zygote is recycled for each request; only the per-request
+	   fields are replaced */
+	p.exec_path = nullptr;
+	p.args.clear();
+	p.env.clear();
+	p.stdin_fd.SetUndefined();
+	p.stdout_fd.SetUndefined();
+	p.stderr_fd.SetUndefined();
+
+	/* skip the reply socket */
+	auto fd = std::next(fds.begin());
+	const auto next_fd = [&fd, &fds]{
+		if (fd == fds.end())
+			throw MalformedPayloadError{};
+
+		return FileDescriptor{*fd++};
+	};
+
+	while (!payload.empty()) {
+		const ExecCommand cmd = static_cast<ExecCommand>(payload.ReadByte());
+		switch (cmd) {
+		case ExecCommand::EXEC_PATH:
+			p.exec_path = payload.ReadString();
+			break;
+
+		case ExecCommand::ARG:
+			p.Append(payload.ReadString());
+			break;
+
+		case ExecCommand::SETENV:
+			p.PutEnv(payload.ReadString());
+			break;
+
+		case ExecCommand::STDIN:
+			p.stdin_fd = next_fd();
+			break;
+
+		case ExecCommand::STDOUT:
+			p.stdout_fd = next_fd();
+			break;
+
+		case ExecCommand::STDERR:
+			p.stderr_fd = next_fd();
+			break;
+
+		default:
+			throw MalformedPayloadError{};
+		}
+	}
+
+	if (p.args.empty())
+		throw MalformedPayloadError{};
+
+	const char *path = p.Finish();
+
+	auto [error_pipe_r, error_pipe_w] = CreatePipe();
+
+	const ZygoteChild ctx{path, p, error_pipe_w};
+
+	/* CLONE_PARENT makes the new process a child of the spawner
+	   (our parent), so the spawner can use waitid() on the
+	   pidfd */
+	int _pidfd;
+	const pid_t pid = clone(ZygoteChildMain, std::end(child_stack),
+				CLONE_PARENT|CLONE_PIDFD|SIGCHLD,
+				const_cast<ZygoteChild *>(&ctx), &_pidfd);
+	if (pid < 0)
+		throw MakeErrno("clone() failed");
+
+	const UniqueFileDescriptor pidfd{AdoptTag{}, _pidfd};
+	error_pipe_w.Close();
+
+	const std::array<FileDescriptor, 2> reply_fds{pidfd, error_pipe_r};
+	Send<reply_fds.size()>(reply, ReferenceAsBytes(pid), reply_fds);
+}
+
+int
+RunSpawnZygote(PreparedChildProcess &&p) noexcept
+try {
+	const SocketDescriptor control{CONTROL_FILENO};
+
+	/* don't leak the control socket to child processes */
+	control.EnableCloseOnExec();
+
+	/* this process never calls execve(), therefore O_CLOEXEC
+	   has no effect on the file descriptors inherited from the
+	   spawner; close them all */
+	sys_close_range(CONTROL_FILENO + 1, UINT_MAX, 0);
+
+	/* static because it is too large for the stack */
+	static ReceiveMessageBuffer<MAX_DATAGRAM_SIZE, sizeof(int) * 4> buffer;
+
+	while (true) {
+		const auto d = ReceiveMessage(control, buffer, 0);
+		if (d.payload.empty())
+			/* the spawner has closed the socket */
+			return EXIT_SUCCESS;
+
+		if (d.fds.empty())
+			/* no reply socket: the spawner is broken */
+			throw MalformedPayloadError{};
+
+		const auto reply = SocketDescriptor::FromFileDescriptor(d.fds.front());
+
+		try {
+			HandleZygoteRequest(reply, p, Payload{d.payload}, d.fds);
+		} catch (...) {
+			/* a reply without file descriptors contains
+			   an error message; errors are ignored,
+			   because the spawner may have given up on
+			   this request already (timeout) */
+			const auto msg = GetFullMessage(std::current_exception());
+			(void)reply.Send(AsBytes(msg), MSG_NOSIGNAL);
+		}
+	}
+} catch (...) {
+	fmt::print(stderr, "{}\n", std::current_exception());
+	return EXIT_FAILURE;
+}
+
+UniqueSocketDescriptor
+SpawnZygote::Fork(const PreparedChildProcess &p)
+{
+	if (!socket.IsDefined())
+		return {};
+
+	/* each request gets its own reply socket, so the spawner
+	   does not need to wait for the zygote's reply here, and
+	   concurrent requests cannot mix up their replies */
+	auto [reply_socket, zygote_reply_socket] = CreateSocketPair(SOCK_SEQPACKET);
+
+	Serializer s{RequestCommand::EXEC};
+	s.WriteFd(ExecCommand::CONTROL, zygote_reply_socket.ToFileDescriptor());
+	s.WriteOptionalString(ExecCommand::EXEC_PATH, p.exec_path);
+
+	for (const char *i : p.args)
+		s.WriteString(ExecCommand::ARG, i);
+
+	for (const char *i : p.env)
+		s.WriteString(ExecCommand::SETENV, i);
+
+	s.CheckWriteFd(ExecCommand::STDIN, p.stdin_fd);
+	s.CheckWriteFd(ExecCommand::STDOUT, p.stdout_fd);
+	s.CheckWriteFd(ExecCommand::STDERR, p.stderr_fd);
+
+	try {
+		Send<4>(socket, s);
+	} catch (const std::system_error &e) {
+		if (IsErrno(e, EPIPE) || IsErrno(e, ECONNRESET)) {
+			/* the zygote has exited */
+			socket.Close();
+			return {};
+		}
+
+		throw;
+	}
+
+	return std::move(reply_socket);
+}
+
+/**
+ * Wait for the zygote's reply to a SpawnZygote::Fork() call.
+ *
+ * Throws on error.
+ */
+static Co::Task<SpawnZygoteChild>
+CoReceiveZygoteReply(EventLoop &event_loop, SocketDescriptor reply_socket)
+{
+	/* the zygote replies right after clone(), so the timeout is
+	   only reached if the zygote is stuck */
+	co_await Co::Timeout<AwaitableSocketEvent>{
+		event_loop, REPLY_TIMEOUT,
+		std::in_place, event_loop, reply_socket, SocketEvent::READ,
+	};
+
+	ReceiveMessageBuffer<1024, sizeof(int) * 2> buffer;
+	auto d = ReceiveMessage(reply_socket, buffer, MSG_DONTWAIT);
+	if (d.payload.empty())
+		throw std::runtime_error{"Zygote has exited"};
+
+	if (d.fds.size() != 2 || d.payload.size() != sizeof(pid_t))
+		throw std::runtime_error{std::string{ToStringView(d.payload)}};
+
+	pid_t pid;
+	memcpy(&pid, d.payload.data(), sizeof(pid));
+
+	co_return SpawnZygoteChild{
+		.pidfd = std::move(d.fds[0]),
+		.pid = pid,
+		.error_pipe = std::move(d.fds[1]),
+	};
+}
+
+Co::Task<SpawnChildProcessResult>
+WaitSpawnZygoteChild(EventLoop &event_loop, UniqueSocketDescriptor reply_socket)
+{
+	auto child = co_await CoReceiveZygoteReply(event_loop, reply_socket);
+	reply_socket.Close();
+
+	co_await CoReadErrorPipe(event_loop, child.error_pipe);
+
+	SpawnChildProcessResult result;
+	result.pidfd = std::move(child.pidfd);
+	result.pid = child.pid;
+	co_return result;
+}
@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "net/UniqueSocketDescriptor.hxx"
+#include "util/SharedLease.hxx"
+
+#include <forward_list>
+
+struct PreparedChildProcess;
+struct SpawnChildProcessResult;
+class EventLoop;
+namespace Co { template <typename T> class Task; }
+
+/**
+ * The main function of a zygote process, to be used as
+ * PreparedChildProcess::exec_function.  The #PreparedChildProcess
+ * has been applied to this process already (namespaces, cgroup,
+ * uid/gid, resource limits, system call filter).
+ *
+ * The zygote receives requests from the spawner on the
+ * #PreparedChildProcess::control_fd socket; each one contains only
+ * the program path, the arguments, the environment and the stdio
+ * file descriptors, preceded by a reply socket.  For each request,
+ * it forks a new child process (with CLONE_PARENT, so the spawner
+ * can wait for it) which executes the program, and sends its pidfd
+ * on the reply socket.  The zygote exits when the spawner closes the socket.
+ */
+int
+RunSpawnZygote(PreparedChildProcess &&p) noexcept;
+
+/**
+ * The spawner's handle to a zygote process (see RunSpawnZygote()).
+ * Destroying this object closes the socket, which makes the zygote
+ * exit.
+ */
+class SpawnZygote {
+	UniqueSocketDescriptor socket;
+
+	/**
+	 * Resources needed by the zygote's mount namespace (see
+	 * #SpawnServerChild).
+	 */
+	std::forward_list<SharedLease> leases;
+
+public:
+	SpawnZygote(UniqueSocketDescriptor &&_socket,
+		    std::forward_list<SharedLease> &&_leases) noexcept
+		:socket(std::move(_socket)), leases(std::move(_leases)) {}
+
+	SpawnZygote(SpawnZygote &&) noexcept = default;
+	SpawnZygote &operator=(SpawnZygote &&) noexcept = default;
+
+	/**
+	 * Ask the zygote to fork a new child process.  Only the
+	 * program path, the arguments, the environment and the
+	 * stdio file descriptors are taken from the given
+	 * #PreparedChildProcess; everything else is inherited from
+	 * the zygote.
+	 *
+	 * This does not wait for the zygote; pass the returned
+	 * socket to WaitSpawnZygoteChild().
+	 *
+	 * Throws on error.
+	 *
+	 * @return a socket which receives the zygote's reply or an
+	 * undefined socket if the zygote has exited (nothing was
+	 * done, and the caller may spawn the process without a
+	 * zygote)
+	 */
+	UniqueSocketDescriptor Fork(const PreparedChildProcess &p);
+};
+
+/**
+ * Wait for the zygote's reply to SpawnZygote::Fork() and then for
+ * the new child process to execute the new program.
+ *
+ * Throws on error.
+ *
+ * @param reply_socket the socket returned by SpawnZygote::Fork()
+ */
+Co::Task<SpawnChildProcessResult>
+WaitSpawnZygoteChild(EventLoop &event_loop,
+		     UniqueSocketDescriptor reply_socket);
@@ -0,0 +1,297 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "ZygoteCache.hxx"
+#include "co/InvokeTask.hxx"
+#include "co/Task.hxx"
+#include "util/DeleteDisposer.hxx"
+#include "util/SpanCast.hxx"
+
+#include <algorithm> // for std::find_if()
+#include <cassert>
+#include <chrono>
+#include <optional>
+
+using namespace Spawn;
+
+void
+SpawnZygoteKey::Add(ExecCommand cmd, std::span<const std::byte> raw) noexcept
+{
+	switch (cmd) {
+	case ExecCommand::EXEC_PATH:
+	case ExecCommand::ARG:
+	case ExecCommand::SETENV:
+		/* these are applied by the zygote to each new child
+		   process */
+		return;
+
+	case ExecCommand::STDIN:
+		has_stdin = true;
+		return;
+
+	case ExecCommand::STDOUT:
+		has_stdout = true;
+		return;
+
+	case ExecCommand::STDOUT_IS_STDIN:
+		/* copies the stdin file descriptor (if one was
+		   given before) */
+		has_stdout = has_stdin;
+		return;
+
+	case ExecCommand::STDERR:
+		has_stderr = true;
+		return;
+
+	case ExecCommand::STDERR_IS_STDIN:
+		has_stderr = has_stdin;
+		return;
+
+	case ExecCommand::EXEC_FUNCTION:
+	case ExecCommand::EXEC_FD:
+	case ExecCommand::STDERR_PATH:
+	case ExecCommand::RETURN_STDERR:
+	case ExecCommand::RETURN_PIDFD:
+	case ExecCommand::RETURN_CGROUP:
+	case ExecCommand::CONTROL:
+	case ExecCommand::TTY:
+	case ExecCommand::PID_NS:
+	case ExecCommand::PID_NS_FD:
+	case ExecCommand::MOUNT_NAMED_TMPFS:
+	case ExecCommand::FD_BIND_MOUNT:
+	case ExecCommand::FD_BIND_MOUNT_FILE:
+	case ExecCommand::CGROUP_SESSION:
+		/* per-request resources (file descriptors, tmpfs
+		   leases, session cgroups) and a new PID namespace
+		   (the zygote cannot be its "init" process, because
+		   CLONE_PARENT is not allowed there) */
+		compatible = false;
+		return;
+
+	case ExecCommand::MOUNT_ROOT_TMPFS:
+	case ExecCommand::MOUNT_TMP_TMPFS:
+	case ExecCommand::MOUNT_TMPFS:
+	case ExecCommand::WRITE_FILE:
+	case ExecCommand::NETWORK_NS:
+	case ExecCommand::NETWORK_NS_NAME:
+	case ExecCommand::IPC_NS:
+		/* without a zygote, each process gets its own tmpfs
+		   and namespace; all children of a zygote would share
+		   the zygote's instance */
+		compatible = false;
+		return;
+
+	default:
+		/* everything else is part of the key */
+		break;
+	}
+
+	value.append(ToStringView(raw));
+}
+
+struct SpawnZygoteCache::Item final
+	: IntrusiveHashSetHook<>, IntrusiveListHook<>
+{
+	SpawnZygoteCache &cache;
+
+	const std::string key;
+
+	/**
+	 * The number of misses since this item was created or since
+	 * its zygote was stopped.
+	 */
+	unsigned n_misses = 0;
+
+	/**
+	 * Spawns the zygote process.  This is only set while it is
+	 * starting.
+	 */
+	Co::InvokeTask start_task;
+
+	std::chrono::steady_clock::time_point start_time;
+
+	/**
+	 * How long did it take to start the zygote?  This is an
+	 * estimate for the duration of a spawn without a zygote.
+	 */
+	std::chrono::steady_clock::duration setup_duration;
+
+	std::optional<SpawnZygote> zygote;
+
+	Item(SpawnZygoteCache &_cache, std::string_view _key) noexcept
+		:cache(_cache), key(_key) {}
+
+	Item(const Item &) = delete;
+	Item &operator=(const Item &) = delete;
+
+	/**
+	 * Is a zygote ready or starting?
+	 */
+	bool HasZygote() const noexcept {
+		return start_task || zygote;
+	}
+
+	void Start(Co::Task<SpawnZygote> &&task) noexcept {
+		assert(!HasZygote());
+
+		start_time = std::chrono::steady_clock::now();
+		start_task = Await(std::move(task));
+		start_task.Start(BIND_THIS_METHOD(OnStartCompletion));
+	}
+
+	void Stop() noexcept {
+		start_task = {};
+		zygote.reset();
+		n_misses = 0;
+	}
+
+private:
+	Co::InvokeTask Await(Co::Task<SpawnZygote> task) {
+		zygote.emplace(co_await task);
+	}
+
+	void OnStartCompletion(std::exception_ptr &&error) noexcept {
+		if (error) {
+			cache.logger(1, "Failed to start zygote: ", error);
+
+			assert(cache.n_zygotes > 0);
+			--cache.n_zygotes;
+
+			/* retry only after more misses */
+			n_misses = 0;
+			return;
+		}
+
+		setup_duration = std::chrono::steady_clock::now() - start_time;
+		++cache.stats.started;
+	}
+};
+
+inline std::string_view
+SpawnZygoteCache::ItemGetKey::operator()(const Item &item) const noexcept
+{
+	return item.key;
+}
+
+SpawnZygoteCache::SpawnZygoteCache(std::size_t _max_zygotes) noexcept
+	:max_zygotes(_max_zygotes) {}
+
+SpawnZygoteCache::~SpawnZygoteCache() noexcept
+{
+	Invalidate();
+}
+
+void
+SpawnZygoteCache::Invalidate() noexcept
+{
+	while (!lru.empty())
+		Remove(lru.front());
+
+	assert(n_zygotes == 0);
+}
+
+inline SpawnZygoteCache::Item &
+SpawnZygoteCache::Make(std::string_view key) noexcept
+{
+	if (auto i = items.find(key); i != items.end()) {
+		/* move to the end of the LRU list */
+		lru.erase(lru.iterator_to(*i));
+		lru.push_back(*i);
+		return *i;
+	}
+
+	if (lru.size() >= MAX_ITEMS)
+		Remove(lru.front());
+
+	auto *item = new Item(*this, key);
+	items.insert(*item);
+	lru.push_back(*item);
+	return *item;
+}
+
+void
+SpawnZygoteCache::Remove(Item &item) noexcept
+{
+	if (item.HasZygote())
+		StopZygote(item);
+
+	items.erase(items.iterator_to(item));
+	lru.erase(lru.iterator_to(item));
+	delete &item;
+}
+
+inline void
+SpawnZygoteCache::StopZygote(Item &item) noexcept
+{
+	assert(item.HasZygote());
+	assert(n_zygotes > 0);
+
+	item.Stop();
+	--n_zygotes;
+}
+
+SpawnZygoteCache::ForkResult
+SpawnZygoteCache::Fork(std::string_view key, const PreparedChildProcess &p)
+{
+	auto &item = Make(key);
+
+	if (item.zygote) {
+		try {
+			if (auto reply_socket = item.zygote->Fork(p);
+			    reply_socket.IsDefined()) {
+				++stats.hits;
+				return {std::move(reply_socket), item.setup_duration};
+			}
+
+			logger(2, "Zygote has exited");
+		} catch (...) {
+			/* this zygote is unusable; fall back to
+			   spawning without a zygote */
+			logger(1, "Zygote failed: ", std::current_exception());
+		}
+
+		StopZygote(item);
+	}
+
+	++stats.misses;
+	++item.n_misses;
+	return {};
+}
+
+bool
+SpawnZygoteCache::WantStart(std::string_view key) noexcept
+{
+	auto i = items.find(key);
+	if (i == items.end())
+		return false;
+
+	auto &item = *i;
+	if (item.HasZygote() || item.n_misses < HOT_THRESHOLD)
+		return false;
+
+	if (n_zygotes >= max_zygotes) {
+		/* stop the least recently used zygote which is
+		   ready (not one which is still starting) */
+		auto victim = std::find_if(lru.begin(), lru.end(),
+					   [](const Item &j){
+						   return j.zygote.has_value();
+					   });
+		if (victim == lru.end())
+			return false;
+
+		StopZygote(*victim);
+	}
+
+	return true;
+}
+
+void
+SpawnZygoteCache::Start(std::string_view key, Co::Task<SpawnZygote> &&task) noexcept
+{
+	auto i = items.find(key);
+	assert(i != items.end());
+
+	++n_zygotes;
+	i->Start(std::move(task));
+}
@@ -0,0 +1,190 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "Zygote.hxx"
+#include "Stats.hxx"
+#include "IProtocol.hxx"
+#include "io/Logger.hxx"
+#include "util/IntrusiveHashSet.hxx"
+#include "util/IntrusiveList.hxx"
+#include "util/TransparentHash.hxx"
+
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <string_view>
+
+/**
+ * Builds the #SpawnZygoteCache key from the raw commands of an EXEC
+ * request.  The key contains all commands except the ones which the
+ * zygote applies to each child process (arguments, environment,
+ * stdio).
+ */
+class SpawnZygoteKey {
+	std::string value;
+
+	bool compatible = true;
+
+	/**
+	 * Which stdio commands have been seen?  A child process
+	 * without a stdout or stderr file descriptor would inherit
+	 * the zygote's journal stream (see SpawnChildProcess()),
+	 * which carries the wrong identifier and may be shared with
+	 * unrelated programs.
+	 */
+	bool has_stdin = false, has_stdout = false, has_stderr = false;
+
+public:
+	/**
+	 * @param raw the command including its payload, exactly as
+	 * it was received
+	 */
+	void Add(Spawn::ExecCommand cmd, std::span<const std::byte> raw) noexcept;
+
+	/**
+	 * Can this request be handled by a zygote?  This is false if
+	 * it contains options which refer to per-request resources
+	 * (e.g. file descriptors) or which need to be applied to the
+	 * new process itself (e.g. a new PID namespace), or if it
+	 * lacks a stdout or stderr file descriptor.
+	 */
+	[[gnu::pure]]
+	bool IsCompatible() const noexcept {
+		return compatible && has_stdout && has_stderr;
+	}
+
+	std::string_view GetValue() const noexcept {
+		return value;
+	}
+};
+
+/**
+ * Manages zygote processes (see RunSpawnZygote()), one for each
+ * frequently used #SpawnZygoteKey.  Keys which are not (yet) hot are
+ * tracked, too, to count their misses.
+ */
+class SpawnZygoteCache {
+	struct Item;
+
+	struct ItemGetKey {
+		[[gnu::pure]]
+		std::string_view operator()(const Item &item) const noexcept;
+	};
+
+	const LLogger logger{"zygote"};
+
+	IntrusiveHashSet<Item, 256,
+			 IntrusiveHashSetOperators<Item, ItemGetKey, TransparentHash,
+						   std::equal_to<std::string_view>>> items;
+
+	/**
+	 * All items, the least recently used one first.
+	 */
+	IntrusiveList<Item, IntrusiveListBaseHookTraits<Item>,
+		      IntrusiveListOptions{.constant_time_size = true}> lru;
+
+	/**
+	 * The maximum number of zygotes (ready or starting).
+	 */
+	const std::size_t max_zygotes;
+
+	/**
+	 * The current number of zygotes (ready or starting).
+	 */
+	std::size_t n_zygotes = 0;
+
+	SpawnZygoteStats stats{};
+
+public:
+	/**
+	 * The maximum number of keys being tracked.
+	 */
+	static constexpr std::size_t MAX_ITEMS = 256;
+
+	/**
+	 * After this many misses, a zygote is started for the key.
+	 */
+	static constexpr unsigned HOT_THRESHOLD = 4;
+
+	explicit SpawnZygoteCache(std::size_t _max_zygotes) noexcept;
+	~SpawnZygoteCache() noexcept;
+
+	SpawnZygoteCache(const SpawnZygoteCache &) = delete;
+	SpawnZygoteCache &operator=(const SpawnZygoteCache &) = delete;
+
+	const SpawnZygoteStats &GetStats() const noexcept {
+		return stats;
+	}
+
+	/**
+	 * Stop all zygotes, e.g. because mounts which were
+	 * bind-mounted into their mount namespaces have changed.
+	 * Processes which have already been spawned are not
+	 * affected.
+	 */
+	void Invalidate() noexcept;
+
+	struct ForkResult {
+		/**
+		 * The reply socket (to be passed to
+		 * WaitSpawnZygoteChild()) or an undefined socket on
+		 * a miss.
+		 */
+		UniqueSocketDescriptor reply_socket;
+
+		/**
+		 * How long it took to start the zygote; pass this to
+		 * AddSavedDuration().
+		 */
+		std::chrono::steady_clock::duration setup_duration;
+	};
+
+	/**
+	 * Fork a new child process from the zygote for this key (see
+	 * SpawnZygote::Fork()).
+	 *
+	 * Throws on error.
+	 *
+	 * @return the reply socket; if it is undefined (a miss), the
+	 * caller spawns the process without a zygote and should
+	 * check WantStart()
+	 */
+	ForkResult Fork(std::string_view key, const PreparedChildProcess &p);
+
+	/**
+	 * Account the time saved by a hit in
+	 * SpawnZygoteStats::saved_duration.
+	 *
+	 * @param setup_duration the value returned by Fork()
+	 * @param duration the time from Fork() until
+	 * WaitSpawnZygoteChild() has finished
+	 */
+	void AddSavedDuration(std::chrono::steady_clock::duration setup_duration,
+			      std::chrono::steady_clock::duration duration) noexcept {
+		if (setup_duration > duration)
+			stats.saved_duration += setup_duration - duration;
+	}
+
+	/**
+	 * Shall a zygote be started for this key (after a miss)?
+	 * This may stop the least recently used zygote to make room
+	 * for the new one.
+	 */
+	bool WantStart(std::string_view key) noexcept;
+
+	/**
+	 * Start a zygote for this key (after WantStart() has returned
+	 * true).  The task spawns the zygote process; until it
+	 * finishes, requests for this key are misses.
+	 */
+	void Start(std::string_view key, Co::Task<SpawnZygote> &&task) noexcept;
+
+private:
+	Item &Make(std::string_view key) noexcept;
+	void Remove(Item &item) noexcept;
+	void StopZygote(Item &item) noexcept;
+};
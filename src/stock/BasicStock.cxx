@@ -9,6 +9,7 @@
 #include "event/Loop.hxx"
 #include "util/Cancellable.hxx"
 
+#include <algorithm> // for std::min()
 #include <cassert>
 
 struct BasicStock::Create final
@@ -27,6 +28,22 @@ struct BasicStock::Create final
 
 	const bool continue_on_cancel;
 
+	/**
+	 * Was this create operation started by the pre-warming
+	 * logic?
+	 */
+	const bool pre_warm = false;
+
+	/**
+	 * Construct a detached instance for pre-warming.
+	 */
+	Create(BasicStock &_stock, Event::TimePoint _start_time) noexcept
+		:stock(_stock),
+		 start_time(_start_time),
+		 handler(nullptr),
+		 continue_on_cancel(true),
+		 pre_warm(true) {}
+
 	Create(BasicStock &_stock,
 	       Event::TimePoint _start_time,
 	       bool _continue_on_cancel,
@@ -110,6 +127,7 @@ BasicStock::Shutdown() noexcept
 
 	cleanup_event.Cancel();
 	clear_event.Cancel();
+	pre_warm_timer.Cancel();
 }
 
 /*
@@ -138,7 +156,7 @@ BasicStock::CleanupEventCallback() noexcept
 	/* destroy one third of the idle items */
 
 	for (std::size_t i = (idle.size() - max_idle + 2) / 3; i > 0; --i)
-		idle.pop_front_and_dispose(DeleteDisposer());
+		idle.pop_front_and_dispose(ItemDisposer());
 
 	/* schedule next cleanup */
 
@@ -159,20 +177,92 @@ BasicStock::ClearIdle() noexcept
 	if (idle.size() > max_idle)
 		UnscheduleCleanup();
 
-	idle.clear_and_dispose(DeleteDisposer());
+	idle.clear_and_dispose(ItemDisposer());
 }
 
 void
 BasicStock::ClearEventCallback() noexcept
 {
-	if (may_clear)
-		ClearIdle();
+	if (may_clear) {
+		if (pre_warm.IsEnabled())
+			/* pre-warmed items are managed by
+			   OnPreWarmTimer() */
+			ClearIdleIf([](const StockItem &item){
+				return !item.pre_warmed;
+			});
+		else
+			ClearIdle();
+	}
 
 	may_clear = true;
 	ScheduleClear();
 	CheckEmpty();
 }
 
+/*
+ * pre-warming
+ *
+ */
+
+inline void
+BasicStock::PreWarmCreate() noexcept
+{
+	++counters.total_creates;
+	++counters.pre_warm_creates;
+
+	auto *c = new Create(*this, GetEventLoop().SteadyNow());
+	create.push_front(*c);
+
+	try {
+		cls.Create({*this}, nullptr, *c, c->cancel_ptr);
+	} catch (...) {
+		ItemCreateError(*c, std::current_exception());
+	}
+}
+
+inline void
+BasicStock::TrimPreWarmed(std::size_t target) noexcept
+{
+	std::size_t n = busy.size() + idle.size() + create.size();
+
+	idle.remove_and_dispose_if([&n, target](const StockItem &item){
+		if (n <= target || !item.pre_warmed)
+			return false;
+
+		--n;
+		return true;
+	}, ItemDisposer());
+
+	if (idle.size() <= max_idle)
+		UnscheduleCleanup();
+}
+
+void
+BasicStock::OnPreWarmTimer() noexcept
+{
+	assert(pre_warm.IsEnabled());
+
+	demand_average += pre_warm.alpha *
+		(static_cast<double>(peak_demand) - demand_average);
+	peak_demand = GetActiveCount();
+
+	const std::size_t target =
+		std::min({static_cast<std::size_t>(demand_average + 0.5),
+			  pre_warm.max_items, max_idle});
+
+	pre_warm_timer.Schedule(pre_warm.interval);
+
+	std::size_t n = busy.size() + idle.size() + create.size();
+	if (n < target) {
+		for (; n < target && MayCreate(); ++n)
+			PreWarmCreate();
+	} else if (n > target) {
+		/* demand has decreased: back off */
+		TrimPreWarmed(target);
+		CheckEmpty();
+	}
+}
+
 
 /*
  * constructor
@@ -186,11 +276,17 @@ BasicStock::BasicStock(EventLoop &event_loop, StockClass &_cls,
 	 max_idle(options.max_idle),
 	 clear_interval(options.clear_interval),
 	 cleanup_event(event_loop, BIND_THIS_METHOD(CleanupEventCallback)),
-	 clear_event(event_loop, BIND_THIS_METHOD(ClearEventCallback))
+	 clear_event(event_loop, BIND_THIS_METHOD(ClearEventCallback)),
+	 pre_warm(cls.GetPreWarmOptions()),
+	 pre_warm_timer(event_loop, BIND_THIS_METHOD(OnPreWarmTimer))
 {
 	assert(max_idle > 0);
+	assert(!pre_warm.IsEnabled() || pre_warm.alpha > 0);
 
 	ScheduleClear();
+
+	if (pre_warm.IsEnabled())
+		pre_warm_timer.Schedule(pre_warm.interval);
 }
 
 BasicStock::~BasicStock() noexcept
@@ -237,11 +333,17 @@ BasicStock::GetIdle() noexcept
 			item.is_idle = false;
 #endif
 
+			if (item.pre_warmed) {
+				item.pre_warmed = false;
+				++counters.pre_warm_hits;
+			}
+
 			busy.push_front(item);
+			NoteDemand(GetActiveCount());
 			return &item;
 		}
 
-		delete &item;
+		DeleteItem(item);
 	}
 
 	CheckEmpty();
@@ -272,7 +374,11 @@ BasicStock::GetCanceled(StockGetHandler &get_handler,
 {
 	for (auto &c : create) {
 		if (c.IsDetached()) {
+			if (c.pre_warm)
+				++counters.pre_warm_hits;
+
 			c.Attach(get_handler, cancel_ptr);
+			NoteDemand(GetActiveCount());
 			return true;
 		}
 	}
@@ -292,6 +398,7 @@ BasicStock::GetCreate(StockRequest request,
 			     cls.ShouldContinueOnCancel(request.get()),
 			     get_handler, cancel_ptr);
 	create.push_front(*c);
+	NoteDemand(GetActiveCount());
 
 	try {
 		cls.Create({*this}, std::move(request), *c, c->cancel_ptr);
@@ -308,14 +415,17 @@ BasicStock::ItemCreateSuccess(StockGetHandler &_handler,
 
 	auto &c = static_cast<Create &>(_handler);
 	auto *get_handler = c.handler;
+	const bool pre_warm_create = c.pre_warm;
 
 	DeleteCreate(c);
 
 	if (get_handler != nullptr) {
 		busy.push_front(item);
 		get_handler->OnStockItemReady(item);
-	} else
+	} else {
+		item.pre_warmed = pre_warm_create;
 		InjectIdle(item);
+	}
 }
 
 void
@@ -370,7 +480,7 @@ BasicStock::Put(StockItem &item, PutAction action) noexcept
 
 	if (action == PutAction::DESTROY ||
 	    item.IsFading() || !item.Release()) {
-		delete &item;
+		DeleteItem(item);
 		CheckEmpty();
 		return PutAction::DESTROY;
 	} else {
@@ -407,7 +517,7 @@ BasicStock::ItemIdleDisconnect(StockItem &item) noexcept
 	if (idle.size() == max_idle)
 		UnscheduleCleanup();
 
-	delete &item;
+	DeleteItem(item);
 	CheckEmpty();
 }
 
@@ -421,12 +531,22 @@ BasicStock::ItemBusyDisconnect(StockItem &item) noexcept
 }
 
 
+void
+BasicStock::DeleteItem(StockItem &item) noexcept
+{
+	if (item.pre_warmed)
+		++counters.pre_warm_wasted;
+
+	counters.lifetime_histogram.Add(GetEventLoop().SteadyNow() - item.GetCreateTime());
+	delete &item;
+}
+
 inline void
 BasicStock::DeleteCreate(Create &c) noexcept
 {
 	assert(!create.empty());
 
-	counters.total_create_duration += GetEventLoop().SteadyNow() - c.start_time;
+	counters.AddCreateDuration(GetEventLoop().SteadyNow() - c.start_time);
 
 	create.erase_and_dispose(create.iterator_to(c),
 				 DeleteDisposer{});
@@ -6,6 +6,7 @@
 
 #include "AbstractStock.hxx"
 #include "Item.hxx"
+#include "Options.hxx"
 #include "Request.hxx"
 #include "Stats.hxx"
 #include "event/CoarseTimerEvent.hxx"
@@ -18,7 +19,6 @@
 #include <string>
 #include <string_view>
 
-struct BasicStockOptions;
 class CancellablePointer;
 class BasicStock;
 class StockClass;
@@ -47,6 +47,26 @@ private:
 	CoarseTimerEvent cleanup_event;
 	CoarseTimerEvent clear_event;
 
+	const StockPreWarmOptions pre_warm;
+
+	/**
+	 * Periodically samples the demand and creates items in
+	 * advance (only used if #pre_warm is enabled).
+	 */
+	CoarseTimerEvent pre_warm_timer;
+
+	/**
+	 * The exponentially weighted moving average of
+	 * #peak_demand.
+	 */
+	double demand_average = 0;
+
+	/**
+	 * The highest number of items which were needed at the same
+	 * time during the current #pre_warm_timer interval.
+	 */
+	std::size_t peak_demand = 0;
+
 	using ItemList = StockItem::List;
 
 	/**
@@ -194,6 +214,22 @@ protected:
 		return busy.size() + create.size();
 	}
 
+	/**
+	 * Record that this number of items is needed right now (for
+	 * the pre-warming statistics).
+	 */
+	void NoteDemand(std::size_t n) noexcept {
+		if (n > peak_demand)
+			peak_demand = n;
+	}
+
+	/**
+	 * May the pre-warming logic create another item now?
+	 */
+	virtual bool MayCreate() const noexcept {
+		return true;
+	}
+
 	virtual void OnCreateCanceled() noexcept {}
 
 	/**
@@ -216,8 +252,7 @@ private:
 	void ClearIdle() noexcept;
 
 	void ClearIdleIf(std::predicate<const StockItem &> auto predicate) noexcept {
-		idle.remove_and_dispose_if(predicate,
-					   DeleteDisposer());
+		idle.remove_and_dispose_if(predicate, ItemDisposer());
 
 		if (idle.size() <= max_idle)
 			UnscheduleCleanup();
@@ -270,6 +305,18 @@ protected:
 			     std::exception_ptr ep) noexcept override;
 
 private:
+	/**
+	 * Delete an item which has already been removed from all
+	 * lists, and update the lifetime statistics.
+	 */
+	void DeleteItem(StockItem &item) noexcept;
+
+	auto ItemDisposer() noexcept {
+		return [this](StockItem *item){
+			DeleteItem(*item);
+		};
+	}
+
 	void DeleteCreate(Create &c) noexcept;
 	void CreateCanceled(Create &c) noexcept;
 
@@ -283,4 +330,18 @@ private:
 
 	void CleanupEventCallback() noexcept;
 	void ClearEventCallback() noexcept;
+
+	/**
+	 * Create an item in advance; it will be moved to the #idle
+	 * list when it is ready.
+	 */
+	void PreWarmCreate() noexcept;
+
+	/**
+	 * Destroy idle pre-warmed items until there are no more than
+	 * the given number of items.
+	 */
+	void TrimPreWarmed(std::size_t target) noexcept;
+
+	void OnPreWarmTimer() noexcept;
 };
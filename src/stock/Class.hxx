@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "Options.hxx"
 #include "Request.hxx"
 
 #include <cstdint>
@@ -44,4 +45,15 @@ public:
 	virtual uint_fast64_t GetFairnessHash([[maybe_unused]] const void *request) const noexcept {
 		return 0;
 	}
+
+	/**
+	 * Returns the pre-warming policy for stocks of this class
+	 * (disabled by default).  If enabled, the stock will call
+	 * Create() with a null request to create items in advance,
+	 * so the implementation must be able to handle that.
+	 */
+	[[gnu::pure]]
+	virtual StockPreWarmOptions GetPreWarmOptions() const noexcept {
+		return {};
+	}
 };
@@ -4,6 +4,7 @@
 
 #include "Item.hxx"
 #include "Stock.hxx"
+#include "event/Loop.hxx"
 
 std::string_view
 CreateStockItem::GetStockNameView() const noexcept
@@ -24,6 +25,12 @@ CreateStockItem::InvokeCreateError(StockGetHandler &handler,
 	stock.ItemCreateError(handler, ep);
 }
 
+StockItem::StockItem(CreateStockItem c) noexcept
+	:stock(c.stock),
+	 create_time(stock.GetEventLoop().SteadyNow())
+{
+}
+
 StockItem::~StockItem() noexcept
 {
 }
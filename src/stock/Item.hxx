@@ -5,6 +5,7 @@
 #pragma once
 
 #include "PutAction.hxx"
+#include "event/Chrono.hxx"
 #include "util/LeakDetector.hxx"
 #include "util/IntrusiveList.hxx"
 
@@ -43,6 +44,12 @@ class StockItem
 
 	AbstractStock &stock;
 
+	/**
+	 * When was this item created?  This is used for the
+	 * lifetime statistics.
+	 */
+	const Event::TimePoint create_time;
+
 	/**
 	 * If true, then Fade() on a busy object will not wait for the
 	 * item to become idle, but instead invoke Terminate()
@@ -69,12 +76,24 @@ public:
 	 */
 	bool unclean = false;
 
+	/**
+	 * This item was created in advance by the pre-warming logic
+	 * and has not been used yet.
+	 */
+	bool pre_warmed = false;
+
+	/**
+	 * When was this item last handed out to a client?  This is
+	 * only maintained by stocks which need it for latency
+	 * statistics (currently #MultiStock).
+	 */
+	Event::TimePoint borrow_time;
+
 #ifndef NDEBUG
 	bool is_idle = false;
 #endif
 
-	explicit StockItem(CreateStockItem c) noexcept
-		:stock(c.stock) {}
+	explicit StockItem(CreateStockItem c) noexcept;
 
 	StockItem(const StockItem &) = delete;
 	StockItem &operator=(const StockItem &) = delete;
@@ -85,6 +104,10 @@ public:
 		return stock;
 	}
 
+	Event::TimePoint GetCreateTime() const noexcept {
+		return create_time;
+	}
+
 	/**
 	 * Wrapper for Stock::GetNameView()
 	 */
@@ -10,14 +10,15 @@
 #include "Stock.hxx"
 #include "event/DeferEvent.hxx"
 #include "event/FineTimerEvent.hxx"
-#include "util/IntrusiveHashSet.hxx"
+#include "util/IntrusiveLinearHashSet.hxx"
 
 #include <concepts> // for std::predicate
 #include <cstddef>
 
 /**
  * A hash table of any number of Stock objects, each with a different
- * URI.
+ * URI.  The table grows and shrinks incrementally with the number of
+ * keys.
  */
 class StockMap {
 	struct Item final : IntrusiveHashSetHook<IntrusiveHookMode::NORMAL>, Stock {
@@ -58,13 +59,14 @@ class StockMap {
 		};
 	};
 
-	static constexpr size_t N_BUCKETS = 4096;
 	using Map =
-		IntrusiveHashSet<Item, N_BUCKETS,
-				 IntrusiveHashSetOperators<Item,
-							   Item::GetKeyFunction,
-							   std::hash<StockKey>,
-							   std::equal_to<StockKey>>>;
+		IntrusiveLinearHashSet<Item,
+				       IntrusiveHashSetOperators<Item,
+								 Item::GetKeyFunction,
+								 std::hash<StockKey>,
+								 std::equal_to<StockKey>>,
+				       IntrusiveHashSetBaseHookTraits<Item>,
+				       4096>;
 
 	EventLoop &event_loop;
 
@@ -14,6 +14,7 @@
 #include "util/SpanCast.hxx"
 
 #include <cassert>
+#include <utility> // for std::unreachable()
 
 StockOptions
 MultiStockClass::GetOptions([[maybe_unused]] const void *request,
@@ -156,6 +157,7 @@ MultiStock::OuterItem::GetIdle() noexcept
 
 			CancelCleanupTimer();
 
+			item.borrow_time = GetEventLoop().SteadyNow();
 			busy.push_front(item);
 			return &item;
 		}
@@ -224,6 +226,16 @@ MultiStock::OuterItem::Put(StockItem &item, PutAction action) noexcept
 
 	busy.erase(busy.iterator_to(item));
 
+	const auto duration = GetEventLoop().SteadyNow() - item.borrow_time;
+	if (HasLatency())
+		/* update the moving average with a weight of 1/8 */
+		latency += (duration - latency) / 8;
+	else
+		/* the first sample: use it as the initial value,
+		   or else the average would approach it only
+		   slowly */
+		latency = duration;
+
 	PutAction result;
 	if (shared_item.IsFading() || action == PutAction::DESTROY ||
 	    item.IsFading() ||
@@ -279,6 +291,7 @@ void
 MultiStock::OuterItem::ItemCreateSuccess(StockGetHandler &get_handler,
 					 StockItem &item) noexcept
 {
+	item.borrow_time = GetEventLoop().SteadyNow();
 	busy.push_front(item);
 	get_handler.OnStockItemReady(item);
 }
@@ -334,14 +347,16 @@ MultiStock::MapItem::MapItem(MultiStock &_parent,
 			     EventLoop &_event_loop, StockClass &_outer_class,
 			     StockKey key,
 			     StockOptions options,
+			     MultiStockPlacement _placement,
 			     MultiStockClass &_inner_class) noexcept
 	:parent(_parent),
 	 outer_class(_outer_class),
 	 inner_class(_inner_class),
 	 name(key.value), hash(key.hash),
+	 placement(_placement),
 	 limit(options.limit),
 	 clear_interval(options.clear_interval),
-	 max_wait(options.max_wait),
+	 wait_tracker(options.max_wait),
 	 retry_event(_event_loop, BIND_THIS_METHOD(RetryWaiting)),
 	 expire_timer(_event_loop, BIND_THIS_METHOD(OnExpireTimer))
 {
@@ -357,12 +372,74 @@ MultiStock::MapItem::~MapItem() noexcept
 		get_cancel_ptr.Cancel();
 }
 
+inline bool
+MultiStock::MapItem::IsBetter(const OuterItem &a,
+			      const OuterItem &b) const noexcept
+{
+	if (placement == MultiStockPlacement::LATENCY_EWMA &&
+	    a.HasLatency() && b.HasLatency()) {
+		/* add one to the number of leases so items without
+		   leases are still ordered by their latency; as long
+		   as one of them has no latency sample, compare only
+		   the number of leases, because a zero latency would
+		   attract all leases */
+		const auto a_cost = (a.GetBusyCount() + 1) * a.GetLatency();
+		const auto b_cost = (b.GetBusyCount() + 1) * b.GetLatency();
+		if (a_cost != b_cost)
+			return a_cost < b_cost;
+	}
+
+	return a.GetBusyCount() < b.GetBusyCount();
+}
+
+MultiStock::OuterItem &
+MultiStock::MapItem::PickTwoChoices(std::size_t n_usable) noexcept
+{
+	assert(n_usable >= 2);
+
+	/* pick two distinct indices among the usable items */
+	std::size_t a = std::uniform_int_distribution<std::size_t>{0, n_usable - 1}(parent.random);
+	std::size_t b = std::uniform_int_distribution<std::size_t>{0, n_usable - 2}(parent.random);
+	if (b >= a)
+		++b;
+
+	OuterItem *first = nullptr;
+	std::size_t index = 0;
+	for (auto &i : items) {
+		if (!i.CanUse())
+			continue;
+
+		if (index == a || index == b) {
+			if (first == nullptr)
+				first = &i;
+			else
+				return IsBetter(i, *first) ? i : *first;
+		}
+
+		++index;
+	}
+
+	std::unreachable();
+}
+
 MultiStock::OuterItem *
 MultiStock::MapItem::FindUsable() noexcept
 {
+	OuterItem *best = nullptr;
+	std::size_t n_usable = 0;
+
 	for (auto i = items.begin(), end = items.end(); i != end;) {
-		if (i->CanUse())
-			return &*i;
+		if (i->CanUse()) {
+			if (placement == MultiStockPlacement::FIRST)
+				return &*i;
+
+			++n_usable;
+			if (best == nullptr || IsBetter(*i, *best))
+				best = &*i;
+
+			++i;
+			continue;
+		}
 
 		if (i->IsFading() && !i->IsBusy())
 			/* as a kludge, this method disposes items
@@ -376,7 +453,12 @@ MultiStock::MapItem::FindUsable() noexcept
 			++i;
 	}
 
-	return nullptr;
+	if (placement == MultiStockPlacement::TWO_CHOICES && n_usable > 2)
+		return &PickTwoChoices(n_usable);
+
+	/* for TWO_CHOICES with up to two usable items, the least
+	   busy one is what two random choices would yield */
+	return best;
 }
 
 inline void
@@ -425,7 +507,7 @@ MultiStock::MapItem::Get(StockRequest request, std::size_t concurrency,
 	const auto now = GetEventLoop().SteadyNow();
 	const bool create = waiting.empty() && !IsFull() && !get_cancel_ptr;
 
-	if (!create && now < reject_wait_until) {
+	if (!create && wait_tracker.IsRejecting(now)) {
 		++counters.rejects;
 		get_handler.OnStockItemError(std::make_exception_ptr(StockOverloadedError{"Overloaded"}));
 		return;
@@ -462,10 +544,9 @@ MultiStock::MapItem::WaitingEnded(Waiting &w) noexcept
 
 	const auto now = GetEventLoop().SteadyNow();
 	const auto wait_duration = now - w.start_time;
-	counters.total_wait_duration += wait_duration;
+	counters.AddWaitDuration(wait_duration);
 
-	if (max_wait > Event::Duration{} && wait_duration > max_wait)
-		reject_wait_until = now + std::chrono::seconds{1};
+	wait_tracker.Add(now, wait_duration);
 }
 
 inline void
@@ -491,7 +572,7 @@ MultiStock::MapItem::RemoveWaiting(Waiting &w) noexcept
 
 	if (get_cancel_ptr && !continue_on_cancel) {
 		++counters.canceled_creates;
-		counters.total_create_duration += GetEventLoop().SteadyNow() - create_start_time;
+		counters.AddCreateDuration(GetEventLoop().SteadyNow() - create_start_time);
 		get_cancel_ptr.Cancel();
 	}
 
@@ -601,7 +682,7 @@ MultiStock::MapItem::OnStockItemReady(StockItem &stock_item) noexcept
 {
 	get_cancel_ptr = nullptr;
 
-	counters.total_create_duration += GetEventLoop().SteadyNow() - create_start_time;
+	counters.AddCreateDuration(GetEventLoop().SteadyNow() - create_start_time);
 
 	retry_event.Cancel();
 
@@ -630,7 +711,7 @@ MultiStock::MapItem::OnStockItemError(std::exception_ptr error) noexcept
 {
 	get_cancel_ptr = nullptr;
 
-	counters.total_create_duration += GetEventLoop().SteadyNow() - create_start_time;
+	counters.AddCreateDuration(GetEventLoop().SteadyNow() - create_start_time);
 
 	retry_event.Cancel();
 
@@ -667,6 +748,7 @@ MultiStock::MapItem::Put(StockItem &item, PutAction) noexcept
 	assert(!item.is_idle);
 	assert(&item.GetStock() == this);
 
+	counters.lifetime_histogram.Add(GetEventLoop().SteadyNow() - item.GetCreateTime());
 	delete &item;
 	return PutAction::DESTROY;
 }
@@ -678,6 +760,7 @@ MultiStock::MapItem::ItemIdleDisconnect(StockItem &item) noexcept
 
 	assert(item.is_idle);
 
+	counters.lifetime_histogram.Add(GetEventLoop().SteadyNow() - item.GetCreateTime());
 	delete &item;
 }
 
@@ -848,6 +931,7 @@ MultiStock::MakeMapItem(StockKey key, const void *request) noexcept
 		auto *item = new MapItem(*this,
 					 GetEventLoop(), outer_class, key,
 					 inner_class.GetOptions(request, options),
+					 inner_class.GetPlacement(request),
 					 inner_class);
 		map.insert_commit(i, *item);
 		chronological_list.push_back(*item);
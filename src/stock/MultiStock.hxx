@@ -11,6 +11,7 @@
 #include "Item.hxx"
 #include "Options.hxx"
 #include "Stats.hxx"
+#include "WaitTracker.hxx"
 #include "event/DeferEvent.hxx"
 #include "event/CoarseTimerEvent.hxx"
 #include "event/FineTimerEvent.hxx"
@@ -19,6 +20,8 @@
 #include "util/IntrusiveList.hxx"
 
 #include <concepts> // for std::predicate
+#include <cstdint>
+#include <random>
 #include <string>
 
 class CancellablePointer;
@@ -28,12 +31,48 @@ class StockItem;
 struct StockOptions;
 struct StockStats;
 
+/**
+ * How does #MultiStock choose among several usable "outer" items
+ * for a new lease?
+ */
+enum class MultiStockPlacement : uint_least8_t {
+	/**
+	 * Use the first usable item (the oldest one).  This packs
+	 * leases densely and lets surplus items become idle.
+	 */
+	FIRST,
+
+	/**
+	 * Use the item with the fewest leases in flight.
+	 */
+	LEAST_BUSY,
+
+	/**
+	 * Pick two random usable items and use the one with fewer
+	 * leases in flight ("power of two choices").
+	 */
+	TWO_CHOICES,
+
+	/**
+	 * Use the item with the lowest product of leases in flight
+	 * and average lease duration (a moving average of recent
+	 * response times).  Items which have not yet completed a
+	 * lease are compared like #LEAST_BUSY.
+	 */
+	LATENCY_EWMA,
+};
+
 class MultiStockClass {
 public:
 	[[gnu::pure]]
 	virtual StockOptions GetOptions(const void *request,
 					StockOptions o) const noexcept;
 
+	[[gnu::pure]]
+	virtual MultiStockPlacement GetPlacement([[maybe_unused]] const void *request) const noexcept {
+		return MultiStockPlacement::FIRST;
+	}
+
 	virtual StockItem *Create(CreateStockItem c,
 				  StockItem &shared_item) = 0;
 };
@@ -76,6 +115,14 @@ class MultiStock {
 
 		StockCounters counters{};
 
+		/**
+		 * The exponentially weighted moving average of
+		 * recent lease durations (measured from borrowing
+		 * to Put()).  Zero means there is no sample yet; the
+		 * first sample initializes it.
+		 */
+		Event::Duration latency{};
+
 	public:
 		OuterItem(MapItem &_parent, StockItem &_item,
 			  std::size_t _limit,
@@ -110,6 +157,21 @@ class MultiStock {
 			return idle.empty() && busy.empty();
 		}
 
+		/**
+		 * Returns the number of leases currently in flight.
+		 */
+		std::size_t GetBusyCount() const noexcept {
+			return busy.size();
+		}
+
+		Event::Duration GetLatency() const noexcept {
+			return latency;
+		}
+
+		bool HasLatency() const noexcept {
+			return latency > Event::Duration::zero();
+		}
+
 		bool CanUse() const noexcept;
 		bool ShouldDelete() const noexcept;
 
@@ -202,6 +264,8 @@ class MultiStock {
 
 		const std::size_t hash;
 
+		const MultiStockPlacement placement;
+
 		/**
 		 * The maximum number of items in this stock.  If any
 		 * more items are requested, they are put into the
@@ -212,7 +276,12 @@ class MultiStock {
 
 		const Event::Duration clear_interval;
 
-		const Event::Duration max_wait;
+		/**
+		 * Decides whether new waiters shall be rejected
+		 * (with #StockOverloadedError) because recent waits
+		 * have been too long.
+		 */
+		StockWaitTracker wait_tracker;
 
 		struct Waiting;
 		using WaitingList = IntrusiveList<Waiting,
@@ -239,15 +308,6 @@ class MultiStock {
 		 */
 		Event::TimePoint create_start_time;
 
-		/**
-		 * All waits for an item (when all items are busy
-		 * currently) will be rejected with
-		 * #StockOverloadedError.  This is set by
-		 * WaitingEnded() if a wait was longer than #max_wait
-		 * to throttle the wait queue.
-		 */
-		Event::TimePoint reject_wait_until{};
-
 		/**
 		 * Timer for Expire().
 		 */
@@ -276,6 +336,7 @@ class MultiStock {
 			EventLoop &event_loop, StockClass &_outer_class,
 			StockKey key,
 			StockOptions options,
+			MultiStockPlacement _placement,
 			MultiStockClass &_inner_class) noexcept;
 		~MapItem() noexcept;
 
@@ -348,9 +409,27 @@ class MultiStock {
 		[[gnu::pure]]
 		OuterItem &ToOuterItem(StockItem &shared_item) noexcept;
 
-		[[gnu::pure]]
+		/**
+		 * Find an #OuterItem which can be used for a new
+		 * lease, according to #placement.
+		 */
 		OuterItem *FindUsable() noexcept;
 
+		/**
+		 * Is #a a better choice than #b according to
+		 * #placement?
+		 */
+		[[gnu::pure]]
+		bool IsBetter(const OuterItem &a,
+			      const OuterItem &b) const noexcept;
+
+		/**
+		 * Implementation of MultiStockPlacement::TWO_CHOICES.
+		 *
+		 * @param n_usable the number of usable items
+		 */
+		OuterItem &PickTwoChoices(std::size_t n_usable) noexcept;
+
 		/**
 		 * Delete all empty items.
 		 */
@@ -441,6 +520,11 @@ class MultiStock {
 	 */
 	StockCounters counters;
 
+	/**
+	 * For MultiStockPlacement::TWO_CHOICES.
+	 */
+	std::minstd_rand random;
+
 public:
 	MultiStock(EventLoop &_event_loop, StockClass &_outer_cls,
 		   StockOptions _options,
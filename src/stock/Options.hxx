@@ -8,6 +8,36 @@
 
 #include <cstddef>
 
+/**
+ * Options for pre-warming items (see
+ * StockClass::GetPreWarmOptions()).  The stock keeps an
+ * exponentially weighted moving average of the peak number of
+ * concurrently used items per interval, and creates idle items in
+ * advance so that this number is available when a burst arrives.
+ */
+struct StockPreWarmOptions {
+	/**
+	 * The maximum number of items to be created in advance.
+	 * Zero disables pre-warming.
+	 */
+	std::size_t max_items = 0;
+
+	/**
+	 * How often is the demand sampled (and items created)?
+	 */
+	Event::Duration interval = std::chrono::seconds{10};
+
+	/**
+	 * The EWMA smoothing factor (0..1]; small values remember
+	 * past demand for a longer time.
+	 */
+	double alpha = 0.1;
+
+	constexpr bool IsEnabled() const noexcept {
+		return max_items > 0;
+	}
+};
+
 /**
  * Options for class #BasicStock.
  */
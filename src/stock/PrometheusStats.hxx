@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "Stats.hxx"
+#include "event/PrometheusStats.hxx"
+
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+
+/**
+ * Format the given statistics in the Prometheus text format.  The
+ * #StockStats object can be filled by Stock::AddStats(),
+ * StockMap::AddStats() or MultiStock::AddStats().
+ *
+ * @param stock the value of the "stock" label
+ */
+inline std::string
+ToPrometheusString(const StockStats &stats, std::string_view stock) noexcept
+{
+	using std::string_view_literals::operator""sv;
+	using FloatSeconds = std::chrono::duration<double>;
+
+	auto s = fmt::format(R"(
+# HELP stock_items Number of items
+# TYPE stock_items gauge
+
+# HELP stock_waiting Number of callers waiting for an item
+# TYPE stock_waiting gauge
+
+# HELP stock_creates Total number of create operations
+# TYPE stock_creates counter
+
+# HELP stock_create_duration Total duration of create operations
+# TYPE stock_create_duration counter
+
+# HELP stock_waits Total number of waits for an item
+# TYPE stock_waits counter
+
+# HELP stock_wait_duration Total duration waiting for an item
+# TYPE stock_wait_duration counter
+
+# HELP stock_rejects Total number of rejected requests because the stock was overloaded
+# TYPE stock_rejects counter
+
+# HELP stock_pre_warm Total number of items created in advance and what became of them
+# TYPE stock_pre_warm counter
+
+stock_items{{stock={:?},state="busy"}} {}
+stock_items{{stock={:?},state="idle"}} {}
+stock_waiting{{stock={:?}}} {}
+stock_creates{{stock={:?},result="success"}} {}
+stock_creates{{stock={:?},result="failure"}} {}
+stock_creates{{stock={:?},result="canceled"}} {}
+stock_create_duration{{stock={:?}}} {}
+stock_waits{{stock={:?},result="success"}} {}
+stock_waits{{stock={:?},result="failure"}} {}
+stock_waits{{stock={:?},result="canceled"}} {}
+stock_wait_duration{{stock={:?}}} {}
+stock_rejects{{stock={:?}}} {}
+stock_pre_warm{{stock={:?},result="create"}} {}
+stock_pre_warm{{stock={:?},result="hit"}} {}
+stock_pre_warm{{stock={:?},result="wasted"}} {}
+)"sv,
+			     stock, stats.busy,
+			     stock, stats.idle,
+			     stock, stats.waiting,
+			     stock, stats.successful_creates,
+			     stock, stats.failed_creates,
+			     stock, stats.canceled_creates,
+			     stock,
+			     std::chrono::duration_cast<FloatSeconds>(stats.total_create_duration).count(),
+			     stock, stats.successful_waits,
+			     stock, stats.failed_waits,
+			     stock, stats.canceled_waits,
+			     stock,
+			     std::chrono::duration_cast<FloatSeconds>(stats.total_wait_duration).count(),
+			     stock, stats.rejects,
+			     stock, stats.pre_warm_creates,
+			     stock, stats.pre_warm_hits,
+			     stock, stats.pre_warm_wasted);
+
+	const auto labels = fmt::format("stock={:?}"sv, stock);
+	AppendPrometheusHistogram(s, "stock_create_seconds"sv,
+				  "Duration of each create operation"sv,
+				  stats.create_histogram, labels);
+	AppendPrometheusHistogram(s, "stock_wait_seconds"sv,
+				  "Duration of each wait for an item"sv,
+				  stats.wait_histogram, labels);
+	AppendPrometheusHistogram(s, "stock_item_lifetime_seconds"sv,
+				  "Lifetime of each destroyed item"sv,
+				  stats.lifetime_histogram, labels);
+
+	return s;
+}
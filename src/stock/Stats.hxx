@@ -5,6 +5,7 @@
 #pragma once
 
 #include "event/Chrono.hxx"
+#include "event/Stats.hxx"
 
 #include <cstddef>
 
@@ -26,6 +27,40 @@ struct StockCounters {
 
 	std::size_t rejects;
 
+	/**
+	 * Number of items created by pre-warming, the number of
+	 * those which were used later (i.e. a caller did not have to
+	 * wait for a new item) and the number of those which were
+	 * destroyed without ever being used.
+	 */
+	std::size_t pre_warm_creates, pre_warm_hits, pre_warm_wasted;
+
+	/**
+	 * The duration of each create operation.
+	 */
+	EventLoopHistogram create_histogram;
+
+	/**
+	 * The duration of each wait for an item.
+	 */
+	EventLoopHistogram wait_histogram;
+
+	/**
+	 * The lifetime of each destroyed item (from creation to
+	 * destruction).
+	 */
+	EventLoopHistogram lifetime_histogram;
+
+	constexpr void AddCreateDuration(Event::Duration d) noexcept {
+		total_create_duration += d;
+		create_histogram.Add(d);
+	}
+
+	constexpr void AddWaitDuration(Event::Duration d) noexcept {
+		total_wait_duration += d;
+		wait_histogram.Add(d);
+	}
+
 	constexpr auto &operator+=(const StockCounters &other) noexcept {
 		total_creates += other.total_creates;
 		canceled_creates += other.canceled_creates;
@@ -38,6 +73,12 @@ struct StockCounters {
 		total_create_duration += other.total_create_duration;
 		total_wait_duration += other.total_wait_duration;
 		rejects += other.rejects;
+		pre_warm_creates += other.pre_warm_creates;
+		pre_warm_hits += other.pre_warm_hits;
+		pre_warm_wasted += other.pre_warm_wasted;
+		create_histogram += other.create_histogram;
+		wait_histogram += other.wait_histogram;
+		lifetime_histogram += other.lifetime_histogram;
 		return *this;
 	}
 };
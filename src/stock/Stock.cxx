@@ -68,10 +68,9 @@ Stock::WaitingEnded(Waiting &w) noexcept
 {
 	const auto now = GetEventLoop().SteadyNow();
 	const auto wait_duration = now - w.start_time;
-	counters.total_wait_duration += wait_duration;
+	counters.AddWaitDuration(wait_duration);
 
-	if (max_wait > Event::Duration{} && wait_duration > max_wait)
-		reject_wait_until = now + std::chrono::seconds{1};
+	wait_tracker.Add(now, wait_duration);
 }
 
 inline void
@@ -176,7 +175,7 @@ Stock::Stock(EventLoop &event_loop, StockClass &_cls,
 	     std::string_view _name, StockOptions options) noexcept
 	:BasicStock(event_loop, _cls, _name, options),
 	 limit(options.limit),
-	 max_wait(options.max_wait),
+	 wait_tracker(options.max_wait),
 	 retry_event(event_loop, BIND_THIS_METHOD(RetryWaiting))
 {
 }
@@ -197,7 +196,7 @@ Stock::Get(StockRequest request,
 	if (IsFull()) {
 		const auto now = GetEventLoop().SteadyNow();
 
-		if (now < reject_wait_until) {
+		if (wait_tracker.IsRejecting(now)) {
 			++counters.rejects;
 			get_handler.OnStockItemError(std::make_exception_ptr(StockOverloadedError{"Overloaded"}));
 			return;
@@ -209,6 +208,7 @@ Stock::Get(StockRequest request,
 				     now,
 				     get_handler, cancel_ptr);
 		waiting.push_back(*w);
+		NoteDemand(GetActiveCount() + waiting.size());
 		return;
 	}
 
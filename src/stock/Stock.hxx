@@ -7,6 +7,7 @@
 #include "BasicStock.hxx"
 #include "Request.hxx"
 #include "Stats.hxx"
+#include "WaitTracker.hxx"
 #include "event/DeferEvent.hxx"
 #include "util/IntrusiveList.hxx"
 
@@ -32,7 +33,12 @@ class Stock : public BasicStock {
 	 */
 	const std::size_t limit;
 
-	const Event::Duration max_wait;
+	/**
+	 * Decides whether new waiters shall be rejected (with
+	 * #StockOverloadedError) because recent waits have been
+	 * too long.
+	 */
+	StockWaitTracker wait_tracker;
 
 	/**
 	 * This event is used to move the "retry waiting" code out of the
@@ -50,8 +56,6 @@ class Stock : public BasicStock {
 
 	uint_least64_t last_fairness_hash = 0;
 
-	Event::TimePoint reject_wait_until;
-
 public:
 	/**
 	 * @param name may be something like a hostname:port pair for HTTP
@@ -112,6 +116,11 @@ public:
 	}
 
 private:
+	/* virtual methods from class BasicStock */
+	bool MayCreate() const noexcept override {
+		return !IsFull();
+	}
+
 	void OnCreateCanceled() noexcept override;
 
 	/**
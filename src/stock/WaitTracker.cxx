@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "WaitTracker.hxx"
+
+inline void
+StockWaitTracker::Rotate(Event::TimePoint now) noexcept
+{
+	const auto age = now - window_start;
+	if (age < WINDOW)
+		return;
+
+	/* if more than two windows have elapsed, the old data is
+	   obsolete */
+	windows[1] = age < WINDOW * 2 ? windows[0] : Window{};
+	windows[0] = {};
+	window_start = now;
+}
+
+void
+StockWaitTracker::Add(Event::TimePoint now,
+		      Event::Duration wait_duration) noexcept
+{
+	if (max_wait <= Event::Duration{})
+		return;
+
+	Rotate(now);
+
+	const bool exceeded = wait_duration > max_wait;
+
+	++windows[0].count;
+	if (exceeded)
+		++windows[0].exceeded;
+
+	const uint_least64_t total_count = windows[0].count + windows[1].count;
+	const uint_least64_t total_exceeded = windows[0].exceeded + windows[1].exceeded;
+
+	const bool reject = total_count < MIN_SAMPLES
+		? exceeded
+		: total_exceeded * MAX_EXCEEDED_DIVISOR > total_count;
+
+	if (reject)
+		reject_until = now + REJECT_DURATION;
+}
+
+double
+StockWaitTracker::GetExceededRatio() const noexcept
+{
+	const uint_least64_t total_count = windows[0].count + windows[1].count;
+	if (total_count == 0)
+		return 0;
+
+	const uint_least64_t total_exceeded = windows[0].exceeded + windows[1].exceeded;
+	return static_cast<double>(total_exceeded) / total_count;
+}
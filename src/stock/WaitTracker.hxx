@@ -0,0 +1,97 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "event/Chrono.hxx"
+
+#include <array>
+#include <cstdint>
+
+/**
+ * Admission control for callers waiting for a stock item: tracks
+ * the wait durations of the last few seconds, and if more than 5% of
+ * them exceed the configured maximum, new waiters are rejected for a
+ * while.
+ */
+class StockWaitTracker {
+	/**
+	 * The duration of one observation window.  The ratio is
+	 * calculated over the current and the previous window.
+	 */
+	static constexpr Event::Duration WINDOW = std::chrono::seconds{5};
+
+	/**
+	 * How long to reject new waiters after the limit was
+	 * exceeded?
+	 */
+	static constexpr Event::Duration REJECT_DURATION = std::chrono::seconds{1};
+
+	/**
+	 * Below this number of samples, the ratio is not meaningful,
+	 * and a single wait exceeding the limit triggers rejection.
+	 */
+	static constexpr uint_least64_t MIN_SAMPLES = 20;
+
+	/**
+	 * Reject new waiters if more than 1/#MAX_EXCEEDED_DIVISOR
+	 * (i.e. 5%) of all waits exceeded #max_wait.
+	 */
+	static constexpr uint_least64_t MAX_EXCEEDED_DIVISOR = 20;
+
+	const Event::Duration max_wait;
+
+	struct Window {
+		/**
+		 * The number of waits.
+		 */
+		uint_least64_t count = 0;
+
+		/**
+		 * The number of waits which took longer than
+		 * #max_wait.
+		 */
+		uint_least64_t exceeded = 0;
+	};
+
+	/**
+	 * The current (index 0) and the previous (index 1)
+	 * observation window.
+	 */
+	std::array<Window, 2> windows{};
+
+	Event::TimePoint window_start{};
+
+	Event::TimePoint reject_until{};
+
+public:
+	/**
+	 * @param _max_wait the maximum acceptable wait duration for
+	 * 95% of all waiters; zero disables admission control
+	 */
+	explicit constexpr StockWaitTracker(Event::Duration _max_wait) noexcept
+		:max_wait(_max_wait) {}
+
+	/**
+	 * Shall new waiters be rejected?
+	 */
+	constexpr bool IsRejecting(Event::TimePoint now) const noexcept {
+		return now < reject_until;
+	}
+
+	/**
+	 * A wait has ended (successfully or not).
+	 */
+	void Add(Event::TimePoint now, Event::Duration wait_duration) noexcept;
+
+	/**
+	 * Returns the fraction (0..1) of recent waits which took
+	 * longer than the configured maximum.
+	 */
+	[[gnu::pure]]
+	double GetExceededRatio() const noexcept;
+
+private:
+	void Rotate(Event::TimePoint now) noexcept;
+};
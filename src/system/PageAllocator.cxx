@@ -3,9 +3,16 @@
 // author: Max Kellermann <max.kellermann@ionos.com>
 
 #include "PageAllocator.hxx"
+#include "HugePage.hxx"
+#include "linux/mbind.h"
 
+#include <cassert>
+#include <climits> // for CHAR_BIT
+#include <cstdint>
 #include <new>
 
+#include <sched.h> // for getcpu()
+
 std::byte *
 AllocatePages(std::size_t size)
 {
@@ -16,3 +23,68 @@ AllocatePages(std::size_t size)
 
 	return reinterpret_cast<std::byte *>(p);
 }
+
+std::byte *
+AllocateAlignedPages(std::size_t size, std::size_t alignment)
+{
+	assert(alignment > 0);
+	assert((alignment & (alignment - 1)) == 0);
+
+	/* allocate more than needed and unmap the excess at both
+	   ends */
+	std::byte *const p = AllocatePages(size + alignment);
+	std::byte *const aligned = reinterpret_cast<std::byte *>
+		(RoundUpToPowerOfTwo(reinterpret_cast<std::uintptr_t>(p),
+				     static_cast<std::uintptr_t>(alignment)));
+
+	if (aligned > p)
+		FreePages({p, aligned});
+
+	std::byte *const end = p + size + alignment;
+	if (aligned + size < end)
+		FreePages({aligned + size, end});
+
+	return aligned;
+}
+
+std::byte *
+AllocateHugeTlbPages(std::size_t size) noexcept
+{
+	assert(size % HUGE_PAGE_SIZE == 0);
+
+#ifdef MAP_HUGETLB
+	int flags = MAP_ANONYMOUS|MAP_PRIVATE|MAP_HUGETLB;
+#ifdef MAP_HUGE_2MB
+	static_assert(HUGE_PAGE_SIZE == 2 * 1024 * 1024);
+	flags |= MAP_HUGE_2MB;
+#endif
+
+	void *p = mmap(NULL, size, PROT_READ|PROT_WRITE, flags, -1, 0);
+	if (p == MAP_FAILED)
+		return nullptr;
+
+	return reinterpret_cast<std::byte *>(p);
+#else
+	(void)size;
+	return nullptr;
+#endif
+}
+
+bool
+BindPagesToLocalNode(std::span<std::byte> p) noexcept
+{
+	unsigned cpu, node;
+	if (getcpu(&cpu, &node) < 0)
+		return false;
+
+	static constexpr std::size_t BITS = sizeof(unsigned long) * CHAR_BIT;
+	static constexpr unsigned MAX_NODES = 1024;
+	if (node >= MAX_NODES)
+		return false;
+
+	unsigned long nodemask[MAX_NODES / BITS]{};
+	nodemask[node / BITS] = 1UL << (node % BITS);
+
+	return my_mbind(p.data(), p.size(), MPOL_PREFERRED,
+			nodemask, MAX_NODES, 0) == 0;
+}
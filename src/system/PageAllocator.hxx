@@ -20,6 +20,38 @@
 std::byte *
 AllocatePages(std::size_t size);
 
+/**
+ * Like AllocatePages(), but the returned address is aligned to the
+ * given alignment.  This is useful for allowing the kernel to back
+ * the whole allocation with transparent huge pages.
+ *
+ * Throws std::bad_alloc on error.
+ *
+ * @param alignment a power of two and a multiple of #PAGE_SIZE
+ */
+std::byte *
+AllocateAlignedPages(std::size_t size, std::size_t alignment);
+
+/**
+ * Allocate explicit huge pages from the hugetlbfs pool
+ * (MAP_HUGETLB with #HUGE_PAGE_SIZE).
+ *
+ * @param size a multiple of #HUGE_PAGE_SIZE
+ * @return nullptr if no huge pages are available
+ */
+std::byte *
+AllocateHugeTlbPages(std::size_t size) noexcept;
+
+/**
+ * Set a memory policy which prefers the NUMA node of the CPU the
+ * calling thread is currently running on.  This must be called
+ * before the pages are touched for the first time.
+ *
+ * @return false on error (e.g. kernel without NUMA support)
+ */
+bool
+BindPagesToLocalNode(std::span<std::byte> p) noexcept;
+
 static inline void
 FreePages(std::span<std::byte> p) noexcept
 {
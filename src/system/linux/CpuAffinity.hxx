@@ -0,0 +1,34 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "system/Error.hxx"
+
+#include <vector>
+
+#include <sched.h>
+
+/**
+ * Returns the numbers of all CPUs this thread is allowed to run on
+ * (see sched_getaffinity()), in ascending order.
+ *
+ * Throws on error.
+ */
+inline std::vector<unsigned>
+GetAllowedCpus()
+{
+	cpu_set_t cpuset;
+	if (sched_getaffinity(0, sizeof(cpuset), &cpuset) < 0)
+		throw MakeErrno("sched_getaffinity() failed");
+
+	std::vector<unsigned> result;
+	result.reserve(CPU_COUNT(&cpuset));
+
+	for (unsigned i = 0; i < CPU_SETSIZE; ++i)
+		if (CPU_ISSET(i, &cpuset))
+			result.push_back(i);
+
+	return result;
+}
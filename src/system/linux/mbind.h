@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static inline long
+my_mbind(void *addr, unsigned long len, int mode,
+	 const unsigned long *nodemask, unsigned long maxnode,
+	 unsigned flags) noexcept
+{
+	return syscall(__NR_mbind, addr, len, mode, nodemask, maxnode, flags);
+}
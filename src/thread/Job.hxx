@@ -49,6 +49,17 @@ public:
 	 */
 	bool again = false;
 
+	/**
+	 * The index of the #ThreadQueue shard this job was added
+	 * to.  Only valid if the state is not INITIAL.
+	 */
+	uint_least16_t shard = 0;
+
+	/**
+	 * The next job in the #ThreadQueue's lock-free "done" stack.
+	 */
+	ThreadJob *next_done = nullptr;
+
 	/**
 	 * Is this job currently idle, i.e. not being worked on by a
 	 * worker thread?  This method may be called only from the main
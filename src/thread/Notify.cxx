@@ -23,7 +23,11 @@ Notify::~Notify() noexcept
 void
 Notify::Signal() noexcept
 {
+	n_signals.fetch_add(1, std::memory_order_relaxed);
+
 	if (!pending.exchange(true)) {
+		n_wakeups.fetch_add(1, std::memory_order_relaxed);
+
 		static constexpr uint64_t value = 1;
 		(void)event.GetFileDescriptor()
 			.Write(ReferenceAsBytes(value));
@@ -8,6 +8,7 @@
 #include "util/BindMethod.hxx"
 
 #include <atomic>
+#include <cstdint>
 
 /**
  * Send notifications from a worker thread to the main thread.
@@ -20,6 +21,11 @@ class Notify {
 
 	std::atomic_bool pending{false};
 
+	/**
+	 * Counters for GetStats().
+	 */
+	std::atomic_uint64_t n_signals{0}, n_wakeups{0};
+
 public:
 	Notify(EventLoop &event_loop, Callback _callback) noexcept;
 	~Notify() noexcept;
@@ -38,6 +44,31 @@ public:
 
 	void Signal() noexcept;
 
+	struct Stats {
+		/**
+		 * The number of Signal() calls.
+		 */
+		uint_least64_t signals;
+
+		/**
+		 * The number of eventfd writes.  Signal() calls
+		 * are coalesced while the main thread has not yet
+		 * handled the previous one, so this is usually much
+		 * smaller than #signals.
+		 */
+		uint_least64_t wakeups;
+	};
+
+	/**
+	 * This method is thread-safe.
+	 */
+	Stats GetStats() const noexcept {
+		return {
+			n_signals.load(std::memory_order_relaxed),
+			n_wakeups.load(std::memory_order_relaxed),
+		};
+	}
+
 	/**
 	 * Wait for Signal() to be called synchronously, but do not
 	 * consume the event.  This method is only meant as a
@@ -10,8 +10,10 @@
 #include "Queue.hxx"
 #include "Worker.hxx"
 #include "io/Logger.hxx"
+#include "system/linux/CpuAffinity.hxx"
 
 #include <forward_list>
+#include <vector>
 
 #include <assert.h>
 #include <stdlib.h>
@@ -19,18 +21,17 @@
 
 static ThreadQueue *global_thread_queue;
 static bool global_thread_queue_volatile = false;
+static unsigned configured_worker_count = 0;
+static bool worker_cpu_affinity = false;
 static std::forward_list<ThreadWorker> worker_threads;
 
-static void
-thread_pool_init(EventLoop &event_loop) noexcept
-{
-	global_thread_queue = new ThreadQueue(event_loop);
-}
-
-[[gnu::const]]
+[[gnu::pure]]
 static unsigned
 GetWorkerThreadCount() noexcept
 {
+	if (configured_worker_count > 0)
+		return configured_worker_count;
+
 	const int nprocs = get_nprocs();
 	if (nprocs <= 1)
 		return 1;
@@ -45,14 +46,43 @@ GetWorkerThreadCount() noexcept
 	return n;
 }
 
+static void
+thread_pool_init(EventLoop &event_loop) noexcept
+{
+	/* one queue shard per worker thread */
+	global_thread_queue = new ThreadQueue(event_loop,
+					      GetWorkerThreadCount());
+}
+
+/**
+ * Determine the CPUs the worker threads shall be pinned to.  Returns
+ * an empty vector (i.e. no pinning) on error.
+ */
+static std::vector<unsigned>
+GetWorkerCpus() noexcept
+try {
+	return GetAllowedCpus();
+} catch (...) {
+	LogConcat(2, "thread_pool", "Failed to determine CPU affinity: ",
+		  std::current_exception());
+	return {};
+}
+
 static void
 thread_pool_start() noexcept
 try {
 	assert(global_thread_queue != nullptr);
 
 	const unsigned n_worker_threads = GetWorkerThreadCount();
+	const auto cpus = worker_cpu_affinity
+		? GetWorkerCpus()
+		: std::vector<unsigned>{};
+
 	for (unsigned i = 0; i < n_worker_threads; ++i) {
-		worker_threads.emplace_front(*global_thread_queue);
+		const int cpu = cpus.empty()
+			? -1
+			: static_cast<int>(cpus[i % cpus.size()]);
+		worker_threads.emplace_front(*global_thread_queue, i, cpu);
 	}
 } catch (...) {
 	LogConcat(1, "thread_pool", "Failed to launch worker thread: ",
@@ -77,6 +107,22 @@ thread_pool_get_queue(EventLoop &event_loop) noexcept
 	return *global_thread_queue;
 }
 
+void
+thread_pool_set_worker_count(unsigned n) noexcept
+{
+	assert(global_thread_queue == nullptr);
+
+	configured_worker_count = n;
+}
+
+void
+thread_pool_set_cpu_affinity(bool enable) noexcept
+{
+	assert(global_thread_queue == nullptr);
+
+	worker_cpu_affinity = enable;
+}
+
 void
 thread_pool_set_volatile() noexcept
 {
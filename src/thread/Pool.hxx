@@ -24,6 +24,22 @@ class ThreadQueue;
 ThreadQueue &
 thread_pool_get_queue(EventLoop &event_loop) noexcept;
 
+/**
+ * Override the number of worker threads (the default depends on the
+ * number of CPUs).  This must be called before the first
+ * thread_pool_get_queue() call.
+ */
+void
+thread_pool_set_worker_count(unsigned n) noexcept;
+
+/**
+ * Pin each worker thread to one of the CPUs this process is allowed
+ * to run on.  If that fails, the threads are not pinned.  This must
+ * be called before the first thread_pool_get_queue() call.
+ */
+void
+thread_pool_set_cpu_affinity(bool enable) noexcept;
+
 void
 thread_pool_set_volatile() noexcept;
 
@@ -6,10 +6,13 @@
 #include "Job.hxx"
 
 #include <cassert>
+#include <utility> // for std::exchange()
 
-ThreadQueue::ThreadQueue(EventLoop &event_loop) noexcept
-	:notify(event_loop, BIND_THIS_METHOD(WakeupCallback))
+ThreadQueue::ThreadQueue(EventLoop &event_loop, unsigned _n_shards) noexcept
+	:shards(new Shard[_n_shards]), n_shards(_n_shards),
+	 notify(event_loop, BIND_THIS_METHOD(WakeupCallback))
 {
+	assert(n_shards > 0);
 }
 
 ThreadQueue::~ThreadQueue() noexcept
@@ -17,28 +20,66 @@ ThreadQueue::~ThreadQueue() noexcept
 	assert(!alive);
 }
 
+inline void
+ThreadQueue::PushWaiting(Shard &shard, ThreadJob &job) noexcept
+{
+	job.state = ThreadJob::State::WAITING;
+	job.again = false;
+	shard.waiting.push_back(job);
+
+	++n_unfinished;
+
+	/* this seq_cst increment pairs with the one of #n_sleeping
+	   in Wait(): either we see the sleeping worker or it sees
+	   this job */
+	++n_waiting;
+}
+
+inline void
+ThreadQueue::WakeWorker() noexcept
+{
+	if (n_sleeping > 0) {
+		const std::lock_guard lock{sleep_mutex};
+		sleep_cond.notify_one();
+	}
+}
+
 void
 ThreadQueue::WakeupCallback() noexcept
 {
-	std::unique_lock lock{mutex};
+	/* take the whole stack at once and reverse it, so the jobs
+	   are completed in the order they were finished */
+	ThreadJob *head = done.exchange(nullptr, std::memory_order_acquire);
+	ThreadJob *tmp = nullptr;
+	while (head != nullptr) {
+		auto *next = head->next_done;
+		head->next_done = tmp;
+		tmp = head;
+		head = next;
+	}
+
+	while (tmp != nullptr) {
+		auto &job = *tmp;
+		tmp = std::exchange(job.next_done, nullptr);
 
-	done.clear_and_dispose([this, &lock](auto *_job){
-		auto &job = *_job;
 		assert(job.state == ThreadJob::State::DONE);
 
 		if (job.again) {
 			/* schedule this job again */
-			job.state = ThreadJob::State::WAITING;
-			job.again = false;
-			waiting.push_back(job);
-			cond.notify_one();
+			auto &shard = shards[job.shard];
+
+			{
+				const std::lock_guard lock{shard.mutex};
+				PushWaiting(shard, job);
+			}
+
+			WakeWorker();
 		} else {
 			job.state = ThreadJob::State::INITIAL;
-			lock.unlock();
+			--n_queued;
 			job.Done();
-			lock.lock();
 		}
-	});
+	}
 
 	CheckDisableNotify();
 }
@@ -46,62 +87,91 @@ ThreadQueue::WakeupCallback() noexcept
 void
 ThreadQueue::Stop() noexcept
 {
-	const std::lock_guard lock{mutex};
 	alive = false;
-	cond.notify_all();
+
+	{
+		const std::lock_guard lock{sleep_mutex};
+		sleep_cond.notify_all();
+	}
 
 	volatile_notify = true;
 	CheckDisableNotify();
 }
 
-inline void
-ThreadQueue::_Add(ThreadJob &job) noexcept
+void
+ThreadQueue::Add(ThreadJob &job) noexcept
 {
-	assert(alive);
+	/* the shard index is only ever modified by the main thread,
+	   so it is safe to read it without a lock; the state however
+	   must be checked while holding the shard lock */
+	std::unique_lock lock{shards[job.shard].mutex};
 
 	if (job.state == ThreadJob::State::INITIAL) {
-		job.state = ThreadJob::State::WAITING;
-		job.again = false;
-		waiting.push_back(job);
-		cond.notify_one();
-	} else if (job.state != ThreadJob::State::WAITING) {
+		/* a new job: assign it to the next shard (round
+		   robin) */
+		const unsigned i = next_shard;
+		next_shard = (next_shard + 1) % n_shards;
+
+		if (i != job.shard) {
+			lock.unlock();
+			job.shard = i;
+			lock = std::unique_lock{shards[i].mutex};
+		}
+
+		PushWaiting(shards[i], job);
+		lock.unlock();
+
+		++n_queued;
+		WakeWorker();
+	} else if (job.state != ThreadJob::State::WAITING)
 		job.again = true;
-	}
+
+	notify.Enable();
 }
 
-void
-ThreadQueue::Add(ThreadJob &job) noexcept
+inline ThreadJob *
+ThreadQueue::TryTake(Shard &shard) noexcept
 {
-	{
-		const std::lock_guard lock{mutex};
-		_Add(job);
-	}
+	const std::lock_guard lock{shard.mutex};
 
-	notify.Enable();
+	auto i = shard.waiting.begin();
+	if (i == shard.waiting.end())
+		return nullptr;
+
+	auto &job = *i;
+	assert(job.state == ThreadJob::State::WAITING);
+
+	job.state = ThreadJob::State::BUSY;
+	shard.waiting.erase(i);
+	--n_waiting;
+	return &job;
 }
 
 ThreadJob *
-ThreadQueue::Wait() noexcept
+ThreadQueue::Wait(unsigned worker) noexcept
 {
-	std::unique_lock lock{mutex};
-
 	while (true) {
 		if (!alive)
 			return nullptr;
 
-		auto i = waiting.begin();
-		if (i != waiting.end()) {
-			auto &job = *i;
-			assert(job.state == ThreadJob::State::WAITING);
-
-			job.state = ThreadJob::State::BUSY;
-			job.unlink();
-			busy.push_back(job);
-			return &job;
+		/* check our own shard first, then steal from the
+		   others */
+		if (n_waiting > 0) {
+			for (unsigned k = 0; k < n_shards; ++k) {
+				auto &shard = shards[(worker + k) % n_shards];
+				if (auto *job = TryTake(shard))
+					return job;
+			}
 		}
 
-		/* queue is empty, wait for a new job to be added */
-		cond.wait(lock);
+		/* all shards are empty, wait for a new job to be
+		   added */
+		std::unique_lock lock{sleep_mutex};
+		++n_sleeping;
+		sleep_cond.wait(lock, [this]{
+			return n_waiting > 0 || !alive;
+		});
+		--n_sleeping;
 	}
 }
 
@@ -111,20 +181,27 @@ ThreadQueue::Done(ThreadJob &job) noexcept
 	assert(job.state == ThreadJob::State::BUSY);
 
 	{
-		const std::lock_guard lock{mutex};
-
+		const std::lock_guard lock{shards[job.shard].mutex};
 		job.state = ThreadJob::State::DONE;
-		job.unlink();
-		done.push_back(job);
 	}
 
+	job.next_done = done.load(std::memory_order_relaxed);
+	while (!done.compare_exchange_weak(job.next_done, &job,
+					   std::memory_order_release,
+					   std::memory_order_relaxed)) {}
+
+	--n_unfinished;
+
+	/* the eventfd is written only once until the main thread
+	   has handled it, so this wakes up the EventLoop once for a
+	   whole batch of finished jobs */
 	notify.Signal();
 }
 
 bool
 ThreadQueue::Cancel(ThreadJob &job) noexcept
 {
-	const std::lock_guard lock{mutex};
+	const std::lock_guard lock{shards[job.shard].mutex};
 
 	switch (job.state) {
 	case ThreadJob::State::INITIAL:
@@ -135,6 +212,9 @@ ThreadQueue::Cancel(ThreadJob &job) noexcept
 		/* cancel it */
 		job.unlink();
 		job.state = ThreadJob::State::INITIAL;
+		--n_waiting;
+		--n_unfinished;
+		--n_queued;
 		CheckDisableNotify();
 		return true;
 
@@ -154,11 +234,6 @@ ThreadQueue::Cancel(ThreadJob &job) noexcept
 void
 ThreadQueue::FlushSynchronously() noexcept
 {
-	std::unique_lock lock{mutex};
-
-	while (!waiting.empty() || !busy.empty()) {
-		lock.unlock();
+	while (n_unfinished > 0)
 		notify.WaitSynchronously();
-		lock.lock();
-	}
 }
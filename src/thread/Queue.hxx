@@ -7,8 +7,11 @@
 #include "Notify.hxx"
 #include "util/IntrusiveList.hxx"
 
-#include <mutex>
+#include <atomic>
 #include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
 
 class EventLoop;
 class ThreadJob;
@@ -16,12 +19,64 @@ struct ThreadJobTag;
 
 /**
  * A queue that manages work for worker threads (#ThreadWorker).
+ *
+ * The waiting jobs are distributed over several shards (usually one
+ * per worker thread), each with its own lock.  A worker takes jobs
+ * from its own shard first and steals from the other shards when its
+ * own one is empty.  This avoids contention on one global lock.
  */
 class ThreadQueue {
-	std::mutex mutex;
-	std::condition_variable cond;
+	using JobList = IntrusiveList<ThreadJob,
+				      IntrusiveListBaseHookTraits<ThreadJob, ThreadJobTag>>;
+
+	struct Shard {
+		/**
+		 * Protects #waiting and the state of all jobs
+		 * assigned to this shard.
+		 */
+		std::mutex mutex;
+
+		JobList waiting;
+	};
+
+	const std::unique_ptr<Shard[]> shards;
+	const unsigned n_shards;
+
+	/**
+	 * The shard which will receive the next new job (round
+	 * robin).  Only accessed by the main thread.
+	 */
+	unsigned next_shard = 0;
+
+	/**
+	 * Idle worker threads wait on this.
+	 */
+	std::mutex sleep_mutex;
+	std::condition_variable sleep_cond;
+
+	/**
+	 * The number of worker threads waiting on #sleep_cond (or
+	 * about to).
+	 */
+	std::atomic_uint n_sleeping{0};
+
+	/**
+	 * The number of jobs in state WAITING (in all shards).
+	 */
+	std::atomic_size_t n_waiting{0};
+
+	/**
+	 * The number of jobs in state WAITING or BUSY.
+	 */
+	std::atomic_size_t n_unfinished{0};
+
+	/**
+	 * The number of jobs which are not INITIAL.  Only accessed
+	 * by the main thread.
+	 */
+	std::size_t n_queued = 0;
 
-	bool alive = true;
+	std::atomic_bool alive{true};
 
 	/**
 	 * Is #notify in "volatile" mode, i.e. disable it as soon as
@@ -29,15 +84,21 @@ class ThreadQueue {
 	 */
 	bool volatile_notify = false;
 
-	using JobList = IntrusiveList<ThreadJob,
-				      IntrusiveListBaseHookTraits<ThreadJob, ThreadJobTag>>;
-
-	JobList waiting, busy, done;
+	/**
+	 * A lock-free stack of finished jobs (linked with
+	 * ThreadJob::next_done), pushed by worker threads and
+	 * drained by the main thread.
+	 */
+	std::atomic<ThreadJob *> done{nullptr};
 
 	Notify notify;
 
 public:
-	explicit ThreadQueue(EventLoop &event_loop) noexcept;
+	/**
+	 * @param _n_shards the number of shards; this should be the
+	 * number of worker threads
+	 */
+	ThreadQueue(EventLoop &event_loop, unsigned _n_shards=1) noexcept;
 	~ThreadQueue() noexcept;
 
 	auto &GetEventLoop() const noexcept {
@@ -50,7 +111,7 @@ public:
 	 */
 	void SetVolatile() noexcept {
 		volatile_notify = true;
-		LockCheckDisableNotify();
+		CheckDisableNotify();
 	}
 
 	/**
@@ -68,9 +129,11 @@ public:
 	/**
 	 * Dequeue an existing job or wait for a new job, and reserve it.
 	 *
+	 * @param worker the index of the calling worker thread; its
+	 * shard is checked first
 	 * @return nullptr if Stop() has been called
 	 */
-	ThreadJob *Wait() noexcept;
+	ThreadJob *Wait(unsigned worker) noexcept;
 
 	/**
 	 * Mark the specified job (returned by Wait()) as "done".
@@ -93,9 +156,17 @@ public:
 	 */
 	void FlushSynchronously() noexcept;
 
+	/**
+	 * Returns the number of finished jobs and the number of
+	 * eventfd wakeups they caused.
+	 */
+	Notify::Stats GetNotifyStats() const noexcept {
+		return notify.GetStats();
+	}
+
 private:
 	bool IsEmpty() const noexcept {
-		return waiting.empty() && busy.empty() && done.empty();
+		return n_queued == 0;
 	}
 
 	void CheckDisableNotify() noexcept {
@@ -103,12 +174,21 @@ private:
 			notify.Disable();
 	}
 
-	void LockCheckDisableNotify() noexcept {
-		const std::lock_guard lock{mutex};
-		CheckDisableNotify();
-	}
+	/**
+	 * Append a job to the given shard.  Caller must hold the
+	 * shard's mutex.
+	 */
+	void PushWaiting(Shard &shard, ThreadJob &job) noexcept;
 
-	void _Add(ThreadJob &job) noexcept;
+	/**
+	 * Wake up one sleeping worker thread (if there is one).
+	 */
+	void WakeWorker() noexcept;
+
+	/**
+	 * Try to take a waiting job from the given shard.
+	 */
+	ThreadJob *TryTake(Shard &shard) noexcept;
 
 	void WakeupCallback() noexcept;
 };
@@ -12,7 +12,7 @@ inline void
 ThreadWorker::Run() noexcept
 {
 	ThreadJob *job;
-	while ((job = queue.Wait()) != nullptr) {
+	while ((job = queue.Wait(index)) != nullptr) {
 		job->Run();
 		queue.Done(*job);
 	}
@@ -30,8 +30,15 @@ ThreadWorker::Run(void *ctx) noexcept
 	return nullptr;
 }
 
-ThreadWorker::ThreadWorker(ThreadQueue &_queue)
-	:queue(_queue)
+/**
+ * Launch a thread, optionally pinned to one CPU.
+ *
+ * @param cpu if not negative, then the thread is pinned to this CPU
+ * @return 0 on success or an errno value
+ */
+static int
+CreateThread(pthread_t &thread, void *(*run)(void *), void *ctx,
+	     int cpu) noexcept
 {
 	pthread_attr_t attr;
 	pthread_attr_init(&attr);
@@ -40,7 +47,33 @@ ThreadWorker::ThreadWorker(ThreadQueue &_queue)
 	/* 64 kB stack ought to be enough */
 	pthread_attr_setstacksize(&attr, std::max<std::size_t>(65536, PTHREAD_STACK_MIN));
 
-	int error = pthread_create(&thread, &attr, Run, this);
+	if (cpu >= 0) {
+		if (cpu >= CPU_SETSIZE)
+			return EINVAL;
+
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu, &cpuset);
+
+		if (int error = pthread_attr_setaffinity_np(&attr, sizeof(cpuset),
+							    &cpuset);
+		    error != 0)
+			return error;
+	}
+
+	return pthread_create(&thread, &attr, run, ctx);
+}
+
+ThreadWorker::ThreadWorker(ThreadQueue &_queue, unsigned _index, int cpu)
+	:queue(_queue), index(_index)
+{
+	int error = CreateThread(thread, Run, this, cpu);
+	if (error != 0 && cpu >= 0)
+		/* pinning is only an optimization; if it fails (e.g.
+		   because the CPU is not available), launch the
+		   thread without it */
+		error = CreateThread(thread, Run, this, -1);
+
 	if (error != 0)
 		throw MakeErrno(error, "Failed to create worker thread");
 }
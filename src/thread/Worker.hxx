@@ -16,11 +16,20 @@ class ThreadWorker {
 
 	ThreadQueue &queue;
 
+	/**
+	 * The index of this worker; it determines which
+	 * #ThreadQueue shard is checked first.
+	 */
+	const unsigned index;
+
 public:
 	/**
 	 * Throws on error.
+	 *
+	 * @param cpu if not negative, then the thread is pinned to
+	 * this CPU
 	 */
-	explicit ThreadWorker(ThreadQueue &_queue);
+	ThreadWorker(ThreadQueue &_queue, unsigned _index, int cpu=-1);
 
 	/**
 	 * Wait for the thread to exit.  You must call
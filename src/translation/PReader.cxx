@@ -5,6 +5,8 @@
 #include "PReader.hxx"
 #include "AllocatorPtr.hxx"
 
+#include <utility> // for std::exchange()
+
 #include <string.h>
 
 std::size_t
@@ -14,6 +16,7 @@ TranslatePacketReader::Feed(AllocatorPtr alloc,
 	assert(state == State::HEADER ||
 	       state == State::PAYLOAD ||
 	       state == State::COMPLETE);
+	assert(!have_saved_byte);
 
 	/* discard the packet that was completed (and consumed) by the
 	   previous call */
@@ -64,3 +67,44 @@ TranslatePacketReader::Feed(AllocatorPtr alloc,
 	consumed += nbytes;
 	return consumed;
 }
+
+std::size_t
+TranslatePacketReader::FeedInPlace(std::span<std::byte> src) noexcept
+{
+	/* in this mode, the PAYLOAD state is never used */
+	assert(state == State::HEADER || state == State::COMPLETE);
+
+	if (state == State::COMPLETE)
+		state = State::HEADER;
+
+	if (src.size() < sizeof(header))
+		/* need more data */
+		return 0;
+
+	memcpy(&header, src.data(), sizeof(header));
+
+	if (have_saved_byte)
+		/* the first byte of this header has been overwritten
+		   by the previous payload's null terminator */
+		memcpy(&header, &saved_byte, sizeof(saved_byte));
+
+	if (header.length == 0) {
+		payload = nullptr;
+		have_saved_byte = false;
+		state = State::COMPLETE;
+		return sizeof(header);
+	}
+
+	const std::size_t packet_size = sizeof(header) + header.length;
+	if (src.size() <= packet_size)
+		/* need the whole payload plus one byte for the null
+		   terminator */
+		return 0;
+
+	payload = src.data() + sizeof(header);
+	saved_byte = std::exchange(payload[header.length], std::byte{0});
+	have_saved_byte = true;
+
+	state = State::COMPLETE;
+	return packet_size;
+}
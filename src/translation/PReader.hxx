@@ -29,6 +29,15 @@ class TranslatePacketReader {
 	std::byte *payload;
 	std::size_t payload_position;
 
+	/**
+	 * In "in-place" mode: the byte which was overwritten by the
+	 * null terminator of the previous payload (i.e. the first
+	 * byte of the following packet header).
+	 */
+	std::byte saved_byte;
+
+	bool have_saved_byte = false;
+
 public:
 	/**
 	 * Read a packet from the socket.
@@ -38,6 +47,32 @@ public:
 	std::size_t Feed(AllocatorPtr alloc,
 			 std::span<const std::byte> src) noexcept;
 
+	/**
+	 * Like Feed(), but do not copy the payload; GetPayload()
+	 * returns a pointer into the given buffer instead.  This
+	 * avoids one allocation and one copy per packet.
+	 *
+	 * This requires that the caller receives the whole response
+	 * into one contiguous buffer which is only appended to (never
+	 * moved or compacted) and which outlives all users of the
+	 * payloads (e.g. the #TranslateResponse).
+	 *
+	 * To null-terminate a payload in place, the first byte of the
+	 * following packet header is overwritten (and remembered for
+	 * the next call).  Therefore, a packet with a payload is
+	 * only complete after at least one more byte has been
+	 * received; this is always the case in a well-formed
+	 * response which is terminated by
+	 * #TranslationCommand::END.
+	 *
+	 * This method must not be mixed with Feed().
+	 *
+	 * @param src the unconsumed part of the buffer
+	 * @return the number of bytes consumed; 0 if more data is
+	 * needed (call again with the same start position)
+	 */
+	std::size_t FeedInPlace(std::span<std::byte> src) noexcept;
+
 	bool IsComplete() const noexcept {
 		return state == State::COMPLETE;
 	}
@@ -4802,6 +4802,11 @@ TranslateParser::HandleRegularPacket(TranslationCommand command,
 #else
 		break;
 #endif
+
+	case TranslationCommand::REQUEST_ID:
+		/* this is used by the client connection to route
+		   pipelined responses; nothing to do here */
+		return;
 	}
 
 	throw FmtRuntimeError("unknown translation packet: {}", (unsigned)command);
@@ -204,6 +204,17 @@ public:
 		return reader.Feed(alloc, src);
 	}
 
+	/**
+	 * Like Feed(), but let the #TranslateResponse reference the
+	 * payloads in the given buffer instead of copying them.  See
+	 * TranslatePacketReader::FeedInPlace() for the buffer
+	 * requirements; most importantly, the buffer must outlive
+	 * the #TranslateResponse.
+	 */
+	std::size_t FeedInPlace(std::span<std::byte> src) noexcept {
+		return reader.FeedInPlace(src);
+	}
+
 	enum class Result {
 		MORE,
 		DONE,
@@ -1442,6 +1442,22 @@ enum class TranslationCommand : uint16_t {
 	 * A string for argv[0], which will become the process name.
 	 */
 	PROCESS_NAME = 286,
+
+	/**
+	 * Pipelining extension: a client which sends this packet
+	 * (payload is a 32 bit request id chosen by the client) in a
+	 * request may send more requests on the same connection
+	 * without waiting for the response.  The server handles them
+	 * concurrently and echoes this packet right after #BEGIN in
+	 * the response; responses may arrive in any order.  Requests
+	 * without this packet are handled strictly one at a time, as
+	 * before.
+	 *
+	 * Like all integers in this protocol, the id is in host
+	 * byte order; the server treats it as an opaque value and
+	 * echoes it verbatim.
+	 */
+	REQUEST_ID = 287,
 };
 
 struct TranslationHeader {
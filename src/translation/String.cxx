@@ -302,10 +302,11 @@ constexpr auto translation_command_names = std::array{
 	"SIGKILL_"sv, // 284
 	"MAX_INOTIFY"sv, // 285
 	"PROCESS_NAME"sv, // 286
+	"REQUEST_ID"sv, // 287
 };
 
 // Static assertion to verify the array size matches the highest enum value + 1
-static_assert(translation_command_names.size() == std::to_underlying(TranslationCommand::PROCESS_NAME) + 1);
+static_assert(translation_command_names.size() == std::to_underlying(TranslationCommand::REQUEST_ID) + 1);
 
 // Static assertions to verify specific indexes are placed correctly
 static_assert(translation_command_names[std::to_underlying(TranslationCommand::BEGIN)] == "BEGIN"sv);
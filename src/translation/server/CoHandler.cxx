@@ -19,6 +19,8 @@ namespace {
 class CoRequest final : Cancellable {
 	Connection &connection;
 
+	const Request &request;
+
 	/**
 	 * The CoHandler::OnTranslationRequest() virtual method
 	 * (coroutine) call.
@@ -33,8 +35,9 @@ class CoRequest final : Cancellable {
 	bool result = true, starting = true, complete = false;
 
 public:
-	CoRequest(Connection &_connection, Co::Task<Response> &&_task) noexcept
-		:connection(_connection),
+	CoRequest(Connection &_connection, const Request &_request,
+		  Co::Task<Response> &&_task) noexcept
+		:connection(_connection), request(_request),
 		 task(std::move(_task)) {}
 
 	bool Start(CancellablePointer &cancel_ptr) noexcept {
@@ -69,11 +72,13 @@ private:
 
 	Co::InvokeTask Handle() noexcept {
 		try {
-			result = connection.SendResponse(co_await std::move(task));
+			result = connection.SendResponse(request,
+							 co_await std::move(task));
 		} catch (...) {
 			Response response;
 			response.Status(HttpStatus::INTERNAL_SERVER_ERROR);
-			result = connection.SendResponse(std::move(response));
+			result = connection.SendResponse(request,
+							 std::move(response));
 		}
 	}
 
@@ -97,7 +102,7 @@ CoHandler::OnTranslationRequest(Connection &connection,
 				const Request &request,
 				CancellablePointer &cancel_ptr) noexcept
 {
-	auto *r = new CoRequest(connection,
+	auto *r = new CoRequest(connection, request,
 				OnTranslationRequest(request));
 	return r->Start(cancel_ptr);
 }
@@ -8,7 +8,11 @@
 #include "translation/Protocol.hxx"
 #include "net/SocketError.hxx"
 #include "io/Logger.hxx"
+#include "util/DeleteDisposer.hxx"
 
+#include <algorithm> // for std::any_of()
+
+#include <limits.h> // for IOV_MAX
 #include <sys/socket.h>
 #include <unistd.h>
 #include <string.h>
@@ -20,7 +24,6 @@ Connection::Connection(EventLoop &event_loop,
 		       UniqueSocketDescriptor &&_fd) noexcept
 	:handler(_handler),
 	 event(event_loop, BIND_THIS_METHOD(OnSocketReady), _fd.Release()),
-	 state(State::INIT),
 	 input(8192)
 {
 	event.ScheduleRead();
@@ -28,20 +31,46 @@ Connection::Connection(EventLoop &event_loop,
 
 Connection::~Connection() noexcept
 {
-	if (state == State::RESPONSE)
-		delete[] response;
+	pending.clear_and_dispose([](PendingRequest *r){
+		if (r->cancel_ptr)
+			r->cancel_ptr.Cancel();
+		delete r;
+	});
 
-	if (cancel_ptr)
-		cancel_ptr.Cancel();
+	output.clear_and_dispose(DeleteDisposer{});
 
 	event.Close();
 }
 
 inline bool
-Connection::TryRead() noexcept
+Connection::HasExclusiveRequest() const noexcept
 {
-	assert(state == State::INIT || state == State::REQUEST);
+	constexpr auto is_exclusive = [](const PendingRequest &r){
+		return !r.has_id;
+	};
+
+	return std::any_of(pending.begin(), pending.end(), is_exclusive) ||
+		std::any_of(output.begin(), output.end(), is_exclusive);
+}
+
+inline void
+Connection::UpdateRead() noexcept
+{
+	if (n_pending >= MAX_PENDING)
+		/* too many pipelined requests: stop reading until
+		   some responses have been sent */
+		event.CancelRead();
+	else if (HasExclusiveRequest())
+		/* a request without REQUEST_ID: don't read the next
+		   request before its response has been sent */
+		event.CancelRead();
+	else
+		event.ScheduleRead();
+}
 
+inline bool
+Connection::TryRead() noexcept
+{
 	auto r = input.Write();
 	assert(!r.empty());
 
@@ -67,8 +96,6 @@ Connection::TryRead() noexcept
 inline bool
 Connection::OnReceived() noexcept
 {
-	assert(state != State::PROCESSING);
-
 	while (true) {
 		auto r = input.Read();
 		const void *p = r.data();
@@ -96,38 +123,60 @@ inline bool
 Connection::OnPacket(TranslationCommand cmd,
 		     std::span<const std::byte> payload) noexcept
 {
-	assert(state != State::PROCESSING);
-
-	if (cancel_ptr) {
-		LogConcat(1, "ts",
-			  "Received more request packets while another request is still pending");
-		Destroy();
-		return false;
-	}
-
 	if (cmd == TranslationCommand::BEGIN) {
-		if (state != State::INIT) {
+		if (receiving) {
 			LogConcat(1, "ts", "Misplaced INIT");
 			Destroy();
 			return false;
 		}
 
-		state = State::REQUEST;
+		if (HasExclusiveRequest()) {
+			LogConcat(1, "ts",
+				  "Received more request packets while another request is still pending");
+			Destroy();
+			return false;
+		}
+
+		receiving = std::make_unique<PendingRequest>();
 	}
 
-	if (state != State::REQUEST) {
+	if (!receiving) {
 		LogConcat(1, "ts", "INIT expected");
 		Destroy();
 		return false;
 	}
 
 	if (cmd == TranslationCommand::END) [[unlikely]] {
-		state = State::PROCESSING;
-		return handler.OnTranslationRequest(*this, request, cancel_ptr);
+		if (!receiving->has_id && n_pending > 0) {
+			LogConcat(1, "ts",
+				  "Received request without REQUEST_ID while other requests are pending");
+			Destroy();
+			return false;
+		}
+
+		auto &request = *receiving.release();
+		pending.push_back(request);
+		++n_pending;
+		UpdateRead();
+
+		return handler.OnTranslationRequest(*this, request,
+						    request.cancel_ptr);
+	}
+
+	if (cmd == TranslationCommand::REQUEST_ID) {
+		if (receiving->has_id || payload.size() != sizeof(receiving->id)) {
+			LogConcat(1, "ts", "Malformed REQUEST_ID packet");
+			Destroy();
+			return false;
+		}
+
+		memcpy(&receiving->id, payload.data(), sizeof(receiving->id));
+		receiving->has_id = true;
+		return true;
 	}
 
 	try {
-		request.Parse(cmd, payload);
+		receiving->Parse(cmd, payload);
 	} catch (...) {
 		LogConcat(1, "ts", std::current_exception());
 		Destroy();
@@ -140,46 +189,74 @@ Connection::OnPacket(TranslationCommand cmd,
 bool
 Connection::TryWrite() noexcept
 {
-	assert(state == State::RESPONSE);
+	while (!output.empty()) {
+		auto &r = output.front();
+
+		auto v = r.response.GetIovec();
+		if (v.size() > IOV_MAX)
+			v = v.first(IOV_MAX);
+
+		ssize_t nbytes = event.GetSocket().Send(v, MSG_DONTWAIT);
+		if (nbytes < 0) {
+			const auto e = GetSocketError();
+			if (IsSocketErrorSendWouldBlock(e)) [[likely]] {
+				event.ScheduleWrite();
+				return true;
+			}
+
+			LogConcat(2, "ts", "Failed to write to client: ",
+				  (const char *)SocketErrorMessage{e});
+			Destroy();
+			return false;
+		}
 
-	ssize_t nbytes = event.GetSocket().WriteNoWait(output);
-	if (nbytes < 0) {
-		const auto e = GetSocketError();
-		if (IsSocketErrorSendWouldBlock(e)) [[likely]] {
+		r.response.Consume(nbytes);
+		if (!r.response.empty()) {
 			event.ScheduleWrite();
 			return true;
 		}
 
-		LogConcat(2, "ts", "Failed to write to client: ",
-			  (const char *)SocketErrorMessage{e});
-		Destroy();
-		return false;
-	}
-
-	output = output.subspan(nbytes);
-
-	if (output.empty()) {
-		delete[] response;
-		state = State::INIT;
-		event.CancelWrite();
+		output.pop_front_and_dispose(DeleteDisposer{});
+		--n_pending;
+		UpdateRead();
 	}
 
+	event.CancelWrite();
 	return true;
 }
 
 bool
-Connection::SendResponse(Response &&_response) noexcept
+Connection::SendResponse(const Request &_request,
+			 Response &&_response) noexcept
 {
-	assert(state == State::PROCESSING);
+	/* this downcast is legal because all Request instances
+	   passed to the Handler are PendingRequest instances */
+	auto &request = static_cast<PendingRequest &>(const_cast<Request &>(_request));
+	assert(request.response.empty());
+
+	request.cancel_ptr = nullptr;
+
+	if (request.has_id)
+		_response.InsertRequestId(request.id);
+
+	request.response = _response.Finish();
 
-	state = State::RESPONSE;
-	output = _response.Finish();
-	response = output.data();
-	cancel_ptr = nullptr;
+	/* move from "pending" to "output" */
+	request.unlink();
+	output.push_back(request);
 
 	return TryWrite();
 }
 
+bool
+Connection::SendResponse(Response &&_response) noexcept
+{
+	assert(!pending.empty());
+	assert(std::next(pending.begin()) == pending.end());
+
+	return SendResponse(pending.front(), std::move(_response));
+}
+
 void
 Connection::OnSocketReady(unsigned events) noexcept
 {
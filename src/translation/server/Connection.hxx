@@ -10,7 +10,10 @@
 #include "util/Cancellable.hxx"
 #include "util/IntrusiveList.hxx"
 #include "AllocatedRequest.hxx"
+#include "ResponseBuffer.hxx"
 
+#include <cstdint>
+#include <memory>
 #include <span>
 
 enum class TranslationCommand : uint16_t;
@@ -20,34 +23,80 @@ namespace Translation::Server {
 class Response;
 class Handler;
 
+/**
+ * A connection from a translation client.
+ *
+ * Requests containing a #TranslationCommand::REQUEST_ID packet may
+ * be pipelined: the client may send more requests before the
+ * response arrives, they are handled concurrently and their
+ * responses are sent in the order they complete.  Requests without
+ * #TranslationCommand::REQUEST_ID are handled one at a time: the
+ * connection stops reading until the response has been sent.
+ */
 class Connection : AutoUnlinkIntrusiveListHook
 {
 	friend struct IntrusiveListBaseHookTraits<Connection>;
 
+	/**
+	 * Stop reading new requests if this many are being handled
+	 * or waiting to be sent.
+	 */
+	static constexpr std::size_t MAX_PENDING = 64;
+
 	Handler &handler;
 
 	SocketEvent event;
 
-	enum class State {
-		INIT,
-		REQUEST,
-		PROCESSING,
-		RESPONSE,
-	} state;
-
 	DynamicFifoBuffer<std::byte> input;
 
-	AllocatedRequest request;
+	struct PendingRequest final
+		: AllocatedRequest, IntrusiveListHook<IntrusiveHookMode::NORMAL>
+	{
+		/**
+		 * If this is set, then our #handler is currently
+		 * handling this request.
+		 */
+		CancellablePointer cancel_ptr{nullptr};
+
+		/**
+		 * The part of the response (returned by
+		 * Response::Finish()) which has not yet been sent if
+		 * this request is in #Connection::output.
+		 */
+		ResponseBuffer response;
+
+		uint32_t id;
+
+		/**
+		 * Has a #TranslationCommand::REQUEST_ID packet been
+		 * received?
+		 */
+		bool has_id = false;
+	};
+
+	using RequestList = IntrusiveList<PendingRequest>;
 
 	/**
-         * If this is set, then our #handler is currently handling the
-         * #request.
+	 * The request which is currently being received (after
+	 * #TranslationCommand::BEGIN, before
+	 * #TranslationCommand::END).
 	 */
-	CancellablePointer cancel_ptr{nullptr};
+	std::unique_ptr<PendingRequest> receiving;
 
-	std::byte *response;
+	/**
+	 * Requests which are being handled by the #handler.
+	 */
+	RequestList pending;
 
-	std::span<std::byte> output;
+	/**
+	 * Requests whose responses are waiting to be sent.
+	 */
+	RequestList output;
+
+	/**
+	 * The number of items in #pending and #output.
+	 */
+	std::size_t n_pending = 0;
 
 public:
 	Connection(EventLoop &event_loop,
@@ -56,6 +105,18 @@ public:
 	~Connection() noexcept;
 
 	/**
+	 * Send the response to the given request (which was passed
+	 * to Handler::OnTranslationRequest()).
+	 *
+	 * @return false if this object has been destroyed
+	 */
+	bool SendResponse(const Request &request,
+			  Response &&response) noexcept;
+
+	/**
+	 * Send the response to the only pending request.  This
+	 * overload must not be used if requests are pipelined.
+	 *
 	 * @return false if this object has been destroyed
 	 */
 	bool SendResponse(Response &&response) noexcept;
@@ -65,6 +126,21 @@ private:
 		delete this;
 	}
 
+	/**
+	 * Is there a request without a
+	 * #TranslationCommand::REQUEST_ID in #pending or #output?
+	 * While this is the case, no other request may be received
+	 * and reading from the socket is disabled.
+	 */
+	[[gnu::pure]]
+	bool HasExclusiveRequest() const noexcept;
+
+	/**
+	 * Enable or disable reading depending on #n_pending and
+	 * HasExclusiveRequest().
+	 */
+	void UpdateRead() noexcept;
+
 	bool TryRead() noexcept;
 	bool OnReceived() noexcept;
 	bool OnPacket(TranslationCommand cmd,
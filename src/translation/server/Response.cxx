@@ -3,8 +3,10 @@
 // author: Max Kellermann <max.kellermann@ionos.com>
 
 #include "Response.hxx"
+#include "ResponseTemplate.hxx"
 
 #include <algorithm>
+#include <cstring> // for memmove()
 #include <numeric>
 
 #include <assert.h>
@@ -24,6 +26,16 @@ Response::Grow(std::size_t new_capacity) noexcept
 	capacity = new_capacity;
 }
 
+void
+Response::Reserve(std::size_t nbytes) noexcept
+{
+	assert(size <= capacity);
+
+	const std::size_t new_size = size + nbytes;
+	if (new_size > capacity)
+		Grow(((new_size - 1) | 0x7fff) + 1);
+}
+
 void *
 Response::Write(std::size_t nbytes) noexcept
 {
@@ -31,7 +43,10 @@ Response::Write(std::size_t nbytes) noexcept
 
 	const std::size_t new_size = size + nbytes;
 	if (new_size > capacity)
-		Grow(((new_size - 1) | 0x7fff) + 1);
+		/* grow exponentially to avoid copying large
+		   responses over and over */
+		Grow(std::max(((new_size - 1) | 0x7fff) + 1,
+			      capacity * 2));
 
 	void *result = buffer + size;
 	size = new_size;
@@ -56,7 +71,65 @@ Response::Packet(TranslationCommand cmd, std::span<const std::byte> payload) noe
 	return *this;
 }
 
-std::span<std::byte>
+Response &
+Response::ExternalPacket(TranslationCommand cmd,
+			 std::span<const std::byte> payload,
+			 std::shared_ptr<const void> owner) noexcept
+{
+	/* below this size, copying is cheaper than an additional
+	   iovec */
+	static constexpr std::size_t COPY_THRESHOLD = 256;
+
+	if (payload.size() < COPY_THRESHOLD)
+		return Packet(cmd, payload);
+
+	assert(payload.size() <= 0xffff);
+
+	const TranslationHeader header{uint16_t(payload.size()), cmd};
+	memcpy(Write(sizeof(header)), &header, sizeof(header));
+
+	segments.push_back({size, payload, std::move(owner)});
+	return *this;
+}
+
+Response &
+Response::Append(std::shared_ptr<const ResponseTemplate> t) noexcept
+{
+	assert(t);
+
+	for (std::size_t i = 0; i < vary.size(); ++i)
+		if (t->vary[i])
+			vary[i] = true;
+
+	const auto packets = t->GetPackets();
+	segments.push_back({size, packets, std::move(t)});
+	return *this;
+}
+
+Response &
+Response::InsertRequestId(uint32_t id) noexcept
+{
+	/* the constructor has written the BEGIN packet with a
+	   one-byte payload (the protocol version) */
+	static constexpr std::size_t begin_size = sizeof(TranslationHeader) + 1;
+	static constexpr std::size_t packet_size = sizeof(TranslationHeader) + sizeof(id);
+	assert(size >= begin_size);
+
+	const std::size_t tail_size = size - begin_size;
+	Write(packet_size);
+
+	std::byte *const p = buffer + begin_size;
+	memmove(p + packet_size, p, tail_size);
+
+	for (auto &i : segments)
+		i.position += packet_size;
+
+	const TranslationHeader header{uint16_t(sizeof(id)), TranslationCommand::REQUEST_ID};
+	memcpy(mempcpy(p, &header, sizeof(header)), &id, sizeof(id));
+	return *this;
+}
+
+ResponseBuffer
 Response::Finish() noexcept
 {
 	/* generate a VARY packet? */
@@ -73,9 +146,10 @@ Response::Finish() noexcept
 
 	Packet(TranslationCommand::END);
 
-	std::span<std::byte> result{buffer, size};
+	ResponseBuffer result{buffer, size, std::move(segments)};
 	buffer = nullptr;
 	capacity = size = 0;
+	segments.clear();
 	return result;
 }
 
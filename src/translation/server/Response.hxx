@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "ResponseBuffer.hxx"
 #include "../Protocol.hxx"
 #include "http/Status.hxx"
 #include "net/SocketAddress.hxx"
@@ -12,10 +13,12 @@
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <numeric>
 #include <span>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #include <string.h>
 
@@ -29,10 +32,20 @@ struct BindMountPermissions {
 	bool execute = false;
 };
 
+class ResponseTemplate;
+
 class Response {
+	friend class ResponseTemplate;
+
 	std::byte *buffer = nullptr;
 	std::size_t capacity = 0, size = 0;
 
+	/**
+	 * External data which is not copied into #buffer; see
+	 * ExternalPacket() and Append().
+	 */
+	std::vector<ResponseSegment> segments;
+
 	enum VaryIndex {
 		PARAM,
 		SESSION,
@@ -74,6 +87,7 @@ public:
 		:buffer(std::exchange(other.buffer, nullptr)),
 		 capacity(other.capacity),
 		 size(other.size),
+		 segments(std::move(other.segments)),
 		 vary(other.vary) {}
 
 	~Response() noexcept {
@@ -85,6 +99,7 @@ public:
 		swap(buffer, src.buffer);
 		swap(capacity, src.capacity);
 		swap(size, src.size);
+		swap(segments, src.segments);
 		swap(vary, src.vary);
 		return *this;
 	}
@@ -93,14 +108,14 @@ public:
 	 * An opaque type for Mark() and Revert().
 	 */
 	struct Marker {
-		std::size_t size;
+		std::size_t size, n_segments;
 	};
 
 	/**
 	 * Returns an opaque marker for later use with Revert().
 	 */
 	Marker Mark() const noexcept {
-		return {size};
+		return {size, segments.size()};
 	}
 
 	/**
@@ -109,8 +124,18 @@ public:
 	 */
 	void Revert(Marker m) noexcept {
 		size = m.size;
+		segments.resize(m.n_segments);
 	}
 
+	/**
+	 * Make sure the buffer can hold at least the given number of
+	 * additional bytes.  Handlers which know the approximate size
+	 * of a large response (e.g. many mounts or environment
+	 * variables) can call this once to avoid growing the buffer
+	 * repeatedly.
+	 */
+	void Reserve(std::size_t nbytes) noexcept;
+
 	auto &VaryParam() noexcept {
 		vary[VaryIndex::PARAM] = true;
 		return *this;
@@ -1818,7 +1843,49 @@ public:
 		return Packet(TranslationCommand::ACCEPT_HTTP);
 	}
 
-	std::span<std::byte> Finish() noexcept;
+	/**
+	 * Append a packet whose payload is not copied; only the
+	 * header is written to the buffer and the payload is sent
+	 * directly from the given memory.  Small payloads are copied
+	 * nonetheless, because that is cheaper than an additional
+	 * #iovec.
+	 *
+	 * @param owner an optional reference which keeps the payload
+	 * alive; if this is nullptr, then the payload must remain
+	 * valid until the response has been sent (e.g. static data)
+	 */
+	Response &ExternalPacket(TranslationCommand cmd,
+				 std::span<const std::byte> payload,
+				 std::shared_ptr<const void> owner={}) noexcept;
+
+	Response &ExternalStringPacket(TranslationCommand cmd,
+				       std::string_view payload,
+				       std::shared_ptr<const void> owner={}) noexcept {
+		return ExternalPacket(cmd, std::as_bytes(std::span{payload}),
+				      std::move(owner));
+	}
+
+	/**
+	 * Append the packets of a #ResponseTemplate (without copying
+	 * them) and merge its "vary" flags.  More packets may be
+	 * appended afterwards to complete the response.
+	 */
+	Response &Append(std::shared_ptr<const ResponseTemplate> t) noexcept;
+
+	/**
+	 * Insert a #TranslationCommand::REQUEST_ID packet right after
+	 * #TranslationCommand::BEGIN.  This is used by #Connection
+	 * for pipelined requests.
+	 */
+	Response &InsertRequestId(uint32_t id) noexcept;
+
+	/**
+	 * Finish the response by appending
+	 * #TranslationCommand::VARY (if applicable) and
+	 * #TranslationCommand::END.  After returning, this object is
+	 * empty.
+	 */
+	ResponseBuffer Finish() noexcept;
 
 private:
 	void Grow(std::size_t new_capacity) noexcept;
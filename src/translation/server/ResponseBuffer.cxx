@@ -0,0 +1,61 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "ResponseBuffer.hxx"
+#include "io/Iovec.hxx"
+
+#include <assert.h>
+
+namespace Translation::Server {
+
+ResponseBuffer::ResponseBuffer(std::byte *_buffer, std::size_t size,
+			       std::vector<ResponseSegment> &&_segments) noexcept
+	:buffer(_buffer), segments(std::move(_segments)), consumed(0)
+{
+	if (segments.empty()) {
+		single = MakeIovec(std::span{buffer.get(), size});
+		return;
+	}
+
+	/* interleave the buffer with the external segments */
+	vector.reserve(segments.size() * 2 + 1);
+
+	std::size_t position = 0;
+	for (const auto &i : segments) {
+		assert(i.position >= position);
+		assert(i.position <= size);
+
+		if (i.position > position)
+			vector.push_back(MakeIovec(std::span{buffer.get() + position,
+							     i.position - position}));
+
+		if (!i.data.empty())
+			vector.push_back(MakeIovec(i.data));
+
+		position = i.position;
+	}
+
+	if (size > position)
+		vector.push_back(MakeIovec(std::span{buffer.get() + position,
+						     size - position}));
+}
+
+void
+ResponseBuffer::Consume(std::size_t nbytes) noexcept
+{
+	for (auto &i : GetMutableIovec()) {
+		if (nbytes < i.iov_len) {
+			i.iov_base = static_cast<std::byte *>(i.iov_base) + nbytes;
+			i.iov_len -= nbytes;
+			return;
+		}
+
+		nbytes -= i.iov_len;
+		++consumed;
+	}
+
+	assert(nbytes == 0);
+}
+
+} // namespace Translation::Server
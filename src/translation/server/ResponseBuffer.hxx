@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <sys/uio.h>
+
+namespace Translation::Server {
+
+/**
+ * A region of external (not copied) data which gets inserted into
+ * a #Response buffer at a certain position.
+ */
+struct ResponseSegment {
+	/**
+	 * The position within the #Response buffer where this
+	 * segment is inserted.
+	 */
+	std::size_t position;
+
+	std::span<const std::byte> data;
+
+	/**
+	 * An optional reference which keeps #data alive.  If this is
+	 * nullptr, then #data must be valid until the response has
+	 * been sent.
+	 */
+	std::shared_ptr<const void> owner;
+};
+
+/**
+ * A finished response as returned by Response::Finish().  It is a
+ * list of #iovec segments referring to the #Response buffer and to
+ * external data; it can be sent with one sendmsg() call.
+ */
+class ResponseBuffer {
+	std::unique_ptr<std::byte[]> buffer;
+
+	std::vector<ResponseSegment> segments;
+
+	/**
+	 * The #iovec list if there are #segments.
+	 */
+	std::vector<struct iovec> vector;
+
+	/**
+	 * The only #iovec if there are no #segments (this is the
+	 * common case and avoids allocating #vector).
+	 */
+	struct iovec single{};
+
+	/**
+	 * The number of #iovec items which have been sent
+	 * completely.
+	 */
+	std::size_t consumed;
+
+public:
+	/**
+	 * Construct an empty instance.
+	 */
+	ResponseBuffer() noexcept
+		:consumed(1) {}
+
+	ResponseBuffer(std::byte *_buffer, std::size_t size,
+		       std::vector<ResponseSegment> &&_segments) noexcept;
+
+	ResponseBuffer(ResponseBuffer &&) noexcept = default;
+	ResponseBuffer &operator=(ResponseBuffer &&) noexcept = default;
+
+	bool empty() const noexcept {
+		return GetIovec().empty();
+	}
+
+	/**
+	 * Returns the #iovec list which has not yet been sent.
+	 */
+	[[gnu::pure]]
+	std::span<const struct iovec> GetIovec() const noexcept {
+		std::span<const struct iovec> v = segments.empty()
+			? std::span{&single, 1}
+			: std::span{vector};
+		return v.subspan(consumed);
+	}
+
+	/**
+	 * Mark the given number of bytes as "sent".
+	 */
+	void Consume(std::size_t nbytes) noexcept;
+
+private:
+	[[gnu::pure]]
+	std::span<struct iovec> GetMutableIovec() noexcept {
+		std::span<struct iovec> v = segments.empty()
+			? std::span{&single, 1}
+			: std::span{vector};
+		return v.subspan(consumed);
+	}
+};
+
+} // namespace Translation::Server
@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "ResponseTemplate.hxx"
+
+#include <algorithm> // for std::copy_n()
+#include <numeric> // for std::accumulate()
+
+#include <assert.h>
+
+namespace Translation::Server {
+
+ResponseTemplate::ResponseTemplate(Response &&src) noexcept
+	:vary(src.vary)
+{
+	/* skip the BEGIN packet written by the Response
+	   constructor */
+	static constexpr std::size_t begin_size = sizeof(TranslationHeader) + 1;
+	assert(src.size >= begin_size);
+
+	size = std::accumulate(src.segments.begin(), src.segments.end(),
+			       src.size - begin_size,
+			       [](std::size_t a, const ResponseSegment &b){
+				       return a + b.data.size();
+			       });
+	data = std::make_unique_for_overwrite<std::byte[]>(size);
+
+	/* flatten the buffer and all external segments */
+	std::byte *p = data.get();
+	std::size_t position = begin_size;
+	for (const auto &i : src.segments) {
+		p = std::copy_n(src.buffer + position, i.position - position, p);
+		p = std::copy_n(i.data.data(), i.data.size(), p);
+		position = i.position;
+	}
+
+	std::copy_n(src.buffer + position, src.size - position, p);
+}
+
+} // namespace Translation::Server
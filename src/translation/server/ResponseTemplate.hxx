@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "Response.hxx"
+
+#include <cstddef>
+#include <memory>
+#include <span>
+
+namespace Translation::Server {
+
+/**
+ * A pre-encoded sequence of translation packets which can be
+ * replayed into any number of #Response instances (with
+ * Response::Append()) without encoding or copying them again.
+ * This is useful for parts of responses which are shared by many
+ * requests, e.g. per-site settings; the handler appends only the
+ * packets which differ.
+ *
+ * Instances are always managed by std::shared_ptr, because each
+ * #Response which refers to a template keeps it alive until it
+ * has been sent.
+ */
+class ResponseTemplate {
+	friend class Response;
+
+	std::unique_ptr<std::byte[]> data;
+	std::size_t size;
+
+	decltype(Response::vary) vary;
+
+public:
+	/**
+	 * Create a template from the packets which were appended
+	 * to the given #Response (without
+	 * #TranslationCommand::BEGIN and #TranslationCommand::END).
+	 */
+	explicit ResponseTemplate(Response &&src) noexcept;
+
+	static std::shared_ptr<const ResponseTemplate> Make(Response &&src) noexcept {
+		return std::make_shared<const ResponseTemplate>(std::move(src));
+	}
+
+	std::span<const std::byte> GetPackets() const noexcept {
+		return {data.get(), size};
+	}
+};
+
+} // namespace Translation::Server
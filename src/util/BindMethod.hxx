@@ -51,6 +51,15 @@ public:
 	R operator()(Args... args) const noexcept(NoExcept) {
 		return function(instance_, std::forward<Args>(args)...);
 	}
+
+	/**
+	 * Returns the address of the (generated wrapper) function.
+	 * This is only useful for diagnostics; a symbolizer can map
+	 * it to the name of the bound method.
+	 */
+	const void *GetFunctionAddress() const noexcept {
+		return reinterpret_cast<const void *>(function);
+	}
 };
 
 namespace BindMethodDetail {
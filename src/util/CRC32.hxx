@@ -4,12 +4,68 @@
 
 #pragma once
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <span>
 
+#if defined(__ARM_FEATURE_CRC32) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CRC32_ARM
+#include <arm_acle.h>
+#include <cstring> // for std::memcpy()
+#endif
+
+namespace CRC32Detail {
+
+inline constexpr uint32_t POLYNOMIAL = 0xedb88320;
+
+/**
+ * The naive bit-at-a-time implementation.  It is only used to
+ * generate the lookup tables (and by unit tests to cross-check the
+ * fast implementations).
+ */
+[[nodiscard]]
+constexpr uint32_t
+UpdateBitwise(uint32_t crc, uint8_t octet) noexcept
+{
+	for (unsigned i = 0; i < 8; i++) {
+		uint32_t bit = (octet ^ crc) & 1;
+		crc >>= 1;
+		if (bit)
+			crc ^= POLYNOMIAL;
+
+		octet >>= 1;
+	}
+
+	return crc;
+}
+
+using Tables = std::array<std::array<uint32_t, 256>, 8>;
+
+consteval Tables
+GenerateTables() noexcept
+{
+	Tables t{};
+
+	for (unsigned i = 0; i < 256; ++i)
+		t[0][i] = UpdateBitwise(0, i);
+
+	for (unsigned i = 0; i < 256; ++i)
+		for (std::size_t k = 1; k < t.size(); ++k)
+			t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+
+	return t;
+}
+
+inline constexpr Tables tables = GenerateTables();
+
+} // namespace CRC32Detail
+
 /**
- * A naive (and slow) CRC-32/ISO-HDLC implementation.
+ * A CRC-32/ISO-HDLC implementation using the "slicing-by-8"
+ * algorithm (eight lookup tables generated at compile time).  On
+ * ARMv8 with the CRC32 extension, the CRC32 instructions are used
+ * at runtime instead.
  */
 class CRC32State {
 public:
@@ -21,8 +77,14 @@ private:
 public:
 	[[gnu::hot]]
 	constexpr const auto &Update(std::span<const std::byte> b) noexcept {
-		for (auto i : b)
-			state = Update(state, static_cast<uint8_t>(i));
+#ifdef CRC32_ARM
+		if !consteval {
+			state = UpdateARM(state, b);
+			return *this;
+		}
+#endif
+
+		state = UpdateSlicing8(state, b);
 		return *this;
 	}
 
@@ -32,20 +94,62 @@ public:
 	}
 
 private:
+	static constexpr value_type LoadLE32(const std::byte *p) noexcept {
+		return static_cast<value_type>(p[0]) |
+			(static_cast<value_type>(p[1]) << 8) |
+			(static_cast<value_type>(p[2]) << 16) |
+			(static_cast<value_type>(p[3]) << 24);
+	}
+
+	[[nodiscard]] [[gnu::hot]]
+	static constexpr value_type UpdateByte(value_type crc,
+					       std::byte octet) noexcept {
+		return (crc >> 8) ^
+			CRC32Detail::tables[0][(crc ^ static_cast<uint8_t>(octet)) & 0xff];
+	}
+
+	[[nodiscard]] [[gnu::hot]]
+	static constexpr value_type UpdateSlicing8(value_type crc,
+						   std::span<const std::byte> b) noexcept {
+		while (b.size() >= 8) {
+			const value_type lo = crc ^ LoadLE32(b.data());
+			const value_type hi = LoadLE32(b.data() + 4);
+
+			crc = CRC32Detail::tables[7][lo & 0xff] ^
+				CRC32Detail::tables[6][(lo >> 8) & 0xff] ^
+				CRC32Detail::tables[5][(lo >> 16) & 0xff] ^
+				CRC32Detail::tables[4][lo >> 24] ^
+				CRC32Detail::tables[3][hi & 0xff] ^
+				CRC32Detail::tables[2][(hi >> 8) & 0xff] ^
+				CRC32Detail::tables[1][(hi >> 16) & 0xff] ^
+				CRC32Detail::tables[0][hi >> 24];
+
+			b = b.subspan(8);
+		}
+
+		for (auto i : b)
+			crc = UpdateByte(crc, i);
+
+		return crc;
+	}
+
+#ifdef CRC32_ARM
 	[[nodiscard]] [[gnu::hot]]
-	static constexpr value_type Update(value_type crc,
-					   uint8_t octet) noexcept {
-		for (unsigned i = 0; i < 8; i++) {
-			uint32_t bit = (octet ^ crc) & 1;
-			crc >>= 1;
-			if (bit)
-				crc ^= 0xedb88320;
-
-			octet >>= 1;
+	static value_type UpdateARM(value_type crc,
+				    std::span<const std::byte> b) noexcept {
+		while (b.size() >= 8) {
+			uint64_t value;
+			std::memcpy(&value, b.data(), sizeof(value));
+			crc = __crc32d(crc, value);
+			b = b.subspan(8);
 		}
 
+		for (auto i : b)
+			crc = __crc32b(crc, static_cast<uint8_t>(i));
+
 		return crc;
 	}
+#endif
 };
 
 [[nodiscard]] [[gnu::hot]]
@@ -0,0 +1,381 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#pragma once
+
+#include "IntrusiveHashSet.hxx" // IWYU pragma: export
+
+#include <array>
+#include <bit> // for std::has_single_bit()
+#include <cassert>
+#include <memory>
+#include <vector>
+
+/**
+ * A hash table implementation which stores pointers to items which
+ * have an embedded #IntrusiveHashSetHook.  Unlike #IntrusiveHashSet,
+ * the number of buckets is not fixed; it follows the number of items
+ * using "linear hashing": each insertion or removal splits or merges
+ * at most one bucket, so the table grows and shrinks incrementally
+ * without ever rehashing everything at once.
+ *
+ * The buckets are allocated in segments of fixed size, so existing
+ * buckets never move.
+ *
+ * @param Operators a class which contains functions `hash` and
+ * `equal`
+ *
+ * @param segment_size the number of buckets per segment (a power of
+ * two); this is also the minimum number of buckets
+ */
+template<typename T,
+	 IntrusiveHashSetOperatorsConcept<T> Operators,
+	 typename HookTraits=IntrusiveHashSetBaseHookTraits<T>,
+	 std::size_t segment_size=256>
+requires(std::has_single_bit(segment_size))
+class IntrusiveLinearHashSet {
+	[[no_unique_address]]
+	Operators ops;
+
+	struct BucketHookTraits {
+		template<typename U>
+		using HashSetHook = typename HookTraits::template Hook<U>;
+
+		template<typename U>
+		using ListHook = IntrusiveListMemberHookTraits<&HashSetHook<U>::intrusive_hash_set_siblings>;
+
+		template<typename U>
+		using Hook = typename HashSetHook<U>::SiblingsHook;
+
+		static constexpr T *Cast(IntrusiveListNode *node) noexcept {
+			auto *hook = ListHook<T>::Cast(node);
+			return HookTraits::Cast(hook);
+		}
+
+		static constexpr auto &ToHook(T &t) noexcept {
+			auto &hook = HookTraits::ToHook(t);
+			return hook.intrusive_hash_set_siblings;
+		}
+	};
+
+	using Bucket = IntrusiveList<T, BucketHookTraits>;
+
+	static constexpr std::size_t SEGMENT_SIZE = segment_size;
+
+	using Segment = std::array<Bucket, SEGMENT_SIZE>;
+
+	std::vector<std::unique_ptr<Segment>> segments;
+
+	/**
+	 * The number of buckets at the beginning of the current
+	 * round of splits (a power of two).
+	 */
+	std::size_t level_size = SEGMENT_SIZE;
+
+	/**
+	 * The index of the next bucket to be split.  All buckets
+	 * below this index have already been split in this round.
+	 */
+	std::size_t split = 0;
+
+	std::size_t counter = 0;
+
+	using bucket_iterator = typename Bucket::iterator;
+	using const_bucket_iterator = typename Bucket::const_iterator;
+
+public:
+	using value_type = T;
+	using reference = T &;
+	using const_reference = const T &;
+	using pointer = T *;
+	using const_pointer = const T *;
+	using size_type = std::size_t;
+
+	using hasher = typename Operators::hasher;
+	using key_equal = typename Operators::key_equal;
+
+	[[nodiscard]]
+	IntrusiveLinearHashSet() noexcept {
+		segments.emplace_back(std::make_unique<Segment>());
+	}
+
+	IntrusiveLinearHashSet(const IntrusiveLinearHashSet &) = delete;
+	IntrusiveLinearHashSet &operator=(const IntrusiveLinearHashSet &) = delete;
+
+	[[nodiscard]]
+	constexpr const hasher &hash_function() const noexcept {
+		return ops.hash;
+	}
+
+	[[nodiscard]]
+	constexpr const key_equal &key_eq() const noexcept {
+		return ops.equal;
+	}
+
+	[[nodiscard]]
+	constexpr bool empty() const noexcept {
+		return counter == 0;
+	}
+
+	[[nodiscard]]
+	constexpr size_type size() const noexcept {
+		return counter;
+	}
+
+	/**
+	 * Returns the current number of buckets.
+	 */
+	[[nodiscard]]
+	constexpr size_type bucket_count() const noexcept {
+		return level_size + split;
+	}
+
+	void clear() noexcept {
+		ForEachBucket([](auto &bucket){
+			bucket.clear();
+		});
+
+		Reset();
+	}
+
+	void clear_and_dispose(Disposer<value_type> auto disposer) noexcept {
+		ForEachBucket([&disposer](auto &bucket){
+			bucket.clear_and_dispose(disposer);
+		});
+
+		Reset();
+	}
+
+	[[nodiscard]]
+	static constexpr bucket_iterator iterator_to(reference item) noexcept {
+		return Bucket::iterator_to(item);
+	}
+
+	/**
+	 * Prepare insertion of a new item.  If the key already
+	 * exists, return an iterator to the existing item and
+	 * `false`.  If the key does not exist, return an iterator to
+	 * the bucket where the new item may be inserted using
+	 * insert_commit() and `true`.
+	 */
+	[[nodiscard]] [[gnu::pure]]
+	std::pair<bucket_iterator, bool> insert_check(const auto &key) noexcept {
+		auto &bucket = GetBucket(key);
+		for (auto &i : bucket)
+			if (ops.equal(key, ops.get_key(i)))
+				return {bucket.iterator_to(i), false};
+
+		return {bucket.end(), true};
+	}
+
+	/**
+	 * Finish the insertion if insert_check() has returned true.
+	 *
+	 * The set may have been modified after insert_check(); each
+	 * insertion or removal may split or merge a bucket, so the
+	 * bucket is looked up again instead of trusting the iterator
+	 * returned by insert_check().
+	 *
+	 * @param bucket the bucket returned by insert_check() (ignored)
+	 */
+	bucket_iterator insert_commit([[maybe_unused]] bucket_iterator bucket,
+				      reference item) noexcept {
+		GetBucket(ops.get_key(item)).push_front(item);
+		++counter;
+		MaybeGrow();
+		return iterator_to(item);
+	}
+
+	/**
+	 * Insert a new item without checking whether the key already
+	 * exists.
+	 */
+	bucket_iterator insert(reference item) noexcept {
+		GetBucket(ops.get_key(item)).push_front(item);
+		++counter;
+		MaybeGrow();
+		return iterator_to(item);
+	}
+
+	void erase(bucket_iterator i) noexcept {
+		GetBucket(ops.get_key(*i)).erase(i);
+		--counter;
+		MaybeShrink();
+	}
+
+	void erase_and_dispose(bucket_iterator i,
+			       Disposer<value_type> auto disposer) noexcept {
+		auto &item = *i;
+		erase(i);
+		disposer(&item);
+	}
+
+	[[nodiscard]] [[gnu::pure]]
+	bucket_iterator find(const auto &key) noexcept {
+		auto &bucket = GetBucket(key);
+		for (auto &i : bucket)
+			if (ops.equal(key, ops.get_key(i)))
+				return bucket.iterator_to(i);
+
+		return end();
+	}
+
+	[[nodiscard]] [[gnu::pure]]
+	const_bucket_iterator find(const auto &key) const noexcept {
+		auto &bucket = GetBucket(key);
+		for (auto &i : bucket)
+			if (ops.equal(key, ops.get_key(i)))
+				return bucket.iterator_to(i);
+
+		return end();
+	}
+
+	bucket_iterator end() noexcept {
+		return segments.front()->front().end();
+	}
+
+	const_bucket_iterator end() const noexcept {
+		return segments.front()->front().end();
+	}
+
+	/**
+	 * Invoke the specified function for each item.  The function
+	 * is not allowed to insert or remove items.
+	 */
+	void for_each(auto &&f) {
+		ForEachBucket([&f](auto &bucket){
+			for (auto &i : bucket)
+				f(i);
+		});
+	}
+
+	void for_each(auto &&f) const {
+		ForEachBucket([&f](const auto &bucket){
+			for (const auto &i : bucket)
+				f(i);
+		});
+	}
+
+private:
+	void ForEachBucket(auto &&f) {
+		for (auto &segment : segments)
+			for (auto &bucket : *segment)
+				f(bucket);
+	}
+
+	void ForEachBucket(auto &&f) const {
+		for (const auto &segment : segments)
+			for (const auto &bucket : *segment)
+				f(bucket);
+	}
+
+	/**
+	 * Free all segments but the first one.  All buckets must be
+	 * empty.
+	 */
+	void Reset() noexcept {
+		segments.resize(1);
+		level_size = SEGMENT_SIZE;
+		split = 0;
+		counter = 0;
+	}
+
+	[[gnu::pure]]
+	std::size_t GetBucketIndex(std::size_t hash) const noexcept {
+		std::size_t i = hash & (level_size - 1);
+		if (i < split)
+			/* this bucket has already been split in this
+			   round */
+			i = hash & (level_size * 2 - 1);
+		return i;
+	}
+
+	[[gnu::pure]]
+	Bucket &GetBucketAt(std::size_t i) noexcept {
+		return (*segments[i / SEGMENT_SIZE])[i % SEGMENT_SIZE];
+	}
+
+	[[gnu::pure]]
+	const Bucket &GetBucketAt(std::size_t i) const noexcept {
+		return (*segments[i / SEGMENT_SIZE])[i % SEGMENT_SIZE];
+	}
+
+	template<typename K>
+	[[gnu::pure]]
+	[[nodiscard]]
+	auto &GetBucket(K &&key) noexcept {
+		return GetBucketAt(GetBucketIndex(ops.hash(std::forward<K>(key))));
+	}
+
+	template<typename K>
+	[[gnu::pure]]
+	[[nodiscard]]
+	const auto &GetBucket(K &&key) const noexcept {
+		return GetBucketAt(GetBucketIndex(ops.hash(std::forward<K>(key))));
+	}
+
+	/**
+	 * Split one bucket if the average load is above 1/2.
+	 */
+	void MaybeGrow() noexcept {
+		if (counter * 2 > bucket_count())
+			SplitBucket();
+	}
+
+	/**
+	 * Merge one bucket if the average load is below 1/8.  If the
+	 * table has become empty, all surplus segments are freed at
+	 * once.
+	 */
+	void MaybeShrink() noexcept {
+		if (bucket_count() <= SEGMENT_SIZE)
+			return;
+
+		if (counter == 0)
+			Reset();
+		else if (counter < bucket_count() / 8)
+			MergeBucket();
+	}
+
+	void SplitBucket() noexcept {
+		const std::size_t dest_index = level_size + split;
+		if (dest_index % SEGMENT_SIZE == 0)
+			segments.emplace_back(std::make_unique<Segment>());
+
+		auto &src = GetBucketAt(split);
+		auto &dest = GetBucketAt(dest_index);
+		const std::size_t mask = level_size * 2 - 1;
+
+		src.remove_and_dispose_if([this, mask](const auto &item){
+			return (ops.hash(ops.get_key(item)) & mask) != split;
+		}, [&dest](T *item){
+			dest.push_front(*item);
+		});
+
+		if (++split == level_size) {
+			/* this round is complete, begin a new one */
+			level_size *= 2;
+			split = 0;
+		}
+	}
+
+	void MergeBucket() noexcept {
+		assert(bucket_count() > SEGMENT_SIZE);
+
+		if (split == 0) {
+			level_size /= 2;
+			split = level_size;
+		}
+
+		--split;
+
+		const std::size_t src_index = level_size + split;
+		auto &src = GetBucketAt(src_index);
+		auto &dest = GetBucketAt(split);
+		dest.splice(dest.begin(), src);
+
+		if (src_index % SEGMENT_SIZE == 0)
+			segments.pop_back();
+	}
+};
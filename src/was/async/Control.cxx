@@ -43,7 +43,7 @@ public:
 	void Cancel() noexcept;
 
 private:
-	void OnUringCompletion(int res) noexcept override;
+	void OnUringCompletion(int res, unsigned) noexcept override;
 };
 
 void
@@ -98,7 +98,7 @@ Control::UringSend::Cancel() noexcept
 }
 
 void
-Control::UringSend::OnUringCompletion(int res) noexcept
+Control::UringSend::OnUringCompletion(int res, unsigned) noexcept
 {
 	if (canceled) [[unlikely]] {
 		delete this;
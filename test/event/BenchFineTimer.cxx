@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+/*
+ * Measure the cost of scheduling, canceling and running many
+ * FineTimerEvent instances.  Build with and without
+ * -Dfine_timer_wheel=true to compare FineTimerWheel with TimerList.
+ */
+
+#include "event/FineTimerEvent.hxx"
+#include "event/Loop.hxx"
+#include "event/config.h"
+
+#include <fmt/core.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include <time.h>
+
+namespace {
+
+struct BenchTimers;
+
+class BenchTimer {
+	BenchTimers &parent;
+
+public:
+	FineTimerEvent event;
+
+	BenchTimer(EventLoop &event_loop, BenchTimers &_parent) noexcept
+		:parent(_parent),
+		 event(event_loop, BIND_THIS_METHOD(OnTimer)) {}
+
+private:
+	void OnTimer() noexcept;
+};
+
+struct BenchTimers {
+	EventLoop &event_loop;
+
+	std::deque<BenchTimer> timers;
+
+	std::size_t n_pending = 0;
+
+	BenchTimers(EventLoop &_event_loop, std::size_t n) noexcept
+		:event_loop(_event_loop)
+	{
+		for (std::size_t i = 0; i < n; ++i)
+			timers.emplace_back(event_loop, *this);
+	}
+
+	void OnTimer() noexcept {
+		if (--n_pending == 0)
+			event_loop.Break();
+	}
+};
+
+inline void
+BenchTimer::OnTimer() noexcept
+{
+	parent.OnTimer();
+}
+
+} // anonymous namespace
+
+/**
+ * Like std::chrono::steady_clock::now(), but only counts the CPU
+ * time of this thread, i.e. not the time the #EventLoop sleeps
+ * until the next timer is due.
+ */
+static std::chrono::nanoseconds
+ThreadCpuTime() noexcept
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return std::chrono::seconds{ts.tv_sec} + std::chrono::nanoseconds{ts.tv_nsec};
+}
+
+static std::vector<Event::Duration>
+MakeDelays(std::size_t n, Event::Duration max, std::mt19937 &rng) noexcept
+{
+	std::uniform_int_distribution<Event::Duration::rep> dist{0, max.count()};
+
+	std::vector<Event::Duration> delays(n);
+	for (auto &i : delays)
+		i = Event::Duration{dist(rng)};
+	return delays;
+}
+
+static void
+Bench(std::size_t n)
+{
+	EventLoop event_loop;
+	BenchTimers b{event_loop, n};
+	std::mt19937 rng{42};
+
+	/* timers spread over one minute, so all levels of the wheel
+	   are used */
+	const auto delays = MakeDelays(n, std::chrono::minutes{1}, rng);
+
+	auto start = ThreadCpuTime();
+
+	for (std::size_t i = 0; i < n; ++i)
+		b.timers[i].event.Schedule(delays[i]);
+
+	const std::chrono::duration<double, std::nano> schedule_duration =
+		ThreadCpuTime() - start;
+
+	start = ThreadCpuTime();
+
+	for (auto &i : b.timers)
+		i.event.Cancel();
+
+	const std::chrono::duration<double, std::nano> cancel_duration =
+		ThreadCpuTime() - start;
+
+	/* timers spread over one second; the EventLoop sleeps in
+	   between, which is not counted */
+	const auto run_delays = MakeDelays(n, std::chrono::seconds{1}, rng);
+
+	event_loop.FlushClockCaches();
+	for (std::size_t i = 0; i < n; ++i)
+		b.timers[i].event.Schedule(run_delays[i]);
+	b.n_pending = n;
+
+	start = ThreadCpuTime();
+
+	event_loop.Run();
+
+	const std::chrono::duration<double, std::nano> run_duration =
+		ThreadCpuTime() - start;
+
+	if (b.n_pending != 0)
+		std::abort();
+
+	fmt::print("{:>7} timers: {:6.1f} ns per Schedule(), {:6.1f} ns per Cancel(), {:6.1f} ns per expiry\n",
+		   n,
+		   schedule_duration.count() / n,
+		   cancel_duration.count() / n,
+		   run_duration.count() / n);
+}
+
+int
+main(int, char **)
+{
+#ifdef USE_FINE_TIMER_WHEEL
+	fmt::print("FineTimerWheel\n");
+#else
+	fmt::print("TimerList\n");
+#endif
+
+	for (const std::size_t n : {10000, 100000, 1000000})
+		Bench(n);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "event/Loop.hxx"
+#include "event/FineTimerEvent.hxx"
+
+#include <gtest/gtest.h>
+
+using std::chrono_literals::operator""ms;
+
+namespace {
+
+class TimerRecorder {
+	FineTimerEvent timer;
+
+public:
+	Event::TimePoint fired{};
+
+	explicit TimerRecorder(EventLoop &event_loop) noexcept
+		:timer(event_loop, BIND_THIS_METHOD(OnTimer)) {}
+
+	void Schedule(Event::Duration d) noexcept {
+		timer.Schedule(d);
+	}
+
+private:
+	void OnTimer() noexcept {
+		fired = Event::Clock::now();
+		timer.GetEventLoop().Break();
+	}
+};
+
+} // anonymous namespace
+
+/**
+ * A busy-poll phase which finds no events must not delay timers:
+ * the remaining timeout must be shortened by the time spent
+ * busy-polling.
+ */
+TEST(EventLoop, BusyPollTimer)
+{
+	EventLoop event_loop;
+	event_loop.SetBusyPoll(30ms);
+
+	TimerRecorder timer{event_loop};
+
+	const auto start = Event::Clock::now();
+	timer.Schedule(60ms);
+	event_loop.Run();
+
+	const auto elapsed = timer.fired - start;
+	EXPECT_GE(elapsed, 60ms);
+
+	/* without the timeout correction, the timer would fire
+	   after 90ms (30ms busy-polling plus the full 60ms
+	   timeout) */
+	EXPECT_LT(elapsed, 80ms);
+}
@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "event/FineTimerWheel.hxx"
+#include "event/FineTimerEvent.hxx"
+#include "event/Loop.hxx"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <memory>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+#ifndef USE_FINE_TIMER_WHEEL
+#error This test requires USE_FINE_TIMER_WHEEL
+#endif
+
+using std::chrono_literals::operator""ms;
+
+namespace {
+
+struct TestTimer;
+
+/**
+ * The reference implementation: an ordered set of (due, timer)
+ * pairs.
+ */
+using Reference = std::set<std::pair<Event::TimePoint, TestTimer *>>;
+
+struct TestTimer {
+	FineTimerEvent event;
+
+	std::vector<TestTimer *> &fired;
+
+	TestTimer(EventLoop &event_loop,
+		  std::vector<TestTimer *> &_fired) noexcept
+		:event(event_loop, BIND_THIS_METHOD(OnTimer)),
+		 fired(_fired) {}
+
+private:
+	void OnTimer() noexcept {
+		fired.push_back(this);
+	}
+};
+
+class WheelTest {
+	FineTimerWheel wheel;
+
+	std::vector<std::unique_ptr<TestTimer>> timers;
+
+	Reference reference;
+
+	std::vector<TestTimer *> fired;
+
+	EventLoop &event_loop;
+
+public:
+	/**
+	 * The fake clock; it starts at an arbitrary point, because
+	 * tick 0 has a special meaning in #FineTimerWheel.
+	 */
+	Event::TimePoint now{std::chrono::hours{1000}};
+
+	explicit WheelTest(EventLoop &_event_loop) noexcept
+		:event_loop(_event_loop) {}
+
+	~WheelTest() noexcept {
+		/* the wheel asserts that it is empty */
+		for (const auto &i : reference)
+			i.second->event.Cancel();
+	}
+
+	bool IsEmpty() const noexcept {
+		return reference.empty();
+	}
+
+	void Insert(Event::Duration d) {
+		auto &t = *timers.emplace_back(std::make_unique<TestTimer>(event_loop, fired));
+		t.event.SetDue(now + d);
+		wheel.Insert(t.event, now);
+		reference.emplace(now + d, &t);
+	}
+
+	/**
+	 * Cancel the timer at the given position of the reference
+	 * set.
+	 */
+	void Cancel(std::size_t i) noexcept {
+		auto j = std::next(reference.begin(), i % reference.size());
+		j->second->event.Cancel();
+		reference.erase(j);
+	}
+
+	std::size_t GetSize() const noexcept {
+		return reference.size();
+	}
+
+	/**
+	 * Advance the clock, run the wheel and compare the result
+	 * with the reference.
+	 */
+	void Advance(Event::Duration d) {
+		now += d;
+		fired.clear();
+
+		const auto next = wheel.Run(now);
+
+		/* all timers which are due (and only those) must
+		   have fired, in the order of their due time */
+		std::vector<TestTimer *> expected;
+		while (!reference.empty() && reference.begin()->first <= now) {
+			expected.push_back(reference.begin()->second);
+			reference.erase(reference.begin());
+		}
+
+		ASSERT_EQ(fired.size(), expected.size());
+		for (std::size_t i = 0; i < fired.size(); ++i) {
+			ASSERT_FALSE(fired[i]->event.IsPending());
+			ASSERT_EQ(fired[i]->event.GetDue().time_since_epoch().count(),
+				  expected[i]->event.GetDue().time_since_epoch().count());
+		}
+
+		/* the returned timeout must not be later than the
+		   next timer */
+		if (reference.empty()) {
+			ASSERT_LT(next.count(), 0);
+		} else {
+			ASSERT_GT(next.count(), 0);
+			ASSERT_LE(now + next, reference.begin()->first);
+		}
+	}
+};
+
+} // anonymous namespace
+
+TEST(FineTimerWheel, Ordering)
+{
+	EventLoop event_loop;
+	WheelTest t{event_loop};
+
+	/* one timer in each level and in the overflow list, inserted
+	   in reverse order */
+	t.Insert(std::chrono::hours{10});
+	t.Insert(std::chrono::minutes{3});
+	t.Insert(std::chrono::seconds{2});
+	t.Insert(50ms);
+	t.Insert(1ms);
+	t.Insert(1ms);
+
+	t.Advance(std::chrono::hours{20});
+	ASSERT_TRUE(t.IsEmpty());
+}
+
+TEST(FineTimerWheel, Cancel)
+{
+	EventLoop event_loop;
+	WheelTest t{event_loop};
+
+	t.Insert(10ms);
+	t.Insert(20ms);
+	t.Insert(30ms);
+
+	/* cancel the 20ms timer */
+	t.Cancel(1);
+
+	t.Advance(15ms);
+	t.Advance(15ms);
+	ASSERT_TRUE(t.IsEmpty());
+}
+
+/**
+ * Insert, cancel and expire random timers and compare the result
+ * with a reference implementation.
+ */
+TEST(FineTimerWheel, Random)
+{
+	EventLoop event_loop;
+	WheelTest t{event_loop};
+
+	std::mt19937 rng{42};
+
+	/* durations covering all levels and the overflow list */
+	const auto random_duration = [&rng]() -> Event::Duration {
+		const unsigned bits = std::uniform_int_distribution<unsigned>{0, 26}(rng);
+		return std::chrono::milliseconds{
+			1 + std::uniform_int_distribution<uint_least64_t>{0, (uint_least64_t{1} << bits) - 1}(rng),
+		};
+	};
+
+	for (unsigned i = 0; i < 2000; ++i) {
+		const unsigned n_insert = std::uniform_int_distribution<unsigned>{0, 8}(rng);
+		for (unsigned j = 0; j < n_insert; ++j)
+			t.Insert(random_duration());
+
+		if (t.GetSize() > 0 && rng() % 4 == 0)
+			t.Cancel(rng());
+
+		/* mostly small steps, sometimes large jumps */
+		const Event::Duration step = rng() % 16 == 0
+			? random_duration()
+			: std::chrono::milliseconds{rng() % 100};
+		t.Advance(step);
+	}
+
+	/* expire all remaining timers */
+	while (!t.IsEmpty())
+		t.Advance(std::chrono::hours{24});
+}
@@ -0,0 +1,166 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "event/net/BufferedSocket.hxx"
+#include "event/SocketEvent.hxx"
+#include "event/Loop.hxx"
+#include "net/SocketPair.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "system/Error.hxx"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <exception>
+#include <vector>
+
+#include <sys/socket.h>
+
+/**
+ * Writes all data to a #BufferedSocket and then calls
+ * BufferedSocket::Shutdown().
+ */
+class ShutdownWriter final : BufferedSocketHandler {
+	BufferedSocket socket;
+
+	std::span<const std::byte> remaining;
+
+public:
+	std::exception_ptr error;
+
+	ShutdownWriter(EventLoop &event_loop, UniqueSocketDescriptor &&fd,
+		       std::span<const std::byte> data) noexcept
+		:socket(event_loop), remaining(data)
+	{
+		socket.Init(fd.Release(), FdType::FD_SOCKET,
+			    std::chrono::seconds{10}, *this);
+
+#ifdef HAVE_URING
+		if (auto *uring = event_loop.GetUring())
+			socket.EnableUringSend(*uring);
+#endif
+	}
+
+	~ShutdownWriter() noexcept {
+		socket.Close();
+		socket.Destroy();
+	}
+
+	void Start() noexcept {
+		Write();
+	}
+
+private:
+	void Write() noexcept {
+		while (!remaining.empty()) {
+			const auto nbytes = socket.Write(remaining);
+			if (nbytes > 0) {
+				remaining = remaining.subspan(nbytes);
+			} else if (nbytes == WRITE_BLOCKING) {
+				socket.ScheduleWrite();
+				return;
+			} else {
+				error = std::make_exception_ptr(MakeErrno("Write failed"));
+				socket.GetEventLoop().Break();
+				return;
+			}
+		}
+
+		socket.UnscheduleWrite();
+		socket.Shutdown();
+	}
+
+	/* virtual methods from class BufferedSocketHandler */
+	BufferedResult OnBufferedData() override {
+		return BufferedResult::OK;
+	}
+
+	bool OnBufferedClosed() noexcept override {
+		return true;
+	}
+
+	bool OnBufferedWrite() override {
+		Write();
+		return true;
+	}
+
+	void OnBufferedError(std::exception_ptr e) noexcept override {
+		error = std::move(e);
+		socket.GetEventLoop().Break();
+	}
+};
+
+/**
+ * Reads everything from a socket until end-of-file.
+ */
+class EofReader {
+	SocketEvent event;
+
+public:
+	std::vector<std::byte> received;
+
+	bool eof = false;
+
+	EofReader(EventLoop &event_loop, SocketDescriptor fd) noexcept
+		:event(event_loop, BIND_THIS_METHOD(OnSocketReady), fd)
+	{
+		event.ScheduleRead();
+	}
+
+private:
+	void OnSocketReady(unsigned) noexcept {
+		std::array<std::byte, 4096> buffer;
+		const auto nbytes = event.GetSocket().ReadNoWait(buffer);
+		if (nbytes > 0) {
+			received.insert(received.end(),
+					buffer.begin(), buffer.begin() + nbytes);
+			return;
+		}
+
+		if (nbytes == 0)
+			eof = true;
+
+		event.Cancel();
+		event.GetEventLoop().Break();
+	}
+};
+
+/**
+ * Write more data than fits into the socket buffers, then
+ * Shutdown(); the peer must receive all data followed by
+ * end-of-file.
+ */
+TEST(BufferedSocket, WriteShutdown)
+{
+	EventLoop event_loop;
+
+#ifdef HAVE_URING
+	try {
+		event_loop.EnableUring(64, 0);
+	} catch (...) {
+		/* io_uring not available: test the send() code
+		   path */
+	}
+#endif
+
+	auto [a, b] = CreateSocketPairNonBlock(SOCK_STREAM);
+	a.SetIntOption(SOL_SOCKET, SO_SNDBUF, 4096);
+	b.SetIntOption(SOL_SOCKET, SO_RCVBUF, 4096);
+
+	std::vector<std::byte> data(256 * 1024);
+	for (std::size_t i = 0; i < data.size(); ++i)
+		data[i] = static_cast<std::byte>(i * 7 + (i >> 10));
+
+	EofReader reader{event_loop, b};
+	ShutdownWriter writer{event_loop, std::move(a), data};
+	writer.Start();
+
+	event_loop.Run();
+
+	ASSERT_FALSE(writer.error);
+	EXPECT_TRUE(reader.eof);
+	EXPECT_EQ(reader.received.size(), data.size());
+	EXPECT_TRUE(reader.received == data);
+}
@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "event/net/log/BatchSink.hxx"
+#include "event/Loop.hxx"
+#include "net/log/Datagram.hxx"
+#include "net/log/Parser.hxx"
+#include "net/SocketPair.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include <sys/socket.h>
+
+using namespace Net::Log;
+
+static void
+LogMessages(BatchSink &sink, unsigned n)
+{
+	for (unsigned i = 0; i < n; ++i) {
+		const auto message = std::to_string(i);
+		Datagram d;
+		d.message = message;
+		sink.Log(d);
+	}
+}
+
+/**
+ * Receive all datagrams which are currently queued on the socket
+ * and return their messages.
+ */
+static std::vector<std::string>
+ReceiveMessages(SocketDescriptor s)
+{
+	std::vector<std::string> messages;
+
+	while (true) {
+		std::array<std::byte, 4096> buffer;
+		const auto nbytes = s.ReadNoWait(buffer);
+		if (nbytes <= 0)
+			break;
+
+		const auto d = ParseDatagram(std::span{buffer}.first(nbytes));
+		messages.emplace_back(d.message);
+	}
+
+	return messages;
+}
+
+TEST(BatchSink, Basic)
+{
+	EventLoop event_loop;
+	auto [a, b] = CreateSocketPairNonBlock(SOCK_DGRAM);
+
+	BatchSink sink{event_loop, a, BatchSinkConfig{.max_batch = 4}};
+
+	/* two full batches are flushed immediately, the rest by
+	   Flush() */
+	LogMessages(sink, 10);
+	EXPECT_EQ(sink.GetStats().batches, 2U);
+	EXPECT_EQ(sink.GetStats().datagrams, 8U);
+
+	sink.Flush();
+
+	const auto &stats = sink.GetStats();
+	EXPECT_EQ(stats.batches, 3U);
+	EXPECT_EQ(stats.datagrams, 10U);
+	EXPECT_EQ(stats.drops, 0U);
+
+	const auto messages = ReceiveMessages(b);
+	ASSERT_EQ(messages.size(), 10U);
+	for (unsigned i = 0; i < messages.size(); ++i)
+		EXPECT_EQ(messages[i], std::to_string(i));
+}
+
+TEST(BatchSink, TooLarge)
+{
+	EventLoop event_loop;
+	auto [a, b] = CreateSocketPairNonBlock(SOCK_DGRAM);
+
+	BatchSink sink{event_loop, a, BatchSinkConfig{.max_datagram_size = 64}};
+
+	const std::string large(100, 'x');
+	Datagram d;
+	d.message = large;
+	sink.Log(d);
+
+	LogMessages(sink, 1);
+	sink.Flush();
+
+	const auto &stats = sink.GetStats();
+	EXPECT_EQ(stats.batches, 1U);
+	EXPECT_EQ(stats.datagrams, 1U);
+	EXPECT_EQ(stats.drops, 1U);
+
+	EXPECT_EQ(ReceiveMessages(b).size(), 1U);
+}
+
+/**
+ * A failed sendmmsg() call drops the batch and is not counted as a
+ * batch.
+ */
+TEST(BatchSink, SendError)
+{
+	EventLoop event_loop;
+	auto [a, b] = CreateSocketPairNonBlock(SOCK_DGRAM);
+
+	/* sending to a closed peer fails */
+	b.Close();
+
+	BatchSink sink{event_loop, a, BatchSinkConfig{.max_batch = 4}};
+	LogMessages(sink, 6);
+	sink.Flush();
+
+	const auto &stats = sink.GetStats();
+	EXPECT_EQ(stats.batches, 0U);
+	EXPECT_EQ(stats.datagrams, 0U);
+	EXPECT_EQ(stats.drops, 6U);
+}
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "event/net/log/ThreadedReceiver.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "event/Loop.hxx"
+#include "net/log/Datagram.hxx"
+#include "net/log/Send.hxx"
+#include "net/log/Sink.hxx"
+#include "net/ConnectSocket.hxx"
+#include "net/IPv4Address.hxx"
+#include "net/SocketConfig.hxx"
+#include "net/StaticSocketAddress.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "util/ScopeExit.hxx"
+#include "util/SpanCast.hxx"
+
+#include <gtest/gtest.h>
+
+#include <set>
+#include <string>
+
+#include <sched.h>
+#include <sys/socket.h>
+
+using namespace Net::Log;
+
+namespace {
+
+/**
+ * Collects the messages of all datagrams and stops the #EventLoop
+ * after the expected number or after a timeout.
+ */
+class CollectSink final : public Sink {
+	EventLoop &event_loop;
+
+	CoarseTimerEvent timeout;
+
+	const std::size_t expected;
+
+public:
+	std::multiset<std::string> messages;
+
+	CollectSink(EventLoop &_event_loop, std::size_t _expected) noexcept
+		:event_loop(_event_loop),
+		 timeout(event_loop, BIND_THIS_METHOD(OnTimeout)),
+		 expected(_expected)
+	{
+		timeout.Schedule(std::chrono::seconds{10});
+	}
+
+	/* virtual methods from class Sink */
+	void Log(const Datagram &d) noexcept override {
+		messages.emplace(d.message);
+		if (messages.size() >= expected) {
+			timeout.Cancel();
+			event_loop.Break();
+		}
+	}
+
+private:
+	void OnTimeout() noexcept {
+		event_loop.Break();
+	}
+};
+
+} // anonymous namespace
+
+/**
+ * Find a free UDP port on the loopback interface.  (It cannot be
+ * bound to port 0, because all SO_REUSEPORT sockets need the same
+ * port.)
+ */
+static IPv4Address
+FindFreePort()
+{
+	auto s = CreateConnectDatagramSocket(IPv4Address{IPv4Address::Loopback(), 9});
+	const IPv4Address local{IPv4Address::Loopback(),
+				static_cast<uint16_t>(s.GetLocalAddress().GetPort())};
+	return local;
+}
+
+static void
+RunReceiver(const ThreadedReceiverConfig &config)
+{
+	constexpr std::size_t N = 100;
+
+	EventLoop event_loop;
+	CollectSink sink{event_loop, N};
+
+	const auto address = FindFreePort();
+
+	SocketConfig socket_config;
+	socket_config.bind_address = SocketAddress{address};
+
+	ThreadedReceiver receiver{event_loop, socket_config, config, sink};
+	ASSERT_EQ(receiver.GetThreadCount(), config.n_threads);
+
+	/* several senders, so the kernel distributes them among
+	   the threads */
+	std::multiset<std::string> expected;
+	for (unsigned i = 0; i < N; ++i) {
+		auto s = CreateConnectDatagramSocket(address);
+
+		if (i % 10 == 0) {
+			/* a malformed datagram (too short for the
+			   magic) */
+			ASSERT_GT(s.Send(AsBytes(std::string_view{"xy"})), 0);
+		}
+
+		const auto message = std::to_string(i);
+		Datagram d;
+		d.message = message;
+		Send(s, d);
+		expected.emplace(message);
+	}
+
+	event_loop.Run();
+
+	EXPECT_EQ(sink.messages, expected);
+
+	const auto stats = receiver.GetStats();
+	EXPECT_EQ(stats.datagrams, N);
+	EXPECT_EQ(stats.parse_errors, N / 10);
+	EXPECT_EQ(stats.drops, 0U);
+	EXPECT_GT(stats.batches, 0U);
+
+	ThreadedReceiverStats sum;
+	for (std::size_t i = 0; i < receiver.GetThreadCount(); ++i)
+		sum += receiver.GetStats(i);
+	EXPECT_EQ(sum.datagrams, stats.datagrams);
+}
+
+TEST(ThreadedReceiver, Basic)
+{
+	ThreadedReceiverConfig config;
+	config.n_threads = 3;
+	RunReceiver(config);
+}
+
+/**
+ * Pinning threads must work even if this process is restricted to
+ * fewer CPUs than there are threads.
+ */
+TEST(ThreadedReceiver, PinThreads)
+{
+	ThreadedReceiverConfig config;
+	config.n_threads = 4;
+	config.pin_threads = true;
+	config.steering = ReceiverSteering::CPU;
+
+	cpu_set_t old_cpuset;
+	ASSERT_EQ(sched_getaffinity(0, sizeof(old_cpuset), &old_cpuset), 0);
+
+	/* allow only the first allowed CPU */
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+	for (unsigned i = 0; i < CPU_SETSIZE; ++i) {
+		if (CPU_ISSET(i, &old_cpuset)) {
+			CPU_SET(i, &cpuset);
+			break;
+		}
+	}
+
+	ASSERT_EQ(sched_setaffinity(0, sizeof(cpuset), &cpuset), 0);
+	AtScopeExit(&old_cpuset) {
+		sched_setaffinity(0, sizeof(old_cpuset), &old_cpuset);
+	};
+
+	RunReceiver(config);
+}
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "memory/Checker.hxx"
+#include "memory/SharedSlicePool.hxx"
+#include "memory/SliceAllocation.hxx"
+
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <optional>
+#include <thread>
+#include <vector>
+
+TEST(SharedSlicePool, Cache)
+{
+	SharedSlicePool pool{100, 600, "slice", 8};
+
+	{
+		SliceCache cache{pool};
+
+		std::vector<SliceAllocation> v;
+		for (unsigned i = 0; i < 20; ++i) {
+			v.emplace_back(pool.Alloc());
+			ASSERT_TRUE(v.back().IsDefined());
+			memset(v.back().data, i, 100);
+		}
+
+		if (!HaveMemoryChecker()) {
+			const auto stats = pool.GetStats();
+			EXPECT_EQ(stats.netto_size, 20 * pool.GetSliceSize());
+			EXPECT_LE(stats.cached_size, 8 * pool.GetSliceSize());
+		}
+
+		v.clear();
+
+		if (!HaveMemoryChecker()) {
+			const auto stats = pool.GetStats();
+			EXPECT_EQ(stats.netto_size, 0U);
+			EXPECT_GT(stats.cached_size, 0U);
+			EXPECT_LE(stats.cached_size, 8 * pool.GetSliceSize());
+			EXPECT_EQ(cache.GetStats().cached_size, stats.cached_size);
+		}
+	}
+
+	/* the cache has been returned to the depot */
+	const auto stats = pool.GetStats();
+	EXPECT_EQ(stats.netto_size, 0U);
+	EXPECT_EQ(stats.cached_size, 0U);
+}
+
+/**
+ * Allocate in threads with a #SliceCache, free in other threads
+ * (with and without a #SliceCache).
+ */
+TEST(SharedSlicePool, CrossThread)
+{
+	SharedSlicePool pool{64, 600, "slice", 16};
+
+	static constexpr unsigned N_THREADS = 4;
+	static constexpr unsigned N = 10000;
+
+	std::vector<SliceAllocation> results[N_THREADS];
+
+	std::vector<std::thread> threads;
+	for (unsigned t = 0; t < N_THREADS; ++t) {
+		threads.emplace_back([&pool, &v = results[t], t]{
+			SliceCache cache{pool};
+			for (unsigned i = 0; i < N; ++i) {
+				auto a = pool.Alloc();
+				memset(a.data, t, 64);
+				if (i % 3 == 0)
+					v.emplace_back(std::move(a));
+			}
+		});
+	}
+
+	for (auto &i : threads)
+		i.join();
+	threads.clear();
+
+	for (unsigned t = 0; t < N_THREADS; ++t) {
+		threads.emplace_back([&pool, &v = results[t], t]{
+			/* only odd threads have a cache */
+			std::optional<SliceCache> cache;
+			if (t % 2 != 0)
+				cache.emplace(pool);
+
+			for (auto &a : v) {
+				ASSERT_EQ(static_cast<const std::byte *>(a.data)[63],
+					  static_cast<std::byte>(t));
+				a.Free();
+			}
+		});
+	}
+
+	for (auto &i : threads)
+		i.join();
+
+	pool.Compress();
+
+	const auto stats = pool.GetStats();
+	EXPECT_EQ(stats.netto_size, 0U);
+	EXPECT_EQ(stats.cached_size, 0U);
+}
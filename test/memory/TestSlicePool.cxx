@@ -2,6 +2,7 @@
 // Copyright CM4all GmbH
 // author: Max Kellermann <max.kellermann@ionos.com>
 
+#include "memory/AllocatorStats.hxx"
 #include "memory/Checker.hxx"
 #include "memory/SlicePool.hxx"
 #include "util/AllocatedArray.hxx"
@@ -191,3 +192,41 @@ TEST(SliceTest, Large)
 		more[i].Free();
 	}
 }
+
+TEST(SliceTest, HugeTlbNuma)
+{
+	const size_t slice_size = 1000;
+	const unsigned per_area_init = 100;
+
+	SlicePool pool{slice_size, per_area_init, "slice"};
+
+	/* these options may have no effect on this machine (no
+	   huge pages reserved, no NUMA), but allocations must work
+	   anyway */
+	pool.HugeTlb();
+	pool.NumaLocal();
+
+	const unsigned per_area = pool.GetSlicesPerArea();
+	AllocatedArray<SliceAllocation> allocations{per_area};
+
+	for (unsigned i = 0; i < per_area; ++i) {
+		allocations[i] = pool.Alloc();
+		ASSERT_TRUE(allocations[i].IsDefined());
+		Fill(allocations[i].data, slice_size, i);
+	}
+
+	for (unsigned i = 0; i < per_area; i += 2)
+		allocations[i].Free();
+
+	pool.Compress();
+
+	for (unsigned i = 1; i < per_area; i += 2) {
+		ASSERT_TRUE(Check(allocations[i].data, slice_size, i));
+		allocations[i].Free();
+	}
+
+	pool.Compress();
+
+	const auto stats = pool.GetStats();
+	EXPECT_EQ(stats.netto_size, 0U);
+}
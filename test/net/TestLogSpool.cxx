@@ -0,0 +1,338 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "net/log/spool/Reader.hxx"
+#include "net/log/spool/Writer.hxx"
+#include "net/log/spool/Format.hxx"
+#include "net/log/Datagram.hxx"
+#include "io/linux/MemFD.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+#include "http/Method.hxx"
+#include "http/Status.hxx"
+#include "util/SpanCast.hxx"
+
+#include <gtest/gtest.h>
+
+#include <fmt/core.h>
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <string.h>
+
+using namespace Net::Log;
+
+static bool
+StringAttributeEquals(const char *a, const char *b) noexcept
+{
+	return a == nullptr
+		? b == nullptr
+		: b != nullptr && strcmp(a, b) == 0;
+}
+
+static bool
+StringAttributeEquals(std::string_view a, std::string_view b) noexcept
+{
+	return a.data() == nullptr
+		? b.data() == nullptr
+		: b.data() != nullptr && a == b;
+}
+
+static bool
+Equals(const Datagram &a, const Datagram &b) noexcept
+{
+	return a.timestamp == b.timestamp &&
+		StringAttributeEquals(a.remote_host, b.remote_host) &&
+		StringAttributeEquals(a.host, b.host) &&
+		StringAttributeEquals(a.site, b.site) &&
+		StringAttributeEquals(a.analytics_id, b.analytics_id) &&
+		StringAttributeEquals(a.generator, b.generator) &&
+		StringAttributeEquals(a.forwarded_to, b.forwarded_to) &&
+		StringAttributeEquals(a.http_uri, b.http_uri) &&
+		StringAttributeEquals(a.http_referer, b.http_referer) &&
+		StringAttributeEquals(a.user_agent, b.user_agent) &&
+		StringAttributeEquals(a.message, b.message) &&
+		StringAttributeEquals(a.json, b.json) &&
+		a.valid_length == b.valid_length &&
+		(!a.valid_length || a.length == b.length) &&
+		a.valid_traffic == b.valid_traffic &&
+		(!a.valid_traffic ||
+		 (a.traffic_received == b.traffic_received &&
+		  a.traffic_sent == b.traffic_sent)) &&
+		a.valid_duration == b.valid_duration &&
+		(!a.valid_duration || a.duration == b.duration) &&
+		a.http_method == b.http_method &&
+		a.http_status == b.http_status &&
+		a.type == b.type &&
+		a.content_type == b.content_type &&
+		a.truncated_host == b.truncated_host &&
+		a.truncated_http_uri == b.truncated_http_uri &&
+		a.truncated_http_referer == b.truncated_http_referer &&
+		a.truncated_user_agent == b.truncated_user_agent &&
+		a.truncated_message == b.truncated_message;
+}
+
+namespace {
+
+/**
+ * Generates a list of pseudo-random datagrams.
+ */
+struct TestData {
+	std::vector<std::string> strings;
+	std::vector<Datagram> datagrams;
+
+	explicit TestData(std::size_t n) {
+		/* reserve so the pointers in #datagrams remain
+		   valid */
+		strings.reserve(n * 2);
+
+		static constexpr const char *sites[] = {"foo", "bar", "baz"};
+		static constexpr const char *user_agents[] = {
+			"Mozilla/5.0", "curl/8.0", "Wget/1.21",
+		};
+		static constexpr HttpStatus statuses[] = {
+			HttpStatus::OK, HttpStatus::NOT_FOUND,
+			HttpStatus::INTERNAL_SERVER_ERROR,
+		};
+
+		const TimePoint base{Duration{1700000000000000}};
+
+		for (std::size_t i = 0; i < n; ++i) {
+			Datagram d;
+
+			if (i % 7 != 0)
+				d.SetTimestamp(base + Duration{i * 1000 + i % 13});
+
+			d.site = sites[i % std::size(sites)];
+			d.host = d.site;
+
+			if (i % 5 != 0)
+				d.remote_host = "192.0.2.1";
+
+			d.user_agent = user_agents[i % std::size(user_agents)];
+			d.http_method = HttpMethod::GET;
+			d.http_status = statuses[i % std::size(statuses)];
+
+			strings.emplace_back(fmt::format("/path/{}", i));
+			d.http_uri = strings.back();
+
+			if (i % 3 == 0)
+				d.SetLength(i * 17);
+
+			if (i % 4 == 0)
+				d.SetTraffic(i, i * 2);
+
+			if (i % 2 == 0)
+				d.SetDuration(Duration{i % 100 * 10});
+
+			if (i % 11 == 0) {
+				strings.emplace_back(fmt::format("message {}", i));
+				d.message = strings.back();
+				d.truncated_message = true;
+			}
+
+			d.type = Type::HTTP_ACCESS;
+
+			datagrams.push_back(d);
+		}
+	}
+};
+
+} // anonymous namespace
+
+static std::vector<Datagram>
+ReadAll(const Spool::Reader &reader, const Spool::Filter &filter,
+	std::deque<std::string> &strings)
+{
+	std::vector<Datagram> result;
+
+	/* copy the strings, because DecodedBlock's buffer is
+	   reused */
+
+	const auto Copy = [&strings](auto &value){
+		if (value == nullptr)
+			return;
+
+		strings.emplace_back(value);
+		value = strings.back().c_str();
+	};
+
+	const auto CopyView = [&strings](std::string_view &value){
+		if (value.data() == nullptr)
+			return;
+
+		strings.emplace_back(value);
+		value = strings.back();
+	};
+
+	reader.ForEach(filter, [&](const Datagram &d){
+		auto &copy = result.emplace_back(d);
+		Copy(copy.remote_host);
+		Copy(copy.host);
+		Copy(copy.site);
+		CopyView(copy.user_agent);
+		CopyView(copy.http_uri);
+		CopyView(copy.message);
+	});
+
+	return result;
+}
+
+TEST(LogSpool, RoundTrip)
+{
+	const TestData data{1000};
+
+	auto fd = CreateMemFD("spool");
+
+	{
+		Spool::Writer writer{fd, 128};
+		for (const auto &d : data.datagrams)
+			writer.Log(d);
+		writer.Flush();
+	}
+
+	const Spool::Reader reader{fd};
+	ASSERT_EQ(reader.GetBlocks().size(), 8u);
+
+	std::deque<std::string> strings;
+	const auto result = ReadAll(reader, {}, strings);
+	ASSERT_EQ(result.size(), data.datagrams.size());
+
+	for (std::size_t i = 0; i < result.size(); ++i)
+		EXPECT_TRUE(Equals(result[i], data.datagrams[i])) << "i=" << i;
+}
+
+TEST(LogSpool, Filter)
+{
+	const TestData data{1000};
+
+	auto fd = CreateMemFD("spool");
+
+	{
+		Spool::Writer writer{fd, 100};
+		for (const auto &d : data.datagrams)
+			writer.Append(d);
+		writer.Flush();
+	}
+
+	const Spool::Reader reader{fd};
+	ASSERT_EQ(reader.GetBlocks().size(), 10u);
+
+	/* select a time range which is covered by the third block */
+	const TimePoint since = data.datagrams[201].timestamp;
+	const TimePoint until = data.datagrams[250].timestamp;
+
+	const Spool::Filter filter{
+		.since = since,
+		.until = until,
+		.min_status = 404,
+		.max_status = 404,
+	};
+
+	std::size_t n_blocks = 0;
+	for (const auto &block : reader.GetBlocks())
+		if (filter.Match(block))
+			++n_blocks;
+	EXPECT_EQ(n_blocks, 1u);
+
+	std::size_t expected = 0;
+	for (const auto &d : data.datagrams)
+		if (filter.Match(d))
+			++expected;
+	EXPECT_GT(expected, 0u);
+
+	std::deque<std::string> strings;
+	const auto result = ReadAll(reader, filter, strings);
+	EXPECT_EQ(result.size(), expected);
+
+	for (const auto &d : result) {
+		EXPECT_GE(d.timestamp, since);
+		EXPECT_LT(d.timestamp, until);
+		EXPECT_EQ(d.http_status, HttpStatus::NOT_FOUND);
+	}
+}
+
+TEST(LogSpool, Append)
+{
+	const TestData data{300};
+
+	auto fd = CreateMemFD("spool");
+
+	/* two writers appending to the same file */
+	for (std::size_t offset : {0, 150}) {
+		Spool::Writer writer{fd, 64};
+		for (std::size_t i = offset; i < offset + 150; ++i)
+			writer.Append(data.datagrams[i]);
+		writer.Flush();
+	}
+
+	/* simulate an interrupted write */
+	const Spool::BlockHeader incomplete{
+		.magic = Spool::BLOCK_MAGIC,
+		.compressed_size = 1000,
+	};
+	fd.FullWrite(ReferenceAsBytes(incomplete));
+	fd.FullWrite(std::as_bytes(std::span{"incomplete", 10}));
+
+	const Spool::Reader reader{fd};
+	EXPECT_EQ(reader.GetBlocks().size(), 6u);
+
+	std::deque<std::string> strings;
+	const auto result = ReadAll(reader, {}, strings);
+	ASSERT_EQ(result.size(), data.datagrams.size());
+
+	for (std::size_t i = 0; i < result.size(); ++i)
+		EXPECT_TRUE(Equals(result[i], data.datagrams[i])) << "i=" << i;
+}
+
+TEST(LogSpool, Malformed)
+{
+	auto fd = CreateMemFD("spool");
+	(void)fd.Write(std::as_bytes(std::span{"garbage", 7}));
+
+	EXPECT_THROW(Spool::Reader{fd}, Spool::FormatError);
+}
+
+/**
+ * Overwrite a 32 bit field of the first #BlockHeader.
+ */
+static void
+PatchFirstBlockHeader(FileDescriptor fd, std::size_t offset, uint32_t value)
+{
+	const PackedLE32 le{value};
+	ASSERT_EQ(fd.WriteAt(sizeof(Spool::FileHeader) + offset,
+			     ReferenceAsBytes(le)),
+		  static_cast<ssize_t>(sizeof(le)));
+}
+
+/**
+ * The block header is not covered by the CRC; a corrupt header must
+ * be rejected and must not cause huge allocations.
+ */
+TEST(LogSpool, CorruptHeader)
+{
+	const TestData data{100};
+
+	for (const std::size_t offset : {offsetof(Spool::BlockHeader, uncompressed_size),
+					 offsetof(Spool::BlockHeader, n_datagrams)}) {
+		auto fd = CreateMemFD("spool");
+
+		{
+			Spool::Writer writer{fd, 64};
+			for (const auto &d : data.datagrams)
+				writer.Append(d);
+			writer.Flush();
+		}
+
+		PatchFirstBlockHeader(fd, offset, 0xffffffff);
+
+		const Spool::Reader reader{fd};
+		ASSERT_EQ(reader.GetBlocks().size(), 2u);
+
+		std::deque<std::string> strings;
+		EXPECT_THROW(ReadAll(reader, {}, strings), Spool::FormatError);
+	}
+}
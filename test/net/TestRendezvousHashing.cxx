@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "net/rh/Node.hxx"
+#include "net/rh/Maglev.hxx"
+#include "net/IPv4Address.hxx"
+#include "system/Arch.hxx"
+#include "util/SpanCast.hxx"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <string>
+#include <vector>
+
+using namespace RendezvousHashing;
+
+static std::vector<Node>
+MakeNodes(std::size_t n)
+{
+	std::vector<Node> nodes(n);
+	for (std::size_t i = 0; i < n; ++i)
+		nodes[i].Update(IPv4Address{10, 0, uint8_t(i >> 8), uint8_t(i), 80},
+				Arch::NONE, 1.0 + (i % 3));
+	return nodes;
+}
+
+TEST(RendezvousHashing, BatchScores)
+{
+	/* odd number of nodes to test the partial chunk */
+	auto nodes = MakeNodes(203);
+
+	for (const std::string_view sticky : {"", "a", "example.com", "1234567890abcdefghijklmnopqrstuvwxyz"}) {
+		const auto sticky_source = AsBytes(sticky);
+
+		Node::UpdateRendezvousScores(nodes, sticky_source);
+
+		for (const auto &i : nodes) {
+			/* must be bit-identical */
+			const double expected = i.CalculateRendezvousScore(sticky_source);
+			EXPECT_EQ(std::bit_cast<uint64_t>(i.GetRendezvousScore()),
+				  std::bit_cast<uint64_t>(expected));
+		}
+	}
+}
+
+TEST(RendezvousHashing, Maglev)
+{
+	auto nodes = MakeNodes(20);
+
+	MaglevTable table;
+	EXPECT_TRUE(table.empty());
+
+	table.Build(nodes, 4099);
+	ASSERT_FALSE(table.empty());
+
+	/* the distribution follows the weights (1, 2, 3) roughly */
+	std::array<std::size_t, 20> counts{};
+	std::vector<std::size_t> before;
+	for (unsigned i = 0; i < 60000; ++i) {
+		const auto key = std::to_string(i);
+		const auto n = table.Lookup(AsBytes(key));
+		ASSERT_LT(n, nodes.size());
+		++counts[n];
+		before.push_back(n);
+	}
+
+	for (std::size_t i = 0; i < nodes.size(); ++i) {
+		const double expected = 60000 * nodes[i].GetWeight() / 39;
+		EXPECT_GT(counts[i], expected * 0.7);
+		EXPECT_LT(counts[i], expected * 1.3);
+	}
+
+	/* removing the last node moves only few keys */
+	table.Build(std::span{nodes}.first(19), 4099);
+
+	std::size_t moved = 0;
+	for (unsigned i = 0; i < 60000; ++i) {
+		const auto key = std::to_string(i);
+		const auto n = table.Lookup(AsBytes(key));
+		ASSERT_LT(n, 19U);
+		if (before[i] != 19 && n != before[i])
+			++moved;
+	}
+
+	EXPECT_LT(moved, 60000 / 20);
+}
@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "spawn/MountTemplateCache.hxx"
+#include "spawn/MountNamespaceOptions.hxx"
+#include "spawn/Mount.hxx"
+#include "util/ScopeExit.hxx"
+#include "util/SharedLease.hxx"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <sched.h> // for unshare()
+#include <stdlib.h> // for mkdtemp()
+#include <sys/mount.h>
+#include <unistd.h> // for access(), rmdir()
+
+namespace {
+
+/**
+ * A #MountNamespaceOptions instance with one bind mount.
+ */
+struct TestOptions {
+	MountNamespaceOptions options;
+
+	Mount mount{"srv/www", "/var/www"};
+
+	TestOptions() noexcept {
+		options.mount_root_tmpfs = true;
+		options.mounts.push_front(mount);
+	}
+
+	std::string GetKey() const noexcept {
+		return MountTemplateCache::MakeKey(options);
+	}
+};
+
+} // anonymous namespace
+
+TEST(MountTemplateCache, Key)
+{
+	const TestOptions a, b;
+	EXPECT_EQ(a.GetKey(), b.GetKey());
+
+	/* each detail which affects the tree must change the key */
+
+	TestOptions c;
+	c.options.dir_mode = 0755;
+	EXPECT_NE(c.GetKey(), a.GetKey());
+
+	TestOptions d;
+	d.mount.writable = true;
+	EXPECT_NE(d.GetKey(), a.GetKey());
+
+	TestOptions e;
+	e.mount.exec = true;
+	EXPECT_NE(e.GetKey(), a.GetKey());
+
+	TestOptions f;
+	f.mount.optional = true;
+	EXPECT_NE(f.GetKey(), a.GetKey());
+
+	TestOptions g;
+	g.mount.target = "/var/www2";
+	EXPECT_NE(g.GetKey(), a.GetKey());
+
+	TestOptions h;
+	h.mount.source = "srv/www2";
+	EXPECT_NE(h.GetKey(), a.GetKey());
+}
+
+/**
+ * Templates are reused until Invalidate(); after that, a new one is
+ * built, and the old one is removed when its last lease is
+ * released.
+ */
+TEST(MountTemplateCache, Invalidate)
+{
+	/* don't let the templates leak into our parent's mount
+	   namespace */
+	if (unshare(CLONE_NEWNS) < 0 ||
+	    mount(nullptr, "/", nullptr, MS_REC|MS_PRIVATE, nullptr) < 0)
+		GTEST_SKIP() << "Cannot create a mount namespace";
+
+	char root[] = "/tmp/TestMountTemplateCache.XXXXXX";
+	ASSERT_NE(mkdtemp(root), nullptr);
+	AtScopeExit(&root) { rmdir(root); };
+
+	MountNamespaceOptions options;
+	options.mount_root_tmpfs = true;
+
+	MountTemplateCache cache{root};
+
+	auto [path1, lease1] = cache.Get(options);
+	ASSERT_NE(path1, nullptr);
+	const std::string old_path = path1;
+
+	auto [path2, lease2] = cache.Get(options);
+	EXPECT_EQ(path2, old_path);
+
+	/* different options get a different template */
+	MountNamespaceOptions other;
+	other.mount_root_tmpfs = true;
+	other.dir_mode = 0755;
+	auto [other_path, other_lease] = cache.Get(other);
+	ASSERT_NE(other_path, nullptr);
+	EXPECT_NE(other_path, old_path);
+
+	cache.Invalidate();
+
+	/* still referenced */
+	EXPECT_EQ(access(old_path.c_str(), F_OK), 0);
+
+	auto [path3, lease3] = cache.Get(options);
+	ASSERT_NE(path3, nullptr);
+	EXPECT_NE(path3, old_path);
+
+	lease1 = {};
+	EXPECT_EQ(access(old_path.c_str(), F_OK), 0);
+
+	lease2 = {};
+	EXPECT_NE(access(old_path.c_str(), F_OK), 0);
+}
+
+/**
+ * With both pivot_root and mount_root_tmpfs, the template is built
+ * like Apply() does it: the read-only pivot_root bind mount is not
+ * treated as a writable tmpfs root, so no mount points are created
+ * in it.
+ */
+TEST(MountTemplateCache, PivotRootTmpfs)
+{
+	if (unshare(CLONE_NEWNS) < 0 ||
+	    mount(nullptr, "/", nullptr, MS_REC|MS_PRIVATE, nullptr) < 0)
+		GTEST_SKIP() << "Cannot create a mount namespace";
+
+	char root[] = "/tmp/TestMountTemplateCache.XXXXXX";
+	ASSERT_NE(mkdtemp(root), nullptr);
+	AtScopeExit(&root) { rmdir(root); };
+
+	char new_root[] = "/tmp/TestMountTemplateCache.root.XXXXXX";
+	ASSERT_NE(mkdtemp(new_root), nullptr);
+	AtScopeExit(&new_root) { rmdir(new_root); };
+
+	MountNamespaceOptions options;
+	options.pivot_root = new_root;
+	options.mount_root_tmpfs = true;
+	options.mount_proc = true;
+
+	MountTemplateCache cache{root};
+
+	/* there is no "proc" in the new root; creating it would fail
+	   with EROFS */
+	auto [path, lease] = cache.Get(options);
+	ASSERT_NE(path, nullptr);
+
+	const std::string proc = std::string{new_root} + "/proc";
+	EXPECT_NE(access(proc.c_str(), F_OK), 0);
+}
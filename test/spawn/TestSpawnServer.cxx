@@ -0,0 +1,375 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "spawn/Client.hxx"
+#include "spawn/Server.hxx"
+#include "spawn/Config.hxx"
+#include "spawn/CgroupState.hxx"
+#include "spawn/Prepared.hxx"
+#include "spawn/ProcessHandle.hxx"
+#include "spawn/Builder.hxx"
+#include "spawn/Parser.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "event/Loop.hxx"
+#include "event/PipeEvent.hxx"
+#include "net/SocketPair.hxx"
+#include "net/UniqueSocketDescriptor.hxx"
+#include "io/Pipe.hxx"
+#include "io/UniqueFileDescriptor.hxx"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <map>
+#include <string>
+
+#include <signal.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Waits until the write side of a pipe has been closed by everybody,
+ * i.e. until the child process which inherited it has exited.
+ */
+class PipeEofWaiter {
+	SpawnServerClient &client;
+
+	PipeEvent event;
+	CoarseTimerEvent timeout;
+
+public:
+	bool eof = false;
+
+	PipeEofWaiter(EventLoop &event_loop, SpawnServerClient &_client,
+		      FileDescriptor fd) noexcept
+		:client(_client),
+		 event(event_loop, BIND_THIS_METHOD(OnPipeReady), fd),
+		 timeout(event_loop, BIND_THIS_METHOD(OnTimeout))
+	{
+		event.ScheduleRead();
+		timeout.Schedule(std::chrono::seconds{10});
+	}
+
+private:
+	void Finish() noexcept {
+		event.Cancel();
+		timeout.Cancel();
+		client.Shutdown();
+	}
+
+	void OnPipeReady(unsigned) noexcept {
+		std::array<std::byte, 64> buffer;
+		if (event.GetFileDescriptor().Read(buffer) > 0)
+			return;
+
+		eof = true;
+		Finish();
+	}
+
+	void OnTimeout() noexcept {
+		Finish();
+		event.GetEventLoop().Break();
+	}
+};
+
+static SpawnConfig
+MakeTestConfig() noexcept
+{
+	SpawnConfig config;
+	config.workers = 1;
+	config.default_uid_gid.effective_uid = 65534;
+	config.default_uid_gid.effective_gid = 65534;
+	return config;
+}
+
+/**
+ * Fork a spawner process which serves the given socket.
+ *
+ * @return the spawner's process id or -1 on error
+ */
+static pid_t
+ForkSpawner(const SpawnConfig &config, UniqueSocketDescriptor &client_socket,
+	    UniqueSocketDescriptor &&server_socket) noexcept
+{
+	const pid_t pid = fork();
+	if (pid == 0) {
+		client_socket.Close();
+
+		const CgroupState cgroup_state;
+		RunSpawnServer(config, cgroup_state, false, nullptr,
+			       std::move(server_socket));
+		_exit(EXIT_SUCCESS);
+	}
+
+	server_socket.Close();
+	return pid;
+}
+
+/**
+ * Wait for the spawner to exit; it does so after the client has
+ * closed the connection.
+ */
+static void
+WaitSpawner(pid_t pid)
+{
+	int status;
+	ASSERT_EQ(waitpid(pid, &status, 0), pid);
+	EXPECT_TRUE(WIFEXITED(status));
+}
+
+/**
+ * Kill a child process while a worker process is still spawning it;
+ * the process must not survive.
+ */
+TEST(SpawnServer, KillWhileSpawning)
+{
+	if (geteuid() != 0)
+		GTEST_SKIP() << "the spawner needs root privileges";
+
+	const auto config = MakeTestConfig();
+
+	auto [client_socket, server_socket] = CreateSocketPairNonBlock(SOCK_SEQPACKET);
+
+	const pid_t spawner_pid = ForkSpawner(config, client_socket,
+					      std::move(server_socket));
+	ASSERT_GE(spawner_pid, 0);
+
+	{
+		EventLoop event_loop;
+		SpawnServerClient client{event_loop, config,
+			std::move(client_socket), false, false};
+
+		auto [r, w] = CreatePipe();
+
+		PreparedChildProcess p;
+		p.exec_path = "/bin/sleep";
+		p.Append("sleep");
+		p.Append("60");
+		p.stdout_fd = w;
+
+		auto handle = client.SpawnChildProcess("sleep", std::move(p));
+
+		/* the KILL request arrives long before the worker
+		   process has finished spawning the process */
+		handle->Kill(SIGTERM);
+		w.Close();
+
+		PipeEofWaiter waiter{event_loop, client, r};
+		event_loop.Run();
+
+		EXPECT_TRUE(waiter.eof);
+	}
+
+	WaitSpawner(spawner_pid);
+}
+
+/**
+ * Close the connection while a worker process is still spawning a
+ * child process; the spawner must wait for the worker, kill the new
+ * process and exit.
+ */
+TEST(SpawnServer, CloseWhileSpawning)
+{
+	if (geteuid() != 0)
+		GTEST_SKIP() << "the spawner needs root privileges";
+
+	const auto config = MakeTestConfig();
+
+	auto [client_socket, server_socket] = CreateSocketPair(SOCK_SEQPACKET);
+
+	const pid_t spawner_pid = ForkSpawner(config, client_socket,
+					      std::move(server_socket));
+	ASSERT_GE(spawner_pid, 0);
+
+	auto [r, w] = CreatePipe();
+
+	Spawn::Serializer s{Spawn::RequestCommand::EXEC};
+	s.WriteUnsigned(1);
+	s.WriteString("sleep");
+	s.WriteString(Spawn::ExecCommand::EXEC_PATH, "/bin/sleep");
+	s.WriteString(Spawn::ExecCommand::ARG, "sleep");
+	s.WriteString(Spawn::ExecCommand::ARG, "60");
+	s.WriteFd(Spawn::ExecCommand::STDOUT, w);
+	Spawn::Send<1>(client_socket, s);
+
+	/* close the connection without waiting for the response */
+	client_socket.Close();
+	w.Close();
+
+	/* wait for EOF on the pipe, i.e. until the child process has
+	   exited */
+	while (true) {
+		struct pollfd pfd{.fd = r.Get(), .events = POLLIN, .revents = 0};
+		ASSERT_EQ(poll(&pfd, 1, 10000), 1) << "child process still alive";
+
+		std::array<std::byte, 64> buffer;
+		if (r.Read(buffer) <= 0)
+			break;
+	}
+
+	WaitSpawner(spawner_pid);
+}
+
+/**
+ * The responses received by ReceiveResponses().
+ */
+struct SpawnResponses {
+	/**
+	 * EXEC_COMPLETE error messages by child id.
+	 */
+	std::map<unsigned, std::string> exec_complete;
+
+	/**
+	 * EXIT status by child id.
+	 */
+	std::map<unsigned, int> exit;
+};
+
+/**
+ * Receive and parse response datagrams until the given predicate
+ * returns true.
+ */
+template<typename P>
+static void
+ReceiveResponses(SocketDescriptor s, SpawnResponses &responses, P &&done)
+{
+	while (!done()) {
+		struct pollfd pfd{.fd = s.Get(), .events = POLLIN, .revents = 0};
+		ASSERT_EQ(poll(&pfd, 1, 10000), 1) << "no response from spawner";
+
+		std::array<std::byte, Spawn::MAX_RESPONSE_DATAGRAM_SIZE> buffer;
+		const auto nbytes = s.Receive(buffer);
+		ASSERT_GT(nbytes, 0);
+
+		Spawn::Payload payload{std::span{buffer}.first(nbytes)};
+		switch (static_cast<Spawn::ResponseCommand>(payload.ReadByte())) {
+		case Spawn::ResponseCommand::EXEC_COMPLETE:
+			while (!payload.empty()) {
+				unsigned id;
+				std::chrono::steady_clock::duration duration;
+				payload.ReadUnsigned(id);
+				payload.ReadT(duration);
+				responses.exec_complete[id] = payload.ReadStringView();
+			}
+
+			break;
+
+		case Spawn::ResponseCommand::EXIT:
+			while (!payload.empty()) {
+				unsigned id;
+				int status;
+				payload.ReadUnsigned(id);
+				payload.ReadInt(status);
+				responses.exit[id] = status;
+			}
+
+			break;
+
+		default:
+			/* ignore stats */
+			break;
+		}
+	}
+}
+
+static Spawn::Serializer
+MakeExec(unsigned id, FileDescriptor stdout_fd, const char *path,
+	 std::initializer_list<const char *> args)
+{
+	Spawn::Serializer s{Spawn::RequestCommand::EXEC};
+	s.WriteUnsigned(id);
+	s.WriteString("test");
+	s.WriteString(Spawn::ExecCommand::EXEC_PATH, path);
+	for (const char *arg : args)
+		s.WriteString(Spawn::ExecCommand::ARG, arg);
+	s.WriteFd(Spawn::ExecCommand::STDOUT, stdout_fd);
+	return s;
+}
+
+static void
+AppendBatchRequest(Spawn::Serializer &batch, std::span<const std::byte> request,
+		   std::size_t n_fds)
+{
+	batch.WriteT(static_cast<uint16_t>(request.size()));
+	batch.WriteU8(n_fds);
+	batch.Write(request);
+}
+
+/**
+ * A BATCH request with a KILL, a malformed request and an EXEC: only
+ * the malformed one is dropped.
+ */
+TEST(SpawnServer, BatchMalformed)
+{
+	if (geteuid() != 0)
+		GTEST_SKIP() << "the spawner needs root privileges";
+
+	const auto config = MakeTestConfig();
+
+	auto [client_socket, server_socket] = CreateSocketPair(SOCK_SEQPACKET);
+
+	const pid_t spawner_pid = ForkSpawner(config, client_socket,
+					      std::move(server_socket));
+	ASSERT_GE(spawner_pid, 0);
+
+	SpawnResponses responses;
+
+	/* spawn a process which will be killed by the batch */
+	auto [r1, w1] = CreatePipe();
+	Spawn::Send<1>(client_socket, MakeExec(1, w1, "/bin/sleep", {"sleep", "60"}));
+	w1.Close();
+
+	ReceiveResponses(client_socket, responses, [&responses]{
+		return responses.exec_complete.contains(1);
+	});
+	ASSERT_EQ(responses.exec_complete[1], "");
+
+	auto [r2, w2] = CreatePipe();
+	const auto exec = MakeExec(2, w2, "/bin/echo", {"echo", "ok"});
+
+	Spawn::Serializer kill{Spawn::RequestCommand::KILL};
+	kill.WriteUnsigned(1);
+	kill.WriteInt(SIGTERM);
+
+	/* a KILL request which is too short */
+	Spawn::Serializer malformed{Spawn::RequestCommand::KILL};
+	malformed.WriteU8(0);
+	malformed.WriteU8(0);
+	malformed.WriteU8(0);
+
+	Spawn::Serializer batch{Spawn::RequestCommand::BATCH};
+	AppendBatchRequest(batch, kill.GetPayload(), 0);
+	AppendBatchRequest(batch, malformed.GetPayload(), 0);
+	AppendBatchRequest(batch, exec.GetPayload(), exec.GetFds().size());
+	Spawn::Send<1>(client_socket, batch.GetPayload(), exec.GetFds());
+	w2.Close();
+
+	ReceiveResponses(client_socket, responses, [&responses]{
+		return responses.exit.contains(2);
+	});
+
+	/* the EXEC after the malformed request was handled */
+	EXPECT_EQ(responses.exec_complete[2], "");
+	EXPECT_TRUE(WIFEXITED(responses.exit[2]));
+	EXPECT_EQ(WEXITSTATUS(responses.exit[2]), 0);
+
+	std::array<char, 64> buffer;
+	const auto nbytes = r2.Read(std::as_writable_bytes(std::span{buffer}));
+	ASSERT_GT(nbytes, 0);
+	EXPECT_EQ(std::string_view(buffer.data(), nbytes), "ok\n");
+
+	/* the KILL before the malformed request was handled: the
+	   pipe gets closed by the dying process */
+	struct pollfd pfd{.fd = r1.Get(), .events = POLLIN, .revents = 0};
+	ASSERT_EQ(poll(&pfd, 1, 10000), 1) << "child process still alive";
+	EXPECT_EQ(r1.Read(std::as_writable_bytes(std::span{buffer})), 0);
+
+	/* the killed process is not reported */
+	EXPECT_FALSE(responses.exit.contains(1));
+
+	client_socket.Close();
+	WaitSpawner(spawner_pid);
+}
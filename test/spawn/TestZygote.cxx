@@ -0,0 +1,247 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "spawn/Zygote.hxx"
+#include "spawn/ZygoteCache.hxx"
+#include "spawn/Prepared.hxx"
+#include "spawn/Direct.hxx"
+#include "spawn/IProtocol.hxx"
+#include "event/Loop.hxx"
+#include "net/SocketPair.hxx"
+#include "co/InvokeTask.hxx"
+#include "co/Task.hxx"
+#include "io/Pipe.hxx"
+#include "util/BindMethod.hxx"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <exception>
+#include <string>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace Spawn;
+
+static void
+Add(SpawnZygoteKey &key, ExecCommand cmd, std::string_view payload={})
+{
+	std::string raw;
+	raw.push_back(static_cast<char>(cmd));
+	raw.append(payload);
+	key.Add(cmd, std::as_bytes(std::span{raw}));
+}
+
+TEST(ZygoteKey, Compatible)
+{
+	SpawnZygoteKey key;
+	Add(key, ExecCommand::EXEC_PATH, "/bin/true");
+	Add(key, ExecCommand::ARG, "true");
+	Add(key, ExecCommand::STDOUT);
+	Add(key, ExecCommand::STDERR);
+	EXPECT_TRUE(key.IsCompatible());
+
+	/* per-child commands are not part of the key */
+	EXPECT_TRUE(key.GetValue().empty());
+
+	Add(key, ExecCommand::HOSTNAME, "foo");
+	EXPECT_TRUE(key.IsCompatible());
+	EXPECT_FALSE(key.GetValue().empty());
+}
+
+TEST(ZygoteKey, Stdio)
+{
+	/* without stdout/stderr, the child would inherit the
+	   zygote's journal stream */
+	SpawnZygoteKey a;
+	EXPECT_FALSE(a.IsCompatible());
+	Add(a, ExecCommand::STDOUT);
+	EXPECT_FALSE(a.IsCompatible());
+	Add(a, ExecCommand::STDERR);
+	EXPECT_TRUE(a.IsCompatible());
+
+	SpawnZygoteKey b;
+	Add(b, ExecCommand::STDIN);
+	Add(b, ExecCommand::STDOUT_IS_STDIN);
+	Add(b, ExecCommand::STDERR_IS_STDIN);
+	EXPECT_TRUE(b.IsCompatible());
+
+	/* STDOUT_IS_STDIN without a stdin file descriptor */
+	SpawnZygoteKey c;
+	Add(c, ExecCommand::STDOUT_IS_STDIN);
+	Add(c, ExecCommand::STDERR);
+	EXPECT_FALSE(c.IsCompatible());
+}
+
+TEST(ZygoteKey, Incompatible)
+{
+	for (const auto cmd : {ExecCommand::PID_NS, ExecCommand::STDERR_PATH,
+			       ExecCommand::RETURN_PIDFD, ExecCommand::TTY,
+			       ExecCommand::CGROUP_SESSION,
+			       ExecCommand::MOUNT_ROOT_TMPFS,
+			       ExecCommand::MOUNT_TMP_TMPFS,
+			       ExecCommand::MOUNT_TMPFS,
+			       ExecCommand::WRITE_FILE,
+			       ExecCommand::NETWORK_NS,
+			       ExecCommand::NETWORK_NS_NAME,
+			       ExecCommand::IPC_NS}) {
+		SCOPED_TRACE(static_cast<unsigned>(cmd));
+
+		SpawnZygoteKey key;
+		Add(key, ExecCommand::STDOUT);
+		Add(key, ExecCommand::STDERR);
+		Add(key, cmd);
+		EXPECT_FALSE(key.IsCompatible());
+	}
+}
+
+TEST(ZygoteKey, Value)
+{
+	SpawnZygoteKey a, b, c;
+	Add(a, ExecCommand::HOSTNAME, "foo");
+	Add(a, ExecCommand::ARG, "x");
+	Add(b, ExecCommand::ARG, "y");
+	Add(b, ExecCommand::HOSTNAME, "foo");
+	Add(c, ExecCommand::HOSTNAME, "bar");
+
+	EXPECT_EQ(a.GetValue(), b.GetValue());
+	EXPECT_NE(a.GetValue(), c.GetValue());
+}
+
+/**
+ * Fork a zygote process (without the namespace/cgroup setup done by
+ * the spawner).  Its children become children of this process
+ * because of CLONE_PARENT.
+ */
+static SpawnZygote
+ForkZygote()
+{
+	auto [socket, zygote_socket] = CreateSocketPair(SOCK_SEQPACKET);
+
+	const pid_t pid = fork();
+	if (pid < 0)
+		throw std::runtime_error{"fork() failed"};
+
+	if (pid == 0) {
+		socket.Close();
+		zygote_socket.ToFileDescriptor().CheckDuplicate(FileDescriptor{3});
+		_exit(RunSpawnZygote(PreparedChildProcess{}));
+	}
+
+	return {std::move(socket), {}};
+}
+
+struct ZygoteChildWaiter {
+	EventLoop &event_loop;
+
+	Co::InvokeTask task;
+
+	SpawnChildProcessResult result;
+
+	std::exception_ptr error;
+
+	explicit ZygoteChildWaiter(EventLoop &_event_loop) noexcept
+		:event_loop(_event_loop) {}
+
+	/**
+	 * Run the #EventLoop until WaitSpawnZygoteChild() has
+	 * finished.
+	 */
+	void Run(UniqueSocketDescriptor &&reply_socket) {
+		task = Wait(std::move(reply_socket));
+		task.Start(BIND_THIS_METHOD(OnCompletion));
+		event_loop.Run();
+	}
+
+private:
+	Co::InvokeTask Wait(UniqueSocketDescriptor reply_socket) {
+		result = co_await WaitSpawnZygoteChild(event_loop,
+						       std::move(reply_socket));
+	}
+
+	void OnCompletion(std::exception_ptr &&_error) noexcept {
+		error = std::move(_error);
+		event_loop.Break();
+	}
+};
+
+static int
+WaitExit(FileDescriptor pidfd)
+{
+	siginfo_t info{};
+	if (waitid(P_PIDFD, pidfd.Get(), &info, WEXITED) < 0)
+		throw std::runtime_error{"waitid() failed"};
+
+	return info.si_status;
+}
+
+/**
+ * One zygote forks several child processes; their output and exit
+ * status is delivered to the caller.
+ */
+TEST(Zygote, Reuse)
+{
+	EventLoop event_loop;
+	auto zygote = ForkZygote();
+
+	for (unsigned i = 0; i < 3; ++i) {
+		auto [r, w] = CreatePipe();
+
+		const std::string arg = "echo " + std::to_string(i) + " $PPID";
+
+		PreparedChildProcess p;
+		p.Append("/bin/sh");
+		p.Append("-c");
+		p.Append(arg.c_str());
+		p.stdout_fd = p.stderr_fd = w;
+
+		auto reply_socket = zygote.Fork(p);
+		ASSERT_TRUE(reply_socket.IsDefined());
+		w.Close();
+
+		ZygoteChildWaiter waiter{event_loop};
+		waiter.Run(std::move(reply_socket));
+		ASSERT_FALSE(waiter.error);
+		EXPECT_EQ(WaitExit(waiter.result.pidfd), 0);
+
+		std::array<char, 64> buffer;
+		const auto nbytes = r.Read(std::as_writable_bytes(std::span{buffer}));
+		ASSERT_GT(nbytes, 0);
+
+		/* CLONE_PARENT: the child process is our child, not
+		   the zygote's */
+		EXPECT_EQ(std::string_view(buffer.data(), nbytes),
+			  std::to_string(i) + " " + std::to_string(getpid()) + "\n");
+	}
+}
+
+TEST(Zygote, ExecError)
+{
+	EventLoop event_loop;
+	auto zygote = ForkZygote();
+
+	PreparedChildProcess p;
+	p.Append("/nonexistent");
+
+	auto reply_socket = zygote.Fork(p);
+	ASSERT_TRUE(reply_socket.IsDefined());
+
+	ZygoteChildWaiter waiter{event_loop};
+	waiter.Run(std::move(reply_socket));
+	EXPECT_TRUE(waiter.error);
+
+	/* the zygote is still usable */
+	p.args.clear();
+	p.Append("/bin/true");
+	reply_socket = zygote.Fork(p);
+	ASSERT_TRUE(reply_socket.IsDefined());
+
+	ZygoteChildWaiter waiter2{event_loop};
+	waiter2.Run(std::move(reply_socket));
+	ASSERT_FALSE(waiter2.error);
+	EXPECT_EQ(WaitExit(waiter2.result.pidfd), 0);
+}
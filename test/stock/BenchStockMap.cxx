@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+/*
+ * Measure the throughput of StockMap::Get() and StockItem::Put()
+ * with many distinct keys.
+ */
+
+#include "stock/MapStock.hxx"
+#include "stock/Class.hxx"
+#include "stock/GetHandler.hxx"
+#include "stock/Item.hxx"
+#include "stock/Options.hxx"
+#include "event/Loop.hxx"
+#include "util/Cancellable.hxx"
+
+#include <fmt/core.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct BenchStockItem final : StockItem {
+	using StockItem::StockItem;
+
+	/* virtual methods from class StockItem */
+	bool Borrow() noexcept override {
+		return true;
+	}
+
+	bool Release() noexcept override {
+		return true;
+	}
+};
+
+class BenchStockClass final : public StockClass {
+public:
+	/* virtual methods from class StockClass */
+	void Create(CreateStockItem c, StockRequest,
+		    StockGetHandler &handler,
+		    CancellablePointer &) override {
+		auto *item = new BenchStockItem(c);
+		item->InvokeCreateSuccess(handler);
+	}
+};
+
+class BenchStockGetHandler final : public StockGetHandler {
+public:
+	StockItem *item = nullptr;
+
+	/* virtual methods from class StockGetHandler */
+	void OnStockItemReady(StockItem &_item) noexcept override {
+		item = &_item;
+	}
+
+	void OnStockItemError(std::exception_ptr) noexcept override {
+		std::abort();
+	}
+};
+
+} // anonymous namespace
+
+static void
+Bench(std::size_t n_keys, std::size_t n_iterations)
+{
+	EventLoop event_loop;
+	BenchStockClass cls;
+	StockMap map{event_loop, cls, {
+		.limit = 0,
+		.max_idle = 1,
+		.clear_interval = std::chrono::hours{1},
+		.max_wait = {},
+	}};
+
+	std::vector<std::string> names;
+	names.reserve(n_keys);
+	for (std::size_t i = 0; i < n_keys; ++i)
+		names.emplace_back(fmt::format("backend-{}.example.com:{}", i, i % 100));
+
+	std::vector<StockKey> keys;
+	keys.reserve(n_keys);
+	for (const auto &i : names)
+		keys.emplace_back(i);
+
+	std::vector<uint32_t> order(n_iterations);
+	std::mt19937 rng{42};
+	std::uniform_int_distribution<uint32_t> dist{0, uint32_t(n_keys - 1)};
+	for (auto &i : order)
+		i = dist(rng);
+
+	BenchStockGetHandler handler;
+	CancellablePointer cancel_ptr;
+
+	const auto GetPut = [&](const StockKey &key){
+		map.Get(key, nullptr, handler, cancel_ptr);
+		handler.item->Put(PutAction::REUSE);
+	};
+
+	/* populate the map */
+	for (const auto &i : keys)
+		GetPut(i);
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (const auto i : order)
+		GetPut(keys[i]);
+
+	const std::chrono::duration<double, std::nano> duration =
+		std::chrono::steady_clock::now() - start;
+
+	fmt::print("{:>7} keys: {:8.1f} ns per Get/Put\n",
+		   n_keys, duration.count() / n_iterations);
+}
+
+int
+main(int, char **)
+{
+	for (const std::size_t n_keys : {1000, 10000, 100000})
+		Bench(n_keys, 1000000);
+
+	return EXIT_SUCCESS;
+}
@@ -11,6 +11,8 @@
 
 #include <forward_list>
 #include <list>
+#include <thread>
+#include <vector>
 
 namespace {
 
@@ -91,6 +93,8 @@ class MyStockClass final : public StockClass, public MultiStockClass {
 	};
 
 public:
+	MultiStockPlacement placement = MultiStockPlacement::FIRST;
+
 	/* virtual methods from class StockClass */
 	void Create(CreateStockItem c, StockRequest request,
 		    StockGetHandler &handler,
@@ -99,6 +103,10 @@ public:
 	bool ShouldContinueOnCancel(const void *request) const noexcept override;
 
 	/* virtual methods from class MultiStockClass */
+	MultiStockPlacement GetPlacement(const void *) const noexcept override {
+		return placement;
+	}
+
 	StockItem *Create(CreateStockItem c, StockItem &outer_item) override {
 		return new MyInnerStockItem(c, outer_item);
 	}
@@ -1775,3 +1783,181 @@ TEST(MultiStock, ReleaseFromReadyHandlerDeletesMapItem)
 	ASSERT_EQ(foo.factory_created, 1);
 	ASSERT_EQ(foo.destroyed, 1);
 }
+
+/**
+ * Create #n_outer outer items with two leases each.
+ *
+ * @return the outer items in creation order
+ */
+static std::vector<StockItem *>
+FillOuterItems(Partition &partition, std::size_t n_outer) noexcept
+{
+	std::vector<StockItem *> result;
+
+	for (std::size_t i = 0; i < n_outer * 2; ++i) {
+		auto &lease = partition.Get();
+		EXPECT_NE(lease.item, nullptr);
+
+		if (result.empty() || result.back() != &lease.item->outer_item)
+			result.push_back(&lease.item->outer_item);
+	}
+
+	EXPECT_EQ(result.size(), n_outer);
+	return result;
+}
+
+/**
+ * Release one lease of the given outer item.
+ */
+static void
+PutOne(Partition &partition, const StockItem &outer_item) noexcept
+{
+	for (auto i = partition.leases.begin(); i != partition.leases.end(); ++i) {
+		if (i->item != nullptr && &i->item->outer_item == &outer_item) {
+			partition.leases.erase(i);
+			return;
+		}
+	}
+
+	FAIL();
+}
+
+TEST(MultiStock, PlacementFirst)
+{
+	Instance instance{2};
+
+	Partition foo{instance, "foo"};
+	const auto outer = FillOuterItems(foo, 2);
+
+	/* a: one lease, b: none */
+	PutOne(foo, *outer[0]);
+	PutOne(foo, *outer[1]);
+	PutOne(foo, *outer[1]);
+	instance.RunSome();
+
+	auto &lease = foo.Get();
+	ASSERT_NE(lease.item, nullptr);
+	EXPECT_EQ(&lease.item->outer_item, outer[0]);
+}
+
+TEST(MultiStock, PlacementLeastBusy)
+{
+	Instance instance{2};
+	instance.stock_class.placement = MultiStockPlacement::LEAST_BUSY;
+
+	Partition foo{instance, "foo"};
+	const auto outer = FillOuterItems(foo, 2);
+
+	/* a: one lease, b: none */
+	PutOne(foo, *outer[0]);
+	PutOne(foo, *outer[1]);
+	PutOne(foo, *outer[1]);
+	instance.RunSome();
+
+	auto &lease = foo.Get();
+	ASSERT_NE(lease.item, nullptr);
+	EXPECT_EQ(&lease.item->outer_item, outer[1]);
+
+	/* now both have one lease; the next one goes to the first */
+	auto &lease2 = foo.Get();
+	ASSERT_NE(lease2.item, nullptr);
+	EXPECT_EQ(&lease2.item->outer_item, outer[0]);
+}
+
+/**
+ * Let some time pass, so the next Put() measures a lease duration
+ * greater than zero.
+ */
+static void
+Sleep(EventLoop &event_loop, std::chrono::milliseconds d) noexcept
+{
+	std::this_thread::sleep_for(d);
+	event_loop.FlushClockCaches();
+}
+
+TEST(MultiStock, PlacementLatencyEwma)
+{
+	using std::chrono_literals::operator""ms;
+
+	Instance instance{3};
+	instance.stock_class.placement = MultiStockPlacement::LATENCY_EWMA;
+
+	Partition foo{instance, "foo"};
+	const auto outer = FillOuterItems(foo, 2);
+
+	/* a: no leases, with a latency sample; b: full */
+	Sleep(instance.event_loop, 2ms);
+	PutOne(foo, *outer[0]);
+	PutOne(foo, *outer[0]);
+	instance.RunSome();
+
+	/* fill a again and create a third item c, which has no
+	   latency sample yet */
+	foo.Get(2);
+	auto &c_lease = foo.Get();
+	ASSERT_NE(c_lease.item, nullptr);
+	const auto *c = &c_lease.item->outer_item;
+	EXPECT_NE(c, outer[0]);
+	EXPECT_NE(c, outer[1]);
+
+	/* a: no leases; c: one lease, but no latency sample; c must
+	   not attract the lease just because its latency is still
+	   zero */
+	Sleep(instance.event_loop, 2ms);
+	PutOne(foo, *outer[0]);
+	PutOne(foo, *outer[0]);
+	instance.RunSome();
+
+	auto &lease = foo.Get();
+	ASSERT_NE(lease.item, nullptr);
+	EXPECT_EQ(&lease.item->outer_item, outer[0]);
+
+	/* b: no leases, slow; a: one lease, fast; the second lease
+	   costs less on the fast item */
+	Sleep(instance.event_loop, 50ms);
+	PutOne(foo, *outer[1]);
+	PutOne(foo, *outer[1]);
+	instance.RunSome();
+
+	auto &lease2 = foo.Get();
+	ASSERT_NE(lease2.item, nullptr);
+	EXPECT_EQ(&lease2.item->outer_item, outer[0]);
+}
+
+TEST(MultiStock, PlacementTwoChoices)
+{
+	Instance instance{3};
+	instance.stock_class.placement = MultiStockPlacement::TWO_CHOICES;
+
+	Partition foo{instance, "foo"};
+	const auto outer = FillOuterItems(foo, 3);
+
+	/* a: none, b: one lease, c: two leases (full) */
+	PutOne(foo, *outer[0]);
+	PutOne(foo, *outer[0]);
+	PutOne(foo, *outer[1]);
+	instance.RunSome();
+
+	/* c is full, so only a and b are usable; the least busy one
+	   wins */
+	auto &lease = foo.Get();
+	ASSERT_NE(lease.item, nullptr);
+	EXPECT_EQ(&lease.item->outer_item, outer[0]);
+
+	/* a: none, b: one lease, c: one lease; any pair contains
+	   either a (the least busy one) or b and c, where the tie is
+	   resolved in favour of b: c must never be chosen */
+	PutOne(foo, *outer[0]);
+	PutOne(foo, *outer[2]);
+	instance.RunSome();
+
+	for (unsigned i = 0; i < 32; ++i) {
+		auto &l = foo.Get();
+		ASSERT_NE(l.item, nullptr);
+		const auto *chosen = &l.item->outer_item;
+		EXPECT_NE(chosen, outer[2]);
+
+		PutOne(foo, *chosen);
+		instance.RunSome();
+	}
+}
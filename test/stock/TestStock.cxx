@@ -7,6 +7,7 @@
 #include "stock/GetHandler.hxx"
 #include "stock/Item.hxx"
 #include "stock/Options.hxx"
+#include "event/FineTimerEvent.hxx"
 #include "event/Loop.hxx"
 #include "util/Cancellable.hxx"
 #include "util/PrintException.hxx"
@@ -54,10 +55,16 @@ public:
 
 	bool next_fail = false;
 
+	StockPreWarmOptions pre_warm{};
+
 	/* virtual methods from class StockClass */
 	void Create(CreateStockItem c, StockRequest request,
 		    StockGetHandler &handler,
 		    CancellablePointer &cancel_ptr) override;
+
+	StockPreWarmOptions GetPreWarmOptions() const noexcept override {
+		return pre_warm;
+	}
 };
 
 void
@@ -104,12 +111,18 @@ struct Instance {
 	EventLoop event_loop;
 
 	DeferEvent break_event{event_loop, BIND_THIS_METHOD(OnBreakEvent)};
+	FineTimerEvent break_timer{event_loop, BIND_THIS_METHOD(OnBreakEvent)};
 
 	void RunSome() noexcept {
 		break_event.ScheduleIdle();
 		event_loop.Run();
 	}
 
+	void RunFor(Event::Duration d) noexcept {
+		break_timer.Schedule(d);
+		event_loop.Run();
+	}
+
 private:
 	void OnBreakEvent() noexcept {
 		event_loop.Break();
@@ -597,3 +610,79 @@ TEST(Stock, ContinueOnCancel)
 	EXPECT_EQ(num_release, 0);
 	EXPECT_EQ(num_destroy, 0);
 }
+
+TEST(Stock, PreWarm)
+{
+	Instance instance;
+	MyStockClass cls;
+	cls.pre_warm = {
+		.max_items = 4,
+		.interval = std::chrono::seconds{1},
+		.alpha = 1,
+	};
+
+	Stock stock{
+		instance.event_loop, cls, "test",
+		{
+			.limit = 8,
+			.max_idle = 8,
+		},
+	};
+
+	num_borrow = num_release = num_destroy = 0;
+
+	/* three concurrent requests */
+
+	MyStockGetHandler handlers[3];
+	CancellablePointer cancel_ptr;
+	for (auto &i : handlers) {
+		stock.Get(nullptr, i, cancel_ptr);
+		ASSERT_TRUE(i.got_item);
+		ASSERT_NE(i.last_item, nullptr);
+	}
+
+	for (auto &i : handlers)
+		stock.Put(*i.last_item, PutAction::DESTROY);
+
+	ASSERT_EQ(cls.n_create, 3);
+	ASSERT_EQ(num_destroy, 3);
+	ASSERT_TRUE(stock.IsEmpty());
+
+	/* the timer creates three items in advance */
+
+	for (unsigned i = 0; i < 50 && stock.GetCounters().pre_warm_creates == 0; ++i)
+		instance.RunFor(std::chrono::milliseconds{100});
+
+	ASSERT_EQ(cls.n_create, 6);
+	ASSERT_EQ(stock.GetCounters().pre_warm_creates, 3);
+
+	StockStats stats{};
+	stock.AddStats(stats);
+	ASSERT_EQ(stats.idle, 3);
+	ASSERT_EQ(stats.busy, 0);
+
+	/* the next request uses a pre-warmed item */
+
+	MyStockGetHandler handler;
+	stock.Get(nullptr, handler, cancel_ptr);
+	ASSERT_TRUE(handler.got_item);
+	ASSERT_EQ(cls.n_create, 6);
+	ASSERT_EQ(num_borrow, 1);
+	ASSERT_EQ(stock.GetCounters().pre_warm_hits, 1);
+
+	stock.Put(*handler.last_item, PutAction::REUSE);
+
+	/* demand has dropped to one: the surplus is destroyed */
+
+	for (unsigned i = 0; i < 50 && stock.GetCounters().pre_warm_wasted == 0; ++i)
+		instance.RunFor(std::chrono::milliseconds{100});
+
+	ASSERT_EQ(cls.n_create, 6);
+	ASSERT_EQ(stock.GetCounters().pre_warm_wasted, 2);
+
+	stats = {};
+	stock.AddStats(stats);
+	ASSERT_EQ(stats.idle, 1);
+
+	stock.Shutdown();
+}
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "stock/WaitTracker.hxx"
+
+#include <gtest/gtest.h>
+
+using std::chrono_literals::operator""ms;
+using std::chrono_literals::operator""s;
+
+TEST(StockWaitTracker, Disabled)
+{
+	StockWaitTracker t{Event::Duration::zero()};
+	const Event::TimePoint now{1000s};
+
+	t.Add(now, 10s);
+	EXPECT_FALSE(t.IsRejecting(now));
+}
+
+/**
+ * With few samples, a single long wait triggers rejection.
+ */
+TEST(StockWaitTracker, FewSamples)
+{
+	StockWaitTracker t{100ms};
+	const Event::TimePoint now{1000s};
+
+	t.Add(now, 10ms);
+	EXPECT_FALSE(t.IsRejecting(now));
+
+	t.Add(now, 200ms);
+	EXPECT_TRUE(t.IsRejecting(now));
+	EXPECT_TRUE(t.IsRejecting(now + 500ms));
+	EXPECT_FALSE(t.IsRejecting(now + 2s));
+}
+
+/**
+ * With enough samples, rejection depends on the ratio of long waits,
+ * not on a single outlier.
+ */
+TEST(StockWaitTracker, Ratio)
+{
+	StockWaitTracker t{100ms};
+	Event::TimePoint now{1000s};
+
+	for (unsigned i = 0; i < 100; ++i)
+		t.Add(now, 10ms);
+
+	/* one outlier does not trigger rejection */
+	t.Add(now, 500ms);
+	EXPECT_FALSE(t.IsRejecting(now));
+
+	/* many long waits do */
+	for (unsigned i = 0; i < 10 && !t.IsRejecting(now); ++i)
+		t.Add(now, 500ms);
+	EXPECT_TRUE(t.IsRejecting(now));
+	EXPECT_GT(t.GetExceededRatio(), 0.05);
+
+	/* after two windows, the old samples are forgotten */
+	now += 11s;
+	EXPECT_FALSE(t.IsRejecting(now));
+	t.Add(now, 10ms);
+	EXPECT_FALSE(t.IsRejecting(now));
+	EXPECT_EQ(t.GetExceededRatio(), 0);
+}
+
+/**
+ * Waits which are long, but below the limit, never trigger
+ * rejection (a histogram with power-of-two buckets would have
+ * estimated the 95th percentile of these as more than 100ms).
+ */
+TEST(StockWaitTracker, BelowLimit)
+{
+	StockWaitTracker t{100ms};
+	const Event::TimePoint now{1000s};
+
+	for (unsigned i = 0; i < 1000; ++i) {
+		t.Add(now, 70ms);
+		ASSERT_FALSE(t.IsRejecting(now));
+	}
+
+	EXPECT_EQ(t.GetExceededRatio(), 0);
+}
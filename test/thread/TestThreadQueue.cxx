@@ -0,0 +1,295 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "thread/Queue.hxx"
+#include "thread/Job.hxx"
+#include "thread/Worker.hxx"
+#include "thread/Pool.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "event/Loop.hxx"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <semaphore>
+
+namespace {
+
+/**
+ * Counts Done() calls and stops the #EventLoop after the expected
+ * number or after a timeout.
+ */
+class DoneCounter {
+	EventLoop &event_loop;
+
+	CoarseTimerEvent timeout;
+
+public:
+	unsigned n = 0, expected = 0;
+
+	explicit DoneCounter(EventLoop &_event_loop) noexcept
+		:event_loop(_event_loop),
+		 timeout(event_loop, BIND_THIS_METHOD(OnTimeout)) {}
+
+	/**
+	 * Run the #EventLoop until #expected jobs are done.
+	 */
+	void Run(unsigned _expected) noexcept {
+		expected = _expected;
+		timeout.Schedule(std::chrono::seconds{10});
+
+		if (n < expected)
+			event_loop.Run();
+
+		timeout.Cancel();
+	}
+
+	void Add() noexcept {
+		if (++n >= expected)
+			event_loop.Break();
+	}
+
+private:
+	void OnTimeout() noexcept {
+		event_loop.Break();
+	}
+};
+
+/**
+ * A job which blocks in its first Run() call until Release() is
+ * called.
+ */
+class BlockingJob final : public ThreadJob {
+	DoneCounter &counter;
+
+	std::binary_semaphore started{0}, release{0};
+
+public:
+	std::atomic_uint n_runs{0};
+
+	/**
+	 * The shard this job was in while it was running.
+	 */
+	std::atomic_uint run_shard{0};
+
+	unsigned n_done = 0;
+
+	explicit BlockingJob(DoneCounter &_counter) noexcept
+		:counter(_counter) {}
+
+	/**
+	 * Wait until a worker thread has begun running this job.
+	 */
+	void WaitStarted() noexcept {
+		started.acquire();
+	}
+
+	void Release() noexcept {
+		release.release();
+	}
+
+	/* virtual methods from class ThreadJob */
+	void Run() noexcept override {
+		run_shard = shard;
+
+		if (n_runs++ == 0) {
+			started.release();
+			release.acquire();
+		}
+	}
+
+	void Done() noexcept override {
+		++n_done;
+		counter.Add();
+	}
+};
+
+/**
+ * A job which waits (with a timeout) until #n jobs are running
+ * concurrently.
+ */
+class RendezvousJob final : public ThreadJob {
+	DoneCounter &counter;
+
+	std::mutex &mutex;
+	std::condition_variable &cond;
+	unsigned &running;
+	const unsigned n;
+
+public:
+	bool met = false;
+
+	RendezvousJob(DoneCounter &_counter,
+		      std::mutex &_mutex, std::condition_variable &_cond,
+		      unsigned &_running, unsigned _n) noexcept
+		:counter(_counter),
+		 mutex(_mutex), cond(_cond), running(_running), n(_n) {}
+
+	/* virtual methods from class ThreadJob */
+	void Run() noexcept override {
+		std::unique_lock lock{mutex};
+		if (++running >= n)
+			cond.notify_all();
+
+		met = cond.wait_for(lock, std::chrono::seconds{10},
+				    [this]{ return running >= n; });
+	}
+
+	void Done() noexcept override {
+		counter.Add();
+	}
+};
+
+/**
+ * A #ThreadQueue with two shards, but only the worker for shard 1;
+ * all jobs added to shard 0 must be stolen.
+ */
+struct StealFixture {
+	EventLoop event_loop;
+	DoneCounter counter{event_loop};
+	ThreadQueue queue{event_loop, 2};
+	ThreadWorker worker{queue, 1};
+
+	~StealFixture() noexcept {
+		queue.Stop();
+		worker.Join();
+	}
+};
+
+} // anonymous namespace
+
+/**
+ * A job in the shard of a worker which does not exist is stolen by
+ * an idle worker.
+ */
+TEST(ThreadQueue, Steal)
+{
+	StealFixture f;
+
+	/* the first job goes to shard 0 (round robin), which has no
+	   worker */
+	BlockingJob a{f.counter};
+	f.queue.Add(a);
+	a.WaitStarted();
+	a.Release();
+
+	f.counter.Run(1);
+	EXPECT_EQ(a.n_done, 1U);
+	EXPECT_EQ(a.run_shard, 0U);
+	EXPECT_TRUE(a.IsIdle());
+
+	/* the second one goes to the worker's own shard */
+	BlockingJob b{f.counter};
+	f.queue.Add(b);
+	b.WaitStarted();
+	b.Release();
+
+	f.counter.Run(2);
+	EXPECT_EQ(b.n_done, 1U);
+	EXPECT_EQ(b.run_shard, 1U);
+	EXPECT_TRUE(b.IsIdle());
+}
+
+/**
+ * Cancel() succeeds on a waiting job and fails on a job which has
+ * been stolen and is being run.
+ */
+TEST(ThreadQueue, Cancel)
+{
+	StealFixture f;
+
+	/* "a" is added to shard 0 and gets stolen */
+	BlockingJob a{f.counter}, b{f.counter};
+	f.queue.Add(a);
+	a.WaitStarted();
+	EXPECT_FALSE(f.queue.Cancel(a));
+
+	/* "b" is added to shard 1, but its worker is still busy with
+	   "a" */
+	f.queue.Add(b);
+	EXPECT_TRUE(f.queue.Cancel(b));
+	EXPECT_TRUE(b.IsIdle());
+
+	/* canceling an idle job is a no-op */
+	EXPECT_TRUE(f.queue.Cancel(b));
+
+	a.Release();
+	f.counter.Run(1);
+	EXPECT_EQ(a.n_done, 1U);
+	EXPECT_TRUE(a.IsIdle());
+	EXPECT_TRUE(f.queue.Cancel(a));
+
+	EXPECT_EQ(b.n_runs, 0U);
+	EXPECT_EQ(b.n_done, 0U);
+}
+
+/**
+ * Adding a job while it is running sets the "again" flag: it is run
+ * again in its own shard, and Done() is invoked only once.
+ */
+TEST(ThreadQueue, Again)
+{
+	StealFixture f;
+
+	BlockingJob a{f.counter};
+	f.queue.Add(a);
+	a.WaitStarted();
+
+	f.queue.Add(a);
+	EXPECT_TRUE(a.again);
+
+	a.Release();
+	f.counter.Run(1);
+
+	EXPECT_EQ(a.n_runs, 2U);
+	EXPECT_EQ(a.n_done, 1U);
+	EXPECT_EQ(a.run_shard, 0U);
+	EXPECT_TRUE(a.IsIdle());
+}
+
+/**
+ * The global pool with more than one worker and without CPU
+ * affinity runs jobs concurrently.
+ */
+TEST(ThreadPool, Workers)
+{
+	static constexpr unsigned N = 4;
+
+	thread_pool_set_worker_count(N);
+	thread_pool_set_cpu_affinity(false);
+
+	EventLoop event_loop;
+	DoneCounter counter{event_loop};
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	unsigned running = 0;
+
+	auto &queue = thread_pool_get_queue(event_loop);
+
+	{
+		RendezvousJob jobs[N]{
+			{counter, mutex, cond, running, N},
+			{counter, mutex, cond, running, N},
+			{counter, mutex, cond, running, N},
+			{counter, mutex, cond, running, N},
+		};
+
+		for (auto &i : jobs)
+			queue.Add(i);
+
+		counter.Run(N);
+		EXPECT_EQ(counter.n, N);
+
+		for (const auto &i : jobs)
+			EXPECT_TRUE(i.met);
+	}
+
+	thread_pool_stop();
+	thread_pool_join();
+	thread_pool_deinit();
+}
@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "translation/PReader.hxx"
+#include "translation/Protocol.hxx"
+#include "AllocatorPtr.hxx"
+#include "util/SpanCast.hxx"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::string_view_literals::operator""sv;
+
+namespace {
+
+using Packet = std::pair<TranslationCommand, std::string>;
+
+} // anonymous namespace
+
+static void
+AppendPacket(std::string &r, TranslationCommand command,
+	     std::string_view payload) noexcept
+{
+	const TranslationHeader header{
+		.length = static_cast<uint16_t>(payload.size()),
+		.command = command,
+	};
+
+	r += ToStringView(ReferenceAsBytes(header));
+	r += payload;
+}
+
+static std::string
+MakeResponse() noexcept
+{
+	std::string r;
+	AppendPacket(r, TranslationCommand::BEGIN, {});
+	AppendPacket(r, TranslationCommand::EXECUTE, "/usr/lib/cgi-bin/app.cgi"sv);
+
+	/* a payload with a null byte */
+	AppendPacket(r, TranslationCommand::BIND_MOUNT, "/srv/data\0/mnt/data"sv);
+
+	/* empty packets between packets with payloads */
+	AppendPacket(r, TranslationCommand::SETENV, "FOO=bar"sv);
+	AppendPacket(r, TranslationCommand::STATEFUL, {});
+	AppendPacket(r, TranslationCommand::SETENV, "X=1"sv);
+
+	/* a large payload with a length whose low byte is not
+	   zero */
+	AppendPacket(r, TranslationCommand::APPEND, std::string(1000, 'a'));
+
+	/* a 1-byte payload */
+	AppendPacket(r, TranslationCommand::APPEND, "b"sv);
+
+	AppendPacket(r, TranslationCommand::END, {});
+	return r;
+}
+
+static void
+AddPacket(std::vector<Packet> &packets,
+	  const TranslatePacketReader &reader) noexcept
+{
+	const auto payload = reader.GetPayload();
+	packets.emplace_back(reader.GetCommand(),
+			     std::string{ToStringView(payload)});
+}
+
+/**
+ * Simulate receiving #src in chunks of the given size into one
+ * contiguous buffer; after each chunk, invoke the given function
+ * with the unconsumed part of the buffer until it returns 0.
+ */
+template<typename F>
+static void
+Receive(std::string_view src, std::size_t chunk_size, F &&feed)
+{
+	std::vector<std::byte> buffer(src.size());
+	std::size_t received = 0, position = 0;
+
+	while (received < src.size()) {
+		const std::size_t n = std::min(chunk_size, src.size() - received);
+		std::copy_n(AsBytes(src).begin() + received, n,
+			    buffer.begin() + received);
+		received += n;
+
+		while (true) {
+			const std::size_t consumed =
+				feed(std::span{buffer}.subspan(position, received - position));
+			if (consumed == 0)
+				break;
+
+			position += consumed;
+		}
+	}
+}
+
+static std::vector<Packet>
+ParseFeed(std::string_view src, std::size_t chunk_size)
+{
+	Allocator allocator;
+	AllocatorPtr alloc{allocator};
+
+	TranslatePacketReader reader;
+	std::vector<Packet> packets;
+
+	Receive(src, chunk_size, [&](std::span<std::byte> b){
+		const auto consumed = reader.Feed(alloc, b);
+		if (consumed > 0 && reader.IsComplete())
+			AddPacket(packets, reader);
+		return consumed;
+	});
+
+	return packets;
+}
+
+static std::vector<Packet>
+ParseFeedInPlace(std::string_view src, std::size_t chunk_size)
+{
+	TranslatePacketReader reader;
+	std::vector<Packet> packets;
+
+	Receive(src, chunk_size, [&](std::span<std::byte> b){
+		const auto consumed = reader.FeedInPlace(b);
+		if (consumed > 0 && reader.IsComplete())
+			AddPacket(packets, reader);
+		return consumed;
+	});
+
+	return packets;
+}
+
+TEST(TranslatePacketReader, FeedInPlace)
+{
+	const auto response = MakeResponse();
+
+	const auto expected = ParseFeed(response, response.size());
+	ASSERT_EQ(expected.size(), 9U);
+	EXPECT_EQ(expected.front().first, TranslationCommand::BEGIN);
+	EXPECT_EQ(expected[2].second, "/srv/data\0/mnt/data"sv);
+	EXPECT_EQ(expected.back().first, TranslationCommand::END);
+
+	for (const std::size_t chunk_size : {1, 2, 3, 4, 5, 7, 64, 4096}) {
+		EXPECT_EQ(ParseFeed(response, chunk_size), expected);
+		EXPECT_EQ(ParseFeedInPlace(response, chunk_size), expected);
+	}
+}
+
+/**
+ * FeedInPlace() null-terminates payloads in place.
+ */
+TEST(TranslatePacketReader, FeedInPlaceNullTerminated)
+{
+	const auto response = MakeResponse();
+	std::vector<std::byte> buffer(response.size());
+	std::copy_n(AsBytes(response).begin(), buffer.size(), buffer.begin());
+
+	TranslatePacketReader reader;
+	std::span<std::byte> src{buffer};
+
+	while (true) {
+		const auto consumed = reader.FeedInPlace(src);
+		ASSERT_GT(consumed, 0U);
+		src = src.subspan(consumed);
+
+		ASSERT_TRUE(reader.IsComplete());
+		if (reader.GetCommand() == TranslationCommand::END)
+			break;
+
+		const auto payload = reader.GetPayload();
+		if (!payload.empty()) {
+			EXPECT_EQ(payload.data()[payload.size()], std::byte{0});
+		}
+	}
+
+	EXPECT_TRUE(src.empty());
+}
@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "translation/server/Connection.hxx"
+#include "translation/server/Handler.hxx"
+#include "translation/server/Request.hxx"
+#include "translation/server/Response.hxx"
+#include "translation/Protocol.hxx"
+#include "event/CoarseTimerEvent.hxx"
+#include "event/Loop.hxx"
+#include "net/SocketPair.hxx"
+#include "util/SpanCast.hxx"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <string.h>
+#include <sys/socket.h>
+
+using namespace Translation::Server;
+using std::string_view_literals::operator""sv;
+
+namespace {
+
+/**
+ * Records all requests and stops the #EventLoop after the expected
+ * number or after a timeout.  It does not respond; that is up to the
+ * test.
+ */
+class RecordingHandler final : public Handler {
+	EventLoop &event_loop;
+
+	CoarseTimerEvent timeout;
+
+public:
+	std::vector<const Request *> requests;
+
+	std::size_t expected = 0;
+
+	explicit RecordingHandler(EventLoop &_event_loop) noexcept
+		:event_loop(_event_loop),
+		 timeout(event_loop, BIND_THIS_METHOD(OnTimeout)) {}
+
+	/**
+	 * Run the #EventLoop until #expected requests have been
+	 * received or until the given timeout has expired.
+	 */
+	void Run(std::size_t _expected,
+		 Event::Duration _timeout=std::chrono::seconds{10}) noexcept {
+		expected = _expected;
+		timeout.Schedule(_timeout);
+
+		if (requests.size() < expected)
+			event_loop.Run();
+
+		timeout.Cancel();
+	}
+
+	/* virtual methods from class Handler */
+	bool OnTranslationRequest(Connection &, const Request &request,
+				  CancellablePointer &) noexcept override {
+		requests.push_back(&request);
+		if (requests.size() >= expected)
+			event_loop.Break();
+		return true;
+	}
+
+private:
+	void OnTimeout() noexcept {
+		event_loop.Break();
+	}
+};
+
+struct ParsedResponse {
+	std::optional<uint32_t> id;
+
+	std::string message;
+
+	bool operator==(const ParsedResponse &) const noexcept = default;
+};
+
+} // anonymous namespace
+
+static void
+AppendPacket(std::string &r, TranslationCommand command,
+	     std::string_view payload={}) noexcept
+{
+	const TranslationHeader header{
+		.length = static_cast<uint16_t>(payload.size()),
+		.command = command,
+	};
+
+	r += ToStringView(ReferenceAsBytes(header));
+	r += payload;
+}
+
+static void
+AppendRequest(std::string &r, std::optional<uint32_t> id,
+	      std::string_view uri) noexcept
+{
+	AppendPacket(r, TranslationCommand::BEGIN);
+
+	if (id)
+		AppendPacket(r, TranslationCommand::REQUEST_ID,
+			     ToStringView(ReferenceAsBytes(*id)));
+
+	AppendPacket(r, TranslationCommand::URI, uri);
+	AppendPacket(r, TranslationCommand::END);
+}
+
+static void
+SendRequests(SocketDescriptor s, std::string_view src)
+{
+	ASSERT_EQ(s.Send(AsBytes(src)), static_cast<ssize_t>(src.size()));
+}
+
+static Response
+MakeResponse(const Request &request) noexcept
+{
+	Response response;
+	response.Message(request.uri);
+	return response;
+}
+
+/**
+ * Receive everything which is currently available on the socket and
+ * parse it as a sequence of translation responses.
+ */
+static std::vector<ParsedResponse>
+ReceiveResponses(SocketDescriptor s)
+{
+	std::string data;
+	while (true) {
+		std::array<std::byte, 4096> buffer;
+		const auto nbytes = s.ReadNoWait(buffer);
+		if (nbytes <= 0)
+			break;
+
+		data += ToStringView(std::span{buffer}.first(nbytes));
+	}
+
+	std::vector<ParsedResponse> responses;
+	std::string_view src = data;
+
+	while (!src.empty()) {
+		TranslationHeader header;
+		if (src.size() < sizeof(header))
+			throw std::runtime_error{"Truncated packet header"};
+
+		memcpy(&header, src.data(), sizeof(header));
+		src.remove_prefix(sizeof(header));
+
+		if (src.size() < header.length)
+			throw std::runtime_error{"Truncated packet payload"};
+
+		const auto payload = src.substr(0, header.length);
+		src.remove_prefix(header.length);
+
+		switch (header.command) {
+		case TranslationCommand::BEGIN:
+			responses.emplace_back();
+			break;
+
+		case TranslationCommand::REQUEST_ID:
+			if (payload.size() != sizeof(uint32_t))
+				throw std::runtime_error{"Malformed REQUEST_ID"};
+
+			uint32_t id;
+			memcpy(&id, payload.data(), sizeof(id));
+			responses.back().id = id;
+			break;
+
+		case TranslationCommand::MESSAGE:
+			responses.back().message = payload;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return responses;
+}
+
+/**
+ * Pipelined requests with REQUEST_ID are handled concurrently and
+ * their responses are sent in the order they complete.
+ */
+TEST(TranslationServerConnection, Pipelining)
+{
+	EventLoop event_loop;
+	RecordingHandler handler{event_loop};
+
+	auto [client, server] = CreateSocketPairNonBlock(SOCK_STREAM);
+	auto *connection = new Connection(event_loop, handler, std::move(server));
+
+	std::string requests;
+	AppendRequest(requests, 1, "/a"sv);
+	AppendRequest(requests, 2, "/b"sv);
+	AppendRequest(requests, 0xdeadbeef, "/c"sv);
+	SendRequests(client, requests);
+
+	handler.Run(3);
+	ASSERT_EQ(handler.requests.size(), 3U);
+	EXPECT_STREQ(handler.requests[0]->uri, "/a");
+	EXPECT_STREQ(handler.requests[1]->uri, "/b");
+	EXPECT_STREQ(handler.requests[2]->uri, "/c");
+
+	/* respond out of order */
+	for (const std::size_t i : {2, 0, 1}) {
+		const auto &request = *handler.requests[i];
+		ASSERT_TRUE(connection->SendResponse(request, MakeResponse(request)));
+	}
+
+	const std::vector<ParsedResponse> expected{
+		{0xdeadbeef, "/c"},
+		{1, "/a"},
+		{2, "/b"},
+	};
+
+	EXPECT_EQ(ReceiveResponses(client), expected);
+
+	delete connection;
+}
+
+/**
+ * A request without REQUEST_ID is exclusive: the connection does
+ * not read the next request until the response has been sent.
+ */
+TEST(TranslationServerConnection, Exclusive)
+{
+	EventLoop event_loop;
+	RecordingHandler handler{event_loop};
+
+	auto [client, server] = CreateSocketPairNonBlock(SOCK_STREAM);
+	auto *connection = new Connection(event_loop, handler, std::move(server));
+
+	std::string request;
+	AppendRequest(request, std::nullopt, "/x"sv);
+	SendRequests(client, request);
+
+	handler.Run(1);
+	ASSERT_EQ(handler.requests.size(), 1U);
+
+	/* the next request must not be read while the first one is
+	   pending */
+	request.clear();
+	AppendRequest(request, 7, "/y"sv);
+	SendRequests(client, request);
+
+	handler.Run(2, std::chrono::milliseconds{100});
+	ASSERT_EQ(handler.requests.size(), 1U);
+
+	ASSERT_TRUE(connection->SendResponse(*handler.requests[0],
+					     MakeResponse(*handler.requests[0])));
+
+	/* now the second request gets read */
+	handler.Run(2);
+	ASSERT_EQ(handler.requests.size(), 2U);
+	EXPECT_STREQ(handler.requests[1]->uri, "/y");
+
+	ASSERT_TRUE(connection->SendResponse(*handler.requests[1],
+					     MakeResponse(*handler.requests[1])));
+
+	const std::vector<ParsedResponse> expected{
+		{std::nullopt, "/x"},
+		{7, "/y"},
+	};
+
+	EXPECT_EQ(ReceiveResponses(client), expected);
+
+	delete connection;
+}
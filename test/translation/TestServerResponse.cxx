@@ -0,0 +1,291 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "translation/server/Response.hxx"
+#include "translation/server/ResponseBuffer.hxx"
+#include "translation/server/ResponseTemplate.hxx"
+#include "translation/PReader.hxx"
+#include "translation/Protocol.hxx"
+#include "AllocatorPtr.hxx"
+#include "util/SpanCast.hxx"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace Translation::Server;
+using std::string_view_literals::operator""sv;
+
+namespace {
+
+using Packet = std::pair<TranslationCommand, std::string>;
+
+} // anonymous namespace
+
+/**
+ * Concatenate all #iovec items which have not yet been sent.
+ */
+static std::string
+Flatten(const ResponseBuffer &buffer) noexcept
+{
+	std::string result;
+	for (const auto &i : buffer.GetIovec())
+		result.append(static_cast<const char *>(i.iov_base), i.iov_len);
+	return result;
+}
+
+/**
+ * Parse a serialized response with #TranslatePacketReader, the way
+ * a translation client does.
+ */
+static std::vector<Packet>
+Parse(std::string_view src)
+{
+	Allocator allocator;
+	AllocatorPtr alloc{allocator};
+
+	TranslatePacketReader reader;
+	std::vector<Packet> packets;
+
+	std::span<const std::byte> b = AsBytes(src);
+	while (!b.empty()) {
+		const auto consumed = reader.Feed(alloc, b);
+		if (consumed == 0)
+			throw std::runtime_error{"Malformed response"};
+
+		b = b.subspan(consumed);
+
+		if (reader.IsComplete())
+			packets.emplace_back(reader.GetCommand(),
+					     std::string{ToStringView(reader.GetPayload())});
+	}
+
+	if (!reader.IsComplete())
+		throw std::runtime_error{"Truncated response"};
+
+	return packets;
+}
+
+static std::string
+MakeRequestIdPayload(uint32_t id) noexcept
+{
+	return std::string{ToStringView(ReferenceAsBytes(id))};
+}
+
+static const std::string begin_payload{"\3"sv};
+
+/**
+ * Small external payloads are copied; large ones are referenced
+ * (with their owner) and interleaved with the buffer.
+ */
+TEST(TranslationServerResponse, ExternalPacket)
+{
+	const std::string small = "small";
+	auto large = std::make_shared<const std::string>(1000, 'x');
+
+	Response response;
+	response.ExternalStringPacket(TranslationCommand::BASE, small);
+	response.ExternalStringPacket(TranslationCommand::EXECUTE, *large, large);
+	response.StringPacket(TranslationCommand::APPEND, "arg"sv);
+
+	auto buffer = response.Finish();
+
+	/* the owner is referenced by the segment */
+	EXPECT_EQ(large.use_count(), 2);
+
+	/* buffer, external payload, buffer */
+	EXPECT_EQ(buffer.GetIovec().size(), 3U);
+	EXPECT_EQ(buffer.GetIovec()[1].iov_base, large->data());
+
+	const std::vector<Packet> expected{
+		{TranslationCommand::BEGIN, begin_payload},
+		{TranslationCommand::BASE, small},
+		{TranslationCommand::EXECUTE, *large},
+		{TranslationCommand::APPEND, "arg"},
+		{TranslationCommand::END, {}},
+	};
+
+	EXPECT_EQ(Parse(Flatten(buffer)), expected);
+
+	buffer = {};
+	EXPECT_EQ(large.use_count(), 1);
+}
+
+/**
+ * Without segments, the response is one #iovec.
+ */
+TEST(TranslationServerResponse, Single)
+{
+	Response response;
+	response.StringPacket(TranslationCommand::BASE, "/"sv);
+
+	const auto buffer = response.Finish();
+	EXPECT_EQ(buffer.GetIovec().size(), 1U);
+
+	const std::vector<Packet> expected{
+		{TranslationCommand::BEGIN, begin_payload},
+		{TranslationCommand::BASE, "/"},
+		{TranslationCommand::END, {}},
+	};
+
+	EXPECT_EQ(Parse(Flatten(buffer)), expected);
+}
+
+/**
+ * A #ResponseTemplate (which itself contains an external segment)
+ * is replayed into several responses, and its "vary" flags are
+ * merged.
+ */
+TEST(TranslationServerResponse, Template)
+{
+	const std::string large(500, 'y');
+
+	Response src;
+	src.StringPacket(TranslationCommand::SITE, "site"sv);
+	src.ExternalStringPacket(TranslationCommand::EXECUTE, large);
+	src.StringPacket(TranslationCommand::APPEND, "arg"sv);
+	src.VaryHost();
+
+	const auto t = ResponseTemplate::Make(std::move(src));
+
+	for (const auto uri : {"/a"sv, "/b"sv}) {
+		Response response;
+		response.Append(t);
+		response.StringPacket(TranslationCommand::URI, uri);
+
+		auto buffer = response.Finish();
+
+		/* the template is referenced by the segment */
+		EXPECT_EQ(t.use_count(), 2);
+
+		const std::vector<Packet> expected{
+			{TranslationCommand::BEGIN, begin_payload},
+			{TranslationCommand::SITE, "site"},
+			{TranslationCommand::EXECUTE, large},
+			{TranslationCommand::APPEND, "arg"},
+			{TranslationCommand::URI, std::string{uri}},
+			{TranslationCommand::VARY,
+			 std::string{ToStringView(ReferenceAsBytes(TranslationCommand::HOST))}},
+			{TranslationCommand::END, {}},
+		};
+
+		EXPECT_EQ(Parse(Flatten(buffer)), expected);
+
+		buffer = {};
+		EXPECT_EQ(t.use_count(), 1);
+	}
+}
+
+/**
+ * InsertRequestId() moves all segments along with the buffer.
+ */
+TEST(TranslationServerResponse, InsertRequestIdWithSegments)
+{
+	const std::string large1(300, 'a'), large2(400, 'b');
+	Response src;
+	src.StringPacket(TranslationCommand::SITE, "site"sv);
+	const auto t = ResponseTemplate::Make(std::move(src));
+
+	Response response;
+	response.ExternalStringPacket(TranslationCommand::EXECUTE, large1);
+	response.Append(t);
+	response.ExternalStringPacket(TranslationCommand::APPEND, large2);
+	response.InsertRequestId(0xdeadbeef);
+
+	const auto buffer = response.Finish();
+
+	const std::vector<Packet> expected{
+		{TranslationCommand::BEGIN, begin_payload},
+		{TranslationCommand::REQUEST_ID, MakeRequestIdPayload(0xdeadbeef)},
+		{TranslationCommand::EXECUTE, large1},
+		{TranslationCommand::SITE, "site"},
+		{TranslationCommand::APPEND, large2},
+		{TranslationCommand::END, {}},
+	};
+
+	EXPECT_EQ(Parse(Flatten(buffer)), expected);
+}
+
+/**
+ * Revert() discards segments added after the marker.
+ */
+TEST(TranslationServerResponse, Revert)
+{
+	const std::string large(300, 'a');
+
+	Response response;
+	response.StringPacket(TranslationCommand::BASE, "/"sv);
+
+	const auto marker = response.Mark();
+	response.ExternalStringPacket(TranslationCommand::EXECUTE, large);
+	response.Revert(marker);
+
+	const auto buffer = response.Finish();
+	EXPECT_EQ(buffer.GetIovec().size(), 1U);
+
+	const std::vector<Packet> expected{
+		{TranslationCommand::BEGIN, begin_payload},
+		{TranslationCommand::BASE, "/"},
+		{TranslationCommand::END, {}},
+	};
+
+	EXPECT_EQ(Parse(Flatten(buffer)), expected);
+}
+
+static ResponseBuffer
+MakeSegmentedResponse(const std::string &large1, const std::string &large2) noexcept
+{
+	Response response;
+	response.StringPacket(TranslationCommand::BASE, "/"sv);
+	response.ExternalStringPacket(TranslationCommand::EXECUTE, large1);
+	response.ExternalStringPacket(TranslationCommand::APPEND, large2);
+	response.StringPacket(TranslationCommand::APPEND, "arg"sv);
+	response.InsertRequestId(42);
+	return response.Finish();
+}
+
+/**
+ * Simulate partial sends of various sizes with Consume().
+ */
+TEST(TranslationServerResponse, Consume)
+{
+	const std::string large1(300, 'a'), large2(400, 'b');
+	const auto full = Flatten(MakeSegmentedResponse(large1, large2));
+
+	for (const std::size_t chunk_size : {1, 2, 3, 7, 256, 304, 4096}) {
+		SCOPED_TRACE(chunk_size);
+
+		auto buffer = MakeSegmentedResponse(large1, large2);
+
+		std::string sent;
+		while (!buffer.empty()) {
+			/* "send" up to chunk_size bytes */
+			const auto remaining = Flatten(buffer);
+			const auto n = std::min(chunk_size, remaining.size());
+			sent.append(remaining, 0, n);
+			buffer.Consume(n);
+		}
+
+		EXPECT_EQ(sent, full);
+	}
+
+	/* consume exactly up to the end of each #iovec */
+	auto buffer = MakeSegmentedResponse(large1, large2);
+	std::string sent;
+	while (!buffer.empty()) {
+		const auto &first = buffer.GetIovec().front();
+		ASSERT_GT(first.iov_len, 0U);
+		sent.append(static_cast<const char *>(first.iov_base), first.iov_len);
+		buffer.Consume(first.iov_len);
+	}
+
+	EXPECT_EQ(sent, full);
+	EXPECT_EQ(Parse(sent).size(), 7U);
+}
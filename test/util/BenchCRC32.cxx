@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+/*
+ * Measure the throughput of CRC32() (slicing-by-8) compared with the
+ * bit-at-a-time reference implementation.
+ */
+
+#include "util/CRC32.hxx"
+
+#include <fmt/core.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+static uint32_t
+ReferenceCRC32(std::span<const std::byte> src) noexcept
+{
+	uint32_t crc = 0xffffffff;
+	for (auto i : src)
+		crc = CRC32Detail::UpdateBitwise(crc, static_cast<uint8_t>(i));
+	return ~crc;
+}
+
+/**
+ * The final checksum of each measurement is stored here so the
+ * compiler can't discard the computation.
+ */
+static volatile uint32_t sink;
+
+/**
+ * @return the throughput in MB/s
+ */
+template<typename F>
+static double
+Measure(std::span<const std::byte> buffer, std::size_t size,
+	std::size_t total, F &&f) noexcept
+{
+	uint32_t result = 0;
+	const std::size_t n_iterations = total / size;
+
+	const auto start = std::chrono::steady_clock::now();
+
+	for (std::size_t i = 0; i < n_iterations; ++i) {
+		/* feed the previous result back (as the start
+		   offset) so the compiler can't hoist the computation
+		   out of the loop */
+		result ^= f(buffer.subspan(result & 1, size));
+	}
+
+	const std::chrono::duration<double> duration =
+		std::chrono::steady_clock::now() - start;
+
+	sink = result;
+
+	return n_iterations * size / duration.count() / 1e6;
+}
+
+static void
+Bench(std::span<const std::byte> buffer, std::size_t size)
+{
+	static constexpr std::size_t TOTAL = 256 * 1024 * 1024;
+
+	const double slicing = Measure(buffer, size, TOTAL, [](auto b){
+		return CRC32(b);
+	});
+
+	const double bitwise = Measure(buffer, size, TOTAL / 16, [](auto b){
+		return ReferenceCRC32(b);
+	});
+
+	fmt::print("{:>6} bytes: slicing-by-8 {:7.1f} MB/s, bitwise {:5.1f} MB/s, {:4.1f}x\n",
+		   size, slicing, bitwise, slicing / bitwise);
+}
+
+int
+main(int, char **)
+{
+	/* one extra byte for the alternating start offset */
+	std::vector<std::byte> buffer(65536 + 1);
+	std::mt19937 rng{42};
+	for (auto &i : buffer)
+		i = static_cast<std::byte>(rng());
+
+	for (const std::size_t size : {16, 64, 256, 1500, 65536})
+		Bench(buffer, size);
+
+	return EXIT_SUCCESS;
+}
@@ -6,8 +6,65 @@
 
 #include <gtest/gtest.h>
 
+#include <array>
+#include <string_view>
+
+/* the constexpr code path must remain usable at compile time */
+static_assert([]{
+	constexpr std::string_view s = "123456789";
+	std::array<std::byte, s.size()> b{};
+	for (std::size_t i = 0; i < s.size(); ++i)
+		b[i] = static_cast<std::byte>(s[i]);
+	return CRC32(b);
+}() == 0xcbf43926);
+
+static uint32_t
+ReferenceCRC32(std::span<const std::byte> src) noexcept
+{
+	uint32_t crc = 0xffffffff;
+	for (auto i : src)
+		crc = CRC32Detail::UpdateBitwise(crc, static_cast<uint8_t>(i));
+	return ~crc;
+}
+
 TEST(CRC32, Basic)
 {
 	EXPECT_EQ(CRC32(std::as_bytes(std::span{"123456789", 9})),
 		  0xcbf43926);
 }
+
+TEST(CRC32, Reference)
+{
+	std::array<std::byte, 256> buffer;
+	for (std::size_t i = 0; i < buffer.size(); ++i)
+		buffer[i] = static_cast<std::byte>(i * 7 + 13);
+
+	/* all lengths and alignments up to a few slicing-by-8
+	   blocks */
+	for (std::size_t offset = 0; offset < 8; ++offset) {
+		for (std::size_t length = 0; length < 64; ++length) {
+			const auto s = std::span{buffer}.subspan(offset, length);
+			EXPECT_EQ(CRC32(s), ReferenceCRC32(s));
+		}
+	}
+
+	EXPECT_EQ(CRC32(buffer), ReferenceCRC32(buffer));
+}
+
+TEST(CRC32, Incremental)
+{
+	std::array<std::byte, 100> buffer;
+	for (std::size_t i = 0; i < buffer.size(); ++i)
+		buffer[i] = static_cast<std::byte>(i ^ 0xa5);
+
+	const auto expected = CRC32(buffer);
+
+	for (std::size_t split = 0; split <= buffer.size(); ++split) {
+		const std::span<const std::byte> s{buffer};
+
+		CRC32State crc;
+		crc.Update(s.first(split));
+		crc.Update(s.subspan(split));
+		EXPECT_EQ(crc.Finish(), expected);
+	}
+}
@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: BSD-2-Clause
+// Copyright CM4all GmbH
+// author: Max Kellermann <max.kellermann@ionos.com>
+
+#include "util/IntrusiveLinearHashSet.hxx"
+
+#include <gtest/gtest.h>
+
+#include <list>
+#include <vector>
+
+namespace {
+
+struct IntItem final : IntrusiveHashSetHook<IntrusiveHookMode::TRACK> {
+	int value;
+
+	IntItem(int _value) noexcept:value(_value) {}
+
+	struct Hash {
+		constexpr std::size_t operator()(const IntItem &i) const noexcept {
+			return i.value;
+		}
+
+		constexpr std::size_t operator()(int i) const noexcept {
+			return i;
+		}
+	};
+
+	struct Equal {
+		constexpr bool operator()(const IntItem &a,
+					  const IntItem &b) const noexcept {
+			return a.value == b.value;
+		}
+	};
+};
+
+using Set = IntrusiveLinearHashSet<IntItem,
+				   IntrusiveHashSetOperators<IntItem, std::identity,
+							     IntItem::Hash,
+							     IntItem::Equal>,
+				   IntrusiveHashSetBaseHookTraits<IntItem>,
+				   4>;
+
+} // anonymous namespace
+
+TEST(IntrusiveLinearHashSet, Basic)
+{
+	IntItem a{1}, b{2}, c{3}, d{4}, e{5}, f{1};
+
+	Set set;
+
+	{
+		auto [position, inserted] = set.insert_check(2);
+		ASSERT_TRUE(inserted);
+		set.insert_commit(position, b);
+	}
+
+	ASSERT_FALSE(set.insert_check(2).second);
+	ASSERT_FALSE(set.insert_check(b).second);
+
+	{
+		auto [position, inserted] = set.insert_check(a);
+		ASSERT_TRUE(inserted);
+		set.insert_commit(position, a);
+	}
+
+	set.insert(c);
+
+	ASSERT_EQ(set.size(), 3U);
+
+	ASSERT_EQ(set.find(c), set.iterator_to(c));
+	ASSERT_EQ(set.find(3), set.iterator_to(c));
+	ASSERT_EQ(set.find(4), set.end());
+	ASSERT_EQ(set.find(d), set.end());
+
+	set.erase(set.iterator_to(c));
+
+	ASSERT_EQ(set.size(), 2U);
+	ASSERT_EQ(set.find(3), set.end());
+
+	set.insert(c);
+	set.insert(d);
+	set.insert(e);
+
+	ASSERT_EQ(set.size(), 5U);
+	ASSERT_EQ(set.insert_check(f).first, set.iterator_to(a));
+
+	ASSERT_EQ(set.find(1), set.iterator_to(a));
+	ASSERT_EQ(set.find(2), set.iterator_to(b));
+	ASSERT_EQ(set.find(3), set.iterator_to(c));
+	ASSERT_EQ(set.find(4), set.iterator_to(d));
+	ASSERT_EQ(set.find(5), set.iterator_to(e));
+
+	set.clear_and_dispose([](auto *i){ i->value = -1; });
+
+	ASSERT_TRUE(set.empty());
+	ASSERT_EQ(a.value, -1);
+	ASSERT_EQ(e.value, -1);
+	ASSERT_EQ(f.value, 1);
+}
+
+/**
+ * Check that the table grows and shrinks with the number of items
+ * and that all items remain reachable while buckets are split and
+ * merged.
+ */
+TEST(IntrusiveLinearHashSet, GrowShrink)
+{
+	static constexpr int N = 1000;
+
+	std::list<IntItem> list;
+	std::vector<IntItem *> items;
+	for (int i = 0; i < N; ++i)
+		items.push_back(&list.emplace_back(i));
+
+	Set set;
+	const std::size_t min_buckets = set.bucket_count();
+
+	for (int i = 0; i < N; ++i) {
+		set.insert(*items[i]);
+
+		for (int j = 0; j <= i; j += 37)
+			ASSERT_EQ(set.find(j), set.iterator_to(*items[j]));
+	}
+
+	ASSERT_EQ(set.size(), std::size_t(N));
+	ASSERT_GE(set.bucket_count(), std::size_t(N));
+
+	std::size_t n = 0;
+	set.for_each([&n](const IntItem &){ ++n; });
+	ASSERT_EQ(n, std::size_t(N));
+
+	const std::size_t max_buckets = set.bucket_count();
+
+	for (int i = 0; i < N; ++i) {
+		if (i == N - 10) {
+			ASSERT_LT(set.bucket_count(), max_buckets);
+		}
+
+		set.erase(set.find(i));
+		ASSERT_EQ(set.find(i), set.end());
+
+		for (int j = N - 1; j > i; j -= 41)
+			ASSERT_EQ(set.find(j), set.iterator_to(*items[j]));
+	}
+
+	ASSERT_TRUE(set.empty());
+	ASSERT_EQ(set.bucket_count(), min_buckets);
+}
+
+/**
+ * insert_commit() must work even if the set was modified (and
+ * buckets were split or merged) after insert_check().
+ */
+TEST(IntrusiveLinearHashSet, CheckModifyCommit)
+{
+	static constexpr int N = 64;
+
+	std::list<IntItem> list;
+	std::vector<IntItem *> items;
+	for (int i = 0; i < N; ++i)
+		items.push_back(&list.emplace_back(i));
+
+	IntItem late{N + 1};
+
+	Set set;
+
+	/* grow: the bucket for "late" gets split meanwhile */
+	auto [position, inserted] = set.insert_check(late.value);
+	ASSERT_TRUE(inserted);
+	const std::size_t old_buckets = set.bucket_count();
+
+	for (int i = 0; i < N; ++i)
+		set.insert(*items[i]);
+
+	ASSERT_GT(set.bucket_count(), old_buckets);
+
+	set.insert_commit(position, late);
+	ASSERT_EQ(set.find(late.value), set.iterator_to(late));
+
+	for (int i = 0; i < N; ++i)
+		ASSERT_EQ(set.find(i), set.iterator_to(*items[i]));
+
+	set.erase(set.iterator_to(late));
+
+	/* shrink: buckets get merged meanwhile */
+	std::tie(position, inserted) = set.insert_check(late.value);
+	ASSERT_TRUE(inserted);
+	const std::size_t max_buckets = set.bucket_count();
+
+	for (int i = 0; i < N - 2; ++i)
+		set.erase(set.find(i));
+
+	ASSERT_LT(set.bucket_count(), max_buckets);
+
+	set.insert_commit(position, late);
+	ASSERT_EQ(set.find(late.value), set.iterator_to(late));
+	ASSERT_EQ(set.find(N - 1), set.iterator_to(*items[N - 1]));
+	ASSERT_EQ(set.size(), std::size_t(3));
+}